@@ -1,29 +1,52 @@
 #include <assert.h>
 #include <algorithm>
+#include <array>
+#include <charconv>
 #include <chrono>
 #include <complex>
 #include <cstddef>
+#include <cstdio>
 #include <cctype>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <iterator>
+#include <limits>
 #include <memory>
+#include <optional>
 #include <sstream>
 #include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "ASTCloner.hpp"
+#include "ArgumentSpecializer.hpp"
 #include "ASTNode.hpp"
+#include "CallGraph.hpp"
+#include "CompileTimeEvaluator.hpp"
 #include "Control.hpp"
+#include "CostModel.hpp"
 #include "FunctionInliningPass.hpp"
+#include "Interpreter.hpp"
 #include "LoopUnrollingPass.hpp"
+#include "Memoizer.hpp"
+#include "NodeCounter.hpp"
+#include "OutputBuffer.hpp"
 #include "PassManager.hpp"
+#include "StringWriteFinder.hpp"
 #include "SymbolTable.hpp"
+#include "StringFoldingPass.hpp"
 #include "TailRecursionPass.hpp"
+#include "ThreadPool.hpp"
+#include "TypeAnnotationPass.hpp"
 #include "TokenQueue.hpp"
+#include "Trace.hpp"
 #include "WATGenerator.hpp"
+#include "WasmCostModel.hpp"
+#include "WasmModule.hpp"
+#include "WatParser.hpp"
 #include "lexer.hpp"
 
 enum class PassId { Inline, Unroll, Tail };
@@ -40,42 +63,97 @@ static std::string TrimCopy(const std::string &input) {
   return input.substr(start, end - start);
 }
 
-static std::vector<PassId> ParsePassOrderSpec(const std::string &spec) {
-  std::vector<PassId> order;
-  std::stringstream ss(spec);
-  std::string token;
-  while (std::getline(ss, token, ',')) {
-    auto trimmed = TrimCopy(token);
-    if (trimmed.empty()) {
+// One entry of a --pass-order spec: a single pass, or a "(...)*" group of
+// entries that is run repeatedly until it no longer changes the program.
+struct PassOrderItem {
+  PassId pass = PassId::Inline;
+  std::vector<PassOrderItem> group{}; // Non-empty for groups.
+
+  bool IsGroup() const { return !group.empty(); }
+};
+
+static PassId ParsePassName(const std::string &name, std::vector<PassId> &seen) {
+  std::string lowered;
+  lowered.reserve(name.size());
+  for (char ch : name) {
+    lowered.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(ch))));
+  }
+
+  PassId passId;
+  if (lowered == "inline") {
+    passId = PassId::Inline;
+  } else if (lowered == "unroll") {
+    passId = PassId::Unroll;
+  } else if (lowered == "tail") {
+    passId = PassId::Tail;
+  } else {
+    std::cout << "Error: Unknown pass '" << name << "' in --pass-order (expected inline, unroll, tail)."
+              << std::endl;
+    exit(1);
+  }
+
+  if (std::find(seen.begin(), seen.end(), passId) != seen.end()) {
+    std::cout << "Error: Duplicate pass '" << name << "' in --pass-order." << std::endl;
+    exit(1);
+  }
+  seen.push_back(passId);
+  return passId;
+}
+
+// Parse comma-separated pass names and groups, starting at pos and stopping at
+// an unmatched ')' or the end of the spec.
+static void ParsePassOrderList(const std::string &spec, size_t &pos, std::vector<PassOrderItem> &items,
+                               std::vector<PassId> &seen) {
+  while (pos < spec.size() && spec[pos] != ')') {
+    if (spec[pos] == ',' || std::isspace(static_cast<unsigned char>(spec[pos]))) {
+      ++pos;
       continue;
     }
-    std::string lowered;
-    lowered.reserve(trimmed.size());
-    for (char ch : trimmed) {
-      lowered.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(ch))));
+
+    if (spec[pos] == '(') {
+      PassOrderItem group;
+      ParsePassOrderList(spec, ++pos, group.group, seen);
+      if (pos >= spec.size()) {
+        std::cout << "Error: Unbalanced parentheses in --pass-order." << std::endl;
+        exit(1);
+      }
+      pos = spec.find_first_not_of(" \t", pos + 1);
+      if (pos == std::string::npos || spec[pos] != '*') {
+        std::cout << "Error: Expected '*' after ')' in --pass-order (groups are written (a,b)*)." << std::endl;
+        exit(1);
+      }
+      ++pos;
+      if (!group.IsGroup()) {
+        std::cout << "Error: Empty group in --pass-order." << std::endl;
+        exit(1);
+      }
+      items.push_back(std::move(group));
+      continue;
     }
 
-    PassId passId;
-    if (lowered == "inline") {
-      passId = PassId::Inline;
-    } else if (lowered == "unroll") {
-      passId = PassId::Unroll;
-    } else if (lowered == "tail") {
-      passId = PassId::Tail;
-    } else {
-      std::cout << "Error: Unknown pass '" << trimmed << "' in --pass-order (expected inline, unroll, tail)."
+    size_t end = std::min(spec.find_first_of(",()*", pos), spec.size());
+    std::string name = TrimCopy(spec.substr(pos, end - pos));
+    pos = end;
+    if (name.empty() || (pos < spec.size() && (spec[pos] == '(' || spec[pos] == '*'))) {
+      std::cout << "Error: Unexpected '" << spec[pos] << "' in --pass-order (groups are written (a,b)*)."
                 << std::endl;
       exit(1);
     }
+    items.push_back(PassOrderItem{ParsePassName(name, seen)});
+  }
+}
 
-    if (std::find(order.begin(), order.end(), passId) != order.end()) {
-      std::cout << "Error: Duplicate pass '" << trimmed << "' in --pass-order." << std::endl;
-      exit(1);
-    }
-    order.push_back(passId);
+static std::vector<PassOrderItem> ParsePassOrderSpec(const std::string &spec) {
+  std::vector<PassOrderItem> order;
+  std::vector<PassId> seen;
+  size_t pos = 0;
+  ParsePassOrderList(spec, pos, order, seen);
+  if (pos < spec.size()) {
+    std::cout << "Error: Unbalanced parentheses in --pass-order." << std::endl;
+    exit(1);
   }
 
-  if (order.size() != 3) {
+  if (seen.size() != 3) {
     std::cout << "Error: --pass-order must specify inline, unroll, and tail exactly once." << std::endl;
     exit(1);
   }
@@ -83,6 +161,55 @@ static std::vector<PassId> ParsePassOrderSpec(const std::string &spec) {
   return order;
 }
 
+static std::string PassOrderToString(const std::vector<PassOrderItem> &order) {
+  std::string out;
+  for (const PassOrderItem &item : order) {
+    if (!out.empty()) {
+      out += ",";
+    }
+    if (item.IsGroup()) {
+      out += "(" + PassOrderToString(item.group) + ")*";
+      continue;
+    }
+    switch (item.pass) {
+    case PassId::Inline:
+      out += "inline";
+      break;
+    case PassId::Unroll:
+      out += "unroll";
+      break;
+    case PassId::Tail:
+      out += "tail";
+      break;
+    }
+  }
+  return out;
+}
+
+// Optimization settings, as given on the command line.
+// How --autotune ranks candidate configurations.
+enum class AutotuneMode {
+  Off,
+  Estimate,  // Static cost model
+  Interpret, // Run main in the interpreter and count steps
+};
+
+struct OptimizationOptions {
+  bool enableLoopUnrolling = true;
+  int unrollFactor = 4;
+  bool enableFunctionInlining = true;
+  bool enableTailLoopify = true;
+  bool enableStringFolding = true;
+  std::vector<PassOrderItem> passOrder = {{PassId::Inline}, {PassId::Unroll}, {PassId::Tail}};
+  size_t fixpointLimit = 8; // Rounds allowed per (...)* group.
+  bool timePasses = false;
+  AutotuneMode autotune = AutotuneMode::Off; // Pick the pass order and unroll factor per function.
+  size_t memoEntries = 0; // Result-table entries per memoized function (0: no memoization).
+  bool enableCtfe = false;       // Evaluate pure calls with literal arguments at compile time.
+  uint64_t ctfeSteps = 10000000; // Interpreter steps allowed per evaluated call.
+  size_t ctfeTimeMs = 2000;      // Wall time allowed for all evaluated calls together.
+};
+
 class Tubular {
 private:
   using ast_ptr_t = std::unique_ptr<ASTNode>;
@@ -91,13 +218,66 @@ private:
   TokenQueue tokens;
   std::vector<fun_ptr_t> functions{};
 
-  struct OpInfo {
-    size_t level;
-    char assoc; // l=left; r=right; n=non
+  SymbolTable symbols{};
+  Control control{symbols};
+
+  // Does the program write into a string through an index?  If so, string
+  // expressions are never folded into shared literals.
+  bool strings_written = false;
+
+  // The program's pure functions, for inlining across functions.  Their
+  // expressions are copies, so that the pipelines (each of which rewrites
+  // only its own function) can all read them while running in parallel.
+  PurityInfo pure_functions{};
+  std::vector<ast_ptr_t> pure_expressions{};
+
+  // Variables reserved for the tail recursion pass's accumulators.
+  AccumulatorVars accumulator_vars{};
+
+  // Threads used for per-function passes and code generation.
+  size_t num_jobs = 1;
+  std::unique_ptr<ThreadPool> pool = nullptr;
+
+  // Wall time of each compilation phase, for --time-phases.
+  struct PhaseStats {
+    std::string name;
+    double seconds = 0.0;
+    size_t bytes = 0; // Text the phase processed: the source, or the WAT for printing.
+    size_t nodes = 0; // AST nodes the phase processed.
   };
-  std::unordered_map<std::string, OpInfo> op_map{};
+  bool time_phases = false;
+  std::vector<PhaseStats> phases{};
+  size_t source_bytes = 0;
+
+  using Clock = std::chrono::steady_clock;
+  static double SecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+  }
+
+  size_t CountNodes() const {
+    NodeCounter counter;
+    for (const auto &fun : functions) {
+      counter.dispatch(*fun);
+    }
+    return static_cast<size_t>(counter.getCount());
+  }
+
+  // Function names for trace events, looked up before work is spread over
+  // threads (empty unless tracing).
+  std::vector<std::string> TraceNames(const std::string &prefix) const {
+    std::vector<std::string> names;
+    if (Trace::Enabled()) {
+      for (const auto &fun : functions)
+        names.push_back(prefix + control.symbols.GetName(fun->GetFunId()));
+    }
+    return names;
+  }
 
-  Control control;
+  ThreadPool &Pool() {
+    if (!pool)
+      pool = std::make_unique<ThreadPool>(std::min(num_jobs, functions.size()));
+    return *pool;
+  }
 
   template <typename... Ts> void TriggerError(Ts... message) {
     if (tokens.None())
@@ -131,17 +311,423 @@ private:
     return node_ptr;
   }
 
-  void SetupOperators() {
-    // Setup operator precedence.
-    size_t cur_prec = 0;
-    op_map["("] = op_map["!"] = OpInfo{cur_prec++, 'n'};
-    op_map["*"] = op_map["/"] = op_map["%"] = OpInfo{cur_prec++, 'l'};
-    op_map["+"] = op_map["-"] = OpInfo{cur_prec++, 'l'};
-    op_map["<"] = op_map["<="] = op_map[">"] = op_map[">="] = OpInfo{cur_prec++, 'n'};
-    op_map["=="] = op_map["!="] = OpInfo{cur_prec++, 'n'};
-    op_map["&&"] = OpInfo{cur_prec++, 'l'};
-    op_map["||"] = OpInfo{cur_prec++, 'l'};
-    op_map["="] = OpInfo{cur_prec++, 'r'};
+  // Emit the runtime helpers in the set (which must include their callees).
+  void EmitRuntimeHelpers(const RuntimeHelperSet &helpers) {
+    if (helpers.test(HelperIndex(RuntimeHelper::AllocStr))) {
+      control
+          .AnnotatedCode(";; Function to allocate a string; add one to size and places "
+                         "null there.")
+          .Code("(func $_alloc_str (param $size i32) (result i32)")
+          .AnnotatedCode("  (local $null_pos i32) ;; Local variable to place null "
+                         "terminator.")
+          .Code("  (global.get $free_mem)")
+          .Comment("Old free mem is alloc start.")
+          .Code("  (global.get $free_mem)")
+          .Comment("Adjust new free mem.")
+          .Code("  (local.get $size)")
+          .Code("  (i32.add)")
+          .Code("  (local.set $null_pos)")
+          .Code("  (i32.store8 (local.get $null_pos) (i32.const 0))")
+          .Comment("Place null terminator.")
+          .Code("  (i32.add (i32.const 1) (local.get $null_pos))")
+          .Code("  (global.set $free_mem)")
+          .Comment("Update free memory start.")
+          .Code(")")
+          .Code("");
+    }
+
+    // strlen
+    if (helpers.test(HelperIndex(RuntimeHelper::Strlen))) {
+      control.AnnotatedCode(";; Function to calculate the length of a null-terminated string.")
+          .Code("(func $_strlen (param $str i32) (result i32)")
+          .AnnotatedCode("  (local $length i32) ;; Local variable to store the string "
+                         "length.")
+          .AnnotatedCode("  (local.set $length (i32.const 0)) ;; Initialize length to 0.")
+          .AnnotatedCode("  (block $exit ;; Outer block for loop termination.")
+          .Code("    (loop $check")
+          .Code("      (br_if $exit (i32.eq (i32.load8_u (local.get $str)) "
+                "(i32.const 0)))")
+          .Comment("If the current byte is null, exit the loop.")
+          .Code("      (local.set $str (i32.add (local.get $str) (i32.const 1)))")
+          .Comment("Increment the pointer and the length counter.")
+          .Code("      (local.set $length (i32.add (local.get $length) "
+                "(i32.const 1)))")
+          .Code("      (br $check)")
+          .Comment("Continue the loop.")
+          .Code("    )")
+          .Code("  )")
+          .AnnotatedCode("  (local.get $length) ;; Return the calculated length.")
+          .Code(")")
+          .Code("");
+    }
+
+    // memcpy
+    if (helpers.test(HelperIndex(RuntimeHelper::Memcpy))) {
+      control
+          .AnnotatedCode(";; Function to copy a specific number of bytes from one "
+                         "location to another (which must not overlap).")
+          .Code("(func $_memcpy (param $src i32) (param $dest i32) (param $size "
+                "i32)")
+          .Code("  (block $words_done")
+          .Code("    (loop $copy_words")
+          .Code("      (br_if $words_done (i32.lt_u (local.get $size) (i32.const 8)))")
+          .Comment("Copy eight bytes at a time while there are that many.")
+          .Code("      (i64.store (local.get $dest) (i64.load (local.get $src)))")
+          .Code("      (local.set $src (i32.add (local.get $src) (i32.const 8)))")
+          .Code("      (local.set $dest (i32.add (local.get $dest) (i32.const 8)))")
+          .Code("      (local.set $size (i32.sub (local.get $size) (i32.const 8)))")
+          .Code("      (br $copy_words)")
+          .Code("    )")
+          .Code("  )")
+          .Code("  (block $done")
+          .Code("    (loop $copy")
+          .Code("      (br_if $done (i32.eqz (local.get $size)))")
+          .Comment("Exit the loop when $size reaches 0.")
+          .Code("      (i32.store8 (local.get $dest) (i32.load8_u (local.get "
+                "$src)))")
+          .Comment("Copy the current byte from source to destination.")
+          .Code("      (local.set $src (i32.add (local.get $src) (i32.const 1)))")
+          .Comment("Increment source and destination pointers.")
+          .Code("      (local.set $dest (i32.add (local.get $dest) (i32.const 1)))")
+          .Comment("Decrement size.")
+          .Code("      (local.set $size (i32.sub (local.get $size) (i32.const 1)))")
+          .Code("      (br $copy)")
+          .Comment("Repeat the loop.")
+          .Code("    )")
+          .Code("  )")
+          .Code(")")
+          .Code("");
+    }
+
+    // strcat
+    if (helpers.test(HelperIndex(RuntimeHelper::Strcat))) {
+      control.AnnotatedCode(";; Function to concatenate two strings.")
+          .Code("(func $_strcat (param $str1 i32) (param $str2 i32) (result i32)")
+          .AnnotatedCode("  (local $len1 i32) ;; Length of the first string.")
+          .AnnotatedCode("  (local $len2 i32) ;; Length of the second string.")
+          .AnnotatedCode("  (local $result i32) ;; Pointer to the new concatenated string.")
+          .AnnotatedCode("  ;; Calculate the length of the first string.")
+          .Code("  (local.set $len1 (call $_strlen (local.get $str1)))")
+          .AnnotatedCode("  ;; Calculate the length of the second string.")
+          .Code("  (local.set $len2 (call $_strlen (local.get $str2)))")
+          .AnnotatedCode("  ;; Allocate memory for the concatenated string using "
+                         "_alloc_str.")
+          .Code("  (local.set $result (call $_alloc_str (i32.add (local.get "
+                "$len1) (local.get $len2))))")
+          .AnnotatedCode("  ;; Copy the first string into the allocated memory.")
+          .Code("  (call $_memcpy (local.get $str1) (local.get $result) "
+                "(local.get $len1))")
+          .AnnotatedCode("  ;; Copy the second string immediately after the first string "
+                         "in the allocated memory.")
+          .AnnotatedCode("  (call $_memcpy (local.get $str2) (i32.add (local.get $result) "
+                         "(local.get $len1)) (local.get $len2)) "
+                         ";; Include null terminator.")
+          .AnnotatedCode("  ;; Return the pointer to the concatenated string.")
+          .Code("  (local.get $result)")
+          .Code(")")
+          .Code("");
+    }
+
+    // concatenate n strings
+    if (helpers.test(HelperIndex(RuntimeHelper::ConcatN))) {
+      control.AnnotatedCode(";; Function to concatenate $count strings whose addresses are stored, in order, at $parts.")
+          .AnnotatedCode(";; Each part is measured once and copied once into a single allocation.")
+          .Code("(func $_concat_n (param $parts i32) (param $count i32) (result i32)")
+          .AnnotatedCode("  (local $end i32) ;; Just past the last stored address.")
+          .AnnotatedCode("  (local $part i32) ;; Where the current part's address is stored.")
+          .AnnotatedCode("  (local $total i32) ;; Combined length of all parts.")
+          .Code("  (local $result i32)")
+          .Code("  (local $src i32)")
+          .Code("  (local $dest i32)")
+          .Code("  (local $byte i32)")
+          .Code("  (local.set $end (i32.add (local.get $parts) (i32.shl (local.get $count) (i32.const 2))))")
+          .Code("  (local.set $part (local.get $parts))")
+          .Code("  (block $measured")
+          .Code("    (loop $measure")
+          .Code("      (br_if $measured (i32.ge_u (local.get $part) (local.get $end)))")
+          .Code("      (local.set $total (i32.add (local.get $total) (call $_strlen (i32.load (local.get $part)))))")
+          .Code("      (local.set $part (i32.add (local.get $part) (i32.const 4)))")
+          .Code("      (br $measure)")
+          .Code("    )")
+          .Code("  )")
+          .Code("  (local.set $result (call $_alloc_str (local.get $total)))")
+          .Code("  (local.set $dest (local.get $result))")
+          .Code("  (local.set $part (local.get $parts))")
+          .Code("  (block $done")
+          .Code("    (loop $next")
+          .Code("      (br_if $done (i32.ge_u (local.get $part) (local.get $end)))")
+          .Code("      (local.set $src (i32.load (local.get $part)))")
+          .Code("      (block $copied")
+          .Code("        (loop $copy")
+          .Code("          (local.set $byte (i32.load8_u (local.get $src)))")
+          .Code("          (br_if $copied (i32.eqz (local.get $byte)))")
+          .Comment("Stop at the part's null terminator.")
+          .Code("          (i32.store8 (local.get $dest) (local.get $byte))")
+          .Code("          (local.set $src (i32.add (local.get $src) (i32.const 1)))")
+          .Code("          (local.set $dest (i32.add (local.get $dest) (i32.const 1)))")
+          .Code("          (br $copy)")
+          .Code("        )")
+          .Code("      )")
+          .Code("      (local.set $part (i32.add (local.get $part) (i32.const 4)))")
+          .Code("      (br $next)")
+          .Code("    )")
+          .Code("  )")
+          .Code("  (local.get $result)")
+          .Code(")")
+          .Code("");
+    }
+
+    // swap
+    if (helpers.test(HelperIndex(RuntimeHelper::Swap))) {
+      control.AnnotatedCode(";; Function to swap the first two values on the stack.")
+          .Code("(func $_swap (param $a i32) (param $b i32) (result i32 i32)")
+          .Code("  (local.get $b)")
+          .Code("  (local.get $a)")
+          .Code(")")
+          .Code("");
+    }
+
+    // repeat string
+    if (helpers.test(HelperIndex(RuntimeHelper::RepeatString))) {
+      control.AnnotatedCode(";; Function to repeat a string a given number of times.  After one copy of the")
+          .AnnotatedCode(";; string, the result is doubled by copying what is already written onto its end,")
+          .AnnotatedCode(";; so n repetitions take one call to $_memcpy per doubling rather than n.")
+          .Code("(func $_repeat_string (param $str i32) (param $count i32) "
+                "(result i32)")
+          .Code("  (local $result i32)")
+          .Comment("Pointer to the resulting string")
+          .Code("  (local $str_len i32)")
+          .Comment("Length of the input string")
+          .Code("  (local $total_len i32)")
+          .Comment("Total length of the resulting string")
+          .Code("  (local $done i32)")
+          .Comment("Bytes of the result written so far")
+          .Code("  (local $chunk i32)")
+          .Comment("Bytes to copy in this step")
+          .Code("  (local.set $str_len (call $_strlen (local.get $str)))")
+          .Code("  (local.set $total_len (i32.mul (local.get $str_len) "
+                "(local.get $count)))")
+          .Code("  (local.set $result (call $_alloc_str (local.get $total_len)))")
+          .Code("  (if (i32.eqz (local.get $total_len))")
+          .Code("    (then (return (local.get $result))))")
+          .Code("  (call $_memcpy (local.get $str) (local.get $result) (local.get $str_len))")
+          .Code("  (local.set $done (local.get $str_len))")
+          .Code("  (block $exit_loop")
+          .Code("    (loop $double_loop")
+          .Code("      (br_if $exit_loop (i32.ge_u (local.get $done) (local.get $total_len)))")
+          .Code("      (local.set $chunk (i32.sub (local.get $total_len) (local.get $done)))")
+          .Code("      (if (i32.gt_u (local.get $chunk) (local.get $done))")
+          .Code("        (then (local.set $chunk (local.get $done))))")
+          .Comment("At most double what is written")
+          .Code("      (call $_memcpy (local.get $result) (i32.add (local.get $result) (local.get $done)) "
+                "(local.get $chunk))")
+          .Code("      (local.set $done (i32.add (local.get $done) (local.get $chunk)))")
+          .Code("      (br $double_loop)")
+          .Code("    )")
+          .Code("  )")
+          .Code("  (local.get $result)")
+          .Code(")")
+          .Code("");
+    }
+
+    // int2string
+    if (helpers.test(HelperIndex(RuntimeHelper::Int2String))) {
+      control.Code("(func $_int2string (param $var0 i32) (result i32)")
+          .Code("  (local $var2 i32)")
+          .Code("  (local $var3 i32)")
+          .Code("  (local $var4 i32)")
+          .Code("  (local $temp0 i32)")
+          .Code("  (local $temp1 i32)")
+          .Code("  (local.get $var0)")
+          .Code("  (i32.const 0)")
+          .Code("  (i32.eq)")
+          .Code("  (if")
+          .Code("    (then")
+          .Code("      (i32.const 0)")
+          .Code("      (return)")
+          .Code("    )")
+          .Code("  )")
+          .Code("  (i32.const 2)")
+          .Code("  (local.set $var2)")
+          .Code("  (i32.const 0)")
+          .Code("  (local.set $var3)")
+          .Code("  (local.get $var0)")
+          .Code("  (i32.const 0)")
+          .Code("  (i32.lt_s)")
+          .Code("  (if")
+          .Code("    (then")
+          .Code("      (i32.const 1)")
+          .Code("      (local.set $var3)")
+          .Code("      (local.get $var0)")
+          .Code("      (i32.const 0)")
+          .Code("      (i32.const 1)")
+          .Code("      (i32.sub)")
+          .Code("      (i32.mul)")
+          .Code("      (local.set $var0)")
+          .Code("    )")
+          .Code("  )")
+          .Code("  (i32.const 13)")
+          .Code("  (local.set $var4)")
+          .Code("  (block $exit1")
+          .Code("    (loop $loop1")
+          .Code("      (local.get $var0)")
+          .Code("      (i32.const 0)")
+          .Code("      (i32.gt_s)")
+          .Code("      (i32.eqz)")
+          .Code("      (br_if $exit1)")
+          .Code("      (i32.const 2)")
+          .Code("      call $_alloc_str")
+          .Code("      (local.set $temp0)")
+          .Code("      (local.get $temp0)")
+          .Code("      (local.get $var2)")
+          .Code("      (local.get $var0)")
+          .Code("      (i32.const 10)")
+          .Code("      (i32.rem_s)")
+          .Code("      (i32.add)")
+          .Code("      (i32.load8_u)")
+          .Code("      i32.store8")
+          .Code("      (local.get $temp0)")
+          .Code("      (local.get $var4)")
+          .Code("      call $_strcat")
+          .Code("      (local.set $var4)")
+          .Code("      (local.get $var0)")
+          .Code("      (i32.const 10)")
+          .Code("      (i32.div_s)")
+          .Code("      (local.set $var0)")
+          .Code("      (br $loop1)")
+          .Code("    )")
+          .Code("  )")
+          .Code("  (local.get $var3)")
+          .Code("  (if")
+          .Code("    (then")
+          .Code("      (i32.const 2)")
+          .Code("      call $_alloc_str")
+          .Code("      (local.set $temp1)")
+          .Code("      (local.get $temp1)")
+          .Code("      (i32.const 45)")
+          .Code("      i32.store8")
+          .Code("      (local.get $temp1)")
+          .Code("      (local.get $var4)")
+          .Code("      call $_strcat")
+          .Code("      (local.set $var4)")
+          .Code("    )")
+          .Code("  )")
+          .Code("  (local.get $var4)")
+          .Code(")")
+          .Code("");
+    }
+
+    // string equality and ordering: both scan 8 bytes per step.  For a word
+    // w, (w - 0x01..01) & ~w & 0x80..80 has its lowest set bit in the first
+    // zero byte; w ^ w' has its lowest set bit in the first differing byte.
+    // Words are only loaded while they lie within memory; past that, bytes.
+    if (helpers.test(HelperIndex(RuntimeHelper::StrEq))) {
+      control.AnnotatedCode(";; Function to test two strings for equality (1 if equal, 0 if not).")
+          .Code("(func $_str_eq (param $lhs i32) (param $rhs i32) (result i32)")
+          .Code("  (local $limit i32)")
+          .Code("  (local $byte i32)")
+          .Code("  (local $word i64)")
+          .Code("  (local $diff i64)")
+          .Code("  (local $zero i64)")
+          .Code("  (if (i32.eq (local.get $lhs) (local.get $rhs))")
+          .Comment("The same string.")
+          .Code("    (then (return (i32.const 1))))")
+          .Code("  (local.set $limit (i32.sub (i32.shl (memory.size) (i32.const 16)) (i32.const 8)))")
+          .Comment("Last address a word can be loaded from.")
+          .Code("  (block $bytes")
+          .Code("    (loop $words")
+          .Code("      (br_if $bytes (i32.gt_u (local.get $lhs) (local.get $limit)))")
+          .Code("      (br_if $bytes (i32.gt_u (local.get $rhs) (local.get $limit)))")
+          .Code("      (local.set $word (i64.load (local.get $lhs)))")
+          .Code("      (local.set $diff (i64.xor (local.get $word) (i64.load (local.get $rhs))))")
+          .Code("      (local.set $zero (i64.and (i64.and (i64.sub (local.get $word) (i64.const 0x0101010101010101))")
+          .Code("                                         (i64.xor (local.get $word) (i64.const -1)))")
+          .Code("                                (i64.const 0x8080808080808080)))")
+          .Code("      (if (i64.eqz (i64.or (local.get $diff) (local.get $zero)))")
+          .Comment("Same bytes, no terminator: next word.")
+          .Code("        (then")
+          .Code("          (local.set $lhs (i32.add (local.get $lhs) (i32.const 8)))")
+          .Code("          (local.set $rhs (i32.add (local.get $rhs) (i32.const 8)))")
+          .Code("          (br $words)))")
+          .Code("      (return (i64.lt_u (i64.ctz (local.get $zero)) (i64.ctz (local.get $diff))))")
+          .Comment("Equal if the string ends before they differ.")
+          .Code("    )")
+          .Code("  )")
+          .Code("  (block $differ")
+          .Code("    (loop $compare")
+          .Code("      (local.set $byte (i32.load8_u (local.get $lhs)))")
+          .Code("      (br_if $differ (i32.ne (local.get $byte) (i32.load8_u (local.get $rhs))))")
+          .Code("      (if (i32.eqz (local.get $byte))")
+          .Code("        (then (return (i32.const 1))))")
+          .Code("      (local.set $lhs (i32.add (local.get $lhs) (i32.const 1)))")
+          .Code("      (local.set $rhs (i32.add (local.get $rhs) (i32.const 1)))")
+          .Code("      (br $compare)")
+          .Code("    )")
+          .Code("  )")
+          .Code("  (i32.const 0)")
+          .Code(")")
+          .Code("");
+    }
+
+    if (helpers.test(HelperIndex(RuntimeHelper::StrCmp))) {
+      control.AnnotatedCode(";; Function to order two strings by their bytes (-1, 0, or 1, like strcmp).")
+          .Code("(func $_str_cmp (param $lhs i32) (param $rhs i32) (result i32)")
+          .Code("  (local $limit i32)")
+          .Code("  (local $a i32)")
+          .Code("  (local $b i32)")
+          .Code("  (local $word i64)")
+          .Code("  (local $diff i64)")
+          .Code("  (local $zero i64)")
+          .Code("  (local $shift i64)")
+          .Code("  (if (i32.eq (local.get $lhs) (local.get $rhs))")
+          .Comment("The same string.")
+          .Code("    (then (return (i32.const 0))))")
+          .Code("  (local.set $limit (i32.sub (i32.shl (memory.size) (i32.const 16)) (i32.const 8)))")
+          .Comment("Last address a word can be loaded from.")
+          .Code("  (block $bytes")
+          .Code("    (loop $words")
+          .Code("      (br_if $bytes (i32.gt_u (local.get $lhs) (local.get $limit)))")
+          .Code("      (br_if $bytes (i32.gt_u (local.get $rhs) (local.get $limit)))")
+          .Code("      (local.set $word (i64.load (local.get $lhs)))")
+          .Code("      (local.set $diff (i64.xor (local.get $word) (i64.load (local.get $rhs))))")
+          .Code("      (local.set $zero (i64.and (i64.and (i64.sub (local.get $word) (i64.const 0x0101010101010101))")
+          .Code("                                         (i64.xor (local.get $word) (i64.const -1)))")
+          .Code("                                (i64.const 0x8080808080808080)))")
+          .Code("      (if (i64.eqz (i64.or (local.get $diff) (local.get $zero)))")
+          .Comment("Same bytes, no terminator: next word.")
+          .Code("        (then")
+          .Code("          (local.set $lhs (i32.add (local.get $lhs) (i32.const 8)))")
+          .Code("          (local.set $rhs (i32.add (local.get $rhs) (i32.const 8)))")
+          .Code("          (br $words)))")
+          .Code("      (if (i64.lt_u (i64.ctz (local.get $zero)) (i64.ctz (local.get $diff)))")
+          .Comment("The string ends before they differ.")
+          .Code("        (then (return (i32.const 0))))")
+          .Code("      (local.set $shift (i64.and (i64.ctz (local.get $diff)) (i64.const 56)))")
+          .Comment("Bit offset of the first differing byte.")
+          .Code("      (local.set $a (i32.wrap_i64 (i64.and (i64.shr_u (local.get $word) (local.get $shift))")
+          .Code("                                           (i64.const 255))))")
+          .Code("      (local.set $b (i32.wrap_i64 (i64.and (i64.shr_u (i64.xor (local.get $word) (local.get $diff))")
+          .Code("                                                      (local.get $shift)) (i64.const 255))))")
+          .Code("      (return (i32.sub (i32.gt_u (local.get $a) (local.get $b))")
+          .Code("                       (i32.lt_u (local.get $a) (local.get $b))))")
+          .Code("    )")
+          .Code("  )")
+          .Code("  (block $differ")
+          .Code("    (loop $compare")
+          .Code("      (local.set $a (i32.load8_u (local.get $lhs)))")
+          .Code("      (local.set $b (i32.load8_u (local.get $rhs)))")
+          .Code("      (br_if $differ (i32.ne (local.get $a) (local.get $b)))")
+          .Code("      (if (i32.eqz (local.get $a))")
+          .Code("        (then (return (i32.const 0))))")
+          .Code("      (local.set $lhs (i32.add (local.get $lhs) (i32.const 1)))")
+          .Code("      (local.set $rhs (i32.add (local.get $rhs) (i32.const 1)))")
+          .Code("      (br $compare)")
+          .Code("    )")
+          .Code("  )")
+          .Code("  (i32.sub (i32.gt_u (local.get $a) (local.get $b)) (i32.lt_u (local.get $a) (local.get $b)))")
+          .Code(")")
+          .Code("");
+    }
   }
 
 public:
@@ -152,9 +738,13 @@ public:
       exit(1);
     }
 
+    const auto start = Clock::now();
     tokens.Load(in_file); // Load all tokens from the file.
+    phases.push_back(PhaseStats{"lex", SecondsSince(start)});
 
-    SetupOperators();
+    in_file.clear();
+    source_bytes = static_cast<size_t>(in_file.tellg());
+    phases.back().bytes = source_bytes;
   }
 
   // Convert any token representing a unary value into an ASTNode.
@@ -282,10 +872,11 @@ public:
     // While there are more tokens to process, try to expand this expression.
     while (tokens.Any()) {
       // Peek at the next token; if it is an op, keep going and get its info.
-      auto op_token = tokens.Peek();
-      if (!op_map.count(op_token.lexeme))
+      const OpId op = tokens.PeekOp();
+      if (!IsBinaryOp(op))
         break; // Not an op token; stop here!
-      OpInfo op_info = op_map[op_token.lexeme];
+      const auto &op_token = tokens.Peek();
+      const OpInfo &op_info = GetOpInfo(op);
 
       // If precedence of next operator is too high, return what we have.
       if (op_info.level > prec_limit)
@@ -308,7 +899,7 @@ public:
       ast_ptr_t node2 = Parse_Expression(next_limit);
 
       // Build the new node.
-      cur_node = MakeNode<ASTNode_Math2>(op_token, std::move(cur_node), std::move(node2));
+      cur_node = MakeNode<ASTNode_Math2>(op_token, op, std::move(cur_node), std::move(node2));
 
       // If operator is non-associative, skip the current precedence for next
       // loop.
@@ -356,10 +947,7 @@ public:
     tokens.Use(';');
 
     auto lhs_node = MakeVarNode(id_token);
-    Type lhs_type = lhs_node->ReturnType(control.symbols);
-    Type rhs_type = rhs_node->ReturnType(control.symbols);
-
-    return MakeNode<ASTNode_Math2>(id_token, "=", std::move(lhs_node), std::move(rhs_node));
+    return MakeNode<ASTNode_Math2>(id_token, OpId::Assign, std::move(lhs_node), std::move(rhs_node));
   }
 
   ast_ptr_t Parse_Statement_If() {
@@ -471,292 +1059,182 @@ public:
   }
 
   void Parse() {
+    TUBULAR_TRACE_PHASE("parse");
+    PhaseStats parse{"parse", 0.0, source_bytes};
+    PhaseStats type_check{"typecheck", 0.0, source_bytes};
     // Outer layer can only be function definitions.
     while (tokens.Any()) {
+      auto start = Clock::now();
       functions.push_back(Parse_Function());
+      parse.seconds += SecondsSince(start);
+      start = Clock::now();
       functions.back()->TypeCheck(control.symbols);
+      type_check.seconds += SecondsSince(start);
     }
+    if (time_phases) {
+      parse.nodes = type_check.nodes = CountNodes();
+    }
+    phases.push_back(parse);
+    phases.push_back(type_check);
+  }
+
+  // Functions reachable through calls from an exported one; the others are
+  // left out of the module.  Returns one flag per function.
+  std::vector<bool> ReachableFunctions() const {
+    std::vector<const ASTNode_Function *> program;
+    std::vector<size_t> roots;
+    for (const auto &fun : functions) {
+      if (fun->IsExported()) {
+        roots.push_back(fun->GetFunId());
+      }
+      program.push_back(fun.get());
+    }
+    return FindReachableFunctions(program, roots);
   }
 
   void ToWAT() {
+    TUBULAR_TRACE_PHASE("codegen");
+    const auto start = Clock::now();
     control.Code("(module");
     control.Indent(2);
 
     // Manage DATA (USED IN PROJECT 4!!)
     control.CommentLine(";; Define a memory block with ten pages (640KB)");
-    control.Code("(memory (export \"memory\") 1)")
+    const std::vector<bool> reachable = ReachableFunctions();
+    size_t memo_bytes = 0; // Room for memoization tables, with alignment.
+    for (size_t i = 0; i < functions.size(); ++i) {
+      if (reachable[i] && functions[i]->IsMemoized()) {
+        memo_bytes += functions[i]->GetMemoEntries() * functions[i]->MemoEntryBytes(control.symbols) + 8;
+      }
+    }
+    const size_t pages = 1 + (memo_bytes + 65535) / 65536;
+    control.Code("(memory (export \"memory\") ", pages, ")")
         .Code("(data (i32.const 0) \"0\\00\")")
         .Code("(data (i32.const 2) \"0123456789\\00\")")
         .Code("(data (i32.const 13) \"\\00\")");
-    for (auto &fun_ptr : functions) {
-      fun_ptr->InitializeWAT(control);
-    }
-    control.Code("(global $free_mem (mut i32) (i32.const ", control.wat_mem_pos, "))").Code("");
-
-    control
-        .Code(";; Function to allocate a string; add one to size and places "
-              "null there.")
-        .Code("(func $_alloc_str (param $size i32) (result i32)")
-        .Code("  (local $null_pos i32) ;; Local variable to place null "
-              "terminator.")
-        .Code("  (global.get $free_mem)")
-        .Comment("Old free mem is alloc start.")
-        .Code("  (global.get $free_mem)")
-        .Comment("Adjust new free mem.")
-        .Code("  (local.get $size)")
-        .Code("  (i32.add)")
-        .Code("  (local.set $null_pos)")
-        .Code("  (i32.store8 (local.get $null_pos) (i32.const 0))")
-        .Comment("Place null terminator.")
-        .Code("  (i32.add (i32.const 1) (local.get $null_pos))")
-        .Code("  (global.set $free_mem)")
-        .Comment("Update free memory start.")
-        .Code(")")
-        .Code("");
-
-    // LOTS OF OTHER HELPER FUNCTIONS SHOULD GO HERE FOR PROJECT 4!!
-    // strlen
-    control.Code(";; Function to calculate the length of a null-terminated string.")
-        .Code("(func $_strlen (param $str i32) (result i32)")
-        .Code("  (local $length i32) ;; Local variable to store the string "
-              "length.")
-        .Code("  (local.set $length (i32.const 0)) ;; Initialize length to 0.")
-        .Code("  (block $exit ;; Outer block for loop termination.")
-        .Code("    (loop $check")
-        .Code("      (br_if $exit (i32.eq (i32.load8_u (local.get $str)) "
-              "(i32.const 0)))")
-        .Comment("If the current byte is null, exit the loop.")
-        .Code("      (local.set $str (i32.add (local.get $str) (i32.const 1)))")
-        .Comment("Increment the pointer and the length counter.")
-        .Code("      (local.set $length (i32.add (local.get $length) "
-              "(i32.const 1)))")
-        .Code("      (br $check)")
-        .Comment("Continue the loop.")
-        .Code("    )")
-        .Code("  )")
-        .Code("  (local.get $length) ;; Return the calculated length.")
-        .Code(")")
-        .Code("");
 
-    // memcpy
-    control
-        .Code(";; Function to copy a specific number of bytes from one "
-              "location to another.")
-        .Code("(func $_memcpy (param $src i32) (param $dest i32) (param $size "
-              "i32)")
-        .Code("  (block $done")
-        .Code("    (loop $copy")
-        .Code("      (br_if $done (i32.eqz (local.get $size)))")
-        .Comment("Exit the loop when $size reaches 0.")
-        .Code("      (i32.store8 (local.get $dest) (i32.load8_u (local.get "
-              "$src)))")
-        .Comment("Copy the current byte from source to destination.")
-        .Code("      (local.set $src (i32.add (local.get $src) (i32.const 1)))")
-        .Comment("Increment source and destination pointers.")
-        .Code("      (local.set $dest (i32.add (local.get $dest) (i32.const 1)))")
-        .Comment("Decrement size.")
-        .Code("      (local.set $size (i32.sub (local.get $size) (i32.const 1)))")
-        .Code("      (br $copy)")
-        .Comment("Repeat the loop.")
-        .Code("    )")
-        .Code("  )")
-        .Code(")")
-        .Code("");
-
-    // strcat
-    control.Code(";; Function to concatenate two strings.")
-        .Code("(func $_strcat (param $str1 i32) (param $str2 i32) (result i32)")
-        .Code("  (local $len1 i32) ;; Length of the first string.")
-        .Code("  (local $len2 i32) ;; Length of the second string.")
-        .Code("  (local $result i32) ;; Pointer to the new concatenated string.")
-        .Code("  ;; Calculate the length of the first string.")
-        .Code("  (local.set $len1 (call $_strlen (local.get $str1)))")
-        .Code("  ;; Calculate the length of the second string.")
-        .Code("  (local.set $len2 (call $_strlen (local.get $str2)))")
-        .Code("  ;; Allocate memory for the concatenated string using "
-              "_alloc_str.")
-        .Code("  (local.set $result (call $_alloc_str (i32.add (local.get "
-              "$len1) (local.get $len2))))")
-        .Code("  ;; Copy the first string into the allocated memory.")
-        .Code("  (call $_memcpy (local.get $str1) (local.get $result) "
-              "(local.get $len1))")
-        .Code("  ;; Copy the second string immediately after the first string "
-              "in the allocated memory.")
-        .Code("  (call $_memcpy (local.get $str2) (i32.add (local.get $result) "
-              "(local.get $len1)) (local.get $len2)) "
-              ";; Include null terminator.")
-        .Code("  ;; Return the pointer to the concatenated string.")
-        .Code("  (local.get $result)")
-        .Code(")")
-        .Code("");
-
-    // swap
-    control.Code(";; Function to swap the first two values on the stack.")
-        .Code("(func $_swap (param $a i32) (param $b i32) (result i32 i32)")
-        .Code("  (local.get $b)")
-        .Code("  (local.get $a)")
-        .Code(")")
-        .Code("");
-
-    // repeat string
-    control.Code(";; Function to repeat a string a given number of times")
-        .Code("(func $_repeat_string (param $str i32) (param $count i32) "
-              "(result i32)")
-        .Code("  (local $result i32)")
-        .Comment("Pointer to the resulting string")
-        .Code("  (local $str_len i32)")
-        .Comment("Length of the input string")
-        .Code("  (local $total_len i32)")
-        .Comment("Total length of the resulting string")
-        .Code("  (local $temp_dest i32)")
-        .Comment("Temporary pointer for destination")
-        .Code("  (local.set $str_len (call $_strlen (local.get $str)))")
-        .Code("  (local.set $total_len (i32.mul (local.get $str_len) "
-              "(local.get $count)))")
-        .Code("  (local.set $result (call $_alloc_str (local.get $total_len)))")
-        .Code("  (local.set $temp_dest (local.get $result))")
-        .Code("  (block $exit_loop")
-        .Code("    (loop $repeat_loop")
-        .Code("      (br_if $exit_loop (i32.eqz (local.get $count)))")
-        .Code("      (call $_memcpy (local.get $str) (local.get $temp_dest) "
-              "(local.get $str_len))")
-        .Code("      (local.set $temp_dest (i32.add (local.get $temp_dest) "
-              "(local.get $str_len)))")
-        .Code("      (local.set $count (i32.sub (local.get $count) (i32.const "
-              "1)))")
-        .Code("      (br $repeat_loop)")
-        .Code("    )")
-        .Code("  )")
-        .Code("  (local.get $result)")
-        .Code(")")
-        .Code("");
+    // Only functions reachable from an export are generated.
+    std::vector<size_t> emitted;
+    for (size_t i = 0; i < functions.size(); ++i) {
+      if (reachable[i]) {
+        emitted.push_back(i);
+        functions[i]->InitializeWAT(control);
+      }
+    }
+    // Literals share memory unless some string is modified in place.
+    StringWriteFinder writes;
+    for (const auto &fun_ptr : functions) {
+      writes.dispatch(*fun_ptr);
+    }
+    control.PlaceStrings(!writes.foundWrite());
+    // Memoization tables follow the strings, below the allocator's memory.
+    for (size_t i : emitted) {
+      if (functions[i]->IsMemoized()) {
+        control.wat_mem_pos = (control.wat_mem_pos + 7) / 8 * 8;
+        functions[i]->SetMemoAddress(control.wat_mem_pos);
+        control.wat_mem_pos += functions[i]->GetMemoEntries() * functions[i]->MemoEntryBytes(control.symbols);
+      }
+    }
 
-    // int2string
-    control.Code("(func $_int2string (param $var0 i32) (result i32)")
-        .Code("  (local $var2 i32)")
-        .Code("  (local $var3 i32)")
-        .Code("  (local $var4 i32)")
-        .Code("  (local $temp0 i32)")
-        .Code("  (local $temp1 i32)")
-        .Code("  (local.get $var0)")
-        .Code("  (i32.const 0)")
-        .Code("  (i32.eq)")
-        .Code("  (if")
-        .Code("    (then")
-        .Code("      (i32.const 0)")
-        .Code("      (return)")
-        .Code("    )")
-        .Code("  )")
-        .Code("  (i32.const 2)")
-        .Code("  (local.set $var2)")
-        .Code("  (i32.const 0)")
-        .Code("  (local.set $var3)")
-        .Code("  (local.get $var0)")
-        .Code("  (i32.const 0)")
-        .Code("  (i32.lt_s)")
-        .Code("  (if")
-        .Code("    (then")
-        .Code("      (i32.const 1)")
-        .Code("      (local.set $var3)")
-        .Code("      (local.get $var0)")
-        .Code("      (i32.const 0)")
-        .Code("      (i32.const 1)")
-        .Code("      (i32.sub)")
-        .Code("      (i32.mul)")
-        .Code("      (local.set $var0)")
-        .Code("    )")
-        .Code("  )")
-        .Code("  (i32.const 13)")
-        .Code("  (local.set $var4)")
-        .Code("  (block $exit1")
-        .Code("    (loop $loop1")
-        .Code("      (local.get $var0)")
-        .Code("      (i32.const 0)")
-        .Code("      (i32.gt_s)")
-        .Code("      (i32.eqz)")
-        .Code("      (br_if $exit1)")
-        .Code("      (i32.const 2)")
-        .Code("      call $_alloc_str")
-        .Code("      (local.set $temp0)")
-        .Code("      (local.get $temp0)")
-        .Code("      (local.get $var2)")
-        .Code("      (local.get $var0)")
-        .Code("      (i32.const 10)")
-        .Code("      (i32.rem_s)")
-        .Code("      (i32.add)")
-        .Code("      (i32.load8_u)")
-        .Code("      i32.store8")
-        .Code("      (local.get $temp0)")
-        .Code("      (local.get $var4)")
-        .Code("      call $_strcat")
-        .Code("      (local.set $var4)")
-        .Code("      (local.get $var0)")
-        .Code("      (i32.const 10)")
-        .Code("      (i32.div_s)")
-        .Code("      (local.set $var0)")
-        .Code("      (br $loop1)")
-        .Code("    )")
-        .Code("  )")
-        .Code("  (local.get $var3)")
-        .Code("  (if")
-        .Code("    (then")
-        .Code("      (i32.const 2)")
-        .Code("      call $_alloc_str")
-        .Code("      (local.set $temp1)")
-        .Code("      (local.get $temp1)")
-        .Code("      (i32.const 45)")
-        .Code("      i32.store8")
-        .Code("      (local.get $temp1)")
-        .Code("      (local.get $var4)")
-        .Code("      call $_strcat")
-        .Code("      (local.set $var4)")
-        .Code("    )")
-        .Code("  )")
-        .Code("  (local.get $var4)")
-        .Code(")")
-        .Code("");
-
-    // string compare
-    control.Code("(func $_str_cmp (param $lhs i32) (param $rhs i32) (result i32)")
-        .Code("  (local $len1 i32)")
-        .Code("  (local $len2 i32)")
-        .Code("  (local.set $len1 (call $_strlen (local.get $lhs)))")
-        .Code("  (local.set $len2 (call $_strlen (local.get $rhs)))")
-        .Code("  (i32.ne (local.get $len1) (local.get $len2))")
-        .Code("  (if (then")
-        .Code("    (return (i32.const 0))")
-        .Code("  ))")
-        .Code("  (block $exit")
-        .Code("    (loop $compare")
-        .Code("      (i32.eqz (local.get $len1))")
-        .Code("      (br_if $exit)")
-        .Code("      (i32.load8_u (local.get $lhs))")
-        .Code("      (i32.load8_u (local.get $rhs))")
-        .Code("      (i32.ne)")
-        .Code("      (if (then")
-        .Code("        (return (i32.const 0))")
-        .Code("      ))")
-        .Code("      (local.set $lhs (i32.add (local.get $lhs) (i32.const 1)))")
-        .Code("      (local.set $rhs (i32.add (local.get $rhs) (i32.const 1)))")
-        .Code("      (local.set $len1 (i32.sub (local.get $len1) (i32.const 1)))")
-        .Code("      (br $compare)")
-        .Code("    )")
-        .Code("  )")
-        .Code("  (i32.const 1)")
-        .Code(")")
-        .Code("");
-
-    // Generate code for each function using the visitor pattern
-    for (auto &fun_ptr : functions) {
+    // Generate code for each function using the visitor pattern.  Each
+    // function gets its own buffer so they can be generated independently;
+    // the buffers are then spliced in source order.
+    std::vector<Control> fun_code;
+    fun_code.reserve(emitted.size());
+    for (size_t i = 0; i < emitted.size(); ++i) {
+      fun_code.push_back(control.MakeFunctionBuffer());
+    }
+    const std::vector<std::string> trace_names = TraceNames("codegen ");
+    Pool().ParallelFor(emitted.size(), [&](size_t i) {
+      TUBULAR_TRACE_SCOPE(trace_names[emitted[i]]);
       // Create a WAT generator visitor and use it to generate code
-      WATGenerator generator(control);
-      fun_ptr->Accept(generator);
+      WATGenerator generator(fun_code[i]);
+      functions[emitted[i]]->Accept(generator);
+    });
+
+    // Only the runtime helpers that the functions call are included.
+    RuntimeHelperSet helpers;
+    for (const auto &buffer : fun_code) {
+      helpers |= buffer.helpers_used;
+    }
+    helpers = WithHelperCallees(helpers);
+    if (helpers.test(HelperIndex(RuntimeHelper::AllocStr))) {
+      control.Code("(global $free_mem (mut i32) (i32.const ", control.wat_mem_pos, "))");
+    }
+    control.Code("");
+    EmitRuntimeHelpers(helpers);
+
+    for (auto &buffer : fun_code) {
+      control.Append(std::move(buffer));
     }
     control.Indent(-2);
     control.Code(")").Comment("END program module");
+    phases.push_back(PhaseStats{"codegen", SecondsSince(start), source_bytes, time_phases ? CountNodes() : 0});
   }
 
-  void PrintCode() const { control.PrintCode(); }
+  // Set how many threads to use for per-function work (minimum one).
+  void SetJobs(size_t jobs) { num_jobs = std::max<size_t>(jobs, 1); }
+
+  // Record how long each phase takes (call before Parse()).  The WAT is then
+  // formatted in memory, so that printing is timed apart from the output
+  // file; call PrintPhaseReport() afterwards.
+  void SetTimePhases(bool enable) { time_phases = enable; }
+
+  // Export only the named functions (call before RunOptimizationPasses()).
+  // The others become internal: they may be specialized for the arguments
+  // they are called with, inlined more eagerly, and are left out of the
+  // module unless an exported function calls them.  Returns false if a name
+  // is not a function, setting unknown to it.
+  bool SetExports(const std::vector<std::string> &names, std::string &unknown) {
+    for (const std::string &name : names) {
+      if (!FindFunction(name)) {
+        unknown = name;
+        return false;
+      }
+    }
+    for (auto &fun : functions) {
+      const std::string &name = control.symbols.GetName(fun->GetFunId());
+      fun->SetExported(std::find(names.begin(), names.end(), name) != names.end());
+    }
+    return true;
+  }
+
+  // Leave comments out of the generated code (call before ToWAT()).
+  void SetStripComments(bool strip) { control.emit_comments = !strip; }
+
+  // Write the WAT to a file (stdout by default); returns false if writing failed.
+  bool PrintCode(std::FILE *file = stdout) {
+    std::cout.flush();
+    if (!time_phases) {
+      OutputBuffer out(file);
+      control.PrintCode(out);
+      return out.Flush();
+    }
+    const auto start = Clock::now();
+    OutputBuffer text;
+    control.PrintCode(text);
+    phases.push_back(PhaseStats{"print", SecondsSince(start), text.Size()});
+    return std::fwrite(text.str().data(), 1, text.str().size(), file) == text.str().size() &&
+           std::fflush(file) == 0;
+  }
+
+  // Print every phase's wall time and throughput as JSON.  Passes appear as
+  // "pass:<name>", with their time summed over all functions.
+  void PrintPhaseReport(std::ostream &os) const {
+    double total = 0.0;
+    os << "{\n  \"source_bytes\": " << source_bytes << ",\n  \"functions\": " << functions.size()
+       << ",\n  \"jobs\": " << num_jobs << ",\n  \"phases\": [";
+    for (size_t i = 0; i < phases.size(); ++i) {
+      const PhaseStats &phase = phases[i];
+      const double seconds = std::max(phase.seconds, 1e-9);
+      total += phase.seconds;
+      os << (i ? "," : "") << "\n    {\"name\": \"" << phase.name << "\", \"seconds\": " << phase.seconds
+         << ", \"bytes\": " << phase.bytes << ", \"nodes\": " << phase.nodes
+         << ", \"mb_per_s\": " << static_cast<double>(phase.bytes) / 1e6 / seconds
+         << ", \"nodes_per_s\": " << static_cast<double>(phase.nodes) / seconds << "}";
+    }
+    os << "\n  ],\n  \"total_seconds\": " << total << "\n}" << std::endl;
+  }
   void PrintSymbols() const { control.symbols.Print(); }
   
   // Get the total size of generated code (for performance comparison)
@@ -774,51 +1252,491 @@ public:
     }
   }
 
-  // New method to run optimization passes
-  void RunOptimizationPasses(bool enableLoopUnrolling = true, int unrollFactor = 4,
-                             bool enableFunctionInlining = true, bool enableTailLoopify = true,
-                             const std::vector<PassId> &passOrder = {}) {
+  // Build the pass pipeline for one function.  Passes keep per-run state, so
+  // each function gets its own pipeline.
+  PassManager MakePipeline(const OptimizationOptions &options) const {
     PassManager passManager;
 
     auto addInlinePass = [&]() {
-      passManager.addPass(std::make_unique<FunctionInliningPass>(control.symbols, true, false, false, 3, 40, 100));
+      passManager.addPass(
+          std::make_unique<FunctionInliningPass>(control.symbols, true, false, false, 3, 40, 100, &pure_functions));
     };
     auto addUnrollPass = [&]() {
-      passManager.addPass(std::make_unique<LoopUnrollingPass>(unrollFactor, false, false, 100, false));
+      passManager.addPass(std::make_unique<LoopUnrollingPass>(options.unrollFactor, false, false, 100, false));
     };
     auto addTailPass = [&]() {
       passManager.addPass(
-          std::make_unique<TailRecursionPass>(control.symbols, enableTailLoopify, false, false, 1000));
+          std::make_unique<TailRecursionPass>(control.symbols, options.enableTailLoopify, options.enableTailLoopify,
+                                              false, 1000, &accumulator_vars));
     };
 
-    std::vector<PassId> effectiveOrder = passOrder;
-    if (effectiveOrder.empty()) {
-      effectiveOrder = {PassId::Inline, PassId::Unroll, PassId::Tail};
+    std::function<void(const std::vector<PassOrderItem> &)> addItems;
+    addItems = [&](const std::vector<PassOrderItem> &items) {
+      for (const PassOrderItem &item : items) {
+        if (item.IsGroup()) {
+          passManager.beginFixedPoint();
+          addItems(item.group);
+          passManager.endFixedPoint();
+          continue;
+        }
+        switch (item.pass) {
+        case PassId::Inline:
+          if (options.enableFunctionInlining) {
+            addInlinePass();
+          }
+          break;
+        case PassId::Unroll:
+          if (options.enableLoopUnrolling) {
+            addUnrollPass();
+          }
+          break;
+        case PassId::Tail:
+          addTailPass();
+          break;
+        }
+      }
+    };
+    if (options.passOrder.empty()) {
+      addItems({{PassId::Inline}, {PassId::Unroll}, {PassId::Tail}});
+    } else {
+      addItems(options.passOrder);
     }
 
-    for (PassId id : effectiveOrder) {
-      switch (id) {
-      case PassId::Inline:
-        if (enableFunctionInlining) {
-          addInlinePass();
+    // Fold constant string expressions, including those inlining exposed.
+    if (options.enableStringFolding && !strings_written) {
+      passManager.addPass(std::make_unique<StringFoldingPass>(true));
+    }
+
+    // Refresh cached node types in any subtrees the passes rewrote, so that
+    // code generation can rely on them.
+    passManager.addPass(std::make_unique<TypeAnnotationPass>(control.symbols));
+    passManager.setFixedPointBudget(options.fixpointLimit, 4.0);
+    passManager.setTimePasses(options.timePasses);
+    return passManager;
+  }
+
+  // Configurations tried by --autotune, starting with the configured one:
+  // every order of the three passes, with each unroll factor.
+  static std::vector<OptimizationOptions> AutotuneCandidates(const OptimizationOptions &options) {
+    std::vector<OptimizationOptions> candidates{options};
+    std::vector<int> factors{1};
+    if (options.enableLoopUnrolling) {
+      factors = {1, 2, 4, 8};
+    }
+
+    std::vector<PassId> order{PassId::Inline, PassId::Unroll, PassId::Tail};
+    do {
+      for (int factor : factors) {
+        OptimizationOptions candidate = options;
+        candidate.passOrder.clear();
+        for (PassId id : order) {
+          candidate.passOrder.push_back(PassOrderItem{id});
         }
-        break;
-      case PassId::Unroll:
-        if (enableLoopUnrolling) {
-          addUnrollPass();
+        candidate.unrollFactor = factor;
+        candidate.enableLoopUnrolling = factor > 1;
+        candidates.push_back(std::move(candidate));
+      }
+    } while (std::next_permutation(order.begin(), order.end()));
+    return candidates;
+  }
+
+  // Result of running a function in the interpreter.
+  struct RunResult {
+    bool ok = false;
+    bool outOfSteps = false; // Stopped by the step limit (ok is false).
+    std::string value{};     // Formatted return value, if ok.
+    std::string error{};     // Why the run failed, if not ok.
+    uint64_t steps = 0;
+  };
+
+  // Recursive programs recurse in the interpreter too, so it runs on a thread
+  // with a large stack.
+  static constexpr size_t INTERPRETER_STACK_BYTES = size_t{1} << 30;
+
+  const ASTNode_Function *FindFunction(const std::string &name) const {
+    for (const auto &fun : functions) {
+      if (control.symbols.GetName(fun->GetFunId()) == name) {
+        return fun.get();
+      }
+    }
+    return nullptr;
+  }
+
+  // Interpret a call to fun with the given (textual) arguments.  If a
+  // replacement is given, it stands in for the function with the same id.
+  RunResult Interpret(const ASTNode_Function &fun, const std::vector<std::string> &args,
+                      const ASTNode_Function *replacement = nullptr,
+                      uint64_t step_limit = std::numeric_limits<uint64_t>::max()) const {
+    RunResult result;
+    ThreadPool::RunWithStack(INTERPRETER_STACK_BYTES, [&]() {
+      std::vector<const ASTNode_Function *> program;
+      for (const auto &f : functions) {
+        program.push_back(f.get());
+      }
+      Interpreter interpreter(control.symbols, program);
+      if (replacement) {
+        interpreter.replaceFunction(*replacement);
+      }
+      interpreter.setStepLimit(step_limit);
+
+      const std::vector<size_t> &param_ids = fun.GetParamIds();
+      std::vector<Interpreter::Value> values;
+      for (size_t i = 0; i < args.size() && i < param_ids.size(); ++i) {
+        try {
+          values.push_back(interpreter.parseArgument(args[i], control.symbols.GetType(param_ids[i])));
+        } catch (const std::logic_error &) {
+          result.error = "Invalid argument '" + args[i] + "' for parameter '" +
+                         control.symbols.GetName(param_ids[i]) + "' (" +
+                         control.symbols.GetType(param_ids[i]).Name() + ")";
+          return;
         }
-        break;
-      case PassId::Tail:
-        addTailPass();
-        break;
+      }
+
+      try {
+        const Interpreter::Value value = interpreter.call(fun.GetFunId(), values);
+        result.value = interpreter.format(value, control.symbols.GetType(fun.GetFunId()).ReturnType());
+        result.ok = true;
+      } catch (const Interpreter::StepLimitExceeded &trap) {
+        result.outOfSteps = true;
+        result.error = trap.what();
+      } catch (const Interpreter::Trap &trap) {
+        result.error = trap.what();
+      }
+      result.steps = interpreter.numSteps();
+    });
+    return result;
+  }
+
+  // Scores one optimized candidate of a function; returns nothing to reject it.
+  // The second argument is the score to beat (a candidate may stop early once
+  // it cannot).
+  using CandidateScorer = std::function<std::optional<CostEstimate>(const ASTNode_Function &, double)>;
+
+  // Optimize a copy of a function with every candidate configuration and
+  // return the index of the one with the lowest score (ties go to the
+  // earliest).  Functions that cannot be copied, or for which every candidate
+  // is rejected, keep the first candidate.
+  size_t AutotuneFunction(const ASTNode_Function &fun, const std::vector<OptimizationOptions> &candidates,
+                          const CandidateScorer &score, CostEstimate &best_cost) const {
+    NodeCounter original;
+    original.dispatch(fun);
+
+    std::optional<size_t> best;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+      ast_ptr_t trial = ASTCloner::clone(fun);
+      if (!trial) {
+        return 0;
+      }
+      if (i == 0) {
+        NodeCounter copied;
+        copied.dispatch(*trial);
+        if (copied.getCount() != original.getCount()) {
+          return 0; // Some node could not be cloned.
+        }
+      }
+
+      OptimizationOptions options = candidates[i];
+      options.timePasses = false;
+      MakePipeline(options).runPasses(*trial);
+      const double to_beat = best ? best_cost.score() : std::numeric_limits<double>::infinity();
+      const std::optional<CostEstimate> cost = score(cast<ASTNode_Function>(*trial), to_beat);
+      if (cost && (!best || cost->score() < best_cost.score())) {
+        best = i;
+        best_cost = *cost;
       }
     }
+    return best.value_or(0);
+  }
 
-    // Run all passes on each function
-    for (auto &fun_ptr : functions) {
-      passManager.runPasses(*fun_ptr);
+  // Build the scorer for --autotune=interpret: the interpreter steps needed to
+  // run main with the candidate swapped in, plus the usual code size penalty.
+  // Candidates that trap or change main's result are rejected (with a warning),
+  // so every pass combination tried is also checked for correctness.  Returns
+  // nothing if main cannot be run, in which case the cost model is used.
+  std::optional<CandidateScorer> MakeInterpretScorer() {
+    const ASTNode_Function *main_fun = FindFunction("main");
+    if (!main_fun || !main_fun->GetParamIds().empty()) {
+      std::cerr << "Warning: --autotune=interpret needs a main() without parameters; using the cost model."
+                << std::endl;
+      return std::nullopt;
+    }
+
+    // Fill every type cache up front; the interpreter then only reads the
+    // original functions, so candidates can be run on several threads.
+    TypeAnnotationPass annotate(control.symbols);
+    AnalysisManager unused;
+    for (auto &fun : functions) {
+      annotate.run(*fun, unused);
+    }
+
+    const RunResult baseline = Interpret(*main_fun, {});
+    if (!baseline.ok) {
+      std::cerr << "Warning: main() failed in the interpreter (" << baseline.error << "); using the cost model."
+                << std::endl;
+      return std::nullopt;
+    }
+
+    return CandidateScorer([this, main_fun, baseline](const ASTNode_Function &trial, double to_beat) {
+      const uint64_t limit = std::isinf(to_beat) ? std::numeric_limits<uint64_t>::max()
+                                                 : static_cast<uint64_t>(to_beat) + 1;
+      const RunResult run = Interpret(*main_fun, {}, &trial, limit);
+      if (!run.ok || run.value != baseline.value) {
+        if (!run.outOfSteps) {
+          std::cerr << "Warning: optimizing '" << control.symbols.GetName(trial.GetFunId())
+                    << "' changed the result of main() (" << (run.ok ? run.value : run.error) << " instead of "
+                    << baseline.value << "); candidate rejected." << std::endl;
+        }
+        return std::optional<CostEstimate>();
+      }
+      NodeCounter counter;
+      counter.dispatch(trial);
+      CostEstimate cost;
+      cost.dynamicCost = static_cast<double>(run.steps);
+      cost.nodeCount = static_cast<size_t>(counter.getCount());
+      return std::optional<CostEstimate>(cost);
+    });
+  }
+
+  // Substitute constant arguments into internal functions, before any
+  // function's pipeline runs (each pipeline sees only its own function).
+  void SpecializeInternalFunctions() {
+    std::vector<ASTNode_Function *> program;
+    for (const auto &fun : functions) {
+      program.push_back(fun.get());
+    }
+    ArgumentSpecializer::run(program, control.symbols);
+  }
+
+  // Replace pure calls with literal arguments by their results, and report
+  // any that ran out of budget.
+  void EvaluateConstantCalls(const OptimizationOptions &options) {
+    TUBULAR_TRACE_PHASE("ctfe");
+    std::vector<ASTNode_Function *> program;
+    for (const auto &fun : functions) {
+      program.push_back(fun.get());
+    }
+    const CompileTimeEvaluator::Budget budget{options.ctfeSteps, std::chrono::milliseconds(options.ctfeTimeMs)};
+    CompileTimeEvaluator::Report report{budget};
+    ThreadPool::RunWithStack(INTERPRETER_STACK_BYTES,
+                             [&]() { report = CompileTimeEvaluator::run(program, control.symbols, budget); });
+    if (report.BudgetHit()) {
+      report.print(std::cerr);
+    }
+  }
+
+  void CollectPureFunctions() {
+    pure_functions.pureFunctions.clear();
+    pure_expressions.clear();
+    for (const auto &fun : functions) {
+      PurityInfo::Summary summary;
+      if (!AnalysisManager::summarizePure(*fun, summary)) {
+        continue;
+      }
+      ast_ptr_t copy = ASTCloner::clone(*summary.returnExpr);
+      if (!copy) {
+        continue;
+      }
+      summary.returnExpr = copy.get();
+      summary.internal = !fun->IsExported();
+      pure_expressions.push_back(std::move(copy));
+      pure_functions.pureFunctions.emplace(fun->GetFunId(), std::move(summary));
     }
   }
+
+  void RunOptimizationPasses(const OptimizationOptions &options) {
+    TUBULAR_TRACE_PHASE("optimize");
+    StringWriteFinder writes;
+    for (const auto &fun : functions) {
+      writes.dispatch(*fun);
+    }
+    strings_written = writes.foundWrite();
+    SpecializeInternalFunctions();
+    if (options.enableCtfe) {
+      EvaluateConstantCalls(options);
+    }
+    CollectPureFunctions();
+    if (options.enableTailLoopify) {
+      std::vector<ASTNode_Function *> program;
+      for (const auto &fun : functions) {
+        program.push_back(fun.get());
+      }
+      accumulator_vars = TailRecursionPass::ReserveAccumulators(program, control.symbols);
+    }
+
+    const bool autotune = options.autotune != AutotuneMode::Off;
+    std::vector<OptimizationOptions> candidates;
+    CandidateScorer score = [this](const ASTNode_Function &trial, double) {
+      return std::optional<CostEstimate>(CostModel::estimate(trial, control.symbols));
+    };
+    bool measured = false; // Were candidates scored by running them?
+    if (autotune) {
+      candidates = AutotuneCandidates(options);
+      if (options.autotune == AutotuneMode::Interpret) {
+        if (auto interpret_score = MakeInterpretScorer()) {
+          score = std::move(*interpret_score);
+          measured = true;
+        }
+      }
+    }
+
+    // Run all passes on each function; functions are optimized independently.
+    const bool collect_stats = options.timePasses || time_phases;
+    std::vector<std::vector<PassStats>> stats(collect_stats ? functions.size() : 0);
+    std::vector<size_t> choices(functions.size(), 0);
+    std::vector<CostEstimate> costs(functions.size());
+    const auto start = std::chrono::steady_clock::now();
+    if (autotune) {
+      // Choose every configuration before changing any function, since
+      // measured candidates run alongside the other (original) functions.
+      const std::vector<std::string> trace_names = TraceNames("autotune ");
+      Pool().ParallelFor(functions.size(), [&](size_t i) {
+        TUBULAR_TRACE_SCOPE(trace_names[i]);
+        choices[i] = AutotuneFunction(*functions[i], candidates, score, costs[i]);
+      });
+      phases.push_back(PhaseStats{"autotune", SecondsSince(start), source_bytes});
+    }
+    const std::vector<std::string> trace_names = TraceNames("optimize ");
+    Pool().ParallelFor(functions.size(), [&](size_t i) {
+      TUBULAR_TRACE_SCOPE(trace_names[i]);
+      OptimizationOptions run_options = autotune ? candidates[choices[i]] : options;
+      run_options.timePasses = collect_stats;
+      PassManager passManager = MakePipeline(run_options);
+      passManager.runPasses(*functions[i]);
+      if (collect_stats) {
+        stats[i] = passManager.getStats();
+      }
+    });
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    if (options.memoEntries > 0) {
+      std::vector<ASTNode_Function *> program;
+      for (const auto &fun : functions) {
+        program.push_back(fun.get());
+      }
+      for (ASTNode_Function *fun : Memoizer::FindCandidates(program, control.symbols)) {
+        fun->SetMemoEntries(options.memoEntries);
+      }
+    }
+
+    if (autotune) {
+      PrintAutotuneReport(candidates, choices, costs, measured);
+    }
+    if (collect_stats) {
+      PassTimingReport report;
+      for (const auto &function_stats : stats) {
+        report.merge(function_stats);
+      }
+      if (options.timePasses) {
+        report.print(std::cerr, elapsed.count());
+      }
+      for (const PassStats &pass : report.getTotals()) {
+        phases.push_back(PhaseStats{"pass:" + pass.name, pass.seconds, source_bytes, pass.nodesBefore});
+      }
+    }
+  }
+
+  // Interpret a call to the named function and print its result; returns the
+  // process exit code.
+  int RunInterpreter(const std::string &name, const std::vector<std::string> &args) const {
+    const ASTNode_Function *fun = FindFunction(name);
+    if (!fun) {
+      std::cout << "Error: No function named '" << name << "' to interpret" << std::endl;
+      return 1;
+    }
+    if (args.size() != fun->GetParamIds().size()) {
+      std::cout << "Error: Function '" << name << "' takes " << fun->GetParamIds().size() << " argument(s), but "
+                << args.size() << " were given with --arg" << std::endl;
+      return 1;
+    }
+
+    const RunResult run = Interpret(*fun, args);
+    if (!run.ok) {
+      std::cerr << "Error: " << run.error << std::endl;
+      return 1;
+    }
+    std::cout << run.value << std::endl;
+    return 0;
+  }
+
+  // Print a static cost estimate of the generated module as JSON: every
+  // function's weighted instruction cost per call (see WasmCostModel), using
+  // the cost model's loop trip counts for the source functions.  Call after ToWAT().
+  void PrintCostEstimate(std::ostream &os = std::cout) const {
+    std::ostringstream wat;
+    control.PrintCode(wat);
+    WasmModule module;
+    try {
+      module = WasmModule::Load(WatParser(wat.str()).ParseModule());
+    } catch (const WasmError &error) {
+      std::cout << "Error: Generated code failed validation: " << error.what() << std::endl;
+      exit(1);
+    }
+
+    std::vector<std::vector<double>> trips(module.functions.size());
+    for (const auto &fun : functions) {
+      const std::string &name = control.symbols.GetName(fun->GetFunId());
+      for (size_t i = 0; i < module.functions.size(); ++i) {
+        if (module.functions[i].name == name)
+          trips[i] = CostModel::estimateLoopTrips(*fun, control.symbols);
+      }
+    }
+    const std::vector<WasmFunctionCost> costs = WasmCostModel::Estimate(module, trips);
+
+    auto number = [](double value) {
+      std::array<char, 32> buffer;
+      auto result = std::to_chars(buffer.data(), buffer.data() + buffer.size(), value, std::chars_format::fixed, 2);
+      std::string text(buffer.data(), result.ptr);
+      text.erase(text.find_last_not_of('0') + 1); // 12.50 -> 12.5, 3.00 -> 3.
+      if (text.back() == '.')
+        text.pop_back();
+      return text;
+    };
+
+    double total = 0.0;
+    os << "{\n  \"functions\": [";
+    for (size_t i = 0; i < costs.size(); ++i) {
+      const WasmFunction &fn = module.functions[i];
+      const WasmFunctionCost &cost = costs[i];
+      total += cost.cost;
+      os << (i ? "," : "") << "\n    {\"name\": \"" << fn.name << "\", \"exported\": "
+         << (module.FindExport(fn.name) ? "true" : "false") << ", \"instructions\": " << cost.instructions
+         << ", \"cost\": " << number(cost.cost) << ", \"inclusive_cost\": " << number(cost.inclusiveCost)
+         << ", \"calls\": " << number(cost.calls) << ", \"memory_ops\": " << number(cost.memoryOps)
+         << ", \"branches\": " << number(cost.branches) << ", \"loops\": [";
+      for (size_t l = 0; l < cost.loops.size(); ++l) {
+        os << (l ? ", " : "") << "{\"depth\": " << cost.loops[l].depth << ", \"trips\": " << number(cost.loops[l].trips)
+           << "}";
+      }
+      os << "], \"callees\": {";
+      bool first = true;
+      for (const auto &[callee, count] : cost.callees) {
+        os << (first ? "" : ", ") << "\"" << module.functions[callee].name << "\": " << number(count);
+        first = false;
+      }
+      os << "}}";
+    }
+    os << "\n  ],\n  \"total_cost\": " << number(total);
+    if (auto main_index = module.FindExport("main"))
+      os << ",\n  \"main_cost\": " << number(costs[*main_index].inclusiveCost);
+    os << "\n}" << std::endl;
+  }
+
+  void PrintAutotuneReport(const std::vector<OptimizationOptions> &candidates, const std::vector<size_t> &choices,
+                           const std::vector<CostEstimate> &costs, bool measured) const {
+    std::cerr << "===== Autotune report =====\n";
+    std::cerr << "  " << std::left << std::setw(20) << "Function" << std::setw(22) << "Pass order" << std::right
+              << std::setw(8) << "Unroll" << std::setw(12) << (measured ? "Run cost" : "Est. cost") << std::setw(8)
+              << "Nodes" << "\n";
+    for (size_t i = 0; i < functions.size(); ++i) {
+      const OptimizationOptions &chosen = candidates[choices[i]];
+      const int factor = chosen.enableLoopUnrolling ? chosen.unrollFactor : 1;
+      std::cerr << "  " << std::left << std::setw(20) << control.symbols.At(functions[i]->GetFunId()).name
+                << std::setw(22) << PassOrderToString(chosen.passOrder) << std::right << std::setw(8) << factor
+                << std::setw(12) << std::fixed << std::setprecision(1) << costs[i].score() << std::setw(8)
+                << costs[i].nodeCount << "\n";
+    }
+    std::cerr << std::defaultfloat << std::flush;
+  }
 };
 
 void printHelp(const char* programName) {
@@ -835,9 +1753,50 @@ void printHelp(const char* programName) {
   std::cout << "  --no-inline             Disable function inlining optimization\n";
   std::cout << "  --tail=loop|off         Control tail recursion optimization\n";
   std::cout << "                          loop: Convert tail recursion to loops (default)\n";
-  std::cout << "                          off:  Disable tail recursion optimization\n\n";
+  std::cout << "                          off:  Disable tail recursion optimization\n";
+  std::cout << "  --no-string-fold        Build constant string expressions at run time instead\n";
+  std::cout << "                          of folding them into literals\n\n";
   std::cout << "  --pass-order=a,b,c      Set optimization pass order using a permutation of\n";
-  std::cout << "                          inline,unroll,tail (default: inline,unroll,tail)\n\n";
+  std::cout << "                          inline,unroll,tail (default: inline,unroll,tail)\n";
+  std::cout << "                          Wrap passes as (a,b)* to repeat them until nothing\n";
+  std::cout << "                          changes, e.g. --pass-order=(inline,unroll)*,tail\n";
+  std::cout << "  --fixpoint-limit=N      Maximum rounds for each (...)* group (1-100, default: 8)\n";
+  std::cout << "  --time-passes           Report wall time, AST node counts, and analysis cache\n";
+  std::cout << "                          hits and misses per pass to stderr\n";
+  std::cout << "  --time-phases           Report the time and throughput of each compiler phase\n";
+  std::cout << "                          (lex, parse, typecheck, passes, codegen, print) to stderr\n";
+  std::cout << "                          as JSON\n";
+  std::cout << "  --trace=FILE            Write a Chrome trace (chrome://tracing, Perfetto) of\n";
+  std::cout << "                          each phase and function, with counters for tokens,\n";
+  std::cout << "                          AST nodes, type interns, dyn_casts, and WAT output\n";
+  std::cout << "  --autotune              Try every pass order and unroll factor (1, 2, 4, 8) on\n";
+  std::cout << "                          each function and keep the lowest estimated cost;\n";
+  std::cout << "                          the choices are reported to stderr\n";
+  std::cout << "  --autotune=interpret    Like --autotune, but rank candidates by running main()\n";
+  std::cout << "                          in the interpreter; results are checked along the way\n";
+  std::cout << "  --interpret[=FUNCTION]  Run FUNCTION (default: main) in the interpreter and print\n";
+  std::cout << "                          its result instead of WAT\n";
+  std::cout << "  --arg=VALUE             Argument for --interpret (repeat once per parameter)\n";
+  std::cout << "  --estimate-cost         Print a static cost estimate of the generated code, per\n";
+  std::cout << "                          function, as JSON instead of WAT\n";
+  std::cout << "  -o FILE                 Write the output to FILE instead of stdout\n";
+  std::cout << "  --strip-comments        Leave comments out of the generated WAT\n";
+  std::cout << "  --export=NAME,...       Export only the named functions (default: all); functions\n";
+  std::cout << "                          they never call, and unused runtime helpers, are left out\n";
+  std::cout << "                          The rest become internal: specialized on constant\n";
+  std::cout << "                          arguments and inlined more eagerly\n";
+  std::cout << "  --export-none-except-main  Same as --export=main\n";
+  std::cout << "  --memoize[=N]           Cache the results of pure, tree-recursive functions of\n";
+  std::cout << "                          int/char parameters in a table of N entries each\n";
+  std::cout << "                          (a power of two; default: 1024)\n";
+  std::cout << "  --ctfe                  Evaluate calls to pure functions with literal arguments\n";
+  std::cout << "                          at compile time; calls over budget are listed on stderr\n";
+  std::cout << "  --ctfe-steps=N          Interpreter steps allowed per evaluated call\n";
+  std::cout << "                          (implies --ctfe; default: 10000000)\n";
+  std::cout << "  --ctfe-time=MS          Milliseconds allowed for all evaluated calls together\n";
+  std::cout << "                          (implies --ctfe; default: 2000)\n";
+  std::cout << "  --jobs=N                Optimize and generate functions on N threads\n";
+  std::cout << "                          (default: number of hardware threads)\n\n";
   std::cout << "EXAMPLES:\n";
   std::cout << "  " << programName << " program.tub              # Compile with default optimizations\n";
   std::cout << "  " << programName << " program.tub --no-unroll  # Disable loop unrolling\n";
@@ -848,10 +1807,11 @@ void printHelp(const char* programName) {
   std::cout << "  • Function Inlining: Inlines small, pure functions to reduce call overhead\n";
   std::cout << "  • Loop Unrolling: Unrolls loops to reduce branch overhead and enable\n";
   std::cout << "    further optimizations\n";
-  std::cout << "  • Tail Recursion: Converts tail-recursive functions to iterative loops\n\n";
+  std::cout << "  • Tail Recursion: Converts tail-recursive functions to iterative loops\n";
+  std::cout << "  • String Folding: Evaluates string expressions over literals at compile time\n\n";
   std::cout << "OUTPUT:\n";
   std::cout << "  The compiler generates WebAssembly Text (WAT) format output to stdout.\n";
-  std::cout << "  Redirect to a file to save: " << programName << " program.tub > output.wat\n";
+  std::cout << "  Save it to a file with: " << programName << " program.tub -o output.wat\n";
 }
 
 int main(int argc, char *argv[]) {
@@ -869,11 +1829,16 @@ int main(int argc, char *argv[]) {
   }
 
   std::string filename = argv[1];
-  bool enableLoopUnrolling = true;
-  int unrollFactor = 4; // default
-  bool enableFunctionInlining = true; // default
-  bool enableTailLoopify = true;      // default
-  std::vector<PassId> passOrder = {PassId::Inline, PassId::Unroll, PassId::Tail};
+  OptimizationOptions options;
+  size_t numJobs = ThreadPool::DefaultThreads();
+  std::string interpretFunction; // Run this function instead of printing WAT.
+  std::vector<std::string> interpretArgs;
+  bool estimateCost = false; // Print a cost estimate instead of WAT.
+  bool timePhases = false;
+  std::string traceFile; // Write a Chrome trace here.
+  std::string outputFile; // Write the output here instead of stdout.
+  bool stripComments = false;
+  std::optional<std::vector<std::string>> exportNames; // Export only these functions.
 
   // Track seen flags for validation
   bool seenNoUnroll = false;
@@ -884,10 +1849,12 @@ int main(int argc, char *argv[]) {
   for (int i = 2; i < argc; ++i) {
     std::string flag = argv[i];
     if (flag == "--no-unroll") {
-      enableLoopUnrolling = false;
+      options.enableLoopUnrolling = false;
       seenNoUnroll = true;
     } else if (flag == "--no-inline") {
-      enableFunctionInlining = false;
+      options.enableFunctionInlining = false;
+    } else if (flag == "--no-string-fold") {
+      options.enableStringFolding = false;
     } else if (flag.rfind("--unroll-factor=", 0) == 0) {
       std::string factorStr = flag.substr(16); // length of "--unroll-factor="
       try {
@@ -895,14 +1862,14 @@ int main(int argc, char *argv[]) {
           std::cout << "Error: Duplicate --unroll-factor specified" << std::endl;
           exit(1);
         }
-        unrollFactor = std::stoi(factorStr);
-        if (unrollFactor < 1 || unrollFactor > 16) {
+        options.unrollFactor = std::stoi(factorStr);
+        if (options.unrollFactor < 1 || options.unrollFactor > 16) {
           std::cout << "Error: Unroll factor must be between 1 and 16" << std::endl;
           exit(1);
         }
         // If unroll factor is 1, disable loop unrolling entirely
-        if (unrollFactor == 1) {
-          enableLoopUnrolling = false;
+        if (options.unrollFactor == 1) {
+          options.enableLoopUnrolling = false;
         }
         seenUnrollFactor = true;
       } catch (const std::exception&) {
@@ -912,17 +1879,17 @@ int main(int argc, char *argv[]) {
     } else if (flag.rfind("--tail=", 0) == 0) {
       std::string mode = flag.substr(7);
       if (mode == "loop") {
-        if (seenTail && !enableTailLoopify) {
+        if (seenTail && !options.enableTailLoopify) {
           std::cout << "Error: Conflicting --tail options: both 'off' and 'loop' specified" << std::endl;
           exit(1);
         }
-        enableTailLoopify = true;
+        options.enableTailLoopify = true;
       } else if (mode == "off") {
-        if (seenTail && enableTailLoopify) {
+        if (seenTail && options.enableTailLoopify) {
           std::cout << "Error: Conflicting --tail options: both 'loop' and 'off' specified" << std::endl;
           exit(1);
         }
-        enableTailLoopify = false;
+        options.enableTailLoopify = false;
       } else {
         std::cout << "Error: Unknown tail mode '" << mode << "' (use loop|off)" << std::endl;
         exit(1);
@@ -934,7 +1901,124 @@ int main(int argc, char *argv[]) {
         std::cout << "Error: --pass-order requires a comma-separated permutation of inline,unroll,tail" << std::endl;
         exit(1);
       }
-      passOrder = ParsePassOrderSpec(spec);
+      options.passOrder = ParsePassOrderSpec(spec);
+    } else if (flag.rfind("--fixpoint-limit=", 0) == 0) {
+      std::string limitStr = flag.substr(17); // length of "--fixpoint-limit="
+      try {
+        size_t pos = 0;
+        int limit = std::stoi(limitStr, &pos);
+        if (pos != limitStr.size() || limit < 1 || limit > 100) {
+          throw std::invalid_argument(limitStr);
+        }
+        options.fixpointLimit = static_cast<size_t>(limit);
+      } catch (const std::exception&) {
+        std::cout << "Error: Invalid fixed-point limit '" << limitStr << "' (must be between 1 and 100)"
+                  << std::endl;
+        exit(1);
+      }
+    } else if (flag == "--time-passes") {
+      options.timePasses = true;
+    } else if (flag == "--time-phases") {
+      timePhases = true;
+    } else if (flag == "-o") {
+      if (i + 1 >= argc) {
+        std::cout << "Error: -o requires a file name" << std::endl;
+        exit(1);
+      }
+      outputFile = argv[++i];
+    } else if (flag == "--strip-comments") {
+      stripComments = true;
+    } else if (flag == "--memoize") {
+      options.memoEntries = 1024;
+    } else if (flag.rfind("--memoize=", 0) == 0) {
+      std::string entriesStr = flag.substr(10); // length of "--memoize="
+      try {
+        size_t pos = 0;
+        long entries = std::stol(entriesStr, &pos);
+        if (pos != entriesStr.size() || entries < 2 || entries > (1 << 20) || (entries & (entries - 1)) != 0) {
+          throw std::invalid_argument(entriesStr);
+        }
+        options.memoEntries = static_cast<size_t>(entries);
+      } catch (const std::exception&) {
+        std::cout << "Error: Invalid memoization table size '" << entriesStr
+                  << "' (must be a power of two between 2 and 1048576)" << std::endl;
+        exit(1);
+      }
+    } else if (flag == "--ctfe") {
+      options.enableCtfe = true;
+    } else if (flag.rfind("--ctfe-steps=", 0) == 0 || flag.rfind("--ctfe-time=", 0) == 0) {
+      const bool steps = flag[7] == 's';
+      std::string budgetStr = flag.substr(steps ? 13 : 12); // length of "--ctfe-steps=" or "--ctfe-time="
+      try {
+        size_t pos = 0;
+        long long budget = std::stoll(budgetStr, &pos);
+        if (pos != budgetStr.size() || budget < 1) {
+          throw std::invalid_argument(budgetStr);
+        }
+        if (steps) {
+          options.ctfeSteps = static_cast<uint64_t>(budget);
+        } else {
+          options.ctfeTimeMs = static_cast<size_t>(budget);
+        }
+        options.enableCtfe = true;
+      } catch (const std::exception&) {
+        std::cout << "Error: Invalid CTFE " << (steps ? "step" : "time") << " budget '" << budgetStr
+                  << "' (must be a positive integer)" << std::endl;
+        exit(1);
+      }
+    } else if (flag == "--export-none-except-main") {
+      exportNames = std::vector<std::string>{"main"};
+    } else if (flag.rfind("--export=", 0) == 0) {
+      exportNames.emplace();
+      std::stringstream list(flag.substr(9)); // length of "--export="
+      for (std::string name; std::getline(list, name, ',');) {
+        name = TrimCopy(name);
+        if (!name.empty()) {
+          exportNames->push_back(name);
+        }
+      }
+      if (exportNames->empty()) {
+        std::cout << "Error: --export= requires a comma-separated list of function names" << std::endl;
+        exit(1);
+      }
+    } else if (flag.rfind("--trace=", 0) == 0) {
+      traceFile = flag.substr(8); // length of "--trace="
+      if (traceFile.empty()) {
+        std::cout << "Error: --trace= requires a file name" << std::endl;
+        exit(1);
+      }
+    } else if (flag == "--autotune" || flag == "--autotune=estimate") {
+      options.autotune = AutotuneMode::Estimate;
+    } else if (flag == "--autotune=interpret") {
+      options.autotune = AutotuneMode::Interpret;
+    } else if (flag.rfind("--autotune=", 0) == 0) {
+      std::cout << "Error: Unknown autotune mode '" << flag.substr(11) << "' (use estimate|interpret)" << std::endl;
+      exit(1);
+    } else if (flag == "--interpret") {
+      interpretFunction = "main";
+    } else if (flag.rfind("--interpret=", 0) == 0) {
+      interpretFunction = flag.substr(12); // length of "--interpret="
+      if (interpretFunction.empty()) {
+        std::cout << "Error: --interpret= requires a function name" << std::endl;
+        exit(1);
+      }
+    } else if (flag == "--estimate-cost") {
+      estimateCost = true;
+    } else if (flag.rfind("--arg=", 0) == 0) {
+      interpretArgs.push_back(flag.substr(6)); // length of "--arg="
+    } else if (flag.rfind("--jobs=", 0) == 0) {
+      std::string jobsStr = flag.substr(7); // length of "--jobs="
+      try {
+        size_t pos = 0;
+        int jobs = std::stoi(jobsStr, &pos);
+        if (pos != jobsStr.size() || jobs < 1) {
+          throw std::invalid_argument(jobsStr);
+        }
+        numJobs = static_cast<size_t>(jobs);
+      } catch (const std::exception&) {
+        std::cout << "Error: Invalid job count '" << jobsStr << "' (must be a positive integer)" << std::endl;
+        exit(1);
+      }
     } else {
       std::cout << "Error: Unknown flag '" << flag << "'" << std::endl;
       exit(1);
@@ -942,22 +2026,99 @@ int main(int argc, char *argv[]) {
   }
 
   // Validate combinations after parsing
-  if (seenNoUnroll && seenUnrollFactor && unrollFactor > 1) {
-    std::cout << "Error: Cannot combine --no-unroll with --unroll-factor=" << unrollFactor
+  if (seenNoUnroll && seenUnrollFactor && options.unrollFactor > 1) {
+    std::cout << "Error: Cannot combine --no-unroll with --unroll-factor=" << options.unrollFactor
               << ". Use one or set --unroll-factor=1 to disable unrolling." << std::endl;
     exit(1);
   }
+  if (!interpretArgs.empty() && interpretFunction.empty()) {
+    std::cout << "Error: --arg can only be used with --interpret" << std::endl;
+    exit(1);
+  }
+  if (estimateCost && !interpretFunction.empty()) {
+    std::cout << "Error: Cannot combine --estimate-cost with --interpret" << std::endl;
+    exit(1);
+  }
+  if (!outputFile.empty() && !interpretFunction.empty()) {
+    std::cout << "Error: -o cannot be used with --interpret" << std::endl;
+    exit(1);
+  }
+
+  if (exportNames && !interpretFunction.empty() &&
+      std::find(exportNames->begin(), exportNames->end(), interpretFunction) == exportNames->end()) {
+    std::cout << "Error: --interpret=" << interpretFunction << " needs '" << interpretFunction << "' to be exported"
+              << std::endl;
+    exit(1);
+  }
+
+  if (!traceFile.empty()) {
+    if (!Trace::COMPILED_IN) {
+      std::cout << "Error: --trace is unavailable; this build was compiled without TUBULAR_TRACE" << std::endl;
+      exit(1);
+    }
+    Trace::Start();
+  }
+  auto writeTrace = [&traceFile]() {
+    if (!traceFile.empty() && !Trace::Write(traceFile)) {
+      std::cout << "Error: Unable to write trace file '" << traceFile << "'" << std::endl;
+      exit(1);
+    }
+  };
 
   Tubular prog(filename);
+  prog.SetJobs(numJobs);
+  prog.SetTimePhases(timePhases);
+  prog.SetStripComments(stripComments);
   prog.Parse();
+  if (exportNames) {
+    std::string unknown;
+    if (!prog.SetExports(*exportNames, unknown)) {
+      std::cout << "Error: No function named '" << unknown << "' to export" << std::endl;
+      exit(1);
+    }
+  }
 
   // Run optimization passes
-  prog.RunOptimizationPasses(enableLoopUnrolling, unrollFactor, enableFunctionInlining, enableTailLoopify, passOrder);
+  prog.RunOptimizationPasses(options);
 
   // -- uncomment for debugging --
   // prog.PrintSymbols();
   // prog.PrintAST();
 
+  if (!interpretFunction.empty()) {
+    const int status = prog.RunInterpreter(interpretFunction, interpretArgs);
+    writeTrace();
+    exit(status);
+  }
+
   prog.ToWAT();
-  prog.PrintCode();
+  std::FILE *out = stdout;
+  if (!outputFile.empty()) {
+    out = std::fopen(outputFile.c_str(), "w");
+    if (!out) {
+      std::cout << "Error: Unable to open output file '" << outputFile << "'" << std::endl;
+      exit(1);
+    }
+  }
+  bool written = true;
+  if (estimateCost) {
+    std::ostringstream estimate;
+    prog.PrintCostEstimate(estimate);
+    const std::string text = estimate.str();
+    written = std::fwrite(text.data(), 1, text.size(), out) == text.size() && std::fflush(out) == 0;
+  } else {
+    written = prog.PrintCode(out);
+  }
+  if (out != stdout) {
+    written &= std::fclose(out) == 0;
+  }
+  if (!written) {
+    std::cout << "Error: Unable to write output" << (outputFile.empty() ? "" : " file '" + outputFile + "'")
+              << std::endl;
+    exit(1);
+  }
+  if (timePhases) {
+    prog.PrintPhaseReport(std::cerr);
+  }
+  writeTrace();
 }
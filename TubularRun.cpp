@@ -0,0 +1,255 @@
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "WasmInstance.hpp"
+#include "WasmModule.hpp"
+#include "WatParser.hpp"
+
+// String arguments are written here, matching the compiler's --interpret.
+static constexpr uint32_t STRING_ARG_POS = 50000;
+
+struct RunOptions {
+  std::string filename;
+  std::string invoke = "main";
+  std::vector<std::string> args{};
+  std::vector<bool> stringArgs{}; // Parallel to args: write the text to memory and pass its address.
+  bool stringResult = false;
+  bool validateOnly = false;
+  bool report = false;
+  bool reportJson = false;
+  uint64_t maxInstructions = std::numeric_limits<uint64_t>::max();
+};
+
+void printHelp(const char *programName) {
+  std::cout << "tubular-run - Validate and execute a WebAssembly text module produced by Tubular\n\n";
+  std::cout << "USAGE:\n";
+  std::cout << "  " << programName << " <module.wat|-> [OPTIONS]\n\n";
+  std::cout << "OPTIONS:\n";
+  std::cout << "  --invoke=NAME          Call the exported function NAME (default: main)\n";
+  std::cout << "  --arg=VALUE            Pass an i32 or f64 argument (repeatable, in order)\n";
+  std::cout << "  --string-arg=TEXT      Write TEXT into memory and pass its address\n";
+  std::cout << "  --string-result        Print the result as the string at that address\n";
+  std::cout << "  --validate             Only load and validate the module\n";
+  std::cout << "  --report               Print instruction, call and memory counts to stderr\n";
+  std::cout << "  --report-json          Print the same counts as JSON to stderr\n";
+  std::cout << "  --max-instructions=N   Trap after executing N instructions\n";
+  std::cout << "  --help, -h             Show this help message\n\n";
+  std::cout << "Instruction counts are deterministic, so they can compare generated code\n";
+  std::cout << "without wat2wasm, a WebAssembly runtime, or timing noise.\n";
+}
+
+static std::string ReadSource(const std::string &filename) {
+  if (filename == "-")
+    return std::string(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+  std::ifstream file(filename);
+  if (!file) {
+    std::cout << "Error: Unable to open file '" << filename << "'" << std::endl;
+    exit(1);
+  }
+  return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static std::string FormatF64(double value) {
+  std::array<char, 32> buffer;
+  auto result = std::to_chars(buffer.data(), buffer.data() + buffer.size(), value);
+  return std::string(buffer.data(), result.ptr);
+}
+
+static std::string JsonEscape(const std::string &text) {
+  std::string out;
+  for (char ch : text) {
+    if (ch == '"' || ch == '\\') {
+      out.push_back('\\');
+      out.push_back(ch);
+    } else if (static_cast<unsigned char>(ch) < 0x20) {
+      std::ostringstream hex;
+      hex << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(ch);
+      out += hex.str();
+    } else {
+      out.push_back(ch);
+    }
+  }
+  return out;
+}
+
+// Convert command-line text to a value of the parameter's type.
+static uint64_t ParseArgument(const std::string &text, ValType type, size_t position) {
+  try {
+    size_t used = 0;
+    if (type == ValType::F64) {
+      const double value = std::stod(text, &used);
+      if (used == text.size())
+        return WasmInstance::FromF64(value);
+    } else if (type == ValType::I64) {
+      if (auto value = WasmModule::ParseI64(text))
+        return *value;
+    } else {
+      const long long value = std::stoll(text, &used, 0);
+      if (used == text.size() && value >= std::numeric_limits<int32_t>::min() &&
+          value <= std::numeric_limits<uint32_t>::max())
+        return static_cast<uint32_t>(value);
+    }
+  } catch (const std::exception &) {
+  }
+  std::cout << "Error: Invalid " << ValTypeName(type) << " argument '" << text << "' for parameter " << position
+            << std::endl;
+  exit(1);
+}
+
+static void PrintReport(const WasmModule &module, const WasmInstance &instance, std::ostream &out) {
+  const auto &stats = instance.GetFunctionStats();
+  out << "Instructions executed: " << instance.NumInstructions() << "\n";
+  out << "Memory high-water:     " << instance.MemoryHighWater() << " bytes (" << instance.PeakMemoryPages()
+      << " page(s))\n";
+  out << std::left << std::setw(24) << "Function" << std::right << std::setw(12) << "Calls" << std::setw(16)
+      << "Instructions" << "\n";
+  for (size_t i = 0; i < module.functions.size(); ++i) {
+    if (stats[i].calls == 0)
+      continue;
+    out << std::left << std::setw(24) << module.functions[i].name << std::right << std::setw(12) << stats[i].calls
+        << std::setw(16) << stats[i].instructions << "\n";
+  }
+}
+
+static void PrintReportJson(const WasmModule &module, const WasmInstance &instance, std::ostream &out) {
+  const auto &stats = instance.GetFunctionStats();
+  out << "{\"instructions\": " << instance.NumInstructions() << ", \"memory_high_water\": "
+      << instance.MemoryHighWater() << ", \"memory_pages\": " << instance.PeakMemoryPages() << ", \"functions\": [";
+  bool first = true;
+  for (size_t i = 0; i < module.functions.size(); ++i) {
+    if (stats[i].calls == 0)
+      continue;
+    out << (first ? "" : ", ") << "{\"name\": \"" << JsonEscape(module.functions[i].name)
+        << "\", \"calls\": " << stats[i].calls << ", \"instructions\": " << stats[i].instructions << "}";
+    first = false;
+  }
+  out << "]}\n";
+}
+
+static RunOptions ParseOptions(int argc, char *argv[]) {
+  RunOptions options;
+  for (int i = 1; i < argc; ++i) {
+    std::string flag = argv[i];
+    if (flag == "--help" || flag == "-h") {
+      printHelp(argv[0]);
+      exit(0);
+    } else if (flag.rfind("--invoke=", 0) == 0) {
+      options.invoke = flag.substr(9);
+    } else if (flag.rfind("--arg=", 0) == 0) {
+      options.args.push_back(flag.substr(6));
+      options.stringArgs.push_back(false);
+    } else if (flag.rfind("--string-arg=", 0) == 0) {
+      options.args.push_back(flag.substr(13));
+      options.stringArgs.push_back(true);
+    } else if (flag == "--string-result") {
+      options.stringResult = true;
+    } else if (flag == "--validate") {
+      options.validateOnly = true;
+    } else if (flag == "--report") {
+      options.report = true;
+    } else if (flag == "--report-json") {
+      options.reportJson = true;
+    } else if (flag.rfind("--max-instructions=", 0) == 0) {
+      std::string value = flag.substr(19);
+      try {
+        size_t used = 0;
+        options.maxInstructions = std::stoull(value, &used);
+        if (used != value.size() || value[0] == '-')
+          throw std::invalid_argument(value);
+      } catch (const std::exception &) {
+        std::cout << "Error: Invalid instruction limit '" << value << "'" << std::endl;
+        exit(1);
+      }
+    } else if (flag.size() > 1 && flag[0] == '-') {
+      std::cout << "Error: Unknown option '" << flag << "'\n\n";
+      printHelp(argv[0]);
+      exit(1);
+    } else if (options.filename.empty()) {
+      options.filename = flag;
+    } else {
+      std::cout << "Error: More than one module specified" << std::endl;
+      exit(1);
+    }
+  }
+  if (options.filename.empty()) {
+    std::cout << "Error: No input file specified\n\n";
+    printHelp(argv[0]);
+    exit(1);
+  }
+  return options;
+}
+
+int main(int argc, char *argv[]) {
+  const RunOptions options = ParseOptions(argc, argv);
+  const std::string source = ReadSource(options.filename);
+
+  WasmModule module;
+  try {
+    module = WasmModule::Load(WatParser(source).ParseModule());
+  } catch (const WasmError &error) {
+    std::cout << "Error: Invalid module: " << error.what() << std::endl;
+    exit(1);
+  }
+  if (options.validateOnly) {
+    std::cout << "Module is valid (" << module.functions.size() << " functions)" << std::endl;
+    return 0;
+  }
+
+  const std::optional<uint32_t> func = module.FindExport(options.invoke);
+  if (!func) {
+    std::cout << "Error: No exported function named '" << options.invoke << "'" << std::endl;
+    exit(1);
+  }
+  const WasmFunction &fn = module.functions[*func];
+  if (options.args.size() != fn.params.size()) {
+    std::cout << "Error: Function '" << options.invoke << "' expects " << fn.params.size() << " argument(s), got "
+              << options.args.size() << std::endl;
+    exit(1);
+  }
+
+  try {
+    WasmInstance instance(module);
+    instance.SetInstructionLimit(options.maxInstructions);
+
+    std::vector<uint64_t> args;
+    uint32_t string_pos = STRING_ARG_POS;
+    for (size_t i = 0; i < options.args.size(); ++i) {
+      if (options.stringArgs[i]) {
+        instance.WriteBytes(string_pos, options.args[i] + '\0');
+        args.push_back(string_pos);
+        string_pos += static_cast<uint32_t>(options.args[i].size() + 1);
+      } else {
+        args.push_back(ParseArgument(options.args[i], fn.params[i], i + 1));
+      }
+    }
+
+    const std::vector<uint64_t> results = instance.Invoke(*func, args);
+    for (size_t i = 0; i < results.size(); ++i) {
+      if (options.stringResult && fn.results[i] == ValType::I32)
+        std::cout << instance.ReadString(static_cast<uint32_t>(results[i])) << std::endl;
+      else if (fn.results[i] == ValType::F64)
+        std::cout << FormatF64(WasmInstance::AsF64(results[i])) << std::endl;
+      else if (fn.results[i] == ValType::I64)
+        std::cout << static_cast<int64_t>(results[i]) << std::endl;
+      else
+        std::cout << WasmInstance::AsI32(results[i]) << std::endl;
+    }
+    if (options.report)
+      PrintReport(module, instance, std::cerr);
+    if (options.reportJson)
+      PrintReportJson(module, instance, std::cerr);
+  } catch (const WasmTrap &trap) {
+    std::cout << "Error: Trap: " << trap.what() << std::endl;
+    exit(1);
+  }
+  return 0;
+}
@@ -4,6 +4,11 @@ Autotuning runner for the Tubular compiler.
 
 Compiles benchmarks with a set of optimization flag variants, executes each
 generated WebAssembly module via Node.js, and writes timing results to CSV.
+
+When wat2wasm or Node.js is unavailable (or with --runner tubular-run) the
+modules are executed by the bundled tubular-run interpreter instead, which also
+records a deterministic executed-instruction count for each variant.  Every
+row also carries the compiler's static cost estimate (--estimate-cost) of main.
 """
 
 from __future__ import annotations
@@ -52,16 +57,28 @@ def run_command(cmd: List[str], *, cwd: Path | None = None,
     )
 
 
-def ensure_tools(tubular: Path, wat2wasm: str, node_exec: str) -> None:
+def ensure_tools(tubular: Path, wat2wasm: str, node_exec: str, runner: str, tubular_run: Path) -> str:
+    """Check requirements and return the runner to use ('node' or 'tubular-run')."""
     missing: List[str] = []
     if not tubular.exists():
         missing.append(f"Tubular executable not found at {tubular}")
+    node_missing: List[str] = []
     if not shell_available(wat2wasm):
-        missing.append("'wat2wasm' not found in PATH")
+        node_missing.append("'wat2wasm' not found in PATH")
     if not shell_available(node_exec):
-        missing.append("'node' not found in PATH")
+        node_missing.append("'node' not found in PATH")
+
+    if runner == "auto":
+        runner = "node" if not node_missing else "tubular-run"
+        if node_missing and tubular_run.exists():
+            print("[INFO] " + "; ".join(node_missing) + f" - using {tubular_run}", file=sys.stderr)
+    if runner == "node":
+        missing.extend(node_missing)
+    elif not tubular_run.exists():
+        missing.append(f"tubular-run executable not found at {tubular_run}")
     if missing:
         raise SystemExit("Missing requirements:\n  " + "\n  ".join(missing))
+    return runner
 
 
 def load_config(path: Path) -> Dict[str, Any]:
@@ -76,6 +93,11 @@ def compile_benchmark(tubular: Path, bench_path: Path, flags: List[str],
         run_command([str(tubular), str(bench_path), *flags], stdout=out)
 
 
+def estimate_cost(tubular: Path, bench_path: Path, flags: List[str]) -> Any:
+    completed = run_command([str(tubular), str(bench_path), *flags, "--estimate-cost"], stdout=subprocess.PIPE)
+    return json.loads(completed.stdout).get("main_cost", "")
+
+
 def convert_wasm(wat2wasm: str, wat_path: Path, wasm_path: Path) -> None:
     wasm_path.parent.mkdir(parents=True, exist_ok=True)
     run_command([wat2wasm, str(wat_path), "-o", str(wasm_path)], stdout=subprocess.PIPE)
@@ -86,6 +108,11 @@ def run_wasm(node_exec: str, wasm_path: Path, invoke: str) -> subprocess.Complet
                        stdout=subprocess.PIPE)
 
 
+def run_tubular_run(tubular_run: Path, wat_path: Path, invoke: str) -> subprocess.CompletedProcess:
+    return run_command([str(tubular_run), str(wat_path), f"--invoke={invoke}", "--report-json"],
+                       stdout=subprocess.PIPE)
+
+
 def normalize_pass_token(token: str) -> str:
     trimmed = token.strip().lower()
     if trimmed not in PASS_ORDER_TOKENS:
@@ -124,6 +151,8 @@ def measure_variant(
     tubular: Path,
     wat2wasm: str,
     node_exec: str,
+    runner: str,
+    tubular_run: Path,
     bench: Dict[str, Any],
     variant_name: str,
     flags: List[str],
@@ -142,23 +171,33 @@ def measure_variant(
     wasm_path = output_dir / f"{bench_name}__{variant_name}__{wat_suffix}.wasm"
 
     compile_benchmark(tubular, benchmark_path, flags, wat_path)
-    convert_wasm(wat2wasm, wat_path, wasm_path)
+    static_cost = estimate_cost(tubular, benchmark_path, flags)
+    if runner == "node":
+        convert_wasm(wat2wasm, wat_path, wasm_path)
 
     invoke = bench.get("invoke", "main")
     expected = bench.get("expected")
 
+    def execute() -> subprocess.CompletedProcess:
+        if runner == "node":
+            return run_wasm(node_exec, wasm_path, invoke)
+        return run_tubular_run(tubular_run, wat_path, invoke)
+
     # Warm-up: execute but discard timings.
     for _ in range(max(0, warmup_runs)):
-        run_wasm(node_exec, wasm_path, invoke)
+        execute()
 
     timings: List[float] = []
     results: List[str] = []
+    instructions = ""
     for _ in range(runs):
         start = time.perf_counter()
-        completed = run_wasm(node_exec, wasm_path, invoke)
+        completed = execute()
         elapsed_ms = (time.perf_counter() - start) * 1000.0
         timings.append(elapsed_ms)
         results.append(completed.stdout.strip())
+        if runner == "tubular-run":
+            instructions = json.loads(completed.stderr)["instructions"]
 
     if not results:
         raise RuntimeError("No timing data recorded.")
@@ -182,12 +221,14 @@ def measure_variant(
         "pass_order": pass_order_name,
         "flags": " ".join(flags),
         "wat_size": wat_path.stat().st_size,
-        "wasm_size": wasm_path.stat().st_size,
+        "wasm_size": wasm_path.stat().st_size if runner == "node" else "",
         "runs": runs,
         "warmup_runs": warmup_runs,
         "p25_ms": p25,
         "median_ms": median,
         "p75_ms": p75,
+        "instructions": instructions,
+        "static_cost": static_cost,
         "result": canonical,
     }
 
@@ -208,6 +249,8 @@ def write_csv(rows: List[Dict[str, Any]], output_path: Path) -> None:
         "p25_ms",
         "median_ms",
         "p75_ms",
+        "instructions",
+        "static_cost",
         "result",
     ]
     with output_path.open("w", newline="", encoding="utf-8") as csvfile:
@@ -253,6 +296,18 @@ def main(argv: List[str]) -> int:
         default="node",
         help="Node.js executable (default: %(default)s)",
     )
+    parser.add_argument(
+        "--runner",
+        choices=["auto", "node", "tubular-run"],
+        default="auto",
+        help="How to execute modules: Node.js, tubular-run, or auto (Node.js when available; default)",
+    )
+    parser.add_argument(
+        "--tubular-run",
+        type=Path,
+        default=Path("build/tubular-run"),
+        help="Path to the tubular-run interpreter (default: %(default)s)",
+    )
     parser.add_argument(
         "--runs",
         type=int,
@@ -272,7 +327,7 @@ def main(argv: List[str]) -> int:
     runs = args.runs if args.runs is not None else config.get("runs", 5)
     warmup = args.warmup if args.warmup is not None else config.get("warmup_runs", 1)
 
-    ensure_tools(args.tubular, args.wat2wasm, args.node)
+    runner = ensure_tools(args.tubular, args.wat2wasm, args.node, args.runner, args.tubular_run)
 
     benchmarks = config.get("benchmarks", [])
     variants = config.get("variants", [])
@@ -301,6 +356,8 @@ def main(argv: List[str]) -> int:
                         args.tubular,
                         args.wat2wasm,
                         args.node,
+                        runner,
+                        args.tubular_run,
                         bench,
                         variant["name"],
                         order_flags,
@@ -310,9 +367,10 @@ def main(argv: List[str]) -> int:
                         warmup,
                     )
                     results.append(result)
+                    count = f", {result['instructions']} instructions" if result["instructions"] != "" else ""
                     print(
                         f"[OK] {bench['name']} / {variant['name']} [{order_name}]: "
-                        f"{result['median_ms']:.3f} ms (flags: {result['flags']})"
+                        f"{result['median_ms']:.3f} ms{count} (flags: {result['flags']})"
                     )
                 except subprocess.CalledProcessError as exc:
                     print(
@@ -0,0 +1,262 @@
+#!/usr/bin/env python3
+"""
+Benchmark the speed of the Tubular compiler itself.
+
+A synthetic Tube program is generated for each workload (arithmetic-heavy,
+string-heavy, or a mix), with a chosen number of functions, statements per
+function, and control-flow nesting depth.  Each program is compiled several
+times with ``--time-phases`` and the median time of every phase (lex, parse,
+typecheck, each optimization pass, codegen, print) is reported as JSON,
+together with its throughput in MB of source per second and AST nodes per
+second.  Generation is seeded, so runs over time compare the same programs.
+"""
+
+from __future__ import annotations
+
+import argparse
+import json
+import random
+import statistics
+import subprocess
+import sys
+import tempfile
+from pathlib import Path
+from typing import Dict, List
+
+WORKLOADS = ("arith", "string", "mixed")
+
+
+class ProgramGenerator:
+    """Generates a valid Tube program; every function returns through its last statement."""
+
+    def __init__(self, functions: int, statements: int, depth: int, workload: str, seed: int) -> None:
+        self.functions = functions
+        self.statements = statements
+        self.depth = depth
+        self.workload = workload
+        self.rng = random.Random(seed)
+        self.lines: List[str] = []
+        self.int_funcs: List[str] = []
+        self.str_funcs: List[str] = []
+        self.counter = 0
+
+    def fresh(self, prefix: str) -> str:
+        self.counter += 1
+        return f"{prefix}{self.counter}"
+
+    def emit(self, indent: int, text: str) -> None:
+        self.lines.append("  " * indent + text)
+
+    # ---- Expressions ----
+
+    def int_expr(self, ints: List[str], strs: List[str], depth: int = 0) -> str:
+        choice = self.rng.random()
+        if depth >= 2 or choice < 0.25:
+            if ints and self.rng.random() < 0.7:
+                return self.rng.choice(ints)
+            return str(self.rng.randint(0, 99))
+        if choice < 0.35 and self.int_funcs and len(ints) >= 2:
+            callee = self.rng.choice(self.int_funcs)
+            return f"{callee}({self.rng.choice(ints)}, {self.int_expr(ints, strs, depth + 1)})"
+        if choice < 0.45 and strs:
+            return f"size({self.rng.choice(strs)})"
+        op = self.rng.choice(["+", "-", "*", "+", "-", "/", "%"])
+        rhs = self.int_expr(ints, strs, depth + 1)
+        if op in "/%":
+            rhs = f"({rhs} + 1)"
+        return f"({self.int_expr(ints, strs, depth + 1)} {op} {rhs})"
+
+    def str_expr(self, ints: List[str], strs: List[str], depth: int = 0) -> str:
+        choice = self.rng.random()
+        if depth >= 2 or choice < 0.3:
+            if strs and self.rng.random() < 0.7:
+                return self.rng.choice(strs)
+            return '"' + "".join(self.rng.choice("abcdefgh") for _ in range(self.rng.randint(1, 6))) + '"'
+        if choice < 0.4 and self.str_funcs and ints:
+            callee = self.rng.choice(self.str_funcs)
+            return f"{callee}({self.str_expr(ints, strs, depth + 1)}, {self.rng.choice(ints)})"
+        if choice < 0.5:
+            return f"({self.str_expr(ints, strs, depth + 1)} * {self.rng.randint(1, 3)})"
+        return f"({self.str_expr(ints, strs, depth + 1)} + {self.str_expr(ints, strs, depth + 1)})"
+
+    # ---- Statements ----
+
+    def string_weight(self) -> float:
+        return {"arith": 0.0, "string": 0.8, "mixed": 0.4}[self.workload]
+
+    def block(self, indent: int, budget: int, depth: int, ints: List[str], strs: List[str]) -> int:
+        """Emit statements using up to budget; returns the number emitted."""
+        ints = list(ints)
+        strs = list(strs)
+        used = 0
+        while used < budget:
+            kind = self.rng.random()
+            nested = budget - used - 1
+            if depth < self.depth and nested >= 3 and kind < 0.15:
+                cond = f"{self.int_expr(ints, strs)} < {self.int_expr(ints, strs)}"
+                self.emit(indent, f"if ({cond}) {{")
+                inner = self.block(indent + 1, nested // 2, depth + 1, ints, strs)
+                self.emit(indent, "} else {")
+                inner += self.block(indent + 1, nested // 2, depth + 1, ints, strs)
+                self.emit(indent, "}")
+                used += 1 + inner
+            elif depth < self.depth and nested >= 3 and kind < 0.3:
+                var = self.fresh("i")
+                self.emit(indent, f"int {var} = 0;")
+                self.emit(indent, f"while ({var} < {self.rng.randint(2, 16)}) {{")
+                inner = self.block(indent + 1, nested // 2, depth + 1, ints + [var], strs)
+                self.emit(indent + 1, f"{var} = {var} + 1;")
+                self.emit(indent, "}")
+                used += 2 + inner
+            elif self.rng.random() < self.string_weight():
+                if strs and self.rng.random() < 0.4:
+                    self.emit(indent, f"{self.rng.choice(strs)} = {self.str_expr(ints, strs)};")
+                elif strs and ints and self.rng.random() < 0.3:
+                    var = self.fresh("c")
+                    self.emit(indent, f"char {var} = {self.rng.choice(strs)}[0];")
+                else:
+                    var = self.fresh("s")
+                    self.emit(indent, f"string {var} = {self.str_expr(ints, strs)};")
+                    strs.append(var)
+                used += 1
+            else:
+                if ints and self.rng.random() < 0.4:
+                    self.emit(indent, f"{self.rng.choice(ints)} = {self.int_expr(ints, strs)};")
+                else:
+                    var = self.fresh("v")
+                    self.emit(indent, f"int {var} = {self.int_expr(ints, strs)};")
+                    ints.append(var)
+                used += 1
+        return used
+
+    def function(self, index: int) -> None:
+        returns_string = self.workload != "arith" and self.rng.random() < self.string_weight()
+        name = f"{'S' if returns_string else 'F'}{index}"
+        if returns_string:
+            self.emit(0, f"function {name}(string s, int n) : string {{")
+            ints, strs = ["n"], ["s"]
+        else:
+            self.emit(0, f"function {name}(int a, int b) : int {{")
+            ints, strs = ["a", "b"], []
+        self.block(1, self.statements, 0, ints, strs)
+        if returns_string:
+            self.emit(1, f"return {self.str_expr(ints, strs)};")
+            self.str_funcs.append(name)
+        else:
+            self.emit(1, f"return {self.int_expr(ints, strs)};")
+            self.int_funcs.append(name)
+        self.emit(0, "}")
+        self.emit(0, "")
+
+    def generate(self) -> str:
+        for index in range(self.functions):
+            self.function(index)
+        calls = [f"{fn}(1, 2)" for fn in self.int_funcs[-4:]] or ["0"]
+        calls += [f"size({fn}(\"x\", 2))" for fn in self.str_funcs[-4:]]
+        self.emit(0, "function main() : int {")
+        self.emit(1, f"return {' + '.join(calls)};")
+        self.emit(0, "}")
+        return "\n".join(self.lines) + "\n"
+
+
+def time_compile(compiler: Path, source: Path, flags: List[str], repeat: int) -> Dict:
+    reports = []
+    for _ in range(repeat):
+        cmd = [str(compiler), str(source), "--time-phases", *flags]
+        result = subprocess.run(cmd, text=True, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, check=False)
+        if result.returncode != 0:
+            raise RuntimeError(f"compilation failed: {result.stderr.strip()[:500]}")
+        reports.append(json.loads(result.stderr[result.stderr.index("{"):]))
+
+    # Median of each phase over the repetitions.
+    phases = []
+    for position, phase in enumerate(reports[0]["phases"]):
+        seconds = statistics.median(report["phases"][position]["seconds"] for report in reports)
+        safe = max(seconds, 1e-9)
+        phases.append(
+            {
+                "name": phase["name"],
+                "seconds": seconds,
+                "bytes": phase["bytes"],
+                "nodes": phase["nodes"],
+                "mb_per_s": phase["bytes"] / 1e6 / safe,
+                "nodes_per_s": phase["nodes"] / safe,
+            }
+        )
+    total = statistics.median(report["total_seconds"] for report in reports)
+    return {
+        "source_bytes": reports[0]["source_bytes"],
+        "functions": reports[0]["functions"],
+        "total_seconds": total,
+        "mb_per_s": reports[0]["source_bytes"] / 1e6 / max(total, 1e-9),
+        "phases": phases,
+    }
+
+
+def main(argv: List[str]) -> int:
+    parser = argparse.ArgumentParser(description="Benchmark the Tubular compiler on synthetic programs")
+    parser.add_argument("--compiler", type=Path, default=Path("build/Tubular"), help="Compiler binary (default: build/Tubular)")
+    parser.add_argument("--functions", type=int, default=200, help="Functions per program (default: 200)")
+    parser.add_argument("--statements", type=int, default=40, help="Statements per function (default: 40)")
+    parser.add_argument("--depth", type=int, default=3, help="Maximum if/while nesting depth (default: 3)")
+    parser.add_argument(
+        "--workload",
+        choices=[*WORKLOADS, "all"],
+        default="all",
+        help="Program style: arith, string, mixed, or all (default: all)",
+    )
+    parser.add_argument("--repeat", type=int, default=5, help="Compilations per workload; medians are kept (default: 5)")
+    parser.add_argument("--seed", type=int, default=450, help="Random seed for program generation (default: 450)")
+    parser.add_argument("--jobs", type=int, default=1, help="Compiler --jobs setting (default: 1)")
+    parser.add_argument("--flags", default="", help="Extra compiler flags, e.g. '--unroll-factor=8 --no-inline'")
+    parser.add_argument("--output", type=Path, help="Write the JSON report here instead of stdout")
+    parser.add_argument("--keep", type=Path, help="Also save the generated programs in this directory")
+    args = parser.parse_args(argv)
+
+    if not args.compiler.exists():
+        print(f"[bench] compiler not found: {args.compiler}", file=sys.stderr)
+        return 1
+
+    flags = [f"--jobs={args.jobs}", *args.flags.split()]
+    workloads = WORKLOADS if args.workload == "all" else (args.workload,)
+    report = {
+        "compiler": str(args.compiler),
+        "flags": flags,
+        "functions": args.functions,
+        "statements": args.statements,
+        "depth": args.depth,
+        "repeat": args.repeat,
+        "seed": args.seed,
+        "workloads": {},
+    }
+
+    with tempfile.TemporaryDirectory() as tmp:
+        out_dir = args.keep or Path(tmp)
+        out_dir.mkdir(parents=True, exist_ok=True)
+        for workload in workloads:
+            generator = ProgramGenerator(args.functions, args.statements, args.depth, workload, args.seed)
+            source = out_dir / f"bench-{workload}.tube"
+            source.write_text(generator.generate(), encoding="utf-8")
+            try:
+                result = time_compile(args.compiler, source, flags, max(1, args.repeat))
+            except RuntimeError as exc:
+                print(f"[bench] {workload}: {exc}", file=sys.stderr)
+                return 1
+            report["workloads"][workload] = result
+            print(
+                f"[bench] {workload}: {result['source_bytes'] / 1e3:.1f} KB in {result['total_seconds'] * 1e3:.1f} ms "
+                f"({result['mb_per_s']:.2f} MB/s)",
+                file=sys.stderr,
+            )
+
+    text = json.dumps(report, indent=2)
+    if args.output:
+        args.output.parent.mkdir(parents=True, exist_ok=True)
+        args.output.write_text(text + "\n", encoding="utf-8")
+    else:
+        print(text)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
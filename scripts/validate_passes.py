@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+"""
+Check that every optimization configuration preserves program results.
+
+Each benchmark listed in the research config is run through the compiler's
+built-in interpreter (``--interpret``) once per variant and pass order, and
+the value returned by ``main`` is compared against the benchmark's expected
+value.  No WebAssembly toolchain is needed, so the whole matrix runs in a few
+seconds.
+"""
+
+from __future__ import annotations
+
+import argparse
+import json
+import subprocess
+import sys
+import time
+from pathlib import Path
+from typing import Dict, List
+
+
+def run_interpreter(compiler: Path, source: Path, flags: List[str], timeout: float) -> subprocess.CompletedProcess:
+    cmd = [str(compiler), str(source), "--interpret", *flags]
+    return subprocess.run(cmd, text=True, capture_output=True, timeout=timeout, check=False)
+
+
+def main(argv: List[str]) -> int:
+    parser = argparse.ArgumentParser(description="Validate Tubular optimizations with the interpreter")
+    parser.add_argument("--project-root", type=Path, default=Path("."), help="Repository root (default: .)")
+    parser.add_argument(
+        "--config",
+        type=Path,
+        default=Path("research_tests/config.json"),
+        help="Benchmark configuration relative to the project root",
+    )
+    parser.add_argument(
+        "--compiler",
+        type=Path,
+        default=Path("build/Tubular"),
+        help="Compiler binary relative to the project root (default: build/Tubular)",
+    )
+    parser.add_argument("--timeout", type=float, default=60.0, help="Seconds allowed per run (default: 60)")
+    parser.add_argument("--verbose", action="store_true", help="Print every run, not just failures")
+    args = parser.parse_args(argv)
+
+    root = args.project_root.resolve()
+    compiler = args.compiler if args.compiler.is_absolute() else root / args.compiler
+    if not compiler.exists():
+        print(f"[validate] compiler not found: {compiler}", file=sys.stderr)
+        return 1
+    with (root / args.config).open(encoding="utf-8") as fh:
+        config: Dict = json.load(fh)
+
+    variants = config.get("variants") or [{"name": "baseline", "flags": []}]
+    pass_orders = config.get("pass_orders") or [{"name": "default", "order": []}]
+
+    failures = 0
+    runs = 0
+    start = time.perf_counter()
+    for bench in config["benchmarks"]:
+        source = root / bench["path"]
+        expected = str(bench["expected"])
+        for variant in variants:
+            for order in pass_orders:
+                flags = list(variant["flags"])
+                if order["order"]:
+                    flags.append("--pass-order=" + ",".join(order["order"]))
+                label = f"{bench['name']}/{variant['name']}/{order['name']}"
+                runs += 1
+                try:
+                    result = run_interpreter(compiler, source, flags, args.timeout)
+                except subprocess.TimeoutExpired:
+                    failures += 1
+                    print(f"[validate] TIMEOUT {label}")
+                    continue
+
+                actual = result.stdout.strip()
+                if result.returncode != 0 or actual != expected:
+                    failures += 1
+                    detail = result.stderr.strip() or result.stdout.strip()
+                    print(f"[validate] FAIL {label}: expected {expected}, got {actual or '-'} ({detail})")
+                elif args.verbose:
+                    print(f"[validate] ok   {label}: {actual}")
+    elapsed = time.perf_counter() - start
+
+    print(f"[validate] {runs - failures}/{runs} runs matched the expected values in {elapsed:.1f}s")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+// A growing text buffer that is written out in large chunks.
+//
+// Example usage:
+//   OutputBuffer out(stdout);           // Or OutputBuffer out; to keep the text in memory.
+//   out.Spaces(4);
+//   out.Append("(i32.const 1)");
+//   out.Append('\n');
+//   out.Flush();                        // Also done by the destructor.
+//
+// Text is appended to one std::string; once it passes CHUNK_SIZE bytes it is
+// handed to fwrite() in a single call, so a large module costs a few dozen
+// writes instead of a stream insertion (and, with std::endl, a flush) per
+// line.  Without a file the buffer simply grows, and str() returns it all.
+class OutputBuffer {
+public:
+  static constexpr size_t CHUNK_SIZE = 1 << 16;
+
+private:
+  std::string buffer{};
+  std::FILE *file = nullptr;
+  size_t flushed = 0; // Bytes already written to the file.
+  bool failed = false;
+
+  void Write() {
+    failed |= std::fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size();
+    flushed += buffer.size();
+    buffer.clear();
+  }
+
+  void MaybeFlush() {
+    if (file && buffer.size() >= CHUNK_SIZE)
+      Write();
+  }
+
+public:
+  OutputBuffer() = default;
+  explicit OutputBuffer(std::FILE *file) : file(file) { buffer.reserve(CHUNK_SIZE * 2); }
+  OutputBuffer(const OutputBuffer &) = delete;
+  OutputBuffer &operator=(const OutputBuffer &) = delete;
+  ~OutputBuffer() { Flush(); }
+
+  void Append(std::string_view text) {
+    buffer.append(text);
+    MaybeFlush();
+  }
+  void Append(char ch) {
+    buffer.push_back(ch);
+    MaybeFlush();
+  }
+
+  // Append count spaces (for indentation and comment alignment).
+  void Spaces(size_t count) {
+    static constexpr std::string_view SPACES = "                                                                ";
+    for (; count > SPACES.size(); count -= SPACES.size())
+      buffer.append(SPACES);
+    buffer.append(SPACES.substr(0, count));
+  }
+
+  // Write any pending text to the file; returns false if any write has failed.
+  bool Flush() {
+    if (!file)
+      return true;
+    if (!buffer.empty())
+      Write();
+    failed |= std::fflush(file) != 0;
+    return !failed;
+  }
+
+  // Total bytes appended so far.
+  size_t Size() const { return flushed + buffer.size(); }
+
+  // The text not yet written (everything, for an in-memory buffer).
+  const std::string &str() const { return buffer; }
+};
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <pthread.h>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads for running independent, index-based jobs.
+//
+// Example usage:
+//   ThreadPool pool(4);                         // Caller plus three workers.
+//   pool.ParallelFor(items.size(), [&](size_t i) { Process(items[i]); });
+//
+// ParallelFor() returns only once every index has been processed.  Indices are
+// handed out one at a time, so jobs of uneven size still balance out.  The
+// calling thread takes part in the work, so a pool of one thread simply runs
+// everything in order on the caller.
+class ThreadPool {
+private:
+  std::vector<std::thread> workers{};
+
+  std::mutex mutex;
+  std::condition_variable wake_cv; // Signals workers that a new batch is ready.
+  std::condition_variable done_cv; // Signals the caller that workers finished.
+
+  // State of the current batch (guarded by mutex when changed).
+  const std::function<void(size_t)> *task = nullptr;
+  size_t task_count = 0;
+  std::atomic<size_t> next_index = 0;
+  size_t active_workers = 0;
+  size_t batch_id = 0;
+  bool stopping = false;
+
+  void RunTasks() {
+    for (size_t i = next_index++; i < task_count; i = next_index++) {
+      (*task)(i);
+    }
+  }
+
+  void WorkerLoop() {
+    size_t last_batch = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      wake_cv.wait(lock, [&] { return stopping || batch_id != last_batch; });
+      if (stopping)
+        return;
+      last_batch = batch_id;
+
+      lock.unlock();
+      RunTasks();
+      lock.lock();
+
+      if (--active_workers == 0)
+        done_cv.notify_one();
+    }
+  }
+
+public:
+  // Use a total of num_threads threads, including the caller (minimum one).
+  explicit ThreadPool(size_t num_threads) {
+    for (size_t i = 1; i < num_threads; ++i) {
+      workers.emplace_back([this] { WorkerLoop(); });
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake_cv.notify_all();
+    for (auto &worker : workers) {
+      worker.join();
+    }
+  }
+
+  size_t NumThreads() const { return workers.size() + 1; }
+
+  // Call fn(i) for each i in [0, count).
+  void ParallelFor(size_t count, const std::function<void(size_t)> &fn) {
+    if (workers.empty() || count < 2) {
+      for (size_t i = 0; i < count; ++i) {
+        fn(i);
+      }
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      task = &fn;
+      task_count = count;
+      next_index = 0;
+      active_workers = workers.size();
+      ++batch_id;
+    }
+    wake_cv.notify_all();
+
+    RunTasks();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done_cv.wait(lock, [&] { return active_workers == 0; });
+    task = nullptr;
+  }
+
+  // Run fn on a new thread with a stack of the given size and wait for it;
+  // used for deeply recursive work (such as interpreting a recursive program)
+  // that would overflow the default stack.
+  static void RunWithStack(size_t stack_bytes, const std::function<void()> &fn) {
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, stack_bytes);
+    pthread_t thread;
+    const int status = pthread_create(
+        &thread, &attr,
+        [](void *arg) -> void * {
+          (*static_cast<const std::function<void()> *>(arg))();
+          return nullptr;
+        },
+        const_cast<std::function<void()> *>(&fn));
+    pthread_attr_destroy(&attr);
+    if (status != 0) {
+      fn(); // Could not get a bigger stack; make do with this one.
+      return;
+    }
+    pthread_join(thread, nullptr);
+  }
+
+  // Number of hardware threads to default to (at least one).
+  static size_t DefaultThreads() { return std::max(1u, std::thread::hardware_concurrency()); }
+};
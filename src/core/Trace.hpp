@@ -0,0 +1,248 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Hot-path counters, tallied while a trace is being recorded.
+enum class TraceCounter {
+  TokensLexed,
+  NodesAllocated,
+  TypeInterns, // Function-type lookups in the TypeContext (Types themselves are plain handles).
+  DynCasts,
+  InstructionsEmitted, // Lines of WAT code generated.
+  BytesPrinted,
+  NUM_COUNTERS
+};
+
+// Scoped timers and counters for --trace, written as Chrome trace-event JSON
+// (open the file in chrome://tracing or https://ui.perfetto.dev).
+//
+// Example usage:
+//   Trace::Start();
+//   {
+//     TUBULAR_TRACE_PHASE("parse");             // Timed until the end of the scope.
+//     TUBULAR_TRACE_COUNT(TokensLexed, tokens.size());
+//   }
+//   Trace::Write("trace.json");
+//
+// A phase records how much every counter moved (on all threads) while it ran;
+// a TUBULAR_TRACE_SCOPE, used for per-function work on pool threads, records
+// only its own thread's counts.  The instrumentation compiles to nothing
+// unless TUBULAR_TRACE is defined (the CMake option of the same name, on by
+// default); compiled in, each point costs one flag test until Start().
+#ifdef TUBULAR_TRACE
+
+class Trace {
+public:
+  static constexpr bool COMPILED_IN = true;
+  static constexpr size_t NUM_COUNTERS = static_cast<size_t>(TraceCounter::NUM_COUNTERS);
+  using Counts = std::array<uint64_t, NUM_COUNTERS>;
+
+private:
+  struct Event {
+    std::string name;
+    const char *category;
+    double start_us;
+    double duration_us;
+    size_t thread;
+    Counts counts; // How much each counter moved during the event.
+  };
+
+  // Counters are kept per thread and written only by their owner, so that
+  // counting needs no atomic read-modify-write.
+  struct ThreadCounters {
+    std::array<std::atomic<uint64_t>, NUM_COUNTERS> values{};
+    size_t thread_id = 0;
+  };
+
+  inline static std::atomic<bool> enabled{false};
+
+  std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+  std::mutex mutex;
+  std::vector<Event> events{};
+  std::vector<std::unique_ptr<ThreadCounters>> threads{};
+
+  static Trace &Get() {
+    static Trace trace;
+    return trace;
+  }
+
+  static ThreadCounters &Local() {
+    thread_local ThreadCounters *local = nullptr;
+    if (!local) {
+      Trace &trace = Get();
+      std::lock_guard<std::mutex> lock(trace.mutex);
+      trace.threads.push_back(std::make_unique<ThreadCounters>());
+      local = trace.threads.back().get();
+      local->thread_id = trace.threads.size() - 1;
+    }
+    return *local;
+  }
+
+  static Counts Snapshot(const ThreadCounters &counters) {
+    Counts out{};
+    for (size_t i = 0; i < NUM_COUNTERS; ++i)
+      out[i] = counters.values[i].load(std::memory_order_relaxed);
+    return out;
+  }
+
+  static std::string Escape(const std::string &text) {
+    std::string out;
+    for (char ch : text) {
+      if (ch == '"' || ch == '\\')
+        out.push_back('\\');
+      if (static_cast<unsigned char>(ch) >= 0x20)
+        out.push_back(ch);
+    }
+    return out;
+  }
+
+public:
+  static constexpr const char *COUNTER_NAMES[NUM_COUNTERS] = {
+      "tokens_lexed", "nodes_allocated", "type_interns", "dyn_casts", "instructions_emitted", "bytes_printed"};
+
+  static bool Enabled() { return enabled.load(std::memory_order_relaxed); }
+
+  // Begin recording; timestamps count from here.  Call from the main thread.
+  static void Start() {
+    Get().origin = std::chrono::steady_clock::now();
+    Local(); // The calling thread becomes thread 0.
+    enabled.store(true, std::memory_order_relaxed);
+  }
+
+  static void Count(TraceCounter counter, uint64_t amount) {
+    if (!Enabled())
+      return;
+    std::atomic<uint64_t> &value = Local().values[static_cast<size_t>(counter)];
+    value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+  }
+
+  // Counter totals, for all threads or just the calling one.
+  static Counts Totals(bool all_threads) {
+    if (!all_threads)
+      return Snapshot(Local());
+    Trace &trace = Get();
+    std::lock_guard<std::mutex> lock(trace.mutex);
+    Counts out{};
+    for (const auto &thread : trace.threads) {
+      const Counts counts = Snapshot(*thread);
+      for (size_t i = 0; i < NUM_COUNTERS; ++i)
+        out[i] += counts[i];
+    }
+    return out;
+  }
+
+  static double NowMicros() {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - Get().origin).count();
+  }
+
+  static void AddEvent(std::string name, const char *category, double start_us, const Counts &counts) {
+    const double end_us = NowMicros();
+    const size_t thread = Local().thread_id;
+    Trace &trace = Get();
+    std::lock_guard<std::mutex> lock(trace.mutex);
+    trace.events.push_back(Event{std::move(name), category, start_us, end_us - start_us, thread, counts});
+  }
+
+  // Write everything recorded so far; returns false if the file cannot be written.
+  static bool Write(const std::string &filename) {
+    const Counts totals = Totals(true);
+    const double end_us = NowMicros();
+    Trace &trace = Get();
+    std::lock_guard<std::mutex> lock(trace.mutex);
+    std::ofstream out(filename);
+    if (!out)
+      return false;
+
+    out << "{\"traceEvents\": [\n";
+    out << "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"Tubular\"}}";
+    for (const auto &thread : trace.threads) {
+      const size_t id = thread->thread_id;
+      out << ",\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << id
+          << ", \"args\": {\"name\": \"" << (id ? "worker " + std::to_string(id) : std::string("main")) << "\"}}";
+    }
+    for (const Event &event : trace.events) {
+      out << ",\n  {\"name\": \"" << Escape(event.name) << "\", \"cat\": \"" << event.category
+          << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.thread << ", \"ts\": " << event.start_us
+          << ", \"dur\": " << event.duration_us << ", \"args\": {";
+      bool first = true;
+      for (size_t i = 0; i < NUM_COUNTERS; ++i) {
+        if (event.counts[i]) {
+          out << (first ? "" : ", ") << "\"" << COUNTER_NAMES[i] << "\": " << event.counts[i];
+          first = false;
+        }
+      }
+      out << "}}";
+    }
+    out << ",\n  {\"name\": \"counters\", \"ph\": \"C\", \"pid\": 1, \"tid\": 0, \"ts\": " << end_us << ", \"args\": {";
+    for (size_t i = 0; i < NUM_COUNTERS; ++i)
+      out << (i ? ", " : "") << "\"" << COUNTER_NAMES[i] << "\": " << totals[i];
+    out << "}}\n], \"displayTimeUnit\": \"ms\"}\n";
+    return static_cast<bool>(out);
+  }
+};
+
+// Records a complete event from construction to destruction.
+class TraceScope {
+private:
+  bool active;
+  bool all_threads;
+  std::string name{};
+  double start_us = 0.0;
+  Trace::Counts start_counts{};
+
+public:
+  TraceScope(std::string name, bool all_threads) : active(Trace::Enabled()), all_threads(all_threads) {
+    if (!active)
+      return;
+    this->name = std::move(name);
+    start_counts = Trace::Totals(all_threads);
+    start_us = Trace::NowMicros();
+  }
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+  ~TraceScope() {
+    if (!active)
+      return;
+    Trace::Counts counts = Trace::Totals(all_threads);
+    for (size_t i = 0; i < Trace::NUM_COUNTERS; ++i)
+      counts[i] -= start_counts[i];
+    Trace::AddEvent(std::move(name), all_threads ? "phase" : "function", start_us, counts);
+  }
+};
+
+#define TUBULAR_TRACE_CONCAT_(a, b) a##b
+#define TUBULAR_TRACE_CONCAT(a, b) TUBULAR_TRACE_CONCAT_(a, b)
+// The name is only built while tracing.
+#define TUBULAR_TRACE_PHASE(name)                                                                                      \
+  TraceScope TUBULAR_TRACE_CONCAT(trace_scope_, __LINE__)(Trace::Enabled() ? std::string(name) : std::string(), true)
+#define TUBULAR_TRACE_SCOPE(name)                                                                                      \
+  TraceScope TUBULAR_TRACE_CONCAT(trace_scope_, __LINE__)(Trace::Enabled() ? std::string(name) : std::string(), false)
+#define TUBULAR_TRACE_COUNT(counter, amount) Trace::Count(TraceCounter::counter, amount)
+
+#else
+
+// Tracing compiled out: the driver can still ask, but nothing is recorded.
+class Trace {
+public:
+  static constexpr bool COMPILED_IN = false;
+  static bool Enabled() { return false; }
+  static void Start() {}
+  static bool Write(const std::string &) { return false; }
+};
+
+// The arguments sit in sizeof, so they still count as used but are never evaluated.
+#define TUBULAR_TRACE_PHASE(name) ((void)sizeof(name))
+#define TUBULAR_TRACE_SCOPE(name) ((void)sizeof(name))
+#define TUBULAR_TRACE_COUNT(counter, amount) ((void)sizeof(amount))
+
+#endif
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <iostream>
+#include <mutex>
 #include <sstream>
 #include <string>
 
@@ -27,9 +28,16 @@ struct FilePos {
   auto operator<=>(const FilePos &) const = default;
 };
 
+// Errors may be raised from worker threads; only the first one gets reported.
+inline std::mutex &ErrorMutex() {
+  static std::mutex error_mutex;
+  return error_mutex;
+}
+
 // Helper function that take a line number and any number of additional args
 // that it uses to write an error message and terminate the program.
 template <typename... Ts> void Error(FilePos file_pos, Ts... message) {
+  ErrorMutex().lock(); // Never released; we are exiting.
   std::cerr << "ERROR (at " << file_pos.line << ":" << file_pos.col << "): ";
   (std::cerr << ... << std::forward<Ts>(message)) << std::endl;
   exit(1);
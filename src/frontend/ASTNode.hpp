@@ -4,18 +4,57 @@
 #include <cstddef>
 #include <locale>
 #include <memory>
+#include <optional>
 #include <sstream>
 #include <string>
 #include <vector>
 
 #include "ASTVisitor.hpp"
 #include "Control.hpp"
+#include "Operators.hpp"
 #include "SymbolTable.hpp"
 #include "TokenQueue.hpp"
+#include "Trace.hpp"
 #include "lexer.hpp"
 #include "tools.hpp"
 
+// Tag identifying the concrete class of every AST node, so that passes can
+// dispatch with a switch (or the isa/cast/dyn_cast helpers below) instead of
+// chains of dynamic_cast.  All ASTNode_Parent kinds must stay in the range
+// [FIRST_PARENT, LAST_PARENT].
+enum class NodeKind {
+  Block,
+  Function,
+  FunctionCall,
+  If,
+  While,
+  Return,
+  ToDouble,
+  ToInt,
+  ToString,
+  Math1,
+  Math2,
+  Indexing,
+  Size,
+  Break,
+  Continue,
+  TailCallLoop,
+  CharLit,
+  IntLit,
+  FloatLit,
+  StringLit,
+  Var,
+
+  FIRST_PARENT = Block,
+  LAST_PARENT = Size
+};
+
 class ASTNode {
+private:
+  NodeKind node_kind; // Concrete class of this node.
+
+  mutable std::optional<Type> type_cache; // Result of ComputeType(), once known.
+
 protected:
   FilePos file_pos; // What file position was this node parsed from in the
                     // original file?
@@ -23,14 +62,18 @@ protected:
 public:
   using ptr_t = std::unique_ptr<ASTNode>;
 
-  ASTNode() : file_pos(0, 0) {}
-  ASTNode(FilePos file_pos) : file_pos(file_pos) {}
+  ASTNode(NodeKind kind, FilePos file_pos) : node_kind(kind), file_pos(file_pos) {
+    TUBULAR_TRACE_COUNT(NodesAllocated, 1);
+  }
   ASTNode(const ASTNode &) = default;
   ASTNode(ASTNode &&) = default;
   virtual ~ASTNode() {}
   ASTNode &operator=(const ASTNode &) = default;
   ASTNode &operator=(ASTNode &&) = default;
 
+  // Which concrete node class is this?
+  NodeKind kind() const { return node_kind; }
+
   // What position in the original file was this node defined at?
   FilePos GetFilePos() const { return file_pos; }
 
@@ -56,7 +99,19 @@ public:
   // - A while loop with a return inside.
   virtual bool MayReturn() const { return false; }
 
-  virtual Type ReturnType(const SymbolTable & /* symbols */) const { return Type(); }
+  // Determine the type of value this node produces.  Nodes override ComputeType();
+  // everyone else should call ReturnType(), which computes the type once and
+  // caches it in the node until the node's children are modified.
+  virtual Type ComputeType(const SymbolTable & /* symbols */) const { return Type(); }
+
+  const Type &ReturnType(const SymbolTable &symbols) const {
+    if (!type_cache)
+      type_cache.emplace(ComputeType(symbols));
+    return *type_cache;
+  }
+
+  bool HasCachedType() const { return type_cache.has_value(); }
+  void InvalidateType() { type_cache.reset(); }
 
   virtual void TypeCheck(const SymbolTable & /* symbols */) {}
 
@@ -77,15 +132,40 @@ public:
   }
 };
 
+// Kind-based type queries (in the style of LLVM's casting helpers).  Each node
+// class provides a static classof(NodeKind) that these rely on.
+template <typename NODE_T> bool isa(const ASTNode &node) { return NODE_T::classof(node.kind()); }
+
+template <typename NODE_T> NODE_T &cast(ASTNode &node) {
+  assert(isa<NODE_T>(node));
+  return static_cast<NODE_T &>(node);
+}
+template <typename NODE_T> const NODE_T &cast(const ASTNode &node) {
+  assert(isa<NODE_T>(node));
+  return static_cast<const NODE_T &>(node);
+}
+
+template <typename NODE_T> NODE_T *dyn_cast(ASTNode *node) {
+  TUBULAR_TRACE_COUNT(DynCasts, 1);
+  return (node && isa<NODE_T>(*node)) ? static_cast<NODE_T *>(node) : nullptr;
+}
+template <typename NODE_T> const NODE_T *dyn_cast(const ASTNode *node) {
+  TUBULAR_TRACE_COUNT(DynCasts, 1);
+  return (node && isa<NODE_T>(*node)) ? static_cast<const NODE_T *>(node) : nullptr;
+}
+
 class ASTNode_Parent : public ASTNode {
 private:
   std::vector<ptr_t> children{};
 
 public:
-  template <typename... NODE_Ts> ASTNode_Parent(FilePos file_pos, NODE_Ts &&...nodes) : ASTNode(file_pos) {
+  template <typename... NODE_Ts>
+  ASTNode_Parent(NodeKind kind, FilePos file_pos, NODE_Ts &&...nodes) : ASTNode(kind, file_pos) {
     (AddChild(std::move(nodes)), ...);
   }
 
+  static bool classof(NodeKind kind) { return kind >= NodeKind::FIRST_PARENT && kind <= NodeKind::LAST_PARENT; }
+
   void TypeCheck(const SymbolTable &symbols) override { TypeCheckChildren(symbols); }
 
   // Tools to work with child nodes...
@@ -94,6 +174,9 @@ public:
     for (auto &child : children) {
       child->TypeCheck(symbols);
     }
+    // Checking children may have adapted their subtrees, so any type computed
+    // for this node before now (e.g., while parsing) can be stale.
+    InvalidateType();
   }
 
   void InitializeWAT(Control &control) override {
@@ -131,7 +214,10 @@ public:
     return first_pos;
   }
 
-  void AddChild(ptr_t &&child) override { children.push_back(std::move(child)); }
+  void AddChild(ptr_t &&child) override {
+    children.push_back(std::move(child));
+    InvalidateType();
+  }
 
   template <typename NODE_T, typename... ARG_Ts> void MakeChild(ARG_Ts &&...args) {
     AddChild(std::make_unique<NODE_T>(std::forward<ARG_Ts>(args)...));
@@ -141,12 +227,14 @@ public:
   template <typename NODE_T> void AdaptChild(size_t id) {
     assert(id < children.size()); // Make sure child is there to adapt.
     children[id] = std::make_unique<NODE_T>(std::move(children[id]));
+    InvalidateType();
   }
 
   // Replace a child with a new node (for loop unrolling)
   void ReplaceChild(size_t id, ptr_t &&new_child) {
     assert(id < children.size()); // Make sure child is there to replace.
     children[id] = std::move(new_child);
+    InvalidateType();
   }
 
   // Generate WAT code for a specified child.
@@ -181,8 +269,9 @@ private:
 
 public:
   template <typename... NODE_Ts>
-  ASTNode_Block(FilePos file_pos, NODE_Ts &&...nodes) : ASTNode_Parent(file_pos, nodes...) {}
+  ASTNode_Block(FilePos file_pos, NODE_Ts &&...nodes) : ASTNode_Parent(NodeKind::Block, file_pos, nodes...) {}
 
+  static bool classof(NodeKind kind) { return kind == NodeKind::Block; }
   std::string GetTypeName() const override { return "BLOCK"; }
 
   void AddChild(ptr_t &&child) override {
@@ -200,7 +289,7 @@ public:
 
   bool IsReturn() const override { return is_return; }
   bool MayReturn() const override { return may_return; }
-  Type ReturnType(const SymbolTable &symbols) const override { return LastChild().ReturnType(symbols); }
+  Type ComputeType(const SymbolTable &symbols) const override { return LastChild().ReturnType(symbols); }
 
   bool ToWAT(Control &control) override {
     bool is_final_node = control.FinalNode();
@@ -229,10 +318,14 @@ protected:
   size_t fun_id;
   std::vector<size_t> param_ids; // The set of variables used as function parameters.
   std::vector<size_t> var_ids;   // The set of variables used inside the function.
+  bool exported = true;          // Is the function exported from the module?
+  size_t memo_entries = 0;       // Entries in the function's result table (0 if not memoized).
+  size_t memo_address = 0;       // Memory position of the result table.
 public:
   ASTNode_Function(const emplex::Token &name_token, size_t fun_id, std::vector<size_t> param_ids, ptr_t &&body)
-      : ASTNode_Parent(name_token, body), fun_id(fun_id), param_ids(param_ids) {}
+      : ASTNode_Parent(NodeKind::Function, name_token, body), fun_id(fun_id), param_ids(param_ids) {}
 
+  static bool classof(NodeKind kind) { return kind == NodeKind::Function; }
   std::string GetTypeName() const override { return std::string("FUNCTION: ") + std::to_string(fun_id); }
 
   void AddVar(size_t var_id) { var_ids.push_back(var_id); }
@@ -243,22 +336,63 @@ public:
   const std::vector<size_t>& GetParamIds() const { return param_ids; }
   const std::vector<size_t>& GetVarIds() const { return var_ids; }
 
-  Type ReturnType(const SymbolTable &symbols) const override { return symbols.At(fun_id).type.ReturnType(); }
+  bool IsExported() const { return exported; }
+  void SetExported(bool in) { exported = in; }
+
+  // Memoization (--memoize): calls look up their arguments in a table of
+  // memo_entries results before running the body.
+  bool IsMemoized() const { return memo_entries > 0; }
+  size_t GetMemoEntries() const { return memo_entries; }
+  void SetMemoEntries(size_t entries) { memo_entries = entries; }
+  void SetMemoAddress(size_t address) { memo_address = address; }
+
+  // Offset of the result within a table entry: after a valid flag and each
+  // argument, rounded up to a multiple of 8 for a double result.
+  size_t MemoResultOffset(const SymbolTable &symbols) const {
+    const size_t offset = 4 + 4 * param_ids.size();
+    return symbols.GetType(fun_id).ReturnType().IsDouble() ? (offset + 7) / 8 * 8 : offset;
+  }
+
+  // Bytes in one table entry, padded to a multiple of 8 so that every entry
+  // (and so every double result) stays 8-byte aligned.
+  size_t MemoEntryBytes(const SymbolTable &symbols) const {
+    const size_t result_bytes = symbols.GetType(fun_id).ReturnType().IsDouble() ? 8 : 4;
+    return (MemoResultOffset(symbols) + result_bytes + 7) / 8 * 8;
+  }
+
+  Type ComputeType(const SymbolTable &symbols) const override { return symbols.At(fun_id).type.ReturnType(); }
 
   bool ToWAT(Control &control) override {
     assert(NumChildren() == 1);
 
+    const std::string &fun_name = control.symbols.At(fun_id).name;
+    if (IsMemoized()) {
+      ToWAT_Definition(control, fun_name + ".impl", false);
+      ToWAT_Memoized(control, fun_name);
+    } else {
+      ToWAT_Definition(control, fun_name, exported);
+    }
+    return false;
+  }
+
+  void Accept(ASTVisitor &visitor) override { visitor.visit(*this); }
+
+private:
+  std::string ParamDeclarations(const Control &control) const {
     std::string param_declare;
     for (size_t id : param_ids) {
       std::string type = control.WATType(id);
       param_declare += ToString(" (param $var", id, " ", type, ")");
     }
+    return param_declare;
+  }
 
-    auto fun_name = control.symbols.At(fun_id).name;
+  // Generate the function's body as a WAT function with the given name.
+  void ToWAT_Definition(Control &control, const std::string &fun_name, bool export_it) {
     auto fun_type = control.symbols.At(fun_id).type;
 
     std::string wat_return = fun_type.ReturnType().ToWAT();
-    control.Code("(func $", fun_name, param_declare, " (result ", wat_return, ")");
+    control.Code("(func $", fun_name, ParamDeclarations(control), " (result ", wat_return, ")");
 
     control.Indent(2);
 
@@ -285,14 +419,62 @@ public:
     control.Indent(-2);
     control.Code(")")
         .Comment("END '", fun_name, "' function definition.")
-        .Code("") // Skip a line.
-        .Code("(export \"", fun_name, "\" (func $", fun_name, "))")
         .Code(""); // Skip a line.
-
-    return false;
+    if (export_it) {
+      control.Code("(export \"", fun_name, "\" (func $", fun_name, "))").Code(""); // Skip a line.
+    }
   }
 
-  void Accept(ASTVisitor &visitor) override { visitor.visit(*this); }
+  // Generate the memoizing entry point; the body is "$<name>.impl".  The
+  // arguments hash to one entry of the result table, which answers the call
+  // if it holds these arguments; otherwise the body runs and fills it.
+  void ToWAT_Memoized(Control &control, const std::string &fun_name) {
+    const std::string wat_return = control.symbols.At(fun_id).type.ReturnType().ToWAT();
+    const size_t result_offset = MemoResultOffset(control.symbols);
+    size_t shift = 32; // Keep the top log2(memo_entries) bits of the hash.
+    for (size_t n = memo_entries; n > 1; n >>= 1) {
+      --shift;
+    }
+
+    std::string hash = ToString("(local.get $var", param_ids[0], ")");
+    std::string hit = "(i32.load (local.get $entry))";
+    std::string args;
+    for (size_t i = 0; i < param_ids.size(); ++i) {
+      const size_t id = param_ids[i];
+      if (i > 0) {
+        hash = ToString("(i32.add (i32.mul ", hash, " (i32.const 31)) (local.get $var", id, "))");
+      }
+      hit = ToString("(i32.and ", hit, " (i32.eq (i32.load offset=", 4 + 4 * i, " (local.get $entry)) (local.get $var",
+                     id, ")))");
+      args += ToString(" (local.get $var", id, ")");
+    }
+
+    control.Code("(func $", fun_name, ParamDeclarations(control), " (result ", wat_return, ")")
+        .Comment("Memoized '", fun_name, "'");
+    control.Indent(2);
+    control.Code("(local $entry i32)")
+        .Code("(local $result ", wat_return, ")")
+        .Code("(local.set $entry (i32.add (i32.const ", memo_address, ")")
+        .Comment("Table entry for these arguments")
+        .Code("  (i32.mul (i32.shr_u (i32.mul ", hash, " (i32.const -1640531535)) (i32.const ", shift, "))")
+        .Code("           (i32.const ", MemoEntryBytes(control.symbols), "))))")
+        .Code("(if ", hit)
+        .Comment("Valid, with the same arguments?")
+        .Code("  (then (return (", wat_return, ".load offset=", result_offset, " (local.get $entry)))))")
+        .Code("(local.set $result (call $", fun_name, ".impl", args, "))")
+        .Code("(i32.store (local.get $entry) (i32.const 1))")
+        .Comment("Fill the entry");
+    for (size_t i = 0; i < param_ids.size(); ++i) {
+      control.Code("(i32.store offset=", 4 + 4 * i, " (local.get $entry) (local.get $var", param_ids[i], "))");
+    }
+    control.Code("(", wat_return, ".store offset=", result_offset, " (local.get $entry) (local.get $result))")
+        .Code("(local.get $result)");
+    control.Indent(-2);
+    control.Code(")").Comment("END memoized '", fun_name, "'").Code("");
+    if (exported) {
+      control.Code("(export \"", fun_name, "\" (func $", fun_name, "))").Code(""); // Skip a line.
+    }
+  }
 };
 
 class ASTNode_FunctionCall : public ASTNode_Parent {
@@ -301,18 +483,19 @@ private:
 
 public:
   ASTNode_FunctionCall(FilePos file_pos, size_t fun_id, std::vector<ptr_t> &&args)
-      : ASTNode_Parent(file_pos), fun_id(fun_id) {
+      : ASTNode_Parent(NodeKind::FunctionCall, file_pos), fun_id(fun_id) {
     for (auto &arg : args) {
       AddChild(std::move(arg));
     }
   }
 
+  static bool classof(NodeKind kind) { return kind == NodeKind::FunctionCall; }
   std::string GetTypeName() const override { return std::string("FUNCTION_CALL: ") + std::to_string(fun_id); }
 
   // Getter for function identifier
   size_t GetFunId() const { return fun_id; }
 
-  Type ReturnType(const SymbolTable &symbols) const override { return symbols.At(fun_id).type.ReturnType(); }
+  Type ComputeType(const SymbolTable &symbols) const override { return symbols.At(fun_id).type.ReturnType(); }
 
   bool ToWAT(Control &control) override {
     auto fun_name = control.symbols.At(fun_id).name;
@@ -330,10 +513,12 @@ public:
 
 class ASTNode_If : public ASTNode_Parent {
 public:
-  ASTNode_If(FilePos file_pos, ptr_t &&test, ptr_t &&action) : ASTNode_Parent(file_pos, test, action) {}
+  ASTNode_If(FilePos file_pos, ptr_t &&test, ptr_t &&action)
+      : ASTNode_Parent(NodeKind::If, file_pos, test, action) {}
   ASTNode_If(FilePos file_pos, ptr_t &&test, ptr_t &&action, ptr_t &&alt_action)
-      : ASTNode_Parent(file_pos, test, action, alt_action) {}
+      : ASTNode_Parent(NodeKind::If, file_pos, test, action, alt_action) {}
 
+  static bool classof(NodeKind kind) { return kind == NodeKind::If; }
   std::string GetTypeName() const override { return "IF"; }
 
   bool IsReturn() const override {
@@ -349,7 +534,7 @@ public:
     return (NumChildren() == 3) && GetChild(2).MayReturn();
   }
 
-  Type ReturnType(const SymbolTable &symbols) const override { return GetChild(1).ReturnType(symbols); }
+  Type ComputeType(const SymbolTable &symbols) const override { return GetChild(1).ReturnType(symbols); }
 
   void TypeCheck(const SymbolTable &symbols) override {
     if (NumChildren() < 2 || NumChildren() > 3) {
@@ -394,18 +579,52 @@ public:
   void Accept(ASTVisitor &visitor) override { visitor.visit(*this); }
 };
 
+class ASTNode_IntLit : public ASTNode {
+protected:
+  int value = 0.0;
+
+public:
+  ASTNode_IntLit(FilePos file_pos, int value) : ASTNode(NodeKind::IntLit, file_pos), value(value) {}
+
+  static bool classof(NodeKind kind) { return kind == NodeKind::IntLit; }
+  std::string GetTypeName() const override { return std::string("INT_LIT:") + std::to_string(value); }
+
+  // Getter for literal value
+  int GetValue() const { return value; }
+
+  Type ComputeType(const SymbolTable & /* symbols */) const override {
+    // For now, ops do not change the return type.
+    return Type("int");
+  }
+
+  bool ToWAT(Control &control) override {
+    control.Code("(i32.const ", value, ")").Comment("Put a ", value, " on the stack");
+    return true;
+  }
+
+  void Accept(ASTVisitor &visitor) override { visitor.visit(*this); }
+};
+
 class ASTNode_While : public ASTNode_Parent {
+private:
+  bool unrolled = false; // Produced by loop unrolling; never unrolled again.
+
 public:
-  ASTNode_While(FilePos file_pos, ptr_t &&test, ptr_t &&action) : ASTNode_Parent(file_pos, test, action) {}
+  ASTNode_While(FilePos file_pos, ptr_t &&test, ptr_t &&action)
+      : ASTNode_Parent(NodeKind::While, file_pos, test, action) {}
 
+  static bool classof(NodeKind kind) { return kind == NodeKind::While; }
   std::string GetTypeName() const override { return "WHILE"; }
 
+  void MarkUnrolled() { unrolled = true; }
+  bool IsUnrolled() const { return unrolled; }
+
   bool IsReturn() const override {
     return false; // Loop may never run, so return is never guaranteed.
   }
   bool MayReturn() const override { return GetChild(1).MayReturn(); }
 
-  Type ReturnType(const SymbolTable &symbols) const override { return GetChild(1).ReturnType(symbols); }
+  Type ComputeType(const SymbolTable &symbols) const override { return GetChild(1).ReturnType(symbols); }
 
   void TypeCheck(const SymbolTable &symbols) override {
     if (NumChildren() != 2) {
@@ -436,15 +655,18 @@ public:
         .Code("  (loop ", while_loop, "")
         .Comment("Inner loop for continuing while.");
     control.Indent(4);
-    control.CommentLine("WHILE Test condition...");
-
-    ChildToWAT(0, control, true);
 
-    control.Code("(i32.eqz)")
-        .Comment("Invert the result of the test condition.")
-        .Code("(br_if ", while_exit, ")")
-        .Comment("If condition is false (0), exit the loop")
-        .CommentLine("WHILE Loop body...");
+    // A constant true condition (as in a loopified tail call) needs no test.
+    const auto *always = dyn_cast<ASTNode_IntLit>(&GetChild(0));
+    if (!always || always->GetValue() == 0) {
+      control.CommentLine("WHILE Test condition...");
+      ChildToWAT(0, control, true);
+      control.Code("(i32.eqz)")
+          .Comment("Invert the result of the test condition.")
+          .Code("(br_if ", while_exit, ")")
+          .Comment("If condition is false (0), exit the loop");
+    }
+    control.CommentLine("WHILE Loop body...");
 
     ChildToWAT(1, control, false);
 
@@ -466,14 +688,15 @@ public:
 
 class ASTNode_Return : public ASTNode_Parent {
 public:
-  ASTNode_Return(FilePos file_pos, ptr_t &&expr) : ASTNode_Parent(file_pos, expr) {}
+  ASTNode_Return(FilePos file_pos, ptr_t &&expr) : ASTNode_Parent(NodeKind::Return, file_pos, expr) {}
 
+  static bool classof(NodeKind kind) { return kind == NodeKind::Return; }
   std::string GetTypeName() const override { return "RETURN"; }
 
   bool IsReturn() const override { return true; }
   bool MayReturn() const override { return true; }
 
-  Type ReturnType(const SymbolTable &symbols) const override { return GetChild(0).ReturnType(symbols); }
+  Type ComputeType(const SymbolTable &symbols) const override { return GetChild(0).ReturnType(symbols); }
 
   void TypeCheck(const SymbolTable &symbols) override {
     if (NumChildren() != 1) {
@@ -498,7 +721,8 @@ public:
 
 class ASTNode_Break : public ASTNode {
 public:
-  ASTNode_Break(FilePos file_pos) : ASTNode(file_pos) {}
+  ASTNode_Break(FilePos file_pos) : ASTNode(NodeKind::Break, file_pos) {}
+  static bool classof(NodeKind kind) { return kind == NodeKind::Break; }
   std::string GetTypeName() const override { return "BREAK"; }
 
   bool ToWAT(Control &control) override {
@@ -514,7 +738,8 @@ public:
 
 class ASTNode_Continue : public ASTNode {
 public:
-  ASTNode_Continue(FilePos file_pos) : ASTNode(file_pos) {}
+  ASTNode_Continue(FilePos file_pos) : ASTNode(NodeKind::Continue, file_pos) {}
+  static bool classof(NodeKind kind) { return kind == NodeKind::Continue; }
   std::string GetTypeName() const override { return "CONTINUE"; }
 
   bool ToWAT(Control &control) override {
@@ -535,11 +760,37 @@ private:
 
 public:
   ASTNode_TailCallLoop(FilePos file_pos, std::vector<size_t> param_ids, std::vector<ptr_t> &&args)
-      : ASTNode(file_pos), param_ids(std::move(param_ids)), args(std::move(args)) {}
+      : ASTNode(NodeKind::TailCallLoop, file_pos), param_ids(std::move(param_ids)), args(std::move(args)) {}
 
+  static bool classof(NodeKind kind) { return kind == NodeKind::TailCallLoop; }
   std::string GetTypeName() const override { return "TAIL_CALL_LOOP"; }
 
   void AddArgument(ptr_t &&arg) { args.push_back(std::move(arg)); }
+  void ReplaceArg(size_t id, ptr_t &&arg) {
+    assert(id < args.size());
+    args[id] = std::move(arg);
+    InvalidateType();
+  }
+
+  // Getters for the parameters being reassigned and their new values.
+  const std::vector<size_t> &GetParamIds() const { return param_ids; }
+  size_t NumArgs() const { return args.size(); }
+  bool HasArg(size_t id) const { return id < args.size() && args[id]; }
+  ASTNode &GetArg(size_t id) {
+    assert(HasArg(id));
+    return *args[id];
+  }
+  const ASTNode &GetArg(size_t id) const {
+    assert(HasArg(id));
+    return *args[id];
+  }
+
+  void InitializeWAT(Control &control) override {
+    for (auto &arg : args) {
+      if (arg)
+        arg->InitializeWAT(control);
+    }
+  }
 
   void TypeCheck(const SymbolTable &symbols) override {
     if (args.size() != param_ids.size()) {
@@ -574,19 +825,25 @@ public:
         Error(file_pos, "Internal error: Missing argument in tail call loop.");
       }
 
-      const Type arg_type = arg->ReturnType(control.symbols);
-      std::string wat_type = arg_type.ToWAT();
-      std::string temp_name = control.DeclareTempVar(wat_type);
-      temp_names.push_back(temp_name);
-
       bool has_value = arg->ToWAT(control);
       if (!has_value) {
         Error(file_pos, "Tail recursion argument did not leave a value on the stack.");
       }
+
+      // No argument is evaluated after the last one, so it can go straight
+      // into its parameter; the others wait in temps.
+      if (i + 1 == args.size()) {
+        control.Code("(local.set $var", param_ids[i], ")").Comment("Assign tail arg ", i, " to parameter");
+        break;
+      }
+      const Type arg_type = arg->ReturnType(control.symbols);
+      std::string wat_type = arg_type.ToWAT();
+      std::string temp_name = control.DeclareTempVar(wat_type);
+      temp_names.push_back(temp_name);
       control.Code("(local.set ", temp_name, ")").Comment("Store tail arg ", i, " into temp");
     }
 
-    for (size_t i = 0; i < param_ids.size(); ++i) {
+    for (size_t i = 0; i < temp_names.size(); ++i) {
       control.Code("(local.get ", temp_names[i], ")").Comment("Reload tail arg ", i);
       control.Code("(local.set $var", param_ids[i], ")").Comment("Assign tail arg ", i, " to parameter");
     }
@@ -601,9 +858,10 @@ public:
 
 class ASTNode_ToDouble : public ASTNode_Parent {
 public:
-  ASTNode_ToDouble(ptr_t &&child) : ASTNode_Parent(child->GetFilePos(), child) {}
+  ASTNode_ToDouble(ptr_t &&child) : ASTNode_Parent(NodeKind::ToDouble, child->GetFilePos(), child) {}
+  static bool classof(NodeKind kind) { return kind == NodeKind::ToDouble; }
   std::string GetTypeName() const override { return "ToDouble"; }
-  Type ReturnType(const SymbolTable &) const override { return Type{"double"}; }
+  Type ComputeType(const SymbolTable &) const override { return Type{"double"}; }
 
   void TypeCheck(const SymbolTable &symbols) override {
     if (NumChildren() != 1) {
@@ -630,9 +888,10 @@ public:
 
 class ASTNode_ToInt : public ASTNode_Parent {
 public:
-  ASTNode_ToInt(ptr_t &&child) : ASTNode_Parent(child->GetFilePos(), child) {}
+  ASTNode_ToInt(ptr_t &&child) : ASTNode_Parent(NodeKind::ToInt, child->GetFilePos(), child) {}
+  static bool classof(NodeKind kind) { return kind == NodeKind::ToInt; }
   std::string GetTypeName() const override { return "ToInt"; }
-  Type ReturnType(const SymbolTable &) const override { return Type("int"); }
+  Type ComputeType(const SymbolTable &) const override { return Type("int"); }
 
   void TypeCheck(const SymbolTable &symbols) override {
     if (NumChildren() != 1) {
@@ -659,11 +918,13 @@ public:
 
 class ASTNode_ToString : public ASTNode_Parent {
 public:
-  ASTNode_ToString(ptr_t &&child) : ASTNode_Parent(child->GetFilePos(), std::move(child)) {}
+  ASTNode_ToString(ptr_t &&child)
+      : ASTNode_Parent(NodeKind::ToString, child->GetFilePos(), std::move(child)) {}
 
+  static bool classof(NodeKind kind) { return kind == NodeKind::ToString; }
   std::string GetTypeName() const override { return "ToString"; }
 
-  Type ReturnType(const SymbolTable &) const override { return Type("string"); }
+  Type ComputeType(const SymbolTable &) const override { return Type("string"); }
 
   void TypeCheck(const SymbolTable &symbols) override {
     if (NumChildren() != 1) {
@@ -698,7 +959,7 @@ private:
   void GenerateCharToString(Control &control, const std::string &str_addr) {
     // Allocate memory for a 2-byte string (1 character + null terminator)
     control.Code("(i32.const 2)").Comment("Allocate 2 bytes for char string");
-    control.Code("call $_alloc_str").Comment("Allocate memory for string");
+    control.CallHelper(RuntimeHelper::AllocStr).Comment("Allocate memory for string");
     // Stack: [address]
     control.Code("(local.set ", str_addr, ")").Comment("Store address in local variable");
 
@@ -713,27 +974,29 @@ private:
 
   void GenerateIntToString(Control &control) {
     ChildToWAT(0, control, true); // Generate code for the int expression
-    control.Code("call $_int2string").Comment("Convert int to string");
+    control.CallHelper(RuntimeHelper::Int2String).Comment("Convert int to string");
   }
 };
 
 class ASTNode_Math1 : public ASTNode_Parent {
 protected:
-  std::string op;
+  OpId op;
 
 public:
-  ASTNode_Math1(FilePos file_pos, std::string op, ptr_t &&child) : ASTNode_Parent(file_pos, child), op(op) {}
-  ASTNode_Math1(const emplex::Token &token, ptr_t &&child) : ASTNode_Math1(token, token.lexeme, std::move(child)) {}
+  ASTNode_Math1(FilePos file_pos, OpId op, ptr_t &&child)
+      : ASTNode_Parent(NodeKind::Math1, file_pos, child), op(op) {}
+  ASTNode_Math1(const emplex::Token &token, ptr_t &&child) : ASTNode_Math1(token, LexOp(token), std::move(child)) {}
 
-  std::string GetTypeName() const override { return std::string("MATH1: ") + op; }
+  static bool classof(NodeKind kind) { return kind == NodeKind::Math1; }
+  std::string GetTypeName() const override { return std::string("MATH1: ") + OpSymbol(op); }
 
-  // Getter for operator symbol
-  const std::string &GetOp() const { return op; }
+  // Getter for operator
+  OpId GetOp() const { return op; }
 
-  Type ReturnType(const SymbolTable &symbols) const override {
-    if (op == "!")
+  Type ComputeType(const SymbolTable &symbols) const override {
+    if (op == OpId::Not)
       return Type("int");
-    if (op == "sqrt")
+    if (op == OpId::Sqrt)
       return Type("double");
 
     // Negation does not change the return type.
@@ -742,24 +1005,24 @@ public:
 
   void TypeCheck(const SymbolTable &symbols) override {
     if (NumChildren() != 1) {
-      Error(file_pos, "Internal error: Expected one child in Math1 node (", op, "), found ", NumChildren());
+      Error(file_pos, "Internal error: Expected one child in Math1 node (", OpSymbol(op), "), found ", NumChildren());
     }
     TypeCheckChildren(symbols);
 
     const Type &child_type = GetChild(0).ReturnType(symbols);
-    if (op == "-") {
+    if (op == OpId::Sub) {
       if (child_type.IsChar() || !child_type.IsNumeric())
         Error(file_pos, "Unary operator NEGATE (-) cannot be used on type '", child_type.Name(), "'.");
-    } else if (op == "!") {
+    } else if (op == OpId::Not) {
       if (!child_type.IsInt())
         Error(file_pos, "Unary operator NOT (!) can only be used on 'int' types.");
-    } else if (op == "sqrt") {
+    } else if (op == OpId::Sqrt) {
       if (!child_type.IsNumeric())
         Error(file_pos, "Square root (sqrt) must have a numeric argument.");
       if (!child_type.IsDouble())
         AdaptChild<ASTNode_ToDouble>(0);
     } else if (!child_type.IsNumeric()) {
-      Error(file_pos, "In unary operator '", op, "', cannot convert type ", child_type.Name(),
+      Error(file_pos, "In unary operator '", OpSymbol(op), "', cannot convert type ", child_type.Name(),
             " to a numerical value.");
     }
   }
@@ -767,15 +1030,15 @@ public:
   bool ToWAT(Control &control) override {
     assert(NumChildren() == 1);
 
-    if (op == "!") {
+    if (op == OpId::Not) {
       ChildToWAT(0, control, true);
       control.Code("i32.eqz").Comment("Boolean NOT.");
-    } else if (op == "-") {
+    } else if (op == OpId::Sub) {
       std::string type = ReturnType(control.symbols).ToWAT();
       control.Code("(", type, ".const 0)").Comment("Setup unary negation");
       ChildToWAT(0, control, true);
       control.Code("(", type, ".sub)").Comment("Unary negation.");
-    } else if (op == "sqrt") {
+    } else if (op == OpId::Sqrt) {
       ChildToWAT(0, control, true);
       control.Code("(f64.sqrt)").Comment("Square Root");
     }
@@ -788,36 +1051,53 @@ public:
 
 class ASTNode_Math2 : public ASTNode_Parent {
 protected:
-  std::string op;
+  OpId op;
 
 public:
-  ASTNode_Math2(FilePos file_pos, std::string op, ptr_t &&child1, ptr_t &&child2)
-      : ASTNode_Parent(file_pos, child1, child2), op(op) {}
-  ASTNode_Math2(const emplex::Token &token, ptr_t &&child1, ptr_t &&child2)
-      : ASTNode_Parent(token, std::move(child1), std::move(child2)), op(token.lexeme) {}
+  ASTNode_Math2(FilePos file_pos, OpId op, ptr_t &&child1, ptr_t &&child2)
+      : ASTNode_Parent(NodeKind::Math2, file_pos, child1, child2), op(op) {}
 
-  std::string GetTypeName() const override { return std::string("MATH2: " + op); }
+  static bool classof(NodeKind kind) { return kind == NodeKind::Math2; }
+  std::string GetTypeName() const override { return std::string("MATH2: ") + OpSymbol(op); }
 
-  // Getter for operator symbol
-  const std::string &GetOp() const { return op; }
+  // Getter for operator
+  OpId GetOp() const { return op; }
 
-  Type ReturnType(const SymbolTable &symbols) const override {
+  bool IsComparison() const {
+    return op == OpId::Less || op == OpId::LessEqual || op == OpId::Greater || op == OpId::GreaterEqual ||
+           op == OpId::Equal || op == OpId::NotEqual;
+  }
+
+  // Collect the operands of the string concatenations rooted at node, left
+  // to right: a + b + c (however it is grouped) gives a, b, c.  NODE_T is
+  // ASTNode or const ASTNode.
+  template <typename NODE_T>
+  static void CollectConcatParts(NODE_T &node, const SymbolTable &symbols, std::vector<NODE_T *> &parts) {
+    auto *math = dyn_cast<ASTNode_Math2>(&node);
+    if (math && math->op == OpId::Add && math->ReturnType(symbols).IsString()) {
+      CollectConcatParts(math->GetChild(0), symbols, parts);
+      CollectConcatParts(math->GetChild(1), symbols, parts);
+    } else {
+      parts.push_back(&node);
+    }
+  }
+
+  Type ComputeType(const SymbolTable &symbols) const override {
     // Assignments use the type of the variable being assigned.
-    if (op == "=")
+    if (op == OpId::Assign)
       return GetChild(0).ReturnType(symbols);
 
     // Comparisons and Boolean operations always return type int.
-    if (op == "<" || op == "<=" || op == ">" || op == ">=" || op == "==" || op == "!=" || op == "&&" || op == "||" ||
-        op == "%")
+    if (IsComparison() || op == OpId::And || op == OpId::Or || op == OpId::Mod)
       return Type("int");
 
-    if (op == "+" || op == "*") {
+    if (op == OpId::Add || op == OpId::Mult) {
       if (GetChild(0).ReturnType(symbols).IsString() || GetChild(1).ReturnType(symbols).IsString()) {
         return Type("string");
       }
     }
     // Binary math scales to the higher precision of inputs.
-    if (op == "*" || op == "/" || op == "+" || op == "-") {
+    if (op == OpId::Mult || op == OpId::Div || op == OpId::Add || op == OpId::Sub) {
       if (GetChild(0).ReturnType(symbols).BitCount() > GetChild(1).ReturnType(symbols).BitCount()) {
         return GetChild(0).ReturnType(symbols);
       } else {
@@ -842,7 +1122,7 @@ public:
     const Type &type1 = GetChild(1).ReturnType(symbols);
 
     if constexpr (DEBUG) {
-      std::cerr << "TESTING OP '" << op << "' with types " << type0.Name() << " and " << type1.Name() << "."
+      std::cerr << "TESTING OP '" << OpSymbol(op) << "' with types " << type0.Name() << " and " << type1.Name() << "."
                 << std::endl;
     }
 
@@ -850,7 +1130,7 @@ public:
     enum Status { INVALID, OK, PROMOTE0_INT, PROMOTE0_DOUBLE, PROMOTE1_INT, PROMOTE1_DOUBLE };
     Status status = INVALID;
     bool align_numeric = false;
-    if (op == "*") {
+    if (op == OpId::Mult) {
       if ((type0.IsString() || type0.IsChar()) && type1.IsInt()) {
         if (type0.IsChar()) {
           AdaptChild<ASTNode_ToString>(0);
@@ -862,17 +1142,17 @@ public:
         status = PROMOTE0_DOUBLE;
       else if (type0.IsDouble() && type1.IsInt())
         status = PROMOTE1_DOUBLE;
-    } else if (op == "/") {
+    } else if (op == OpId::Div) {
       if ((type0.IsInt() && type1.IsInt()) || (type0.IsDouble() && type1.IsDouble())) {
         status = OK;
       } else if (type0.IsInt() && type1.IsDouble())
         status = PROMOTE0_DOUBLE;
       else if (type0.IsDouble() && type1.IsInt())
         status = PROMOTE1_DOUBLE;
-    } else if (op == "%" || op == "&&" || op == "||") {
+    } else if (op == OpId::Mod || op == OpId::And || op == OpId::Or) {
       if (type0.IsInt() && type1.IsInt())
         status = OK;
-    } else if (op == "+") {
+    } else if (op == OpId::Add) {
       if (type0.IsString() && type1.IsString()) {
         status = OK;
       } else if (type0.IsString() && type1.IsChar()) {
@@ -884,11 +1164,11 @@ public:
       } else {
         align_numeric = true;
       }
-    } else if (op == "==" && type0 == type1 && type0.IsString()) {
+    } else if (IsComparison() && type0.IsString() && type1.IsString()) {
       status = OK;
-    } else if (op == "-" || op == "<" || op == "<=" || op == ">" || op == ">=" || op == "==" || op == "!=") {
+    } else if (op == OpId::Sub || op == OpId::Less || op == OpId::LessEqual || op == OpId::Greater || op == OpId::GreaterEqual || op == OpId::Equal || op == OpId::NotEqual) {
       align_numeric = true;
-    } else if (op == "=") {
+    } else if (op == OpId::Assign) {
       // If both sides already match we're good.
       if (type0 == type1 && !type0.IsFunction())
         status = OK;
@@ -902,7 +1182,7 @@ public:
         status = OK;
     } else {
       // Internal error
-      Error(file_pos, "Unknown binary operator in AST: ", op);
+      Error(file_pos, "Unknown binary operator in AST: ", OpSymbol(op));
     }
 
     // If we deferred aligning numeric types above, handle it now.
@@ -942,7 +1222,7 @@ public:
     // Resolve the current status.
     switch (status) {
     case INVALID:
-      Error(file_pos, "Cannot use operator '", op, "' on types ", type0.Name(), " and ", type1.Name());
+      Error(file_pos, "Cannot use operator '", OpSymbol(op), "' on types ", type0.Name(), " and ", type1.Name());
       break;
     case OK:
       break;
@@ -1022,16 +1302,97 @@ public:
       ChildToWAT(0, control, true);
       ChildToWAT(1, control, true);
       control.Code("(", type0.ToWAT(), ".mul)").Comment("Stack2 * Stack1");
-    } else if (type0.IsString() && type1.IsInt()) {
+    } else if ((type0.IsString() || type0.IsChar()) && type1.IsInt()) {
+      if (type0.IsChar()) {
+        AdaptChild<ASTNode_ToString>(0);
+      }
+      if (ToWAT_RepeatFew(control)) {
+        return;
+      }
       ChildToWAT(0, control, true);
       ChildToWAT(1, control, true);
-      control.Code("call $_repeat_string").Comment("Multiply string");
-    } else if (type0.IsChar() && type1.IsInt()) {
-      AdaptChild<ASTNode_ToString>(0);
+      control.CallHelper(RuntimeHelper::RepeatString).Comment("Multiply string");
+    }
+  }
+
+  // A string repeated a literal zero or one times needs no copying: s * 0 is
+  // empty (the fixed empty string, unless strings are written in place, when
+  // it must be a fresh one) and s * 1 is s itself (only when strings are never
+  // written in place, since the copy would otherwise be observable).
+  bool ToWAT_RepeatFew(Control &control) {
+    const auto *count = dyn_cast<ASTNode_IntLit>(&GetChild(1));
+    if (!count || count->GetValue() < 0 || count->GetValue() > 1) {
+      return false;
+    }
+    if (count->GetValue() == 1) {
+      if (!control.strings_shared) {
+        return false;
+      }
+      ChildToWAT(0, control, true);
+      return true;
+    }
+    ChildToWAT(0, control, true); // Still evaluated, for any side effects.
+    control.Drop();
+    if (control.strings_shared) {
+      control.Code("(i32.const 13)").Comment("String * 0 is the empty string");
+    } else {
+      control.Code("(i32.const 0)").CallHelper(RuntimeHelper::AllocStr).Comment("String * 0 is a new empty string");
+    }
+    return true;
+  }
+
+  // Concatenate a chain of strings.  Two parts use $_strcat; longer chains
+  // store every part's address in a table and make a single $_concat_n call,
+  // which allocates the result once instead of once per '+'.
+  void ToWAT_Concat(Control &control) {
+    std::vector<ASTNode *> parts;
+    CollectConcatParts<ASTNode>(*this, control.symbols, parts);
+    if (parts.size() == 2) {
       ChildToWAT(0, control, true);
       ChildToWAT(1, control, true);
-      control.Code("call $_repeat_string").Comment("Multiply string");
+      control.CallHelper(RuntimeHelper::Strcat).Comment("Concatenate two strings");
+      return;
+    }
+
+    const std::string table = control.DeclareTempVar("i32");
+    control.Code("(i32.const ", parts.size() * 4 - 1, ")")
+        .Comment("Room for ", parts.size(), " string addresses")
+        .CallHelper(RuntimeHelper::AllocStr)
+        .Code("(local.set ", table, ")");
+    for (size_t i = 0; i < parts.size(); ++i) {
+      control.Code("(local.get ", table, ")");
+      [[maybe_unused]] const bool has_value = parts[i]->ToWAT(control);
+      assert(has_value);
+      if (i == 0) {
+        control.Code("(i32.store)").Comment("Store address of part 0");
+      } else {
+        control.Code("(i32.store offset=", i * 4, ")").Comment("Store address of part ", i);
+      }
+    }
+    control.Code("(local.get ", table, ")")
+        .Code("(i32.const ", parts.size(), ")")
+        .CallHelper(RuntimeHelper::ConcatN)
+        .Comment("Concatenate ", parts.size(), " strings");
+  }
+
+  // Compare the two strings on the stack by content: $_str_eq for == and !=,
+  // otherwise the sign of $_str_cmp.
+  void ToWAT_StringCompare(Control &control) {
+    if (op == OpId::Equal || op == OpId::NotEqual) {
+      control.CallHelper(RuntimeHelper::StrEq).Comment("Compare strings for equality");
+      if (op == OpId::NotEqual)
+        control.Code("(i32.eqz)").Comment("Strings differ");
+      return;
     }
+    const char *relation = op == OpId::Less        ? "lt_s"
+                           : op == OpId::LessEqual ? "le_s"
+                           : op == OpId::Greater   ? "gt_s"
+                                                   : "ge_s";
+    control.CallHelper(RuntimeHelper::StrCmp)
+        .Comment("Order strings: -1, 0, or 1")
+        .Code("(i32.const 0)")
+        .Code("(i32.", relation, ")")
+        .Comment("Stack2 ", OpSymbol(op), " Stack1");
   }
 
   void ToWAT_Add(Control &control) {
@@ -1039,10 +1400,8 @@ public:
     const Type &type1 = GetChild(1).ReturnType(control.symbols);
 
     if (type0.IsNumeric() && type1.IsNumeric()) {
-      // Standard mathematical addition.
+      // Standard mathematical addition.  (Strings are handled by ToWAT_Concat.)
       control.Code("(", type0.ToWAT(), ".add)").Comment("Stack2 + Stack1");
-    } else if (type0.IsString() && type1.IsString()) {
-      control.Code("call $_strcat").Comment("Concatenate two strings");
     }
   }
 
@@ -1051,73 +1410,78 @@ public:
 
     // If we are doing an assignment or boolean logic, we need to handle it
     // specially.
-    if (op == "=") {
+    if (op == OpId::Assign) {
       ToWAT_Assign(control);
       return true;
     }
-    if (op == "&&") {
+    if (op == OpId::And) {
       ToWAT_AND(control);
       return true;
     }
-    if (op == "||") {
+    if (op == OpId::Or) {
       ToWAT_OR(control);
       return true;
     }
-    if (op == "*") {
+    if (op == OpId::Mult) {
       ToWAT_Multiply(control);
       return true;
     }
+    if (op == OpId::Add && ReturnType(control.symbols).IsString()) {
+      ToWAT_Concat(control);
+      return true;
+    }
 
     ChildToWAT(0, control,
                true); // Calculate the first arg (so it's top of the stack)
     ChildToWAT(1, control,
                true); // Calculate the second arg (so it's one down on the stack)
 
+    if (IsComparison() && GetChild(0).ReturnType(control.symbols).IsString()) {
+      ToWAT_StringCompare(control);
+      return true;
+    }
+
     std::string type = GetChild(0).ReturnType(control.symbols).ToWAT();
     std::string extra = (type == "i32") ? "_s" : "";
 
-    if (op == "/") {
+    if (op == OpId::Div) {
       control.Code("(", type, ".div", extra, ")").Comment("Stack2 / Stack1");
       return true;
     }
-    if (op == "%") {
+    if (op == OpId::Mod) {
       control.Code("(", type, ".rem", extra, ")").Comment("Stack2 % Stack1");
       return true;
     }
-    if (op == "+") {
+    if (op == OpId::Add) {
       ToWAT_Add(control);
       return true;
     }
-    if (op == "-") {
+    if (op == OpId::Sub) {
       control.Code("(", type, ".sub)").Comment("Stack2 - Stack1");
       return true;
     }
 
-    if (op == "<") {
+    if (op == OpId::Less) {
       control.Code("(", type, ".lt", extra, ")").Comment("Stack2 < Stack1");
       return true;
     }
-    if (op == "<=") {
+    if (op == OpId::LessEqual) {
       control.Code("(", type, ".le", extra, ")").Comment("Stack2 <= Stack1");
       return true;
     }
-    if (op == ">") {
+    if (op == OpId::Greater) {
       control.Code("(", type, ".gt", extra, ")").Comment("Stack2 > Stack1");
       return true;
     }
-    if (op == ">=") {
+    if (op == OpId::GreaterEqual) {
       control.Code("(", type, ".ge", extra, ")").Comment("Stack2 >= Stack1");
       return true;
     }
-    if (op == "==") {
-      if (GetChild(0).ReturnType(control.symbols).IsString()) {
-        control.Code("call $_str_cmp").Comment("call string compare function");
-      } else {
-        control.Code("(", type, ".eq)").Comment("Stack2 == Stack1");
-      }
+    if (op == OpId::Equal) {
+      control.Code("(", type, ".eq)").Comment("Stack2 == Stack1");
       return true;
     }
-    if (op == "!=") {
+    if (op == OpId::NotEqual) {
       control.Code("(", type, ".ne)").Comment("Stack2 != Stack1");
       return true;
     }
@@ -1133,42 +1497,21 @@ protected:
   int value = '\0';
 
 public:
-  ASTNode_CharLit(FilePos file_pos, int value) : ASTNode(file_pos), value(value) {}
+  ASTNode_CharLit(FilePos file_pos, int value) : ASTNode(NodeKind::CharLit, file_pos), value(value) {}
 
+  static bool classof(NodeKind kind) { return kind == NodeKind::CharLit; }
   std::string GetTypeName() const override { return std::string("CHAR_LIT: ") + std::to_string(((int)value)); }
 
-  Type ReturnType(const SymbolTable & /* symbols */) const override {
-    // For now, ops do not change the return type.
-    return Type("char");
-  }
-
-  bool ToWAT(Control &control) override {
-    control.Code("(i32.const ", value, ")").Comment("Put a char \\", value, " on the stack");
-    return true;
-  }
-
-  void Accept(ASTVisitor &visitor) override { visitor.visit(*this); }
-};
-
-class ASTNode_IntLit : public ASTNode {
-protected:
-  int value = 0.0;
-
-public:
-  ASTNode_IntLit(FilePos file_pos, int value) : ASTNode(file_pos), value(value) {}
-
-  std::string GetTypeName() const override { return std::string("INT_LIT:") + std::to_string(value); }
-
   // Getter for literal value
   int GetValue() const { return value; }
 
-  Type ReturnType(const SymbolTable & /* symbols */) const override {
+  Type ComputeType(const SymbolTable & /* symbols */) const override {
     // For now, ops do not change the return type.
-    return Type("int");
+    return Type("char");
   }
 
   bool ToWAT(Control &control) override {
-    control.Code("(i32.const ", value, ")").Comment("Put a ", value, " on the stack");
+    control.Code("(i32.const ", value, ")").Comment("Put a char \\", value, " on the stack");
     return true;
   }
 
@@ -1180,14 +1523,15 @@ protected:
   double value = 0.0;
 
 public:
-  ASTNode_FloatLit(FilePos file_pos, double value) : ASTNode(file_pos), value(value) {}
+  ASTNode_FloatLit(FilePos file_pos, double value) : ASTNode(NodeKind::FloatLit, file_pos), value(value) {}
 
+  static bool classof(NodeKind kind) { return kind == NodeKind::FloatLit; }
   std::string GetTypeName() const override { return "FLOAT_LIT"; }
 
   // Getter for literal value
   double GetValue() const { return value; }
 
-  Type ReturnType(const SymbolTable & /* symbols */) const override {
+  Type ComputeType(const SymbolTable & /* symbols */) const override {
     // For now, ops do not change the return type.
     return Type("double");
   }
@@ -1202,23 +1546,24 @@ public:
 
 class ASTNode_StringLit : public ASTNode {
 protected:
-  size_t mem_pos = 0;
+  size_t string_id = 0; // In the Control's string pool.
   std::string str;
 
 public:
-  ASTNode_StringLit(FilePos file_pos, std::string str) : ASTNode(file_pos), str(str) {}
+  ASTNode_StringLit(FilePos file_pos, std::string str) : ASTNode(NodeKind::StringLit, file_pos), str(str) {}
 
+  static bool classof(NodeKind kind) { return kind == NodeKind::StringLit; }
   std::string GetTypeName() const override { return "STRING_LIT"; }
 
   // Getter for literal value
   const std::string &GetValue() const { return str; }
 
-  Type ReturnType(const SymbolTable &) const override { return Type("string"); }
+  Type ComputeType(const SymbolTable &) const override { return Type("string"); }
 
-  void InitializeWAT(Control &control) override { mem_pos = control.Data(str); }
+  void InitializeWAT(Control &control) override { string_id = control.AddString(str); }
 
   bool ToWAT(Control &control) override {
-    control.Code("(i32.const ", mem_pos, ")").Comment("Load address of string literal");
+    control.Code("(i32.const ", control.StringAddress(string_id), ")").Comment("Load address of string literal");
     return true;
   }
 
@@ -1233,12 +1578,13 @@ protected:
   void TestOK() const { assert(var_id < MAX_ID); }
 
 public:
-  ASTNode_Var(FilePos file_pos, size_t id) : ASTNode(file_pos), var_id(id) { TestOK(); }
+  ASTNode_Var(FilePos file_pos, size_t id) : ASTNode(NodeKind::Var, file_pos), var_id(id) { TestOK(); }
   ASTNode_Var(const emplex::Token &token, SymbolTable &symbols)
-      : ASTNode(token), var_id(symbols.GetVarID(token.lexeme)) {
+      : ASTNode(NodeKind::Var, token), var_id(symbols.GetVarID(token.lexeme)) {
     TestOK();
   }
 
+  static bool classof(NodeKind kind) { return kind == NodeKind::Var; }
   std::string GetTypeName() const override { return std::string("VAR: ") + std::to_string(var_id); }
 
   // Getter for variable identifier
@@ -1247,11 +1593,12 @@ public:
   bool CanAssign() const override { return true; }
   void ToAssignWAT(Control &control) override {
     TestOK();
-    const std::string var_name = control.symbols.GetName(var_id);
-    control.Code("(local.set $var", var_id, ")").Comment("Set var '", var_name, "' from stack");
+    control.Code("(local.set $var", var_id, ")").Comment([&] {
+      return "Set var '" + control.symbols.GetName(var_id) + "' from stack";
+    });
   }
 
-  Type ReturnType(const SymbolTable &symbols) const override {
+  Type ComputeType(const SymbolTable &symbols) const override {
     // For now, ops do not change the return type.
     TestOK();
     return symbols.GetType(var_id);
@@ -1259,9 +1606,9 @@ public:
 
   bool ToWAT(Control &control) override {
     TestOK();
-    const std::string var_name = control.symbols.GetName(var_id);
-
-    control.Code("(local.get $var", var_id, ")").Comment("Place var '", var_name, "' onto stack");
+    control.Code("(local.get $var", var_id, ")").Comment([&] {
+      return "Place var '" + control.symbols.GetName(var_id) + "' onto stack";
+    });
     return true;
   }
 
@@ -1271,11 +1618,12 @@ public:
 class ASTNode_Indexing : public ASTNode_Parent {
 public:
   ASTNode_Indexing(FilePos file_pos, ptr_t &&base_expr, ptr_t &&index_expr)
-      : ASTNode_Parent(file_pos, base_expr, index_expr) {}
+      : ASTNode_Parent(NodeKind::Indexing, file_pos, base_expr, index_expr) {}
 
+  static bool classof(NodeKind kind) { return kind == NodeKind::Indexing; }
   std::string GetTypeName() const override { return "indexing"; }
 
-  Type ReturnType(const SymbolTable &symbols) const override {
+  Type ComputeType(const SymbolTable &symbols) const override {
     const Type &base_type = GetChild(0).ReturnType(symbols);
     if (base_type.IsString()) {
       return Type("char");
@@ -1308,7 +1656,7 @@ public:
     ChildToWAT(0, control, true);
     ChildToWAT(1, control, true);
     control.Code("(i32.add)").Comment("Compute address: base + index");
-    control.Code("(call $_swap)").Comment("Swapping top 2 values on the stack to alight then for store.");
+    control.CallHelper(RuntimeHelper::Swap).Comment("Swapping top 2 values on the stack to alight then for store.");
     control.Code("(i32.store8)").Comment("Store value at computed address");
   }
 
@@ -1325,10 +1673,11 @@ public:
 
 class ASTNode_Size : public ASTNode_Parent {
 public:
-  ASTNode_Size(FilePos file_pos, ptr_t &&arg) : ASTNode_Parent(file_pos, arg) {}
+  ASTNode_Size(FilePos file_pos, ptr_t &&arg) : ASTNode_Parent(NodeKind::Size, file_pos, arg) {}
+  static bool classof(NodeKind kind) { return kind == NodeKind::Size; }
   std::string GetTypeName() const override { return "SIZE"; }
 
-  Type ReturnType(const SymbolTable &) const override { return Type("int"); }
+  Type ComputeType(const SymbolTable &) const override { return Type("int"); }
 
   void TypeCheck(const SymbolTable &symbols) override {
     if (NumChildren() != 1) {
@@ -1343,7 +1692,7 @@ public:
 
   bool ToWAT(Control &control) override {
     ChildToWAT(0, control, true);
-    control.Code("(call $_strlen)").Comment("Call _strlen for size()");
+    control.CallHelper(RuntimeHelper::Strlen).Comment("Call _strlen for size()");
     return true;
   }
 
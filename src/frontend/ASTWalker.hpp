@@ -0,0 +1,115 @@
+#pragma once
+
+#include <type_traits>
+
+#include "ASTNode.hpp"
+
+// A CRTP walker that dispatches on NodeKind with a single switch.
+//
+// Derived classes override only the visit methods they care about; every
+// concrete visit method defaults to visitParent() or visitNode(), so a walker
+// that just needs to see each node can override those two alone.
+//
+// Example usage:
+//   struct CallCounter : ASTWalker<CallCounter> {
+//     size_t calls = 0;
+//     void visitFunctionCall(ASTNode_FunctionCall &node) { ++calls; walkChildren(node); }
+//     void visitParent(ASTNode_Parent &node) { walkChildren(node); }
+//   };
+//   CallCounter counter;
+//   counter.dispatch(root);
+//
+// Set IS_CONST to walk a tree through const references.
+template <typename DERIVED_T, typename RETURN_T = void, bool IS_CONST = false> class ASTWalker {
+protected:
+  template <typename NODE_T> using ref_t = std::conditional_t<IS_CONST, const NODE_T &, NODE_T &>;
+
+  DERIVED_T &Derived() { return static_cast<DERIVED_T &>(*this); }
+
+public:
+  RETURN_T dispatch(ref_t<ASTNode> node) {
+    switch (node.kind()) {
+    case NodeKind::Block:
+      return Derived().visitBlock(cast<ASTNode_Block>(node));
+    case NodeKind::Function:
+      return Derived().visitFunction(cast<ASTNode_Function>(node));
+    case NodeKind::FunctionCall:
+      return Derived().visitFunctionCall(cast<ASTNode_FunctionCall>(node));
+    case NodeKind::If:
+      return Derived().visitIf(cast<ASTNode_If>(node));
+    case NodeKind::While:
+      return Derived().visitWhile(cast<ASTNode_While>(node));
+    case NodeKind::Return:
+      return Derived().visitReturn(cast<ASTNode_Return>(node));
+    case NodeKind::ToDouble:
+      return Derived().visitToDouble(cast<ASTNode_ToDouble>(node));
+    case NodeKind::ToInt:
+      return Derived().visitToInt(cast<ASTNode_ToInt>(node));
+    case NodeKind::ToString:
+      return Derived().visitToString(cast<ASTNode_ToString>(node));
+    case NodeKind::Math1:
+      return Derived().visitMath1(cast<ASTNode_Math1>(node));
+    case NodeKind::Math2:
+      return Derived().visitMath2(cast<ASTNode_Math2>(node));
+    case NodeKind::Indexing:
+      return Derived().visitIndexing(cast<ASTNode_Indexing>(node));
+    case NodeKind::Size:
+      return Derived().visitSize(cast<ASTNode_Size>(node));
+    case NodeKind::Break:
+      return Derived().visitBreak(cast<ASTNode_Break>(node));
+    case NodeKind::Continue:
+      return Derived().visitContinue(cast<ASTNode_Continue>(node));
+    case NodeKind::TailCallLoop:
+      return Derived().visitTailCallLoop(cast<ASTNode_TailCallLoop>(node));
+    case NodeKind::CharLit:
+      return Derived().visitCharLit(cast<ASTNode_CharLit>(node));
+    case NodeKind::IntLit:
+      return Derived().visitIntLit(cast<ASTNode_IntLit>(node));
+    case NodeKind::FloatLit:
+      return Derived().visitFloatLit(cast<ASTNode_FloatLit>(node));
+    case NodeKind::StringLit:
+      return Derived().visitStringLit(cast<ASTNode_StringLit>(node));
+    case NodeKind::Var:
+      return Derived().visitVar(cast<ASTNode_Var>(node));
+    }
+    assert(false); // Unknown node kind!
+    return RETURN_T();
+  }
+
+  // Dispatch on each (non-null) child of a parent node, in order.
+  void walkChildren(ref_t<ASTNode_Parent> node) {
+    for (size_t i = 0; i < node.NumChildren(); ++i) {
+      if (node.HasChild(i))
+        Derived().dispatch(node.GetChild(i));
+    }
+  }
+
+  // Fallbacks for categories of nodes.
+  RETURN_T visitNode(ref_t<ASTNode>) { return RETURN_T(); }
+  RETURN_T visitParent(ref_t<ASTNode_Parent> node) { return Derived().visitNode(node); }
+
+  // Parent nodes.
+  RETURN_T visitBlock(ref_t<ASTNode_Block> node) { return Derived().visitParent(node); }
+  RETURN_T visitFunction(ref_t<ASTNode_Function> node) { return Derived().visitParent(node); }
+  RETURN_T visitFunctionCall(ref_t<ASTNode_FunctionCall> node) { return Derived().visitParent(node); }
+  RETURN_T visitIf(ref_t<ASTNode_If> node) { return Derived().visitParent(node); }
+  RETURN_T visitWhile(ref_t<ASTNode_While> node) { return Derived().visitParent(node); }
+  RETURN_T visitReturn(ref_t<ASTNode_Return> node) { return Derived().visitParent(node); }
+  RETURN_T visitToDouble(ref_t<ASTNode_ToDouble> node) { return Derived().visitParent(node); }
+  RETURN_T visitToInt(ref_t<ASTNode_ToInt> node) { return Derived().visitParent(node); }
+  RETURN_T visitToString(ref_t<ASTNode_ToString> node) { return Derived().visitParent(node); }
+  RETURN_T visitMath1(ref_t<ASTNode_Math1> node) { return Derived().visitParent(node); }
+  RETURN_T visitMath2(ref_t<ASTNode_Math2> node) { return Derived().visitParent(node); }
+  RETURN_T visitIndexing(ref_t<ASTNode_Indexing> node) { return Derived().visitParent(node); }
+  RETURN_T visitSize(ref_t<ASTNode_Size> node) { return Derived().visitParent(node); }
+
+  // Leaf nodes.
+  RETURN_T visitBreak(ref_t<ASTNode_Break> node) { return Derived().visitNode(node); }
+  RETURN_T visitContinue(ref_t<ASTNode_Continue> node) { return Derived().visitNode(node); }
+  RETURN_T visitTailCallLoop(ref_t<ASTNode_TailCallLoop> node) { return Derived().visitNode(node); }
+  RETURN_T visitCharLit(ref_t<ASTNode_CharLit> node) { return Derived().visitNode(node); }
+  RETURN_T visitIntLit(ref_t<ASTNode_IntLit> node) { return Derived().visitNode(node); }
+  RETURN_T visitFloatLit(ref_t<ASTNode_FloatLit> node) { return Derived().visitNode(node); }
+  RETURN_T visitStringLit(ref_t<ASTNode_StringLit> node) { return Derived().visitNode(node); }
+  RETURN_T visitVar(ref_t<ASTNode_Var> node) { return Derived().visitNode(node); }
+};
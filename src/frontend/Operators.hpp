@@ -0,0 +1,101 @@
+#pragma once
+
+#include <array>
+#include <assert.h>
+#include <cstddef>
+
+#include "lexer.hpp"
+
+// Operators are identified once, when tokens are loaded, so that neither the
+// parser nor the AST ever needs to compare operator lexemes.
+//
+// Sub doubles as unary negation in ASTNode_Math1, matching its '-' token.
+enum class OpId : unsigned char {
+  None = 0, // Not an operator.
+  Paren,    // '(' (only reserves the tightest binary precedence level)
+  Not,
+  Sqrt,
+  Mult,
+  Div,
+  Mod,
+  Add,
+  Sub,
+  Less,
+  LessEqual,
+  Greater,
+  GreaterEqual,
+  Equal,
+  NotEqual,
+  And,
+  Or,
+  Assign,
+  NUM_OPS
+};
+
+struct OpInfo {
+  const char *symbol;
+  size_t level; // Binary precedence; lower binds tighter.
+  char assoc;   // l=left; r=right; n=non; '\0'=not a binary operator
+};
+
+// Operator details, indexed by OpId.
+inline constexpr std::array<OpInfo, static_cast<size_t>(OpId::NUM_OPS)> OP_INFO = {{
+    {"", 0, '\0'},      // None
+    {"(", 0, 'n'},      // Paren
+    {"!", 0, 'n'},      // Not
+    {"sqrt", 0, '\0'},  // Sqrt
+    {"*", 1, 'l'},      // Mult
+    {"/", 1, 'l'},      // Div
+    {"%", 1, 'l'},      // Mod
+    {"+", 2, 'l'},      // Add
+    {"-", 2, 'l'},      // Sub
+    {"<", 3, 'n'},      // Less
+    {"<=", 3, 'n'},     // LessEqual
+    {">", 3, 'n'},      // Greater
+    {">=", 3, 'n'},     // GreaterEqual
+    {"==", 4, 'n'},     // Equal
+    {"!=", 4, 'n'},     // NotEqual
+    {"&&", 5, 'l'},     // And
+    {"||", 6, 'l'},     // Or
+    {"=", 7, 'r'},      // Assign
+}};
+
+constexpr const OpInfo &GetOpInfo(OpId op) { return OP_INFO[static_cast<size_t>(op)]; }
+constexpr const char *OpSymbol(OpId op) { return GetOpInfo(op).symbol; }
+constexpr bool IsBinaryOp(OpId op) { return GetOpInfo(op).assoc != '\0'; }
+
+// Operator for each token id.  The comparison token ids cover several
+// operators each; they map to the first, and LexOp() refines them.
+inline constexpr std::array<OpId, 256> TOKEN_OPS = [] {
+  using emplex::Lexer;
+  std::array<OpId, 256> ops{};
+  ops['('] = OpId::Paren;
+  ops['!'] = OpId::Not;
+  ops['*'] = OpId::Mult;
+  ops['/'] = OpId::Div;
+  ops['%'] = OpId::Mod;
+  ops['+'] = OpId::Add;
+  ops['-'] = OpId::Sub;
+  ops['='] = OpId::Assign;
+  ops[Lexer::ID_SQRT] = OpId::Sqrt;
+  ops[Lexer::ID_EXPR_COMPARE] = OpId::Less;
+  ops[Lexer::ID_EXPR_COMPARE_EQ] = OpId::Equal;
+  ops[Lexer::ID_AND] = OpId::And;
+  ops[Lexer::ID_OR] = OpId::Or;
+  return ops;
+}();
+
+// Determine which operator (if any) a token represents.
+inline OpId LexOp(const emplex::Token &token) {
+  assert(token.id >= 0 && token.id < 256);
+  switch (token.id) {
+  case emplex::Lexer::ID_EXPR_COMPARE: // <, <=, >, >=
+    if (token.lexeme[0] == '<')
+      return token.lexeme.size() == 1 ? OpId::Less : OpId::LessEqual;
+    return token.lexeme.size() == 1 ? OpId::Greater : OpId::GreaterEqual;
+  case emplex::Lexer::ID_EXPR_COMPARE_EQ: // ==, !=
+    return token.lexeme[0] == '=' ? OpId::Equal : OpId::NotEqual;
+  default:
+    return TOKEN_OPS[static_cast<size_t>(token.id)];
+  }
+}
@@ -17,6 +17,8 @@
 #include <assert.h>
 #include <vector>
 
+#include "Operators.hpp"
+#include "Trace.hpp"
 #include "lexer.hpp"
 
 class TokenQueue {
@@ -24,6 +26,7 @@ private:
   emplex::Lexer lexer;
 
   std::vector<emplex::Token> tokens{};
+  std::vector<OpId> ops{}; // Operator represented by each token (if any).
   size_t token_id = 0;
 
   const emplex::Token eof_token{0, "_EOF_", 0, 0};
@@ -33,34 +36,50 @@ private:
     assert(token_id <= tokens.size());
     if (token_id) {
       tokens.erase(tokens.begin(), tokens.begin() + token_id);
+      ops.erase(ops.begin(), ops.begin() + token_id);
       token_id = 0;
     }
   }
 
+  // Identify the operator for each newly loaded token.
+  void LexOps() {
+    ops.reserve(tokens.size());
+    for (size_t i = ops.size(); i < tokens.size(); ++i) {
+      ops.push_back(LexOp(tokens[i]));
+    }
+  }
+
 public:
   void Reset() {
     tokens.resize(0);
+    ops.resize(0);
     token_id = 0;
   }
 
   // Load in tokens from a stream.
   void Load(std::istream &is) {
+    TUBULAR_TRACE_PHASE("lex");
     Cleanup();
     auto new_tokens = lexer.Tokenize(is);
+    TUBULAR_TRACE_COUNT(TokensLexed, new_tokens.size());
     if (tokens.size() == 0)
       std::swap(tokens, new_tokens);
     else
       tokens.insert(tokens.end(), new_tokens.begin(), new_tokens.end());
+    LexOps();
   }
 
   // Load in tokens from a string.
   void Load(const std::string &str) {
+    TUBULAR_TRACE_PHASE("lex");
     Cleanup();
     auto new_tokens = lexer.Tokenize(str);
+    TUBULAR_TRACE_COUNT(TokensLexed, new_tokens.size());
     if (tokens.size() == 0)
       std::swap(tokens, new_tokens);
     else
       tokens.insert(tokens.end(), new_tokens.begin(), new_tokens.end());
+    LexOps();
   }
 
   // Count remaining tokens.
@@ -85,6 +104,9 @@ public:
     return tokens[token_id];
   }
 
+  // Get the operator of the next token (OpId::None if it is not one).
+  OpId PeekOp() const { return None() ? OpId::None : ops[token_id]; }
+
   // Get the next token, removing it from the queue.
   const emplex::Token &Use() {
     if (None())
@@ -0,0 +1,323 @@
+#pragma once
+
+#include <bitset>
+#include <cstddef>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "ASTNode.hpp"
+#include "ASTWalker.hpp"
+#include "NodeCounter.hpp"
+
+// Analyses that passes can request from an AnalysisManager.
+enum class AnalysisId { CallGraph, Loops, NodeCount, Purity, NUM_ANALYSES };
+
+// The set of analyses a pass leaves valid after it changes the tree.
+class PreservedAnalyses {
+private:
+  std::bitset<static_cast<size_t>(AnalysisId::NUM_ANALYSES)> preserved;
+
+public:
+  static PreservedAnalyses none() { return PreservedAnalyses(); }
+  static PreservedAnalyses all() {
+    PreservedAnalyses out;
+    out.preserved.set();
+    return out;
+  }
+
+  PreservedAnalyses &preserve(AnalysisId id) {
+    preserved.set(static_cast<size_t>(id));
+    return *this;
+  }
+
+  bool preserves(AnalysisId id) const { return preserved.test(static_cast<size_t>(id)); }
+  bool preservesAll() const { return preserved.all(); }
+};
+
+// Functions defined under a root and the functions each of them calls.
+struct CallGraph {
+  std::unordered_map<size_t, ASTNode_Function *> functions;       // Function id -> definition
+  std::unordered_map<size_t, std::unordered_set<size_t>> callees; // Function id -> ids it calls
+
+  ASTNode_Function *getFunction(size_t funId) const {
+    auto it = functions.find(funId);
+    return it == functions.end() ? nullptr : it->second;
+  }
+
+  // Does the function call itself directly?
+  bool isRecursive(size_t funId) const {
+    auto it = callees.find(funId);
+    return it != callees.end() && it->second.count(funId);
+  }
+};
+
+// Structural facts about every while loop under a root.
+struct LoopInfo {
+  struct Loop {
+    size_t depth = 0;                // Number of enclosing loops.
+    bool hasNestedLoop = false;      // Is there another loop in the body?
+    bool hasControlTransfer = false; // Any break, continue, or return in the body?
+  };
+  std::unordered_map<const ASTNode_While *, Loop> loops;
+
+  const Loop *find(const ASTNode_While &loop) const {
+    auto it = loops.find(&loop);
+    return it == loops.end() ? nullptr : &it->second;
+  }
+};
+
+// Functions under a root whose body is just `return <expr>;`, where the
+// expression has no side effects and reads nothing but parameters.
+struct PurityInfo {
+  struct Summary {
+    const ASTNode *returnExpr = nullptr;
+    std::vector<size_t> paramIds{};                // The function's parameters, in order
+    std::unordered_map<size_t, size_t> paramUsage; // Parameter id -> reads
+    size_t nodeCount = 0;                          // Nodes in returnExpr
+    bool internal = false;                         // Not exported, so only the program calls it
+  };
+  std::unordered_map<size_t, Summary> pureFunctions;
+
+  const Summary *find(size_t funId) const {
+    auto it = pureFunctions.find(funId);
+    return it == pureFunctions.end() ? nullptr : &it->second;
+  }
+};
+
+// Computes analyses on demand and caches them for one root (usually a single
+// function) until a pass that does not preserve them changes the tree.
+//
+// Example usage:
+//   AnalysisManager analyses;
+//   const LoopInfo &loops = analyses.getLoops(root);
+//   ...transform root without touching any loops...
+//   analyses.invalidate(PreservedAnalyses::none().preserve(AnalysisId::Loops));
+class AnalysisManager {
+private:
+  const ASTNode *root = nullptr; // Tree the cached results describe.
+
+  std::optional<CallGraph> callGraph;
+  std::optional<LoopInfo> loopInfo;
+  std::optional<size_t> nodeCount;
+  std::optional<PurityInfo> purity;
+
+  size_t computedCount = 0; // Analyses actually computed (reported by --time-passes).
+  size_t cachedCount = 0;   // Requests served from the cache.
+
+  // Switch to a new root, discarding everything cached for the old one.
+  void setRoot(const ASTNode &node) {
+    if (root != &node) {
+      invalidate(PreservedAnalyses::none());
+      root = &node;
+    }
+  }
+
+  template <typename T> bool isCached(const std::optional<T> &result) {
+    if (result) {
+      ++cachedCount;
+      return true;
+    }
+    ++computedCount;
+    return false;
+  }
+
+  // ---- Call graph ----
+
+  struct CallCollector : ASTWalker<CallCollector> {
+    CallGraph &graph;
+    std::vector<size_t> openFunctions{};
+
+    CallCollector(CallGraph &graph) : graph(graph) {}
+
+    void visitFunction(ASTNode_Function &node) {
+      graph.functions[node.GetFunId()] = &node;
+      graph.callees[node.GetFunId()];
+      openFunctions.push_back(node.GetFunId());
+      walkChildren(node);
+      openFunctions.pop_back();
+    }
+    void visitFunctionCall(ASTNode_FunctionCall &node) {
+      if (!openFunctions.empty())
+        graph.callees[openFunctions.back()].insert(node.GetFunId());
+      walkChildren(node);
+    }
+    void visitParent(ASTNode_Parent &node) { walkChildren(node); }
+  };
+
+  // ---- Loops ----
+
+  // Returns (has loop, has control transfer) for the subtree it visits.
+  struct LoopCollector : ASTWalker<LoopCollector, std::pair<bool, bool>> {
+    LoopInfo &info;
+    size_t depth = 0;
+
+    LoopCollector(LoopInfo &info) : info(info) {}
+
+    std::pair<bool, bool> visitNode(ASTNode &) { return {false, false}; }
+    std::pair<bool, bool> visitBreak(ASTNode_Break &) { return {false, true}; }
+    std::pair<bool, bool> visitContinue(ASTNode_Continue &) { return {false, true}; }
+    std::pair<bool, bool> visitReturn(ASTNode_Return &node) { return {visitParent(node).first, true}; }
+    std::pair<bool, bool> visitParent(ASTNode_Parent &node) {
+      std::pair<bool, bool> out{false, false};
+      for (size_t i = 0; i < node.NumChildren(); ++i) {
+        if (!node.HasChild(i))
+          continue;
+        auto [hasLoop, hasTransfer] = dispatch(node.GetChild(i));
+        out.first |= hasLoop;
+        out.second |= hasTransfer;
+      }
+      return out;
+    }
+    std::pair<bool, bool> visitWhile(ASTNode_While &node) {
+      LoopInfo::Loop loop;
+      loop.depth = depth++;
+      if (node.NumChildren() > 1 && node.HasChild(1)) {
+        auto [hasLoop, hasTransfer] = dispatch(node.GetChild(1));
+        loop.hasNestedLoop = hasLoop;
+        loop.hasControlTransfer = hasTransfer;
+      }
+      --depth;
+      info.loops[&node] = loop;
+      return {true, loop.hasControlTransfer};
+    }
+  };
+
+  // ---- Purity ----
+
+  static const ASTNode *extractReturnExpression(const ASTNode_Function &fn) {
+    if (!fn.HasChild(0))
+      return nullptr;
+    const ASTNode *body = &fn.GetChild(0);
+
+    if (auto *block = dyn_cast<ASTNode_Block>(body)) {
+      if (block->NumChildren() != 1 || !block->HasChild(0))
+        return nullptr;
+      body = &block->GetChild(0);
+    }
+    if (auto *ret = dyn_cast<ASTNode_Return>(body)) {
+      if (ret->NumChildren() == 1 && ret->HasChild(0))
+        return &ret->GetChild(0);
+    }
+    return nullptr;
+  }
+
+  static bool isPureExpression(const ASTNode &expr, const std::unordered_set<size_t> &params,
+                               std::unordered_map<size_t, size_t> &usage) {
+    switch (expr.kind()) {
+    case NodeKind::IntLit:
+    case NodeKind::FloatLit:
+    case NodeKind::CharLit:
+    case NodeKind::StringLit:
+      return true;
+
+    case NodeKind::Var: {
+      size_t id = cast<ASTNode_Var>(expr).GetVarId();
+      if (!params.count(id))
+        return false;
+      usage[id]++;
+      return true;
+    }
+
+    case NodeKind::Math2:
+      if (cast<ASTNode_Math2>(expr).GetOp() == OpId::Assign)
+        return false;
+      [[fallthrough]];
+    case NodeKind::Indexing: {
+      const auto &parent = cast<ASTNode_Parent>(expr);
+      return isPureExpression(parent.GetChild(0), params, usage) &&
+             isPureExpression(parent.GetChild(1), params, usage);
+    }
+
+    case NodeKind::Math1:
+    case NodeKind::ToDouble:
+    case NodeKind::ToInt:
+    case NodeKind::ToString:
+    case NodeKind::Size:
+      return isPureExpression(cast<ASTNode_Parent>(expr).GetChild(0), params, usage);
+
+    default:
+      // Conservative: disallow nested function calls or control structures
+      return false;
+    }
+  }
+
+public:
+  // Summarize fn if it is pure (see PurityInfo); returns false if it is not.
+  static bool summarizePure(const ASTNode_Function &fn, PurityInfo::Summary &summary) {
+    const ASTNode *expr = extractReturnExpression(fn);
+    if (!expr)
+      return false;
+
+    const auto &paramIds = fn.GetParamIds();
+    std::unordered_set<size_t> params(paramIds.begin(), paramIds.end());
+    if (!isPureExpression(*expr, params, summary.paramUsage))
+      return false;
+
+    NodeCounter counter;
+    counter.dispatch(*expr);
+    summary.returnExpr = expr;
+    summary.paramIds = paramIds;
+    summary.nodeCount = static_cast<size_t>(counter.getCount());
+    return true;
+  }
+
+  const CallGraph &getCallGraph(ASTNode &node) {
+    setRoot(node);
+    if (!isCached(callGraph)) {
+      callGraph.emplace();
+      CallCollector collector(*callGraph);
+      collector.dispatch(node);
+    }
+    return *callGraph;
+  }
+
+  const LoopInfo &getLoops(ASTNode &node) {
+    setRoot(node);
+    if (!isCached(loopInfo)) {
+      loopInfo.emplace();
+      LoopCollector collector(*loopInfo);
+      collector.dispatch(node);
+    }
+    return *loopInfo;
+  }
+
+  size_t getNodeCount(ASTNode &node) {
+    setRoot(node);
+    if (!isCached(nodeCount)) {
+      NodeCounter counter;
+      counter.dispatch(node);
+      nodeCount = static_cast<size_t>(counter.getCount());
+    }
+    return *nodeCount;
+  }
+
+  const PurityInfo &getPurity(ASTNode &node) {
+    const CallGraph &graph = getCallGraph(node);
+    if (!isCached(purity)) {
+      purity.emplace();
+      for (const auto &[funId, fn] : graph.functions) {
+        PurityInfo::Summary summary;
+        if (summarizePure(*fn, summary))
+          purity->pureFunctions.emplace(funId, std::move(summary));
+      }
+    }
+    return *purity;
+  }
+
+  // Drop every cached analysis that is not preserved.
+  void invalidate(const PreservedAnalyses &keep) {
+    if (!keep.preserves(AnalysisId::CallGraph))
+      callGraph.reset();
+    if (!keep.preserves(AnalysisId::Loops))
+      loopInfo.reset();
+    if (!keep.preserves(AnalysisId::NodeCount))
+      nodeCount.reset();
+    if (!keep.preserves(AnalysisId::Purity))
+      purity.reset();
+  }
+
+  size_t numComputed() const { return computedCount; }
+  size_t numCached() const { return cachedCount; }
+};
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "ASTCloner.hpp"
+#include "ASTWalker.hpp"
+#include "CallGraph.hpp"
+#include "SymbolTable.hpp"
+
+// Specialize internal (non-exported) functions on their constant arguments.
+// Only calls inside the program can reach an internal function, so if every
+// call passes the same literal for a parameter that the function never
+// assigns, each read of that parameter can be replaced with the literal.
+// Later passes then see the constant, for example as a loop bound or an
+// inlined operand.
+//
+// Example usage:
+//   size_t count = ArgumentSpecializer::run(functions, symbols);
+class ArgumentSpecializer {
+private:
+  // Variables assigned anywhere in a function.
+  struct AssignFinder : ASTWalker<AssignFinder, void, true> {
+    std::unordered_set<size_t> assigned{};
+
+    void visitMath2(const ASTNode_Math2 &node) {
+      if (node.GetOp() == OpId::Assign) {
+        if (const auto *var = dyn_cast<ASTNode_Var>(&node.GetChild(0)))
+          assigned.insert(var->GetVarId());
+      }
+      walkChildren(node);
+    }
+    void visitTailCallLoop(const ASTNode_TailCallLoop &node) {
+      assigned.insert(node.GetParamIds().begin(), node.GetParamIds().end());
+      for (size_t i = 0; i < node.NumArgs(); ++i) {
+        if (node.HasArg(i))
+          dispatch(node.GetArg(i));
+      }
+    }
+    void visitParent(const ASTNode_Parent &node) { walkChildren(node); }
+  };
+
+  // Replace reads of the given variables with copies of their literals.
+  struct VarReplacer : ASTWalker<VarReplacer> {
+    const std::unordered_map<size_t, const ASTNode *> &values;
+    size_t replaced = 0;
+
+    VarReplacer(const std::unordered_map<size_t, const ASTNode *> &values) : values(values) {}
+
+    std::unique_ptr<ASTNode> replacement(const ASTNode &node) {
+      const auto *var = dyn_cast<ASTNode_Var>(&node);
+      if (!var)
+        return nullptr;
+      auto it = values.find(var->GetVarId());
+      if (it == values.end())
+        return nullptr;
+      ++replaced;
+      return ASTCloner::clone(*it->second);
+    }
+
+    void visitParent(ASTNode_Parent &node) {
+      for (size_t i = 0; i < node.NumChildren(); ++i) {
+        if (!node.HasChild(i))
+          continue;
+        if (auto literal = replacement(node.GetChild(i)))
+          node.ReplaceChild(i, std::move(literal));
+        else
+          dispatch(node.GetChild(i));
+      }
+    }
+    void visitTailCallLoop(ASTNode_TailCallLoop &node) {
+      for (size_t i = 0; i < node.NumArgs(); ++i) {
+        if (!node.HasArg(i))
+          continue;
+        if (auto literal = replacement(node.GetArg(i)))
+          node.ReplaceArg(i, std::move(literal));
+        else
+          dispatch(node.GetArg(i));
+      }
+    }
+  };
+
+  static bool sameLiteral(const ASTNode &a, const ASTNode &b) {
+    if (a.kind() != b.kind())
+      return false;
+    switch (a.kind()) {
+    case NodeKind::IntLit:
+      return cast<ASTNode_IntLit>(a).GetValue() == cast<ASTNode_IntLit>(b).GetValue();
+    case NodeKind::CharLit:
+      return cast<ASTNode_CharLit>(a).GetValue() == cast<ASTNode_CharLit>(b).GetValue();
+    case NodeKind::FloatLit:
+      return cast<ASTNode_FloatLit>(a).GetValue() == cast<ASTNode_FloatLit>(b).GetValue();
+    default:
+      return false; // String literals are addresses; they are left alone.
+    }
+  }
+
+  // The literal every call passes as argument i, if they agree and it has the
+  // parameter's exact type.
+  static const ASTNode *commonArgument(const std::vector<const ASTNode_FunctionCall *> &calls, size_t i,
+                                       const Type &param_type, const SymbolTable &symbols) {
+    const ASTNode &first = calls.front()->GetChild(i);
+    const bool literal = isa<ASTNode_IntLit>(first) || isa<ASTNode_CharLit>(first) || isa<ASTNode_FloatLit>(first);
+    if (!literal || !(first.ReturnType(symbols) == param_type))
+      return nullptr;
+    for (const ASTNode_FunctionCall *call : calls) {
+      if (!sameLiteral(first, call->GetChild(i)))
+        return nullptr;
+    }
+    return &first;
+  }
+
+public:
+  // Specialize every internal function, repeating while specializing one
+  // makes another's arguments constant.  Returns the number of parameter
+  // reads replaced.
+  static size_t run(const std::vector<ASTNode_Function *> &functions, const SymbolTable &symbols) {
+    size_t total = 0;
+    for (size_t round = 0; round <= functions.size(); ++round) {
+      std::unordered_map<size_t, std::vector<const ASTNode_FunctionCall *>> calls; // Callee id -> its calls.
+      for (const ASTNode_Function *fun : functions) {
+        CallFinder finder;
+        finder.dispatch(*fun);
+        for (const ASTNode_FunctionCall *call : finder.getCalls()) {
+          calls[call->GetFunId()].push_back(call);
+        }
+      }
+
+      // Plan every substitution before changing any function.  Only variable
+      // reads are replaced, so the literals found in callers stay in place.
+      std::vector<std::pair<ASTNode_Function *, std::unordered_map<size_t, const ASTNode *>>> plans;
+      for (ASTNode_Function *fun : functions) {
+        auto it = calls.find(fun->GetFunId());
+        if (fun->IsExported() || it == calls.end())
+          continue;
+        AssignFinder writes;
+        writes.dispatch(*fun);
+        std::unordered_map<size_t, const ASTNode *> values;
+        const std::vector<size_t> &param_ids = fun->GetParamIds();
+        for (size_t i = 0; i < param_ids.size(); ++i) {
+          if (writes.assigned.count(param_ids[i]))
+            continue;
+          if (const ASTNode *literal = commonArgument(it->second, i, symbols.GetType(param_ids[i]), symbols))
+            values.emplace(param_ids[i], literal);
+        }
+        if (!values.empty())
+          plans.emplace_back(fun, std::move(values));
+      }
+
+      size_t replaced = 0;
+      for (size_t p = 0; p < plans.size(); ++p) {
+        VarReplacer replacer(plans[p].second);
+        replacer.dispatch(*plans[p].first);
+        replaced += replacer.replaced;
+      }
+      total += replaced;
+      if (replaced == 0)
+        break;
+    }
+    return total;
+  }
+};
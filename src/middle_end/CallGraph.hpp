@@ -0,0 +1,62 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "ASTWalker.hpp"
+
+// Collect every function call in a (sub)tree, in order.
+class CallFinder : public ASTWalker<CallFinder, void, true> {
+private:
+  std::vector<const ASTNode_FunctionCall *> calls;
+
+public:
+  const std::vector<const ASTNode_FunctionCall *> &getCalls() const { return calls; }
+
+  void visitFunctionCall(const ASTNode_FunctionCall &node) {
+    calls.push_back(&node);
+    walkChildren(node);
+  }
+
+  void visitTailCallLoop(const ASTNode_TailCallLoop &node) {
+    for (size_t i = 0; i < node.NumArgs(); ++i) {
+      if (node.HasArg(i))
+        dispatch(node.GetArg(i));
+    }
+  }
+
+  void visitParent(const ASTNode_Parent &node) { walkChildren(node); }
+};
+
+// Find the functions reachable through calls from the given roots.  Returns
+// one flag per function, in the same order.
+inline std::vector<bool> FindReachableFunctions(const std::vector<const ASTNode_Function *> &functions,
+                                                const std::vector<size_t> &root_ids) {
+  std::unordered_map<size_t, size_t> index_of; // Function id -> position.
+  for (size_t i = 0; i < functions.size(); ++i) {
+    index_of[functions[i]->GetFunId()] = i;
+  }
+
+  std::vector<bool> reachable(functions.size(), false);
+  std::vector<size_t> worklist;
+  auto mark = [&](size_t fun_id) {
+    auto it = index_of.find(fun_id);
+    if (it != index_of.end() && !reachable[it->second]) {
+      reachable[it->second] = true;
+      worklist.push_back(it->second);
+    }
+  };
+  for (size_t id : root_ids) {
+    mark(id);
+  }
+  while (!worklist.empty()) {
+    const size_t pos = worklist.back();
+    worklist.pop_back();
+    CallFinder finder;
+    finder.dispatch(*functions[pos]);
+    for (const ASTNode_FunctionCall *call : finder.getCalls()) {
+      mark(call->GetFunId());
+    }
+  }
+  return reachable;
+}
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "ASTWalker.hpp"
+#include "Interpreter.hpp"
+#include "StringFreeFunctions.hpp"
+#include "SymbolTable.hpp"
+
+// Compile-time function evaluation (--ctfe).  A call whose arguments are all
+// literals, to a function that never touches a string (see
+// StringFreeFunctions), is run in the Interpreter and replaced with a literal
+// of its result.  Each call gets at most a step budget of interpreter steps,
+// and all calls together get a time budget.  Calls that exceed a budget stay
+// in place and are listed in the report.  So do calls that trap, since they
+// must still trap at run time.  A function without parameters, such as main,
+// is evaluated the same way, and its body reduced to returning the result.
+//
+// Example usage:
+//   auto report = CompileTimeEvaluator::run(functions, symbols, {1000000, std::chrono::milliseconds(1000)});
+//   report.print(std::cerr);
+class CompileTimeEvaluator {
+public:
+  struct Budget {
+    uint64_t steps;                 // Interpreter steps allowed per call.
+    std::chrono::milliseconds time; // Wall time allowed for all calls together.
+  };
+
+  struct Report {
+    Budget budget;
+    size_t folded = 0;                       // Calls replaced with literals.
+    size_t bodies_folded = 0;                // Functions without parameters reduced to `return <literal>;`.
+    size_t trapped = 0;                      // Calls left in place because they trap.
+    std::vector<std::string> out_of_steps{}; // Calls over the step budget, e.g. "Fib(40) at 12:10".
+    std::vector<std::string> out_of_time{};  // Calls cut off (or never tried) for lack of time.
+
+    bool BudgetHit() const { return !out_of_steps.empty() || !out_of_time.empty(); }
+
+    void print(std::ostream &out) const {
+      out << "CTFE: folded " << folded << " call(s) and " << bodies_folded << " function body(s); "
+          << out_of_steps.size() << " over the step budget (" << budget.steps << " steps), " << out_of_time.size()
+          << " over the time budget (" << budget.time.count() << " ms), " << trapped << " trapped.\n";
+      for (const std::string &call : out_of_steps)
+        out << "  step budget: " << call << "\n";
+      for (const std::string &call : out_of_time)
+        out << "  time budget: " << call << "\n";
+    }
+  };
+
+private:
+  const SymbolTable &symbols;
+  std::vector<const ASTNode_Function *> program;
+  std::unordered_set<size_t> foldable; // Functions that calls may be evaluated for.
+  std::unique_ptr<Interpreter> interpreter;
+  std::chrono::steady_clock::time_point deadline;
+  Report report;
+
+  // Results by callee and arguments (as raw bits); nothing if the call cannot be folded.
+  std::map<std::vector<uint64_t>, std::optional<Interpreter::Value>> results;
+
+  // Replace each foldable call with its result, innermost calls first.
+  struct CallFolder : ASTWalker<CallFolder> {
+    CompileTimeEvaluator &ctfe;
+
+    CallFolder(CompileTimeEvaluator &ctfe) : ctfe(ctfe) {}
+
+    void visitParent(ASTNode_Parent &node) {
+      for (size_t i = 0; i < node.NumChildren(); ++i) {
+        if (!node.HasChild(i))
+          continue;
+        dispatch(node.GetChild(i));
+        if (auto literal = ctfe.fold(node.GetChild(i)))
+          node.ReplaceChild(i, std::move(literal));
+      }
+    }
+    void visitTailCallLoop(ASTNode_TailCallLoop &node) {
+      for (size_t i = 0; i < node.NumArgs(); ++i) {
+        if (!node.HasArg(i))
+          continue;
+        dispatch(node.GetArg(i));
+        if (auto literal = ctfe.fold(node.GetArg(i)))
+          node.ReplaceArg(i, std::move(literal));
+      }
+    }
+  };
+
+  CompileTimeEvaluator(const std::vector<ASTNode_Function *> &functions, const SymbolTable &symbols, Budget budget)
+      : symbols(symbols), program(functions.begin(), functions.end()),
+        foldable(StringFreeFunctions::Find(functions, symbols)),
+        deadline(std::chrono::steady_clock::now() + budget.time), report{budget} {}
+
+  // The value a literal argument passes for a parameter of the given type, if it is one.
+  static std::optional<Interpreter::Value> argumentValue(const ASTNode &arg, const Type &type) {
+    if (type.IsDouble()) {
+      if (const auto *lit = dyn_cast<ASTNode_FloatLit>(&arg))
+        return Interpreter::Value::Double(lit->GetValue());
+      if (const auto *lit = dyn_cast<ASTNode_IntLit>(&arg))
+        return Interpreter::Value::Double(lit->GetValue());
+      return std::nullopt;
+    }
+    if (const auto *lit = dyn_cast<ASTNode_IntLit>(&arg))
+      return Interpreter::Value::Int(lit->GetValue());
+    if (const auto *lit = dyn_cast<ASTNode_CharLit>(&arg))
+      return Interpreter::Value::Int(lit->GetValue());
+    return std::nullopt;
+  }
+
+  std::string describe(size_t fun_id, const std::vector<Interpreter::Value> &args, FilePos pos) const {
+    const Type &fun_type = symbols.GetType(fun_id);
+    std::string out = symbols.GetName(fun_id) + "(";
+    for (size_t i = 0; i < args.size(); ++i) {
+      const Type &type = fun_type.ParamType(i);
+      const std::string value = interpreter->format(args[i], type);
+      out += (i ? ", " : "") + (type.IsChar() ? "'" + value + "'" : value);
+    }
+    return out + ") at " + pos.ToString();
+  }
+
+  // Run the call, or return nothing if it cannot finish within budget.
+  std::optional<Interpreter::Value> evaluate(size_t fun_id, const std::vector<Interpreter::Value> &args,
+                                             FilePos pos) {
+    if (!interpreter)
+      interpreter = std::make_unique<Interpreter>(symbols, program);
+    if (std::chrono::steady_clock::now() > deadline) {
+      report.out_of_time.push_back(describe(fun_id, args, pos));
+      return std::nullopt;
+    }
+    interpreter->setStepLimit(interpreter->numSteps() + report.budget.steps);
+    interpreter->setDeadline(deadline);
+    try {
+      return interpreter->call(fun_id, args);
+    } catch (const Interpreter::StepLimitExceeded &) {
+      report.out_of_steps.push_back(describe(fun_id, args, pos));
+    } catch (const Interpreter::TimeLimitExceeded &) {
+      report.out_of_time.push_back(describe(fun_id, args, pos));
+    } catch (const Interpreter::Trap &) {
+      ++report.trapped;
+    }
+    interpreter.reset(); // An interrupted call leaves its frames behind.
+    return std::nullopt;
+  }
+
+  // The result of a call as a literal, or nullptr if it cannot be folded.
+  std::unique_ptr<ASTNode> result(size_t fun_id, const std::vector<Interpreter::Value> &args, FilePos pos) {
+    const Type return_type = symbols.GetType(fun_id).ReturnType();
+    if (!foldable.count(fun_id) || (!return_type.IsInt() && !return_type.IsChar() && !return_type.IsDouble()))
+      return nullptr;
+
+    std::vector<uint64_t> key{fun_id};
+    for (const Interpreter::Value &arg : args) {
+      key.push_back(static_cast<uint32_t>(arg.i));
+      key.push_back(std::bit_cast<uint64_t>(arg.d));
+    }
+    auto it = results.find(key);
+    if (it == results.end())
+      it = results.emplace(std::move(key), evaluate(fun_id, args, pos)).first;
+    if (!it->second)
+      return nullptr;
+
+    const Interpreter::Value &value = *it->second;
+    if (return_type.IsDouble()) {
+      // Double literals are written with ToString(), so only fold values that survive it.
+      if (!std::isfinite(value.d) || std::stod(ToString(value.d)) != value.d)
+        return nullptr;
+      return std::make_unique<ASTNode_FloatLit>(pos, value.d);
+    }
+    if (return_type.IsChar())
+      return std::make_unique<ASTNode_CharLit>(pos, value.i);
+    return std::make_unique<ASTNode_IntLit>(pos, value.i);
+  }
+
+  // A literal for node's value, if it is a call with literal arguments that can be folded.
+  std::unique_ptr<ASTNode> fold(const ASTNode &node) {
+    const auto *call = dyn_cast<ASTNode_FunctionCall>(&node);
+    if (!call || !foldable.count(call->GetFunId()))
+      return nullptr;
+    const Type &fun_type = symbols.GetType(call->GetFunId());
+    std::vector<Interpreter::Value> args;
+    for (size_t i = 0; i < call->NumChildren(); ++i) {
+      const auto value = argumentValue(call->GetChild(i), fun_type.ParamType(i));
+      if (!value)
+        return nullptr;
+      args.push_back(*value);
+    }
+    auto literal = result(call->GetFunId(), args, call->GetFilePos());
+    if (literal)
+      ++report.folded;
+    return literal;
+  }
+
+public:
+  static Report run(const std::vector<ASTNode_Function *> &functions, const SymbolTable &symbols, Budget budget) {
+    CompileTimeEvaluator ctfe(functions, symbols, budget);
+    CallFolder folder(ctfe);
+    for (ASTNode_Function *fun : functions) {
+      folder.dispatch(*fun);
+    }
+    // A function without parameters (such as main) is a call with constant
+    // arguments too; its whole body can become `return <result>;`.
+    for (ASTNode_Function *fun : functions) {
+      if (!fun->GetParamIds().empty())
+        continue;
+      if (auto literal = ctfe.result(fun->GetFunId(), {}, fun->GetFilePos())) {
+        auto body = std::make_unique<ASTNode_Block>(fun->GetFilePos());
+        body->AddChild(std::make_unique<ASTNode_Return>(fun->GetFilePos(), std::move(literal)));
+        fun->ReplaceChild(0, std::move(body));
+        fun->SetVars({});
+        ++ctfe.report.bodies_folded;
+      }
+    }
+    return ctfe.report;
+  }
+};
@@ -1,18 +1,31 @@
 #pragma once
 
+#include <algorithm>
+#include <charconv>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <type_traits>
 
+#include "OutputBuffer.hpp"
+#include "RuntimeHelpers.hpp"
+#include "StringPool.hpp"
 #include "SymbolTable.hpp"
+#include "Trace.hpp"
 
 // A struct that contains all of the state information to control compilation.
 
 struct Control {
-  SymbolTable symbols{};
+  SymbolTable &symbols;
   int indent = 0;
   bool final_node =
       false; // Are we processing the final (right-most) node in a function?
   size_t wat_mem_pos = 14; // Position for generating fixed data in WAT memory.
+  std::shared_ptr<StringPool> strings = std::make_shared<StringPool>(); // Shared by function buffers.
+  bool strings_shared = false; // Set by PlaceStrings(): no string is ever written in place.
 
   std::vector<std::string>
       break_stack; // Stack of break labels for active scopes.
@@ -30,10 +43,46 @@ struct Control {
   };
   std::vector<WAT_Line> code;
 
+  bool emit_comments = true; // False to leave comments out of the generated code.
+
+  // Widest code on a commented line, kept up to date as comments are added so
+  // that printing needs no extra pass; stale only if such a line was dropped.
+  size_t comment_width = 0;
+  bool comment_width_stale = false;
+
+  RuntimeHelperSet helpers_used; // Runtime helpers called by the generated code.
+
   int temp_var_counter = 0;
   std::vector<std::pair<std::string, std::string>> temp_vars;
 
 public: // Member functions.
+  Control(SymbolTable &symbols) : symbols(symbols) {}
+
+  // Make an empty code buffer for generating a single function.  It shares the
+  // symbol table and current indent, but has its own label and temp-variable
+  // namespaces, so functions can be generated independently (and in parallel)
+  // and then spliced back together in order with Append().
+  Control MakeFunctionBuffer() const {
+    Control out(symbols);
+    out.indent = indent;
+    out.wat_mem_pos = wat_mem_pos;
+    out.strings = strings;
+    out.strings_shared = strings_shared;
+    out.emit_comments = emit_comments;
+    return out;
+  }
+
+  // Move all code from another buffer onto the end of this one.
+  Control &Append(Control &&other) {
+    code.insert(code.end(), std::make_move_iterator(other.code.begin()),
+                std::make_move_iterator(other.code.end()));
+    other.code.clear();
+    comment_width = std::max(comment_width, other.comment_width);
+    comment_width_stale |= other.comment_width_stale;
+    helpers_used |= other.helpers_used;
+    return *this;
+  }
+
   bool FinalNode() const { return final_node; }
   void FinalNode(bool in) { final_node = in; }
 
@@ -43,72 +92,137 @@ public: // Member functions.
     return *this;
   }
 
+  // Append one argument of Code() or Comment() as it would be streamed, but
+  // without a stream for the common cases: strings, characters, and integers.
+  template <typename T> static void AppendText(std::string &out, const T &value) {
+    if constexpr (std::is_convertible_v<const T &, std::string_view>) {
+      out.append(std::string_view(value));
+    } else if constexpr (std::is_same_v<T, char>) {
+      out.push_back(value);
+    } else if constexpr (std::is_integral_v<T> && !std::is_same_v<T, bool> && sizeof(T) > 1) {
+      char buffer[24];
+      out.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), value).ptr);
+    } else {
+      std::ostringstream ss;
+      ss << value;
+      out += ss.str();
+    }
+  }
+
   // Provide code that should be printed.
   template <typename... Ts> Control &Code(Ts &&...args) {
-    std::stringstream ss;
-    (ss << ... << std::forward<Ts>(args));
-    code.emplace_back(indent, ss.str(), "");
+    std::string text;
+    (AppendText(text, args), ...);
+    code.emplace_back(indent, std::move(text), "");
+    TUBULAR_TRACE_COUNT(InstructionsEmitted, 1);
     return *this;
   }
 
-  // Add code for string data and return its memory position.
-  // (NOTE: THIS IS A HELPER FOR PROJECT 4!)
-  size_t Data(std::string str) {
-    Code("(data (i32.const ", wat_mem_pos, ") \"", str, "\\00\")");
-    size_t out = wat_mem_pos;
-    wat_mem_pos += str.size() + 1;
-    return out;
+  // Call a runtime helper, recording that the module needs it.
+  Control &CallHelper(RuntimeHelper helper) {
+    helpers_used.set(HelperIndex(helper));
+    return Code("call $", HelperName(helper));
   }
 
+  // Provide fixed code that carries its own ";;" comment (after the code, or
+  // as the whole line); the comment is left out along with all others.
+  Control &AnnotatedCode(std::string_view line) {
+    if (emit_comments)
+      return Code(line);
+    line = line.substr(0, line.find(";;"));
+    line = line.substr(0, line.find_last_not_of(' ') + 1);
+    return line.empty() ? *this : Code(line);
+  }
+
+  // String data: register each literal with AddString() (from InitializeWAT),
+  // then PlaceStrings() lays them all out in the data segment, after which
+  // StringAddress() gives a literal's memory position.
+  size_t AddString(const std::string &str) { return strings->Add(str); }
+  void PlaceStrings(bool share) {
+    strings_shared = share;
+    wat_mem_pos = strings->Place(wat_mem_pos, share);
+    for (const auto &segment : strings->Segments()) {
+      Code("(data (i32.const ", segment.address, ") \"", segment.text, "\\00\")");
+    }
+  }
+  size_t StringAddress(size_t id) const { return strings->Address(id); }
+
   // Drop the top value on the stack.
   // Either remove the last instruction (if no side effects) or add a "(drop)"
   Control &Drop() {
     if (code.back().code.starts_with("(local.get")) {
+      if (code.back().comment.size() && code.back().code.size() == comment_width)
+        comment_width_stale = true;
       code.pop_back();
     } else {
-      code.emplace_back(indent, "(drop)", "Remove unneeded value from stack.");
+      Code("(drop)").Comment("Remove unneeded value from stack.");
     }
     return *this;
   }
 
-  // Add a comment to the most recent line of code added.
+  // Add a comment to the most recent line of code added.  Nothing is
+  // formatted when comments are off; a comment that needs work to build (such
+  // as a symbol lookup) can be passed as a callable returning the text, which
+  // is then only invoked when the comment is kept:
+  //   control.Code(...).Comment([&] { return "Set var '" + symbols.GetName(id) + "'"; });
   template <typename... Ts> Control &Comment(Ts &&...args) {
-    std::stringstream ss;
-    (ss << ... << std::forward<Ts>(args));
-    code.back().comment = ss.str();
+    if (!emit_comments)
+      return *this;
+    if constexpr (sizeof...(Ts) == 1 && (std::is_invocable_v<Ts> && ...)) {
+      code.back().comment = (std::forward<Ts>(args)(), ...);
+    } else if constexpr (sizeof...(Ts) == 1 && (std::is_convertible_v<Ts, std::string_view> && ...)) {
+      code.back().comment = (std::string_view(args), ...);
+    } else {
+      std::string text;
+      (AppendText(text, args), ...);
+      code.back().comment = std::move(text);
+    }
+    comment_width = std::max(comment_width, code.back().code.size());
     return *this;
   }
 
   // Special command for a whole-line comment that should indent with the code.
   template <typename... Ts> Control &CommentLine(Ts &&...args) {
+    if (!emit_comments)
+      return *this;
     code.emplace_back(indent, "", "");
     return Comment(std::forward<Ts>(args)...);
   }
 
-  // Generate code to the provided output stream (cout by default)
-  void PrintCode(std::ostream &os = std::cout) const {
-    // First, process code to identify the widest line with a comment.
-    size_t max_width = 0;
-    for (const auto &line : code) {
-      if (line.comment.size() && line.code.size() > max_width) {
-        max_width = line.code.size();
+  // Generate code into the provided buffer.
+  void PrintCode(OutputBuffer &out) const {
+    TUBULAR_TRACE_PHASE("print");
+    const size_t start_size = out.Size();
+    size_t max_width = comment_width;
+    if (comment_width_stale) {
+      max_width = 0;
+      for (const auto &line : code) {
+        if (line.comment.size() && line.code.size() > max_width)
+          max_width = line.code.size();
       }
     }
 
-    // Print code, line by line.
     for (const auto &line : code) {
-      os << std::string(line.indent, ' '); // Tabbing
-      os << line.code;
+      out.Spaces(static_cast<size_t>(line.indent));
+      out.Append(line.code);
       if (line.comment.size()) {
-        if (line.code
-                .size()) { // If there is code on this line, align comments.
-          size_t gap = max_width - line.code.size() + 2;
-          os << std::string(gap, ' ');
+        if (line.code.size()) { // If there is code on this line, align comments.
+          out.Spaces(max_width - line.code.size() + 2);
         }
-        os << ";; " << line.comment;
+        out.Append(";; ");
+        out.Append(line.comment);
       }
-      os << std::endl;
+      out.Append('\n');
     }
+    TUBULAR_TRACE_COUNT(BytesPrinted, out.Size() - start_size);
+  }
+
+  // Generate code to the provided output stream (cout by default)
+  void PrintCode(std::ostream &os = std::cout) const {
+    OutputBuffer out;
+    PrintCode(out);
+    os.write(out.str().data(), static_cast<std::streamsize>(out.str().size()));
+    os.flush();
   }
 
   // Add a unique number to the end of any label base provided.
@@ -149,7 +263,7 @@ public: // Member functions.
     CommentLine("Variables");
     for (size_t i : var_ids) {
       Code("(local $var", i, " ", WATType(i), ")")
-          .Comment("Variable: ", symbols.GetName(i));
+          .Comment([&] { return "Variable: " + symbols.GetName(i); });
     }
     Code("");
   }
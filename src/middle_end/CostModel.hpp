@@ -0,0 +1,340 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "ASTNode.hpp"
+#include "ASTWalker.hpp"
+#include "SymbolTable.hpp"
+
+// Static cost estimate of a function, used to compare optimized variants.
+struct CostEstimate {
+  double dynamicCost = 0.0; // Estimated instructions executed per call.
+  size_t nodeCount = 0;     // Size of the tree (a stand-in for code size).
+
+  // Variants are ranked by this; each node of code costs a little, so that a
+  // transformation has to pay for the code it adds.
+  double score() const { return dynamicCost + CODE_SIZE_WEIGHT * static_cast<double>(nodeCount); }
+
+  static constexpr double CODE_SIZE_WEIGHT = 0.5;
+};
+
+// Estimate the cost of a single call of a function, in rough WebAssembly
+// instruction units.
+//
+// Example usage:
+//   CostEstimate cost = CostModel::estimate(function, symbols);
+//
+// Loop trip counts are derived where the loop variable's start value, bound,
+// and step are all integer constants; other loops are assumed to run
+// DEFAULT_TRIPS times.  A `while (1)` loop (as produced for tail recursion)
+// can only exit through a return, so its body is counted once: each further
+// trip stands in for a recursive call, which is likewise counted only once.
+class CostModel : public ASTWalker<CostModel, double, true> {
+public:
+  static constexpr double DEFAULT_TRIPS = 10.0; // Trips assumed for a loop with unknown bounds.
+
+private:
+  static constexpr double MAX_TRIPS = 1e6;
+  static constexpr double BRANCH_COST = 2.0;  // Conditional branch plus block bookkeeping.
+  static constexpr double CALL_COST = 10.0;   // Call, frame setup, and return.
+  static constexpr double STRING_COST = 20.0; // Runtime helper for a string operation.
+
+  const SymbolTable &symbols;
+  size_t nodeCount = 0;
+  std::unordered_map<size_t, long long> known; // Variables currently holding a known int.
+  std::vector<double> loopTrips{};             // Estimated trips of each while loop, in preorder.
+
+  CostModel(const SymbolTable &symbols) : symbols(symbols) {}
+
+  std::optional<long long> constValue(const ASTNode &node) const {
+    if (auto *lit = dyn_cast<ASTNode_IntLit>(&node))
+      return lit->GetValue();
+    if (auto *lit = dyn_cast<ASTNode_CharLit>(&node))
+      return lit->GetValue();
+    if (auto *var = dyn_cast<ASTNode_Var>(&node)) {
+      auto it = known.find(var->GetVarId());
+      if (it != known.end())
+        return it->second;
+      return std::nullopt;
+    }
+    if (auto *math = dyn_cast<ASTNode_Math2>(&node)) {
+      auto lhs = constValue(math->GetChild(0));
+      auto rhs = lhs ? constValue(math->GetChild(1)) : std::nullopt;
+      if (!rhs)
+        return std::nullopt;
+      switch (math->GetOp()) {
+      case OpId::Add:
+        return *lhs + *rhs;
+      case OpId::Sub:
+        return *lhs - *rhs;
+      case OpId::Mult:
+        return *lhs * *rhs;
+      default:
+        return std::nullopt;
+      }
+    }
+    return std::nullopt;
+  }
+
+  // Collect every variable assigned anywhere under node.
+  static void collectAssigned(const ASTNode &node, std::unordered_set<size_t> &out) {
+    if (auto *math = dyn_cast<ASTNode_Math2>(&node)) {
+      if (math->GetOp() == OpId::Assign) {
+        if (auto *var = dyn_cast<ASTNode_Var>(&math->GetChild(0)))
+          out.insert(var->GetVarId());
+      }
+    } else if (auto *tail = dyn_cast<ASTNode_TailCallLoop>(&node)) {
+      out.insert(tail->GetParamIds().begin(), tail->GetParamIds().end());
+    }
+    if (auto *parent = dyn_cast<ASTNode_Parent>(&node)) {
+      for (size_t i = 0; i < parent->NumChildren(); ++i) {
+        if (parent->HasChild(i))
+          collectAssigned(parent->GetChild(i), out);
+      }
+    }
+  }
+
+  // Find the constant step of a `var = var +/- N` assignment directly in a loop body.
+  static std::optional<long long> findStep(const ASTNode &body, size_t varId) {
+    auto *block = dyn_cast<ASTNode_Block>(&body);
+    if (!block)
+      return std::nullopt;
+    for (size_t i = 0; i < block->NumChildren(); ++i) {
+      auto *assign = block->HasChild(i) ? dyn_cast<ASTNode_Math2>(&block->GetChild(i)) : nullptr;
+      if (!assign || assign->GetOp() != OpId::Assign)
+        continue;
+      auto *lhs = dyn_cast<ASTNode_Var>(&assign->GetChild(0));
+      auto *rhs = dyn_cast<ASTNode_Math2>(&assign->GetChild(1));
+      if (!lhs || lhs->GetVarId() != varId || !rhs)
+        continue;
+      auto *base = dyn_cast<ASTNode_Var>(&rhs->GetChild(0));
+      auto *amount = dyn_cast<ASTNode_IntLit>(&rhs->GetChild(1));
+      if (!base || base->GetVarId() != varId || !amount)
+        return std::nullopt;
+      if (rhs->GetOp() == OpId::Add)
+        return amount->GetValue();
+      if (rhs->GetOp() == OpId::Sub)
+        return -static_cast<long long>(amount->GetValue());
+      return std::nullopt;
+    }
+    return std::nullopt;
+  }
+
+  // Number of trips through a loop, and the loop variable's value on exit,
+  // if they can be worked out from constants.
+  struct Trips {
+    double count = DEFAULT_TRIPS;
+    std::optional<std::pair<size_t, long long>> exitValue{};
+  };
+
+  Trips estimateTrips(const ASTNode_While &loop) const {
+    Trips trips;
+    const ASTNode &cond = loop.GetChild(0);
+    if (auto value = constValue(cond)) {
+      trips.count = *value ? 1.0 : 0.0;
+      return trips;
+    }
+
+    auto *compare = dyn_cast<ASTNode_Math2>(&cond);
+    auto *var = compare ? dyn_cast<ASTNode_Var>(&compare->GetChild(0)) : nullptr;
+    if (!var)
+      return trips;
+    const size_t varId = var->GetVarId();
+    auto start = constValue(*var);
+    auto bound = constValue(compare->GetChild(1));
+    auto step = findStep(loop.GetChild(1), varId);
+    if (!start || !bound || !step || *step == 0)
+      return trips;
+
+    std::unordered_set<size_t> assigned;
+    collectAssigned(loop.GetChild(1), assigned);
+    if (assigned.count(varId) == 0)
+      return trips;
+
+    // Distance to cover before the condition fails, in the step's direction.
+    long long distance = 0;
+    switch (compare->GetOp()) {
+    case OpId::Less:
+      distance = *bound - *start;
+      break;
+    case OpId::LessEqual:
+      distance = *bound - *start + 1;
+      break;
+    case OpId::Greater:
+      distance = *start - *bound;
+      break;
+    case OpId::GreaterEqual:
+      distance = *start - *bound + 1;
+      break;
+    default:
+      return trips;
+    }
+    const bool increasing = compare->GetOp() == OpId::Less || compare->GetOp() == OpId::LessEqual;
+    if (increasing != (*step > 0))
+      return trips; // Runs "forever" (or not at all); no better guess.
+
+    const long long stride = std::abs(*step);
+    const long long count = distance <= 0 ? 0 : (distance + stride - 1) / stride;
+    trips.count = std::min(static_cast<double>(count), MAX_TRIPS);
+    trips.exitValue = std::make_pair(varId, *start + count * *step);
+    return trips;
+  }
+
+  double walkChildrenCost(const ASTNode_Parent &node) {
+    double cost = 0.0;
+    for (size_t i = 0; i < node.NumChildren(); ++i) {
+      if (node.HasChild(i))
+        cost += dispatch(node.GetChild(i));
+    }
+    return cost;
+  }
+
+  bool isString(const ASTNode &node) const { return node.ReturnType(symbols).IsString(); }
+
+public:
+  static CostEstimate estimate(const ASTNode &function, const SymbolTable &symbols) {
+    CostModel model(symbols);
+    CostEstimate out;
+    out.dynamicCost = model.dispatch(function);
+    out.nodeCount = model.nodeCount;
+    return out;
+  }
+
+  // Estimated trip count of every while loop in a function, in source order
+  // (the order code generation emits their WebAssembly loops).
+  static std::vector<double> estimateLoopTrips(const ASTNode &function, const SymbolTable &symbols) {
+    CostModel model(symbols);
+    model.dispatch(function);
+    return std::move(model.loopTrips);
+  }
+
+  double visitNode(const ASTNode &) {
+    ++nodeCount;
+    return 1.0;
+  }
+
+  double visitParent(const ASTNode_Parent &node) {
+    ++nodeCount;
+    return 1.0 + walkChildrenCost(node);
+  }
+
+  double visitBlock(const ASTNode_Block &node) {
+    ++nodeCount;
+    return walkChildrenCost(node);
+  }
+
+  double visitFunction(const ASTNode_Function &node) {
+    ++nodeCount;
+    known.clear();
+    return walkChildrenCost(node);
+  }
+
+  double visitFunctionCall(const ASTNode_FunctionCall &node) {
+    ++nodeCount;
+    return CALL_COST + walkChildrenCost(node);
+  }
+
+  double visitTailCallLoop(const ASTNode_TailCallLoop &node) {
+    ++nodeCount;
+    double cost = BRANCH_COST;
+    for (size_t i = 0; i < node.NumArgs(); ++i) {
+      if (node.HasArg(i))
+        cost += dispatch(node.GetArg(i)) + 2.0; // Evaluate into a temp, then store.
+    }
+    for (size_t id : node.GetParamIds())
+      known.erase(id);
+    return cost;
+  }
+
+  double visitIf(const ASTNode_If &node) {
+    ++nodeCount;
+    double cost = dispatch(node.GetChild(0)) + BRANCH_COST;
+
+    // Assume either branch is equally likely; afterwards, only values that
+    // both branches agree on are still known.
+    const auto before = known;
+    const double thenCost = dispatch(node.GetChild(1));
+    double elseCost = 0.0;
+    if (node.NumChildren() > 2 && node.HasChild(2)) {
+      auto afterThen = std::move(known);
+      known = before;
+      elseCost = dispatch(node.GetChild(2));
+      for (auto it = known.begin(); it != known.end();) {
+        auto match = afterThen.find(it->first);
+        it = (match == afterThen.end() || match->second != it->second) ? known.erase(it) : std::next(it);
+      }
+    } else {
+      for (auto it = known.begin(); it != known.end();) {
+        auto match = before.find(it->first);
+        it = (match == before.end() || match->second != it->second) ? known.erase(it) : std::next(it);
+      }
+    }
+    return cost + 0.5 * (thenCost + elseCost);
+  }
+
+  double visitWhile(const ASTNode_While &node) {
+    ++nodeCount;
+    const Trips trips = estimateTrips(node);
+    loopTrips.push_back(trips.count);
+
+    // Inside the body (and after the loop), anything the body assigns varies.
+    std::unordered_set<size_t> assigned;
+    collectAssigned(node.GetChild(1), assigned);
+    for (size_t id : assigned)
+      known.erase(id);
+
+    const double condCost = dispatch(node.GetChild(0));
+    const double bodyCost = dispatch(node.GetChild(1));
+    for (size_t id : assigned)
+      known.erase(id);
+    if (trips.exitValue)
+      known[trips.exitValue->first] = trips.exitValue->second;
+
+    return (trips.count + 1.0) * (condCost + BRANCH_COST) + trips.count * bodyCost;
+  }
+
+  double visitMath1(const ASTNode_Math1 &node) {
+    ++nodeCount;
+    return 1.0 + walkChildrenCost(node);
+  }
+
+  double visitMath2(const ASTNode_Math2 &node) {
+    ++nodeCount;
+    const OpId op = node.GetOp();
+    if (op == OpId::Assign) {
+      const double cost = 1.0 + dispatch(node.GetChild(1));
+      if (auto *var = dyn_cast<ASTNode_Var>(&node.GetChild(0))) {
+        ++nodeCount;
+        if (auto value = constValue(node.GetChild(1)))
+          known[var->GetVarId()] = *value;
+        else
+          known.erase(var->GetVarId());
+        return cost;
+      }
+      return cost + dispatch(node.GetChild(0));
+    }
+
+    double cost = walkChildrenCost(node);
+    if (isString(node.GetChild(0)) || isString(node.GetChild(1)))
+      return cost + STRING_COST;
+    if (op == OpId::Div || op == OpId::Mod)
+      return cost + 2.0;
+    return cost + 1.0;
+  }
+
+  double visitIndexing(const ASTNode_Indexing &node) {
+    ++nodeCount;
+    return 3.0 + walkChildrenCost(node);
+  }
+
+  double visitToString(const ASTNode_ToString &node) {
+    ++nodeCount;
+    return STRING_COST + walkChildrenCost(node);
+  }
+};
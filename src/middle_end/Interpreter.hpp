@@ -0,0 +1,723 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <assert.h>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ASTNode.hpp"
+#include "StringPool.hpp"
+#include "StringWriteFinder.hpp"
+#include "SymbolTable.hpp"
+
+// Runs functions directly from their (optimized) AST.
+//
+// Example usage:
+//   Interpreter interpreter(symbols, functions);
+//   Interpreter::Value result = interpreter.call(main_id, {});
+//   std::cout << interpreter.format(result, symbols.GetType(main_id).ReturnType());
+//
+// The interpreter mirrors the module that code generation would emit for the
+// same trees: one 64KB page of linear memory, the same fixed data and string
+// literal layout, the same bump allocator and string helpers, 32-bit wrapping
+// integer math, and a trap wherever WebAssembly would trap (division by zero,
+// out-of-bounds memory access, and so on).  Strings are memory addresses, so
+// even casting a string to an int gives the same result as the compiled code.
+//
+// Each evaluated node counts as one step; setStepLimit() bounds the work a
+// call may do, which lets search-based optimizations reject runaway variants,
+// and setDeadline() bounds its wall time.
+class Interpreter {
+public:
+  // A WebAssembly value: i32 for char, int, and string (an address); f64 for double.
+  struct Value {
+    int32_t i = 0;
+    double d = 0.0;
+
+    static Value Int(int32_t value) { return Value{value, 0.0}; }
+    static Value Double(double value) { return Value{0, value}; }
+  };
+
+  // Thrown when execution traps (or exceeds a limit).
+  class Trap : public std::runtime_error {
+  public:
+    using std::runtime_error::runtime_error;
+  };
+
+  // Thrown when a call runs past the step limit.
+  class StepLimitExceeded : public Trap {
+  public:
+    StepLimitExceeded() : Trap("step limit exceeded") {}
+  };
+
+  // Thrown when a call runs past the deadline.
+  class TimeLimitExceeded : public Trap {
+  public:
+    TimeLimitExceeded() : Trap("time limit exceeded") {}
+  };
+
+  static constexpr uint32_t MEMORY_SIZE = 65536; // The module declares a single page.
+  static constexpr uint32_t ARG_STRING_POS = 50000; // Where string arguments are written (as testers do).
+
+private:
+  enum class Flow { Next, Break, Continue, Return };
+
+  // Where a function's locals live in the frame: var ids are allocated
+  // contiguously per function, so a frame covers [first_id, first_id + size).
+  struct FunctionInfo {
+    const ASTNode_Function *fn = nullptr;
+    size_t first_id = 0;
+    size_t num_slots = 0;
+  };
+
+  const SymbolTable &symbols;
+  std::unordered_map<size_t, FunctionInfo> functions; // Function id -> definition
+
+  std::vector<uint8_t> memory;
+  uint32_t free_mem = 0;    // Next address for the bump allocator.
+  uint32_t arg_pos = ARG_STRING_POS;
+  uint32_t high_water = 0;  // Highest allocated address.
+  bool strings_shared = false; // No string is written in place (literals share memory).
+
+  std::vector<Value> locals; // Frames of all active calls.
+  size_t frame_base = 0;     // Index of the current frame's first slot in locals.
+  size_t frame_first_id = 0; // Var id stored in the current frame's first slot.
+  size_t call_depth = 0;
+  Value return_value;
+
+  uint64_t steps = 0;
+  uint64_t step_limit = std::numeric_limits<uint64_t>::max();
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+  size_t call_depth_limit = 50000;
+
+  // ---- Setup ----
+
+  // Store a string the way it appears in a WAT data segment (with its escapes
+  // decoded) and return the number of bytes written.
+  size_t storeDataString(uint32_t pos, const std::string &str) {
+    const std::string bytes = StringPool::Decode(str);
+    for (size_t i = 0; i < bytes.size(); ++i) {
+      store8(pos + static_cast<uint32_t>(i), static_cast<uint8_t>(bytes[i]));
+    }
+    store8(pos + static_cast<uint32_t>(bytes.size()), 0);
+    return bytes.size();
+  }
+
+  // Gather string literals in the order InitializeWAT() registers them.
+  static void collectLiterals(const ASTNode &node, std::vector<const ASTNode_StringLit *> &literals) {
+    if (auto *str = dyn_cast<ASTNode_StringLit>(&node)) {
+      literals.push_back(str);
+    } else if (auto *parent = dyn_cast<ASTNode_Parent>(&node)) {
+      for (size_t i = 0; i < parent->NumChildren(); ++i) {
+        collectLiterals(parent->GetChild(i), literals);
+      }
+    } else if (auto *tail = dyn_cast<ASTNode_TailCallLoop>(&node)) {
+      for (size_t i = 0; i < tail->NumArgs(); ++i) {
+        if (tail->HasArg(i))
+          collectLiterals(tail->GetArg(i), literals);
+      }
+    }
+  }
+
+  StringPool strings; // Laid out as Control::PlaceStrings() does.
+  std::unordered_map<const ASTNode *, uint32_t> literal_pos;
+
+  static void collectVarIds(const ASTNode &node, size_t &lo, size_t &hi) {
+    if (auto *var = dyn_cast<ASTNode_Var>(&node)) {
+      lo = std::min(lo, var->GetVarId());
+      hi = std::max(hi, var->GetVarId());
+    } else if (auto *tail = dyn_cast<ASTNode_TailCallLoop>(&node)) {
+      for (size_t id : tail->GetParamIds()) {
+        lo = std::min(lo, id);
+        hi = std::max(hi, id);
+      }
+      for (size_t i = 0; i < tail->NumArgs(); ++i) {
+        if (tail->HasArg(i))
+          collectVarIds(tail->GetArg(i), lo, hi);
+      }
+    } else if (auto *parent = dyn_cast<ASTNode_Parent>(&node)) {
+      for (size_t i = 0; i < parent->NumChildren(); ++i) {
+        if (parent->HasChild(i))
+          collectVarIds(parent->GetChild(i), lo, hi);
+      }
+    }
+  }
+
+  static FunctionInfo makeInfo(const ASTNode_Function &fn) {
+    size_t lo = std::numeric_limits<size_t>::max();
+    size_t hi = 0;
+    for (size_t id : fn.GetParamIds()) {
+      lo = std::min(lo, id);
+      hi = std::max(hi, id);
+    }
+    for (size_t id : fn.GetVarIds()) {
+      lo = std::min(lo, id);
+      hi = std::max(hi, id);
+    }
+    collectVarIds(fn, lo, hi);
+    if (lo > hi)
+      return FunctionInfo{&fn, 0, 0};
+    return FunctionInfo{&fn, lo, hi - lo + 1};
+  }
+
+  // ---- Memory and runtime helpers (as emitted by Tubular::ToWAT) ----
+
+  static uint32_t address(int32_t addr) { return static_cast<uint32_t>(addr); }
+
+  uint8_t load8(uint32_t addr) const {
+    if (addr >= MEMORY_SIZE)
+      throw Trap("out of bounds memory access");
+    return memory[addr];
+  }
+
+  void store8(uint32_t addr, uint8_t value) {
+    if (addr >= MEMORY_SIZE)
+      throw Trap("out of bounds memory access");
+    memory[addr] = value;
+  }
+
+  // Little-endian, as i32.load and i32.store are.
+  uint32_t load32(uint32_t addr) const {
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < 4; ++i)
+      value |= uint32_t{load8(addr + i)} << (8 * i);
+    return value;
+  }
+
+  void store32(uint32_t addr, uint32_t value) {
+    for (uint32_t i = 0; i < 4; ++i)
+      store8(addr + i, static_cast<uint8_t>(value >> (8 * i)));
+  }
+
+  int32_t allocString(int32_t size) {
+    const uint32_t start = free_mem;
+    const uint32_t null_pos = start + address(size);
+    store8(null_pos, 0);
+    free_mem = null_pos + 1;
+    high_water = std::max(high_water, free_mem);
+    return static_cast<int32_t>(start);
+  }
+
+  int32_t strlen(int32_t str) const {
+    int32_t length = 0;
+    for (uint32_t addr = address(str); load8(addr) != 0; ++addr)
+      ++length;
+    return length;
+  }
+
+  void memcpy(int32_t src, int32_t dest, int32_t size) {
+    for (; size != 0; --size)
+      store8(address(dest++), load8(address(src++)));
+  }
+
+  int32_t strcat(int32_t str1, int32_t str2) {
+    const int32_t len1 = strlen(str1);
+    const int32_t len2 = strlen(str2);
+    const int32_t result = allocString(len1 + len2);
+    memcpy(str1, result, len1);
+    memcpy(str2, result + len1, len2);
+    return result;
+  }
+
+  int32_t concatN(int32_t parts, int32_t count) {
+    const uint32_t end = address(parts) + (address(count) << 2);
+    int32_t total = 0;
+    for (uint32_t part = address(parts); part < end; part += 4)
+      total += strlen(static_cast<int32_t>(load32(part)));
+    const int32_t result = allocString(total);
+    uint32_t dest = address(result);
+    for (uint32_t part = address(parts); part < end; part += 4) {
+      for (uint32_t src = load32(part); load8(src) != 0; ++src)
+        store8(dest++, load8(src));
+    }
+    return result;
+  }
+
+  int32_t repeatString(int32_t str, int32_t count) {
+    const int32_t str_len = strlen(str);
+    const uint32_t total_len = static_cast<uint32_t>(str_len) * address(count);
+    const int32_t result = allocString(static_cast<int32_t>(total_len));
+    if (total_len == 0)
+      return result;
+    memcpy(str, result, str_len);
+    // Double what is written until the result is full.
+    for (uint32_t done = address(str_len); done < total_len;) {
+      const uint32_t chunk = std::min(total_len - done, done);
+      memcpy(result, static_cast<int32_t>(address(result) + done), static_cast<int32_t>(chunk));
+      done += chunk;
+    }
+    return result;
+  }
+
+  int32_t intToString(int32_t value) {
+    if (value == 0)
+      return 0; // The "0" string at address zero.
+    bool negative = false;
+    if (value < 0) {
+      negative = true;
+      value = static_cast<int32_t>(0u - address(value)); // Wraps for INT_MIN, as i32.mul would.
+    }
+    int32_t out = 13; // The empty string.
+    while (value > 0) {
+      const int32_t digit = allocString(2);
+      store8(address(digit), load8(address(2 + value % 10)));
+      out = strcat(digit, out);
+      value /= 10;
+    }
+    if (negative) {
+      const int32_t sign = allocString(2);
+      store8(address(sign), '-');
+      out = strcat(sign, out);
+    }
+    return out;
+  }
+
+  // -1, 0, or 1 as lhs orders before, with, or after rhs (bytes compare unsigned).
+  int32_t strCompare(int32_t lhs, int32_t rhs) const {
+    while (true) {
+      const uint8_t a = load8(address(lhs++));
+      const uint8_t b = load8(address(rhs++));
+      if (a != b)
+        return a < b ? -1 : 1;
+      if (a == 0)
+        return 0;
+    }
+  }
+
+  // ---- Evaluation ----
+
+  void step() {
+    if (++steps > step_limit)
+      throw StepLimitExceeded();
+    // Reading the clock is slow, so check the deadline every 4096 steps.
+    if ((steps & 0xFFF) == 0 && std::chrono::steady_clock::now() > deadline)
+      throw TimeLimitExceeded();
+  }
+
+  bool isDouble(const ASTNode &node) const { return node.ReturnType(symbols).IsDouble(); }
+  bool isString(const ASTNode &node) const { return node.ReturnType(symbols).IsString(); }
+
+  Value &local(size_t var_id) {
+    assert(var_id >= frame_first_id && var_id - frame_first_id < locals.size() - frame_base);
+    return locals[frame_base + (var_id - frame_first_id)];
+  }
+
+  static int32_t wrap(int64_t value) { return static_cast<int32_t>(static_cast<uint32_t>(value)); }
+
+  Value evalMath2(const ASTNode_Math2 &node) {
+    const OpId op = node.GetOp();
+    const ASTNode &lhs = node.GetChild(0);
+    const ASTNode &rhs = node.GetChild(1);
+
+    switch (op) {
+    case OpId::Assign: {
+      const Value value = eval(rhs);
+      if (auto *var = dyn_cast<ASTNode_Var>(&lhs)) {
+        local(var->GetVarId()) = value;
+      } else if (auto *index = dyn_cast<ASTNode_Indexing>(&lhs)) {
+        const int32_t base = eval(index->GetChild(0)).i;
+        const int32_t offset = eval(index->GetChild(1)).i;
+        store8(address(base) + address(offset), static_cast<uint8_t>(value.i));
+      } else {
+        throw Trap("left-hand side of assignment is not assignable");
+      }
+      return eval(lhs); // The assignment's value is re-read from its target.
+    }
+    case OpId::And: {
+      if (eval(lhs).i == 0)
+        return Value::Int(0);
+      return Value::Int(eval(rhs).i != 0);
+    }
+    case OpId::Or: {
+      if (eval(lhs).i != 0)
+        return Value::Int(1);
+      return Value::Int(eval(rhs).i != 0);
+    }
+    default:
+      break;
+    }
+
+    // Chains of three or more strings go through a table of part addresses,
+    // as ASTNode_Math2::ToWAT_Concat emits them.
+    if (op == OpId::Add && isString(node)) {
+      std::vector<const ASTNode *> parts;
+      ASTNode_Math2::CollectConcatParts<const ASTNode>(node, symbols, parts);
+      if (parts.size() > 2) {
+        const int32_t table = allocString(static_cast<int32_t>(parts.size() * 4 - 1));
+        for (size_t i = 0; i < parts.size(); ++i)
+          store32(address(table) + static_cast<uint32_t>(i * 4), address(eval(*parts[i]).i));
+        return Value::Int(concatN(table, static_cast<int32_t>(parts.size())));
+      }
+    }
+
+    // A literal count of zero or one, as ASTNode_Math2::ToWAT_RepeatFew lowers it.
+    if (op == OpId::Mult && isString(lhs)) {
+      const auto *count = dyn_cast<ASTNode_IntLit>(&rhs);
+      if (count && count->GetValue() == 0) {
+        eval(lhs);
+        return Value::Int(strings_shared ? 13 : allocString(0));
+      }
+      if (count && count->GetValue() == 1 && strings_shared)
+        return eval(lhs);
+    }
+
+    Value a = eval(lhs);
+    Value b = eval(rhs);
+
+    if (op == OpId::Mult && isString(lhs))
+      return Value::Int(repeatString(a.i, b.i));
+    if (op == OpId::Add && isString(lhs))
+      return Value::Int(strcat(a.i, b.i));
+    if (node.IsComparison() && isString(lhs)) {
+      // Strings compare by content: the comparison applies to their order and 0.
+      a = Value::Int(strCompare(a.i, b.i));
+      b = Value::Int(0);
+    }
+
+    if (isDouble(lhs)) {
+      switch (op) {
+      case OpId::Add:
+        return Value::Double(a.d + b.d);
+      case OpId::Sub:
+        return Value::Double(a.d - b.d);
+      case OpId::Mult:
+        return Value::Double(a.d * b.d);
+      case OpId::Div:
+        return Value::Double(a.d / b.d);
+      case OpId::Less:
+        return Value::Int(a.d < b.d);
+      case OpId::LessEqual:
+        return Value::Int(a.d <= b.d);
+      case OpId::Greater:
+        return Value::Int(a.d > b.d);
+      case OpId::GreaterEqual:
+        return Value::Int(a.d >= b.d);
+      case OpId::Equal:
+        return Value::Int(a.d == b.d);
+      case OpId::NotEqual:
+        return Value::Int(a.d != b.d);
+      default:
+        throw Trap(std::string("no f64 instruction for operator '") + OpSymbol(op) + "'");
+      }
+    }
+
+    switch (op) {
+    case OpId::Add:
+      return Value::Int(wrap(int64_t{a.i} + b.i));
+    case OpId::Sub:
+      return Value::Int(wrap(int64_t{a.i} - b.i));
+    case OpId::Mult:
+      return Value::Int(wrap(int64_t{a.i} * b.i));
+    case OpId::Div:
+    case OpId::Mod:
+      if (b.i == 0)
+        throw Trap("integer divide by zero");
+      if (a.i == std::numeric_limits<int32_t>::min() && b.i == -1) {
+        if (op == OpId::Div)
+          throw Trap("integer overflow");
+        return Value::Int(0);
+      }
+      return Value::Int(op == OpId::Div ? a.i / b.i : a.i % b.i);
+    case OpId::Less:
+      return Value::Int(a.i < b.i);
+    case OpId::LessEqual:
+      return Value::Int(a.i <= b.i);
+    case OpId::Greater:
+      return Value::Int(a.i > b.i);
+    case OpId::GreaterEqual:
+      return Value::Int(a.i >= b.i);
+    case OpId::Equal:
+      return Value::Int(a.i == b.i);
+    case OpId::NotEqual:
+      return Value::Int(a.i != b.i);
+    default:
+      throw Trap(std::string("no i32 instruction for operator '") + OpSymbol(op) + "'");
+    }
+  }
+
+  Value eval(const ASTNode &node) {
+    step();
+    switch (node.kind()) {
+    case NodeKind::IntLit:
+      return Value::Int(cast<ASTNode_IntLit>(node).GetValue());
+    case NodeKind::CharLit:
+      return Value::Int(cast<ASTNode_CharLit>(node).GetValue());
+    case NodeKind::FloatLit:
+      return Value::Double(cast<ASTNode_FloatLit>(node).GetValue());
+    case NodeKind::StringLit: {
+      auto it = literal_pos.find(&node);
+      return Value::Int(it == literal_pos.end() ? 0 : static_cast<int32_t>(it->second));
+    }
+    case NodeKind::Var:
+      return local(cast<ASTNode_Var>(node).GetVarId());
+
+    case NodeKind::Math1: {
+      const auto &math = cast<ASTNode_Math1>(node);
+      const Value value = eval(math.GetChild(0));
+      switch (math.GetOp()) {
+      case OpId::Not:
+        return Value::Int(value.i == 0);
+      case OpId::Sqrt:
+        return Value::Double(std::sqrt(value.d));
+      default: // Negation
+        if (isDouble(node))
+          return Value::Double(0.0 - value.d);
+        return Value::Int(wrap(-int64_t{value.i}));
+      }
+    }
+    case NodeKind::Math2:
+      return evalMath2(cast<ASTNode_Math2>(node));
+
+    case NodeKind::ToDouble: {
+      const ASTNode &child = cast<ASTNode_ToDouble>(node).GetChild(0);
+      const Value value = eval(child);
+      return isDouble(child) ? value : Value::Double(static_cast<double>(value.i));
+    }
+    case NodeKind::ToInt: {
+      const ASTNode &child = cast<ASTNode_ToInt>(node).GetChild(0);
+      const Value value = eval(child);
+      if (!isDouble(child))
+        return value;
+      if (std::isnan(value.d))
+        throw Trap("invalid conversion to integer");
+      const double truncated = std::trunc(value.d);
+      if (truncated < -2147483648.0 || truncated > 2147483647.0)
+        throw Trap("integer overflow");
+      return Value::Int(static_cast<int32_t>(truncated));
+    }
+    case NodeKind::ToString: {
+      const ASTNode &child = cast<ASTNode_ToString>(node).GetChild(0);
+      if (child.ReturnType(symbols).IsChar()) {
+        const int32_t str = allocString(2);
+        store8(address(str), static_cast<uint8_t>(eval(child).i));
+        return Value::Int(str);
+      }
+      return Value::Int(intToString(eval(child).i));
+    }
+    case NodeKind::Indexing: {
+      const auto &index = cast<ASTNode_Indexing>(node);
+      const int32_t base = eval(index.GetChild(0)).i;
+      const int32_t offset = eval(index.GetChild(1)).i;
+      return Value::Int(load8(address(base) + address(offset)));
+    }
+    case NodeKind::Size:
+      return Value::Int(strlen(eval(cast<ASTNode_Size>(node).GetChild(0)).i));
+
+    case NodeKind::FunctionCall: {
+      const auto &fn_call = cast<ASTNode_FunctionCall>(node);
+      std::vector<Value> args;
+      args.reserve(fn_call.NumChildren());
+      for (size_t i = 0; i < fn_call.NumChildren(); ++i) {
+        args.push_back(eval(fn_call.GetChild(i)));
+      }
+      return call(fn_call.GetFunId(), args);
+    }
+
+    default:
+      // Statements used as expressions leave no value.
+      if (exec(node) == Flow::Return)
+        throw Trap("unexpected return inside an expression");
+      return Value();
+    }
+  }
+
+  Flow exec(const ASTNode &node) {
+    switch (node.kind()) {
+    case NodeKind::Block: {
+      step();
+      const auto &block = cast<ASTNode_Block>(node);
+      for (size_t i = 0; i < block.NumChildren(); ++i) {
+        if (!block.HasChild(i))
+          continue;
+        const Flow flow = exec(block.GetChild(i));
+        if (flow != Flow::Next)
+          return flow;
+      }
+      return Flow::Next;
+    }
+    case NodeKind::If: {
+      step();
+      const auto &branch = cast<ASTNode_If>(node);
+      if (eval(branch.GetChild(0)).i != 0)
+        return exec(branch.GetChild(1));
+      if (branch.HasChild(2))
+        return exec(branch.GetChild(2));
+      return Flow::Next;
+    }
+    case NodeKind::While: {
+      step();
+      const auto &loop = cast<ASTNode_While>(node);
+      while (eval(loop.GetChild(0)).i != 0) {
+        const Flow flow = exec(loop.GetChild(1));
+        if (flow == Flow::Break)
+          break;
+        if (flow == Flow::Return)
+          return flow;
+        step(); // Jump back to the loop head.
+      }
+      return Flow::Next;
+    }
+    case NodeKind::Return:
+      step();
+      return_value = eval(cast<ASTNode_Return>(node).GetChild(0));
+      return Flow::Return;
+    case NodeKind::Break:
+      step();
+      return Flow::Break;
+    case NodeKind::Continue:
+      step();
+      return Flow::Continue;
+    case NodeKind::TailCallLoop: {
+      step();
+      const auto &tail = cast<ASTNode_TailCallLoop>(node);
+      std::vector<Value> args;
+      args.reserve(tail.NumArgs());
+      for (size_t i = 0; i < tail.NumArgs(); ++i) {
+        args.push_back(eval(tail.GetArg(i)));
+      }
+      for (size_t i = 0; i < args.size(); ++i) {
+        local(tail.GetParamIds()[i]) = args[i];
+      }
+      return Flow::Continue;
+    }
+    default:
+      eval(node);
+      return Flow::Next;
+    }
+  }
+
+public:
+  Interpreter(const SymbolTable &symbols, const std::vector<const ASTNode_Function *> &program)
+      : symbols(symbols), memory(MEMORY_SIZE, 0) {
+    // Fixed data, exactly as the module header places it.
+    storeDataString(0, "0");
+    storeDataString(2, "0123456789");
+    storeDataString(13, "");
+    std::vector<const ASTNode_StringLit *> literals;
+    StringWriteFinder writes;
+    for (const ASTNode_Function *fn : program) {
+      collectLiterals(*fn, literals);
+      writes.dispatch(*fn);
+      functions[fn->GetFunId()] = makeInfo(*fn);
+    }
+    for (const ASTNode_StringLit *literal : literals) {
+      strings.Add(literal->GetValue());
+    }
+    strings_shared = !writes.foundWrite();
+    const uint32_t pos = static_cast<uint32_t>(strings.Place(14, strings_shared));
+    for (const auto &segment : strings.Segments()) {
+      storeDataString(static_cast<uint32_t>(segment.address), segment.text);
+    }
+    for (size_t i = 0; i < literals.size(); ++i) {
+      literal_pos[literals[i]] = static_cast<uint32_t>(strings.Address(i));
+    }
+    free_mem = high_water = pos;
+  }
+
+  // Run a different definition (e.g., an optimized variant) for a function.
+  void replaceFunction(const ASTNode_Function &fn) {
+    functions[fn.GetFunId()] = makeInfo(fn);
+    // Literals already in the pool keep their place; new ones go after the existing data.
+    std::vector<const ASTNode_StringLit *> literals;
+    collectLiterals(fn, literals);
+    uint32_t pos = free_mem;
+    for (const ASTNode_StringLit *literal : literals) {
+      if (auto address = strings.Find(literal->GetValue())) {
+        literal_pos[literal] = static_cast<uint32_t>(*address);
+      } else {
+        literal_pos[literal] = pos;
+        pos += static_cast<uint32_t>(storeDataString(pos, literal->GetValue()) + 1);
+      }
+    }
+    free_mem = high_water = pos;
+  }
+
+  void setStepLimit(uint64_t limit) { step_limit = limit; }
+  void setDeadline(std::chrono::steady_clock::time_point time) { deadline = time; }
+  void setCallDepthLimit(size_t limit) { call_depth_limit = limit; }
+
+  uint64_t numSteps() const { return steps; }
+  uint32_t memoryHighWater() const { return high_water; }
+
+  // Call a function with argument values; throws Trap if execution traps.
+  Value call(size_t fun_id, const std::vector<Value> &args) {
+    auto it = functions.find(fun_id);
+    if (it == functions.end())
+      throw Trap("call to unknown function '" + symbols.GetName(fun_id) + "'");
+    const FunctionInfo &info = it->second;
+    if (args.size() != info.fn->GetParamIds().size())
+      throw Trap("wrong number of arguments to '" + symbols.GetName(fun_id) + "'");
+    if (++call_depth > call_depth_limit)
+      throw Trap("call stack exhausted");
+    step();
+
+    const size_t old_base = frame_base;
+    const size_t old_first = frame_first_id;
+    frame_base = locals.size();
+    frame_first_id = info.first_id;
+    locals.resize(frame_base + info.num_slots); // Locals start at zero, as in WebAssembly.
+    for (size_t i = 0; i < args.size(); ++i) {
+      local(info.fn->GetParamIds()[i]) = args[i];
+    }
+
+    return_value = Value();
+    exec(info.fn->GetChild(0));
+    const Value result = return_value;
+
+    locals.resize(frame_base);
+    frame_base = old_base;
+    frame_first_id = old_first;
+    --call_depth;
+    return result;
+  }
+
+  // Turn a command-line argument into a value of the given parameter type.
+  Value parseArgument(const std::string &text, const Type &type) {
+    if (type.IsDouble())
+      return Value::Double(std::stod(text));
+    if (type.IsChar())
+      return Value::Int(text.empty() ? 0 : static_cast<unsigned char>(text[0]));
+    if (type.IsString()) {
+      const int32_t str = static_cast<int32_t>(arg_pos);
+      for (char ch : text)
+        store8(arg_pos++, static_cast<uint8_t>(ch));
+      store8(arg_pos++, 0);
+      return Value::Int(str);
+    }
+    size_t pos = 0;
+    const int value = std::stoi(text, &pos);
+    if (pos != text.size())
+      throw std::invalid_argument(text);
+    return Value::Int(value);
+  }
+
+  std::string readString(int32_t addr) const {
+    std::string out;
+    for (uint32_t pos = address(addr); load8(pos) != 0; ++pos)
+      out.push_back(static_cast<char>(load8(pos)));
+    return out;
+  }
+
+  // Render a value of the given type (strings by their contents).
+  std::string format(const Value &value, const Type &type) const {
+    if (type.IsDouble()) {
+      std::array<char, 32> buffer;
+      auto result = std::to_chars(buffer.data(), buffer.data() + buffer.size(), value.d);
+      return std::string(buffer.data(), result.ptr);
+    }
+    if (type.IsChar())
+      return std::string(1, static_cast<char>(value.i));
+    if (type.IsString())
+      return readString(value.i);
+    return std::to_string(value.i);
+  }
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "ASTNode.hpp"
+#include "AnalysisManager.hpp"
 #include "Pass.hpp"
 #include "../core/ASTCloner.hpp"
 #include <cmath>
@@ -28,6 +29,9 @@ private:
   size_t maxUnrollIterations;
   bool enablePeeling;
 
+  const ::LoopInfo *loops = nullptr; // Loop analysis of the tree being processed.
+  bool changed = false;
+
 public:
   LoopUnrollingPass(int factor, bool aggressive = false, bool nested = false,
                     size_t maxIter = 100, bool peeling = false)
@@ -37,31 +41,44 @@ public:
 
   std::string getName() const override { return "LoopUnrolling"; }
 
-  void run(ASTNode &node) override {
+  bool run(ASTNode &node, AnalysisManager &analyses) override {
     if (unrollFactor <= 1) {
-      return;
+      return false;
     }
+    loops = &analyses.getLoops(node);
+    changed = false;
     processNode(node);
+    loops = nullptr;
+    return changed;
+  }
+
+  // Unrolled bodies are clones, so they call the same functions; functions
+  // that are a lone pure return contain no loops and are never touched.
+  PreservedAnalyses preservedAnalyses() const override {
+    return PreservedAnalyses::none().preserve(AnalysisId::CallGraph).preserve(AnalysisId::Purity);
   }
 
 private:
   void processNode(ASTNode &node) {
-    if (auto *function = dynamic_cast<ASTNode_Function *>(&node)) {
-      if (function->NumChildren() > 0 && function->HasChild(0)) {
-        processNode(function->GetChild(0));
+    switch (node.kind()) {
+    case NodeKind::Function: {
+      auto &function = cast<ASTNode_Function>(node);
+      if (function.NumChildren() > 0 && function.HasChild(0)) {
+        processNode(function.GetChild(0));
       }
       return;
     }
 
-    if (auto *block = dynamic_cast<ASTNode_Block *>(&node)) {
-      processBlock(*block);
+    case NodeKind::Block:
+      processBlock(cast<ASTNode_Block>(node));
       return;
-    }
 
-    if (auto *parent = dynamic_cast<ASTNode_Parent *>(&node)) {
-      for (size_t i = 0; i < parent->NumChildren(); ++i) {
-        if (parent->HasChild(i)) {
-          processNode(parent->GetChild(i));
+    default:
+      if (auto *parent = dyn_cast<ASTNode_Parent>(&node)) {
+        for (size_t i = 0; i < parent->NumChildren(); ++i) {
+          if (parent->HasChild(i)) {
+            processNode(parent->GetChild(i));
+          }
         }
       }
     }
@@ -75,7 +92,7 @@ private:
         continue;
 
       ASTNode &child = block.GetChild(i);
-      if (auto *loop = dynamic_cast<ASTNode_While *>(&child)) {
+      if (auto *loop = dyn_cast<ASTNode_While>(&child)) {
         auto info = analyseLoop(*loop);
         if (info && loopEligible(*loop, *info)) {
           auto replacement = buildReplacement(*loop, *info);
@@ -95,10 +112,15 @@ private:
 
     for (auto it = replacements.rbegin(); it != replacements.rend(); ++it) {
       block.ReplaceChild(it->first, std::move(it->second));
+      changed = true;
     }
   }
 
   bool loopEligible(ASTNode_While &loop, const LoopInfo &info) const {
+    if (loop.IsUnrolled()) {
+      // Already the result of unrolling (when the pass is run repeatedly).
+      return false;
+    }
     if (!aggressiveUnrolling && !info.hasLiteralBound) {
       return false;
     }
@@ -113,7 +135,6 @@ private:
     if (!info.hasLiteralBound) {
       return false;
     }
-    (void)loop;
     return true;
   }
 
@@ -122,12 +143,12 @@ private:
       return std::nullopt;
     }
 
-    auto *condition = dynamic_cast<ASTNode_Math2 *>(&loop.GetChild(0));
+    auto *condition = dyn_cast<ASTNode_Math2>(&loop.GetChild(0));
     if (!condition) {
       return std::nullopt;
     }
 
-    auto *body = dynamic_cast<ASTNode_Block *>(&loop.GetChild(1));
+    auto *body = dyn_cast<ASTNode_Block>(&loop.GetChild(1));
     if (!body) {
       return std::nullopt;
     }
@@ -139,10 +160,13 @@ private:
       return std::nullopt;
     }
 
-    if (!unrollNestedLoops && containsNestedLoop(*body)) {
+    const ::LoopInfo::Loop *facts = loops ? loops->find(loop) : nullptr;
+    const bool hasNestedLoop = facts ? facts->hasNestedLoop : containsNestedLoop(*body);
+    const bool hasControlTransfer = facts ? facts->hasControlTransfer : containsControlTransfer(*body);
+    if (!unrollNestedLoops && hasNestedLoop) {
       return std::nullopt;
     }
-    if (containsControlTransfer(*body)) {
+    if (hasControlTransfer) {
       return std::nullopt;
     }
 
@@ -165,27 +189,27 @@ private:
   }
 
   bool extractCondition(ASTNode_Math2 &cond, LoopInfo &info) {
-    const std::string op = const_cast<ASTNode_Math2 &>(cond).GetOp();
+    const OpId op = cond.GetOp();
     bool inclusive = false;
     bool increasing = true;
 
-    if (op == "<") {
+    if (op == OpId::Less) {
       inclusive = false;
       increasing = true;
-    } else if (op == "<=") {
+    } else if (op == OpId::LessEqual) {
       inclusive = true;
       increasing = true;
-    } else if (op == ">") {
+    } else if (op == OpId::Greater) {
       inclusive = false;
       increasing = false;
-    } else if (op == ">=") {
+    } else if (op == OpId::GreaterEqual) {
       inclusive = true;
       increasing = false;
     } else {
       return false;
     }
 
-    auto *leftVar = dynamic_cast<ASTNode_Var *>(&cond.GetChild(0));
+    auto *leftVar = dyn_cast<ASTNode_Var>(&cond.GetChild(0));
     if (!leftVar) {
       return false;
     }
@@ -196,7 +220,7 @@ private:
     info.hasLiteralBound = false;
     info.boundValue = 0;
 
-    if (auto *lit = dynamic_cast<ASTNode_IntLit *>(&cond.GetChild(1))) {
+    if (auto *lit = dyn_cast<ASTNode_IntLit>(&cond.GetChild(1))) {
       info.hasLiteralBound = true;
       info.boundValue = lit->GetValue();
     }
@@ -212,12 +236,12 @@ private:
     for (size_t i = 0; i < body.NumChildren(); ++i) {
       if (!body.HasChild(i))
         continue;
-      auto *assign = dynamic_cast<ASTNode_Math2 *>(&body.GetChild(i));
+      auto *assign = dyn_cast<ASTNode_Math2>(&body.GetChild(i));
       if (!assign)
         continue;
-      if (const_cast<ASTNode_Math2 &>(*assign).GetOp() != "=")
+      if (assign->GetOp() != OpId::Assign)
         continue;
-      auto *lhs = dynamic_cast<ASTNode_Var *>(&assign->GetChild(0));
+      auto *lhs = dyn_cast<ASTNode_Var>(&assign->GetChild(0));
       if (!lhs || lhs->GetVarId() != varId)
         continue;
 
@@ -232,27 +256,27 @@ private:
   }
 
   bool parseIncrement(ASTNode &expr, size_t varId, int &stepOut) {
-    auto *math2 = dynamic_cast<ASTNode_Math2 *>(&expr);
+    auto *math2 = dyn_cast<ASTNode_Math2>(&expr);
     if (!math2 || math2->NumChildren() < 2) {
       return false;
     }
 
-    const std::string op = const_cast<ASTNode_Math2 &>(*math2).GetOp();
-    if (op != "+" && op != "-") {
+    const OpId op = math2->GetOp();
+    if (op != OpId::Add && op != OpId::Sub) {
       return false;
     }
 
-    auto *lhsVar = dynamic_cast<ASTNode_Var *>(&math2->GetChild(0));
-    auto *rhsLit = dynamic_cast<ASTNode_IntLit *>(&math2->GetChild(1));
+    auto *lhsVar = dyn_cast<ASTNode_Var>(&math2->GetChild(0));
+    auto *rhsLit = dyn_cast<ASTNode_IntLit>(&math2->GetChild(1));
     if (lhsVar && lhsVar->GetVarId() == varId && rhsLit) {
       int value = rhsLit->GetValue();
-      stepOut = (op == "+") ? value : -value;
+      stepOut = (op == OpId::Add) ? value : -value;
       return true;
     }
 
-    if (op == "+") {
-      auto *rhsVar = dynamic_cast<ASTNode_Var *>(&math2->GetChild(1));
-      auto *lhsLit = dynamic_cast<ASTNode_IntLit *>(&math2->GetChild(0));
+    if (op == OpId::Add) {
+      auto *rhsVar = dyn_cast<ASTNode_Var>(&math2->GetChild(1));
+      auto *lhsLit = dyn_cast<ASTNode_IntLit>(&math2->GetChild(0));
       if (rhsVar && rhsVar->GetVarId() == varId && lhsLit) {
         stepOut = lhsLit->GetValue();
         return true;
@@ -263,10 +287,10 @@ private:
   }
 
   bool containsNestedLoop(ASTNode &node) const {
-    if (dynamic_cast<ASTNode_While *>(&node)) {
+    if (isa<ASTNode_While>(node)) {
       return true;
     }
-    if (auto *parent = dynamic_cast<ASTNode_Parent *>(&node)) {
+    if (auto *parent = dyn_cast<ASTNode_Parent>(&node)) {
       for (size_t i = 0; i < parent->NumChildren(); ++i) {
         if (parent->HasChild(i) && containsNestedLoop(parent->GetChild(i))) {
           return true;
@@ -277,11 +301,10 @@ private:
   }
 
   bool containsControlTransfer(ASTNode &node) const {
-    if (dynamic_cast<ASTNode_Break *>(&node) || dynamic_cast<ASTNode_Continue *>(&node) ||
-        dynamic_cast<ASTNode_Return *>(&node)) {
+    if (isa<ASTNode_Break>(node) || isa<ASTNode_Continue>(node) || isa<ASTNode_Return>(node)) {
       return true;
     }
-    if (auto *parent = dynamic_cast<ASTNode_Parent *>(&node)) {
+    if (auto *parent = dyn_cast<ASTNode_Parent>(&node)) {
       for (size_t i = 0; i < parent->NumChildren(); ++i) {
         if (parent->HasChild(i) && containsControlTransfer(parent->GetChild(i))) {
           return true;
@@ -293,17 +316,17 @@ private:
 
   int countAssignments(ASTNode &node, size_t varId) const {
     int count = 0;
-    if (auto *assign = dynamic_cast<ASTNode_Math2 *>(&node)) {
-      if (const_cast<ASTNode_Math2 &>(*assign).GetOp() == "=" &&
+    if (auto *assign = dyn_cast<ASTNode_Math2>(&node)) {
+      if (assign->GetOp() == OpId::Assign &&
           assign->NumChildren() >= 1) {
-        if (auto *lhs = dynamic_cast<ASTNode_Var *>(&assign->GetChild(0))) {
+        if (auto *lhs = dyn_cast<ASTNode_Var>(&assign->GetChild(0))) {
           if (lhs->GetVarId() == varId) {
             ++count;
           }
         }
       }
     }
-    if (auto *parent = dynamic_cast<ASTNode_Parent *>(&node)) {
+    if (auto *parent = dyn_cast<ASTNode_Parent>(&node)) {
       for (size_t i = 0; i < parent->NumChildren(); ++i) {
         if (parent->HasChild(i)) {
           count += countAssignments(parent->GetChild(i), varId);
@@ -318,10 +341,12 @@ private:
     auto replacement = std::make_unique<ASTNode_Block>(loop.GetFilePos());
     auto mainLoop = buildMainLoop(loop, info);
     if (mainLoop) {
+      mainLoop->MarkUnrolled();
       replacement->AddChild(std::move(mainLoop));
     }
     auto remainder = ASTCloner::clone(loop);
     if (remainder) {
+      cast<ASTNode_While>(*remainder).MarkUnrolled();
       replacement->AddChild(std::move(remainder));
     }
     return replacement;
@@ -355,25 +380,25 @@ private:
 
     const int stepAbs = std::abs(info.step);
     int adjustment = 0;
-    std::string op;
+    OpId op = OpId::None;
 
     if (info.increasing) {
       if (info.inclusive) {
         adjustment = stepAbs * (unrollFactor - 1);
-        op = "<=";
+        op = OpId::LessEqual;
       } else {
         adjustment = stepAbs * unrollFactor;
-        op = "<=";
+        op = OpId::LessEqual;
       }
       int newBound = info.boundValue - adjustment;
       return makeComparison(originalCond.GetFilePos(), info.varId, op, newBound);
     } else {
       if (info.inclusive) {
         adjustment = stepAbs * (unrollFactor - 1);
-        op = ">=";
+        op = OpId::GreaterEqual;
       } else {
         adjustment = stepAbs * unrollFactor;
-        op = ">";
+        op = OpId::Greater;
       }
       int newBound = info.boundValue + adjustment;
       return makeComparison(originalCond.GetFilePos(), info.varId, op, newBound);
@@ -413,64 +438,61 @@ private:
 
   std::unique_ptr<ASTNode> cloneWithOffset(const ASTNode &node, size_t varId,
                                            int offset) {
-    if (auto *var = dynamic_cast<const ASTNode_Var *>(&node)) {
-      if (offset == 0 || var->GetVarId() != varId) {
-        return std::make_unique<ASTNode_Var>(node.GetFilePos(), var->GetVarId());
-      }
-      auto base = std::make_unique<ASTNode_Var>(node.GetFilePos(), var->GetVarId());
-      auto absValue = std::make_unique<ASTNode_IntLit>(node.GetFilePos(), std::abs(offset));
-      std::string op = offset > 0 ? "+" : "-";
-      if (offset < 0) {
-        absValue = std::make_unique<ASTNode_IntLit>(node.GetFilePos(), std::abs(offset));
-      }
-      return std::make_unique<ASTNode_Math2>(node.GetFilePos(), op, std::move(base),
-                                             std::move(absValue));
-    }
-
-    if (auto *lit = dynamic_cast<const ASTNode_IntLit *>(&node)) {
-      return std::make_unique<ASTNode_IntLit>(node.GetFilePos(), lit->GetValue());
-    }
-    if (auto *lit = dynamic_cast<const ASTNode_FloatLit *>(&node)) {
-      return std::make_unique<ASTNode_FloatLit>(node.GetFilePos(), lit->GetValue());
-    }
-    if (auto *lit = dynamic_cast<const ASTNode_StringLit *>(&node)) {
-      return std::make_unique<ASTNode_StringLit>(node.GetFilePos(), lit->GetValue());
-    }
+    const FilePos pos = node.GetFilePos();
 
-    if (auto *m1 = dynamic_cast<const ASTNode_Math1 *>(&node)) {
-      auto child = cloneWithOffset(m1->GetChild(0), varId, offset);
+    switch (node.kind()) {
+    case NodeKind::Var: {
+      const auto &var = cast<ASTNode_Var>(node);
+      if (offset == 0 || var.GetVarId() != varId) {
+        return std::make_unique<ASTNode_Var>(pos, var.GetVarId());
+      }
+      auto base = std::make_unique<ASTNode_Var>(pos, var.GetVarId());
+      auto absValue = std::make_unique<ASTNode_IntLit>(pos, std::abs(offset));
+      OpId op = offset > 0 ? OpId::Add : OpId::Sub;
+      return std::make_unique<ASTNode_Math2>(pos, op, std::move(base), std::move(absValue));
+    }
+
+    case NodeKind::IntLit:
+      return std::make_unique<ASTNode_IntLit>(pos, cast<ASTNode_IntLit>(node).GetValue());
+    case NodeKind::FloatLit:
+      return std::make_unique<ASTNode_FloatLit>(pos, cast<ASTNode_FloatLit>(node).GetValue());
+    case NodeKind::StringLit:
+      return std::make_unique<ASTNode_StringLit>(pos, cast<ASTNode_StringLit>(node).GetValue());
+
+    case NodeKind::Math1: {
+      const auto &m1 = cast<ASTNode_Math1>(node);
+      auto child = cloneWithOffset(m1.GetChild(0), varId, offset);
       if (!child)
         return nullptr;
-      return std::make_unique<ASTNode_Math1>(node.GetFilePos(),
-                                             const_cast<ASTNode_Math1 *>(m1)->GetOp(),
-                                             std::move(child));
+      return std::make_unique<ASTNode_Math1>(pos, m1.GetOp(), std::move(child));
     }
 
-    if (auto *m2 = dynamic_cast<const ASTNode_Math2 *>(&node)) {
-      auto left = cloneWithOffset(m2->GetChild(0), varId, offset);
-      auto right = cloneWithOffset(m2->GetChild(1), varId, offset);
+    case NodeKind::Math2: {
+      const auto &m2 = cast<ASTNode_Math2>(node);
+      auto left = cloneWithOffset(m2.GetChild(0), varId, offset);
+      auto right = cloneWithOffset(m2.GetChild(1), varId, offset);
       if (!left || !right)
         return nullptr;
-      return std::make_unique<ASTNode_Math2>(node.GetFilePos(),
-                                             const_cast<ASTNode_Math2 *>(m2)->GetOp(),
-                                             std::move(left), std::move(right));
+      return std::make_unique<ASTNode_Math2>(pos, m2.GetOp(), std::move(left), std::move(right));
     }
 
-    if (auto *ret = dynamic_cast<const ASTNode_Return *>(&node)) {
-      if (!ret->NumChildren() || !ret->HasChild(0))
+    case NodeKind::Return: {
+      const auto &ret = cast<ASTNode_Return>(node);
+      if (!ret.NumChildren() || !ret.HasChild(0))
         return ASTCloner::clone(node);
-      auto child = cloneWithOffset(ret->GetChild(0), varId, offset);
+      auto child = cloneWithOffset(ret.GetChild(0), varId, offset);
       if (!child)
         return nullptr;
-      return std::make_unique<ASTNode_Return>(node.GetFilePos(), std::move(child));
+      return std::make_unique<ASTNode_Return>(pos, std::move(child));
     }
 
-    if (auto *block = dynamic_cast<const ASTNode_Block *>(&node)) {
-      auto clone = std::make_unique<ASTNode_Block>(node.GetFilePos());
-      for (size_t i = 0; i < block->NumChildren(); ++i) {
-        if (!block->HasChild(i))
+    case NodeKind::Block: {
+      const auto &block = cast<ASTNode_Block>(node);
+      auto clone = std::make_unique<ASTNode_Block>(pos);
+      for (size_t i = 0; i < block.NumChildren(); ++i) {
+        if (!block.HasChild(i))
           continue;
-        auto child = cloneWithOffset(block->GetChild(i), varId, offset);
+        auto child = cloneWithOffset(block.GetChild(i), varId, offset);
         if (!child)
           return nullptr;
         clone->AddChild(std::move(child));
@@ -478,83 +500,86 @@ private:
       return clone;
     }
 
-    if (auto *call = dynamic_cast<const ASTNode_FunctionCall *>(&node)) {
+    case NodeKind::FunctionCall: {
+      const auto &call = cast<ASTNode_FunctionCall>(node);
       std::vector<std::unique_ptr<ASTNode>> args;
-      args.reserve(call->NumChildren());
-      for (size_t i = 0; i < call->NumChildren(); ++i) {
-        if (!call->HasChild(i))
+      args.reserve(call.NumChildren());
+      for (size_t i = 0; i < call.NumChildren(); ++i) {
+        if (!call.HasChild(i))
           continue;
-        auto arg = cloneWithOffset(call->GetChild(i), varId, offset);
+        auto arg = cloneWithOffset(call.GetChild(i), varId, offset);
         if (!arg)
           return nullptr;
         args.push_back(std::move(arg));
       }
-      return std::make_unique<ASTNode_FunctionCall>(node.GetFilePos(), call->GetFunId(),
-                                                    std::move(args));
+      return std::make_unique<ASTNode_FunctionCall>(pos, call.GetFunId(), std::move(args));
     }
 
-    if (auto *idx = dynamic_cast<const ASTNode_Indexing *>(&node)) {
-      auto base = cloneWithOffset(idx->GetChild(0), varId, offset);
-      auto sub = cloneWithOffset(idx->GetChild(1), varId, offset);
+    case NodeKind::Indexing: {
+      const auto &idx = cast<ASTNode_Indexing>(node);
+      auto base = cloneWithOffset(idx.GetChild(0), varId, offset);
+      auto sub = cloneWithOffset(idx.GetChild(1), varId, offset);
       if (!base || !sub)
         return nullptr;
-      return std::make_unique<ASTNode_Indexing>(node.GetFilePos(), std::move(base),
-                                                std::move(sub));
+      return std::make_unique<ASTNode_Indexing>(pos, std::move(base), std::move(sub));
     }
 
-    if (auto *sz = dynamic_cast<const ASTNode_Size *>(&node)) {
-      auto arg = cloneWithOffset(sz->GetChild(0), varId, offset);
+    case NodeKind::Size: {
+      auto arg = cloneWithOffset(cast<ASTNode_Size>(node).GetChild(0), varId, offset);
       if (!arg)
         return nullptr;
-      return std::make_unique<ASTNode_Size>(node.GetFilePos(), std::move(arg));
+      return std::make_unique<ASTNode_Size>(pos, std::move(arg));
     }
 
-    if (auto *conv = dynamic_cast<const ASTNode_ToDouble *>(&node)) {
-      auto child = cloneWithOffset(conv->GetChild(0), varId, offset);
+    case NodeKind::ToDouble: {
+      auto child = cloneWithOffset(cast<ASTNode_ToDouble>(node).GetChild(0), varId, offset);
       if (!child)
         return nullptr;
       return std::make_unique<ASTNode_ToDouble>(std::move(child));
     }
 
-    if (auto *conv = dynamic_cast<const ASTNode_ToInt *>(&node)) {
-      auto child = cloneWithOffset(conv->GetChild(0), varId, offset);
+    case NodeKind::ToInt: {
+      auto child = cloneWithOffset(cast<ASTNode_ToInt>(node).GetChild(0), varId, offset);
       if (!child)
         return nullptr;
       return std::make_unique<ASTNode_ToInt>(std::move(child));
     }
 
-    if (auto *conv = dynamic_cast<const ASTNode_ToString *>(&node)) {
-      auto child = cloneWithOffset(conv->GetChild(0), varId, offset);
+    case NodeKind::ToString: {
+      auto child = cloneWithOffset(cast<ASTNode_ToString>(node).GetChild(0), varId, offset);
       if (!child)
         return nullptr;
       return std::make_unique<ASTNode_ToString>(std::move(child));
     }
 
-    if (auto *iff = dynamic_cast<const ASTNode_If *>(&node)) {
-      auto cond = cloneWithOffset(iff->GetChild(0), varId, offset);
+    case NodeKind::If: {
+      const auto &iff = cast<ASTNode_If>(node);
+      auto cond = cloneWithOffset(iff.GetChild(0), varId, offset);
       if (!cond)
         return nullptr;
-      if (iff->NumChildren() == 2) {
-        auto thenBranch = cloneWithOffset(iff->GetChild(1), varId, offset);
+      if (iff.NumChildren() == 2) {
+        auto thenBranch = cloneWithOffset(iff.GetChild(1), varId, offset);
         if (!thenBranch)
           return nullptr;
-        return std::make_unique<ASTNode_If>(node.GetFilePos(), std::move(cond),
-                                            std::move(thenBranch));
-      } else if (iff->NumChildren() == 3) {
-        auto thenBranch = cloneWithOffset(iff->GetChild(1), varId, offset);
-        auto elseBranch = cloneWithOffset(iff->GetChild(2), varId, offset);
+        return std::make_unique<ASTNode_If>(pos, std::move(cond), std::move(thenBranch));
+      } else if (iff.NumChildren() == 3) {
+        auto thenBranch = cloneWithOffset(iff.GetChild(1), varId, offset);
+        auto elseBranch = cloneWithOffset(iff.GetChild(2), varId, offset);
         if (!thenBranch || !elseBranch)
           return nullptr;
-        return std::make_unique<ASTNode_If>(node.GetFilePos(), std::move(cond),
-                                            std::move(thenBranch), std::move(elseBranch));
+        return std::make_unique<ASTNode_If>(pos, std::move(cond), std::move(thenBranch),
+                                            std::move(elseBranch));
       }
+      return ASTCloner::clone(node);
     }
 
-    return ASTCloner::clone(node);
+    default:
+      return ASTCloner::clone(node);
+    }
   }
 
   std::unique_ptr<ASTNode> makeComparison(FilePos pos, size_t varId,
-                                          const std::string &op, int bound) {
+                                          OpId op, int bound) {
     auto lhs = std::make_unique<ASTNode_Var>(pos, varId);
     auto rhs = std::make_unique<ASTNode_IntLit>(pos, bound);
     return std::make_unique<ASTNode_Math2>(pos, op, std::move(lhs), std::move(rhs));
@@ -564,12 +589,12 @@ private:
     auto lhs = std::make_unique<ASTNode_Var>(pos, varId);
     auto base = std::make_unique<ASTNode_Var>(pos, varId);
     auto stepLit = std::make_unique<ASTNode_IntLit>(pos, std::abs(delta));
-    std::string op = delta >= 0 ? "+" : "-";
+    OpId op = delta >= 0 ? OpId::Add : OpId::Sub;
     if (delta < 0) {
       stepLit = std::make_unique<ASTNode_IntLit>(pos, std::abs(delta));
     }
     auto rhs =
         std::make_unique<ASTNode_Math2>(pos, op, std::move(base), std::move(stepLit));
-    return std::make_unique<ASTNode_Math2>(pos, "=", std::move(lhs), std::move(rhs));
+    return std::make_unique<ASTNode_Math2>(pos, OpId::Assign, std::move(lhs), std::move(rhs));
   }
 };
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <algorithm>
+#include <unordered_set>
+#include <vector>
+
+#include "CallGraph.hpp"
+#include "StringFreeFunctions.hpp"
+#include "SymbolTable.hpp"
+
+// Choose functions to memoize (--memoize).  A function qualifies if
+//  - it takes one to MAX_PARAMS int or char parameters and returns an int,
+//    char, or double, so calls can be keyed on a few i32 values;
+//  - it is pure: it never touches a string (see StringFreeFunctions);
+//  - it calls itself at least twice, so recursive calls overlap (a single
+//    self call, as in a tail-recursive loop, never repeats an argument).
+// Code generation then gives each one a direct-mapped table of results in
+// linear memory (see ASTNode_Function::ToWAT_Memoized).
+class Memoizer {
+public:
+  static constexpr size_t MAX_PARAMS = 4;
+
+private:
+  static bool HasMemoSignature(const ASTNode_Function &fun, const SymbolTable &symbols) {
+    const auto &param_ids = fun.GetParamIds();
+    if (param_ids.empty() || param_ids.size() > MAX_PARAMS)
+      return false;
+    for (size_t id : param_ids) {
+      const Type &type = symbols.GetType(id);
+      if (!type.IsInt() && !type.IsChar())
+        return false;
+    }
+    const Type return_type = symbols.GetType(fun.GetFunId()).ReturnType();
+    return return_type.IsInt() || return_type.IsChar() || return_type.IsDouble();
+  }
+
+public:
+  // Returns the functions to memoize, in program order.
+  static std::vector<ASTNode_Function *> FindCandidates(const std::vector<ASTNode_Function *> &functions,
+                                                        const SymbolTable &symbols) {
+    const std::unordered_set<size_t> pure = StringFreeFunctions::Find(functions, symbols);
+    std::vector<ASTNode_Function *> out;
+    for (ASTNode_Function *fun : functions) {
+      if (!pure.count(fun->GetFunId()) || !HasMemoSignature(*fun, symbols))
+        continue;
+      CallFinder finder;
+      finder.dispatch(*fun);
+      const auto &calls = finder.getCalls();
+      const auto self_calls = std::count_if(calls.begin(), calls.end(), [fun](const ASTNode_FunctionCall *call) {
+        return call->GetFunId() == fun->GetFunId();
+      });
+      if (self_calls >= 2)
+        out.push_back(fun);
+    }
+    return out;
+  }
+};
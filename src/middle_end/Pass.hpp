@@ -4,11 +4,20 @@
 #include <string>
 #include <vector>
 
+#include "AnalysisManager.hpp"
+
 class ASTNode;
 
 class Pass {
 public:
   virtual ~Pass() = default;
   virtual std::string getName() const = 0;
-  virtual void run(ASTNode &node) = 0;
+
+  // Transform the tree under node and return whether anything changed;
+  // analyses are cached for that same tree.
+  virtual bool run(ASTNode &node, AnalysisManager &analyses) = 0;
+
+  // Analyses that remain valid after this pass has changed the tree; the
+  // PassManager drops all others from the cache.
+  virtual PreservedAnalyses preservedAnalyses() const { return PreservedAnalyses::none(); }
 };
@@ -1,23 +1,207 @@
 #pragma once
 
+#include "AnalysisManager.hpp"
 #include "Pass.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <assert.h>
+#include <chrono>
+#include <iomanip>
 #include <memory>
+#include <ostream>
 #include <vector>
 
+// Timing and size information for one pass in a pipeline.
+struct PassStats {
+  std::string name;
+  size_t runs = 0;
+  double seconds = 0.0;   // Wall time spent in the pass.
+  size_t nodesBefore = 0; // AST nodes when the pass started...
+  size_t nodesAfter = 0;  // ...and when it finished (summed over runs).
+  size_t analysesComputed = 0; // Analyses the pass requested that had to be computed...
+  size_t analysesCached = 0;   // ...and that were served from the cache.
+};
+
+// Runs a pipeline of passes over a tree.
+//
+// Passes may be grouped to run repeatedly until a full round of the group
+// changes nothing, e.g. the pipeline "(inline,unroll)*,tail":
+//   passManager.beginFixedPoint();
+//   passManager.addPass(inlinePass);
+//   passManager.addPass(unrollPass);
+//   passManager.endFixedPoint();
+//   passManager.addPass(tailPass);
+// Each group is also limited to a number of rounds, and stops early once the
+// tree has grown past a multiple of its size at the start of the pipeline.
 class PassManager {
 private:
-  std::vector<std::unique_ptr<Pass>> passes;
+  // A pipeline step: either a single pass, or a group of steps to repeat.
+  struct Step {
+    std::unique_ptr<Pass> pass = nullptr;
+    size_t statsId = 0;         // Index into stats (for passes).
+    std::vector<Step> group{};  // Steps to repeat (for groups).
+  };
+
+  std::vector<Step> steps;
+  std::vector<std::vector<Step> *> openGroups; // Groups being built, innermost last.
+  bool hasFixedPoint = false;
+  AnalysisManager analyses;
+
+  size_t maxIterations = 8; // Rounds allowed per repeated group.
+  double maxGrowth = 4.0;   // Node count allowed, relative to the starting tree.
+  size_t nodeBudget = 0;
+
+  bool timePasses = false;
+  std::vector<PassStats> stats; // One entry per pass, in pipeline order.
+
+  std::vector<Step> &currentSteps() { return openGroups.empty() ? steps : *openGroups.back(); }
+
+  bool runSteps(std::vector<Step> &list, ASTNode &root) {
+    bool changed = false;
+    for (Step &step : list) {
+      if (step.pass) {
+        changed |= runStep(step, root);
+      } else {
+        changed |= runFixedPoint(step.group, root);
+      }
+    }
+    return changed;
+  }
+
+  bool runFixedPoint(std::vector<Step> &group, ASTNode &root) {
+    bool changed = false;
+    for (size_t round = 0; round < maxIterations; ++round) {
+      if (!runSteps(group, root)) {
+        break;
+      }
+      changed = true;
+      if (analyses.getNodeCount(root) > nodeBudget) {
+        break;
+      }
+    }
+    return changed;
+  }
+
+  bool runStep(Step &step, ASTNode &root) {
+    TUBULAR_TRACE_SCOPE(step.pass->getName());
+    if (!timePasses) {
+      return runPass(*step.pass, root);
+    }
+
+    PassStats &passStats = stats[step.statsId];
+    passStats.nodesBefore += analyses.getNodeCount(root);
+    const size_t computedBefore = analyses.numComputed();
+    const size_t cachedBefore = analyses.numCached();
+    const auto start = std::chrono::steady_clock::now();
+    const bool changed = runPass(*step.pass, root);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    passStats.seconds += elapsed.count();
+    passStats.analysesComputed += analyses.numComputed() - computedBefore;
+    passStats.analysesCached += analyses.numCached() - cachedBefore;
+    passStats.nodesAfter += analyses.getNodeCount(root);
+    ++passStats.runs;
+    return changed;
+  }
 
 public:
   void addPass(std::unique_ptr<Pass> pass) {
-    passes.push_back(std::move(pass));
+    stats.push_back(PassStats{pass->getName()});
+    currentSteps().push_back(Step{std::move(pass), stats.size() - 1});
+  }
+
+  // Passes added until the matching endFixedPoint() form a repeated group.
+  void beginFixedPoint() {
+    auto &list = currentSteps();
+    list.push_back(Step{});
+    openGroups.push_back(&list.back().group);
+    hasFixedPoint = true;
   }
 
-  void runPasses(class ASTNode &root) {
-    for (auto &pass : passes) {
-      pass->run(root);
+  void endFixedPoint() {
+    assert(!openGroups.empty());
+    openGroups.pop_back();
+  }
+
+  // Limit how often each group repeats, and how large (relative to the
+  // starting tree) the tree may grow before groups stop repeating.
+  void setFixedPointBudget(size_t iterations, double growth) {
+    maxIterations = iterations;
+    maxGrowth = growth;
+  }
+
+  // Collect wall time and node counts for every pass that runs.
+  void setTimePasses(bool enabled) { timePasses = enabled; }
+  const std::vector<PassStats> &getStats() const { return stats; }
+
+  // Run the whole pipeline; return whether any pass changed the tree.
+  bool runPasses(class ASTNode &root) {
+    assert(openGroups.empty());
+    if (hasFixedPoint) {
+      nodeBudget = static_cast<size_t>(static_cast<double>(analyses.getNodeCount(root)) * maxGrowth);
+    }
+    return runSteps(steps, root);
+  }
+
+  // Run a single pass; analyses it does not preserve are dropped if it
+  // changed the tree.
+  bool runPass(Pass &pass, ASTNode &root) {
+    const bool changed = pass.run(root, analyses);
+    if (changed) {
+      analyses.invalidate(pass.preservedAnalyses());
+    }
+    return changed;
+  }
+};
+
+// Totals of PassStats across many pipelines (e.g., one per function), for
+// --time-passes.
+class PassTimingReport {
+private:
+  std::vector<PassStats> totals;
+
+public:
+  // Add in the stats from one pipeline.  Passes are matched up by name, so
+  // pipelines may hold their passes in different orders.
+  void merge(const std::vector<PassStats> &stats) {
+    for (const PassStats &passStats : stats) {
+      auto it = std::find_if(totals.begin(), totals.end(),
+                             [&](const PassStats &total) { return total.name == passStats.name; });
+      if (it == totals.end()) {
+        totals.push_back(PassStats{passStats.name});
+        it = totals.end() - 1;
+      }
+      it->runs += passStats.runs;
+      it->seconds += passStats.seconds;
+      it->nodesBefore += passStats.nodesBefore;
+      it->nodesAfter += passStats.nodesAfter;
+      it->analysesComputed += passStats.analysesComputed;
+      it->analysesCached += passStats.analysesCached;
     }
   }
 
-  void runPass(Pass &pass, ASTNode &root) { pass.run(root); }
+  const std::vector<PassStats> &getTotals() const { return totals; }
+
+  void print(std::ostream &os, double totalSeconds) const {
+    os << "===== Pass execution timing report =====\n";
+    os << "  Total optimization wall time: " << std::fixed << std::setprecision(3) << totalSeconds * 1000.0
+       << " ms\n";
+    os << "  " << std::left << std::setw(20) << "Pass" << std::right << std::setw(8) << "Runs" << std::setw(12)
+       << "Wall (ms)" << std::setw(14) << "Nodes before" << std::setw(13) << "Nodes after" << std::setw(10)
+       << "Analyses" << std::setw(8) << "Cached" << "\n";
+    PassStats sum{"Total"};
+    for (const PassStats &stats : totals) {
+      os << "  " << std::left << std::setw(20) << stats.name << std::right << std::setw(8) << stats.runs
+         << std::setw(12) << stats.seconds * 1000.0 << std::setw(14) << stats.nodesBefore << std::setw(13)
+         << stats.nodesAfter << std::setw(10) << stats.analysesComputed << std::setw(8) << stats.analysesCached
+         << "\n";
+      sum.runs += stats.runs;
+      sum.seconds += stats.seconds;
+      sum.analysesComputed += stats.analysesComputed;
+      sum.analysesCached += stats.analysesCached;
+    }
+    os << "  " << std::left << std::setw(20) << sum.name << std::right << std::setw(8) << sum.runs << std::setw(12)
+       << sum.seconds * 1000.0 << std::setw(37) << sum.analysesComputed << std::setw(8) << sum.analysesCached
+       << "\n";
+    os << std::defaultfloat << std::flush;
+  }
 };
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <bitset>
+#include <cstddef>
+#include <initializer_list>
+#include <string_view>
+
+// Runtime helper functions that generated code can call.  Code generation
+// records each helper it calls (Control::CallHelper), and the module then
+// includes only those helpers and the ones they call in turn.
+enum class RuntimeHelper {
+  AllocStr,
+  Strlen,
+  Memcpy,
+  Strcat,
+  ConcatN,
+  Swap,
+  RepeatString,
+  Int2String,
+  StrEq,
+  StrCmp,
+  COUNT
+};
+
+using RuntimeHelperSet = std::bitset<static_cast<size_t>(RuntimeHelper::COUNT)>;
+
+constexpr size_t HelperIndex(RuntimeHelper helper) { return static_cast<size_t>(helper); }
+
+// The helper's WAT function name (without the '$').
+constexpr std::string_view HelperName(RuntimeHelper helper) {
+  switch (helper) {
+  case RuntimeHelper::AllocStr:
+    return "_alloc_str";
+  case RuntimeHelper::Strlen:
+    return "_strlen";
+  case RuntimeHelper::Memcpy:
+    return "_memcpy";
+  case RuntimeHelper::Strcat:
+    return "_strcat";
+  case RuntimeHelper::ConcatN:
+    return "_concat_n";
+  case RuntimeHelper::Swap:
+    return "_swap";
+  case RuntimeHelper::RepeatString:
+    return "_repeat_string";
+  case RuntimeHelper::Int2String:
+    return "_int2string";
+  case RuntimeHelper::StrEq:
+    return "_str_eq";
+  case RuntimeHelper::StrCmp:
+    return "_str_cmp";
+  case RuntimeHelper::COUNT:
+    break;
+  }
+  return "";
+}
+
+// Add every helper called by a helper in the set, directly or indirectly.
+inline RuntimeHelperSet WithHelperCallees(RuntimeHelperSet helpers) {
+  auto add_if = [&helpers](RuntimeHelper caller, std::initializer_list<RuntimeHelper> callees) {
+    if (!helpers.test(HelperIndex(caller)))
+      return;
+    for (RuntimeHelper callee : callees)
+      helpers.set(HelperIndex(callee));
+  };
+  // Callers come before their callees, so one sweep reaches them all.
+  add_if(RuntimeHelper::Int2String, {RuntimeHelper::AllocStr, RuntimeHelper::Strcat});
+  add_if(RuntimeHelper::RepeatString, {RuntimeHelper::Strlen, RuntimeHelper::AllocStr, RuntimeHelper::Memcpy});
+  add_if(RuntimeHelper::ConcatN, {RuntimeHelper::Strlen, RuntimeHelper::AllocStr});
+  add_if(RuntimeHelper::Strcat, {RuntimeHelper::Strlen, RuntimeHelper::AllocStr, RuntimeHelper::Memcpy});
+  return helpers;
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include "ASTNode.hpp"
+#include "Pass.hpp"
+#include "StringPool.hpp"
+#include <climits>
+#include <memory>
+#include <optional>
+#include <string>
+
+// Evaluate string expressions over literals at compile time: concatenation,
+// repetition, comparison, size(), and int or char literals cast to string.
+// String results are new literals, which the StringPool places in the data
+// segment.
+//
+// Example:
+//   ("[" + "core" + "]") * 2   ->  "[core][core]"
+//   size("hello")              ->  5
+//
+// Runs after inlining, so calls with literal arguments (Wrap("x", "*")) fold
+// too.  A folded expression yields the same memory every time it is
+// evaluated, where the runtime helpers allocate a fresh string, so folding is
+// only enabled for programs that never write into a string through an index.
+class StringFoldingPass : public Pass {
+public:
+  static constexpr size_t MAX_FOLDED_SIZE = 1024; // Longer results are still built at run time.
+
+private:
+  bool enabled;
+  bool changed = false;
+
+public:
+  explicit StringFoldingPass(bool enabled) : enabled(enabled) {}
+
+  std::string getName() const override { return "StringFolding"; }
+
+  bool run(ASTNode &node, AnalysisManager &) override {
+    if (!enabled)
+      return false;
+    changed = false;
+    foldChildren(node);
+    return changed;
+  }
+
+private:
+  // Fold bottom-up, so a whole constant expression collapses in one run.
+  void foldChildren(ASTNode &node) {
+    if (auto *parent = dyn_cast<ASTNode_Parent>(&node)) {
+      for (size_t i = 0; i < parent->NumChildren(); ++i) {
+        if (!parent->HasChild(i))
+          continue;
+        foldChildren(parent->GetChild(i));
+        if (auto folded = fold(parent->GetChild(i))) {
+          parent->ReplaceChild(i, std::move(folded));
+          changed = true;
+        }
+      }
+    } else if (auto *loop = dyn_cast<ASTNode_TailCallLoop>(&node)) {
+      for (size_t i = 0; i < loop->NumArgs(); ++i) {
+        if (!loop->HasArg(i))
+          continue;
+        foldChildren(loop->GetArg(i));
+        if (auto folded = fold(loop->GetArg(i))) {
+          loop->ReplaceArg(i, std::move(folded));
+          changed = true;
+        }
+      }
+    }
+  }
+
+  // The bytes of a string literal, unless it holds a null byte (the runtime
+  // helpers would stop there, so it is left for them).
+  static std::optional<std::string> literalBytes(const ASTNode &node) {
+    const auto *lit = dyn_cast<ASTNode_StringLit>(&node);
+    if (!lit)
+      return std::nullopt;
+    std::string bytes = StringPool::Decode(lit->GetValue());
+    if (bytes.find('\0') != std::string::npos)
+      return std::nullopt;
+    return bytes;
+  }
+
+  static std::unique_ptr<ASTNode> makeString(FilePos pos, const std::string &bytes) {
+    return std::make_unique<ASTNode_StringLit>(pos, StringPool::Encode(bytes));
+  }
+
+  std::unique_ptr<ASTNode> fold(const ASTNode &node) const {
+    switch (node.kind()) {
+    case NodeKind::Math2:
+      return foldMath2(cast<ASTNode_Math2>(node));
+
+    case NodeKind::Size:
+      if (auto bytes = literalBytes(cast<ASTNode_Size>(node).GetChild(0)))
+        return std::make_unique<ASTNode_IntLit>(node.GetFilePos(), static_cast<int>(bytes->size()));
+      return nullptr;
+
+    case NodeKind::ToString: {
+      const ASTNode &child = cast<ASTNode_ToString>(node).GetChild(0);
+      if (const auto *lit = dyn_cast<ASTNode_IntLit>(&child)) {
+        if (lit->GetValue() == INT_MIN) // $_int2string cannot negate it.
+          return nullptr;
+        return makeString(node.GetFilePos(), std::to_string(lit->GetValue()));
+      }
+      if (const auto *lit = dyn_cast<ASTNode_CharLit>(&child)) {
+        const char ch = static_cast<char>(lit->GetValue());
+        return makeString(node.GetFilePos(), ch ? std::string(1, ch) : std::string());
+      }
+      return nullptr;
+    }
+
+    default:
+      return nullptr;
+    }
+  }
+
+  std::unique_ptr<ASTNode> foldMath2(const ASTNode_Math2 &node) const {
+    const OpId op = node.GetOp();
+    if (op != OpId::Add && op != OpId::Mult && !node.IsComparison())
+      return nullptr;
+    auto lhs = literalBytes(node.GetChild(0));
+    if (!lhs)
+      return nullptr;
+
+    if (node.IsComparison()) {
+      auto rhs = literalBytes(node.GetChild(1));
+      if (!rhs)
+        return nullptr;
+      const int order = lhs->compare(*rhs); // Bytewise, as unsigned chars ($_str_cmp agrees).
+      bool result = false;
+      switch (op) {
+      case OpId::Less:
+        result = order < 0;
+        break;
+      case OpId::LessEqual:
+        result = order <= 0;
+        break;
+      case OpId::Greater:
+        result = order > 0;
+        break;
+      case OpId::GreaterEqual:
+        result = order >= 0;
+        break;
+      case OpId::Equal:
+        result = order == 0;
+        break;
+      default:
+        result = order != 0;
+        break;
+      }
+      return std::make_unique<ASTNode_IntLit>(node.GetFilePos(), result ? 1 : 0);
+    }
+
+    if (op == OpId::Add) {
+      auto rhs = literalBytes(node.GetChild(1));
+      if (!rhs || lhs->size() + rhs->size() > MAX_FOLDED_SIZE)
+        return nullptr;
+      return makeString(node.GetFilePos(), *lhs + *rhs);
+    }
+
+    const auto *count = dyn_cast<ASTNode_IntLit>(&node.GetChild(1));
+    if (!count || count->GetValue() < 0)
+      return nullptr;
+    const size_t times = static_cast<size_t>(count->GetValue());
+    if (!lhs->empty() && times > MAX_FOLDED_SIZE / lhs->size())
+      return nullptr;
+    std::string out;
+    out.reserve(lhs->size() * times);
+    for (size_t i = 0; i < times; ++i)
+      out += *lhs;
+    return makeString(node.GetFilePos(), out);
+  }
+};
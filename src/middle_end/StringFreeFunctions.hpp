@@ -0,0 +1,77 @@
+#pragma once
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "ASTWalker.hpp"
+#include "SymbolTable.hpp"
+
+// Find the functions that never touch a string: nothing in them has string
+// type, and they call only other such functions.  Strings are the only memory
+// a program can allocate or write, so these functions keep all of their state
+// in locals.  A call's result then depends only on its arguments, and making
+// the call has no other effect.
+class StringFreeFunctions {
+private:
+  // Does anything in the tree have string type, and which functions does it call?
+  struct BodyScan : ASTWalker<BodyScan, void, true> {
+    const SymbolTable &symbols;
+    bool uses_strings = false;
+    std::vector<size_t> callees{};
+
+    BodyScan(const SymbolTable &symbols) : symbols(symbols) {}
+
+    void visitNode(const ASTNode &node) {
+      if (node.ReturnType(symbols).IsString())
+        uses_strings = true;
+    }
+    void visitParent(const ASTNode_Parent &node) {
+      visitNode(node);
+      walkChildren(node);
+    }
+    void visitFunction(const ASTNode_Function &node) { walkChildren(node); }
+    void visitFunctionCall(const ASTNode_FunctionCall &node) {
+      callees.push_back(node.GetFunId());
+      visitParent(node);
+    }
+    void visitTailCallLoop(const ASTNode_TailCallLoop &node) {
+      for (size_t i = 0; i < node.NumArgs(); ++i) {
+        if (node.HasArg(i))
+          dispatch(node.GetArg(i));
+      }
+    }
+  };
+
+public:
+  // Returns the ids of the qualifying functions.
+  static std::unordered_set<size_t> Find(const std::vector<ASTNode_Function *> &functions,
+                                         const SymbolTable &symbols) {
+    std::unordered_map<size_t, std::vector<size_t>> callees; // Function id -> ids it calls.
+    std::unordered_set<size_t> found;
+    for (const ASTNode_Function *fun : functions) {
+      BodyScan scan(symbols);
+      scan.dispatch(*fun);
+      if (!scan.uses_strings)
+        found.insert(fun->GetFunId());
+      callees.emplace(fun->GetFunId(), std::move(scan.callees));
+    }
+
+    // A function that calls one outside the set leaves it; repeat until stable.
+    for (bool changed = true; changed;) {
+      changed = false;
+      for (const auto &[fun_id, called] : callees) {
+        if (!found.count(fun_id))
+          continue;
+        for (size_t callee : called) {
+          if (!found.count(callee)) {
+            found.erase(fun_id);
+            changed = true;
+            break;
+          }
+        }
+      }
+    }
+    return found;
+  }
+};
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Lays out string literals in the data segment, giving identical literals one
+// copy and letting a literal that ends another share its bytes.
+//
+// Example usage:
+//   StringPool pool;
+//   size_t a = pool.Add("hello");     // Texts are as written in the source, with escapes.
+//   size_t b = pool.Add("lo");
+//   size_t end = pool.Place(14, true); // "lo" lives inside "hello": Address(b) == Address(a) + 3.
+//   for (const auto &segment : pool.Segments()) ...emit (data (i32.const address) "text\00")...
+//
+// Strings are null-terminated, so a literal can point into the tail of any
+// literal that ends with the same bytes.  Sharing is only safe when no string
+// is modified in place; with share set to false every added literal gets its
+// own copy, in the order added.
+class StringPool {
+public:
+  struct Segment {
+    size_t address;
+    std::string text; // As written in the source (escapes intact).
+  };
+
+private:
+  std::vector<std::string> texts{};     // Every added literal, in order.
+  std::vector<size_t> addresses{};      // Parallel to texts, once placed.
+  std::vector<Segment> segments{};      // Data actually emitted.
+  std::unordered_map<std::string, size_t> shared{}; // Text -> address, when sharing.
+
+public:
+  // The bytes a WAT string denotes (\n, \t, \r, \\, \', \", and \hh escapes).
+  static std::string Decode(const std::string &text) {
+    std::string out;
+    out.reserve(text.size());
+    for (size_t i = 0; i < text.size(); ++i) {
+      char byte = text[i];
+      if (text[i] == '\\' && i + 1 < text.size()) {
+        const char next = text[++i];
+        switch (next) {
+        case 'n':
+          byte = '\n';
+          break;
+        case 't':
+          byte = '\t';
+          break;
+        case 'r':
+          byte = '\r';
+          break;
+        case '\\':
+        case '\'':
+        case '"':
+          byte = next;
+          break;
+        default:
+          if (std::isxdigit(static_cast<unsigned char>(next)) && i + 1 < text.size() &&
+              std::isxdigit(static_cast<unsigned char>(text[i + 1]))) {
+            byte = static_cast<char>(std::stoi(text.substr(i, 2), nullptr, 16));
+            ++i;
+          }
+        }
+      }
+      out.push_back(byte);
+    }
+    return out;
+  }
+
+  // WAT string text for the given bytes (the inverse of Decode).
+  static std::string Encode(const std::string &bytes) {
+    static constexpr char HEX[] = "0123456789abcdef";
+    std::string out;
+    out.reserve(bytes.size());
+    for (char ch : bytes) {
+      const auto byte = static_cast<unsigned char>(ch);
+      if (byte >= 0x20 && byte < 0x7f && ch != '"' && ch != '\\') {
+        out.push_back(ch);
+      } else {
+        out.push_back('\\');
+        out.push_back(HEX[byte >> 4]);
+        out.push_back(HEX[byte & 0xf]);
+      }
+    }
+    return out;
+  }
+
+  // Register a literal; returns its id for Address().
+  size_t Add(const std::string &text) {
+    texts.push_back(text);
+    return texts.size() - 1;
+  }
+
+  // Assign every literal an address, starting at start; returns the first
+  // address past the data.
+  size_t Place(size_t start, bool share) {
+    addresses.assign(texts.size(), 0);
+    segments.clear();
+    shared.clear();
+    size_t pos = start;
+    if (!share) {
+      for (size_t i = 0; i < texts.size(); ++i) {
+        addresses[i] = pos;
+        segments.push_back(Segment{pos, texts[i]});
+        pos += Decode(texts[i]).size() + 1;
+      }
+      return pos;
+    }
+
+    // Unique byte strings (however they were escaped), in order of first use.
+    std::vector<size_t> unique;
+    std::vector<size_t> unique_of(texts.size());
+    std::vector<std::string> reversed;
+    std::unordered_map<std::string, size_t> first;
+    for (size_t i = 0; i < texts.size(); ++i) {
+      std::string bytes = Decode(texts[i]);
+      auto [it, added] = first.emplace(bytes, unique.size());
+      unique_of[i] = it->second;
+      if (added) {
+        unique.push_back(i);
+        reversed.emplace_back(bytes.rbegin(), bytes.rend());
+      }
+    }
+
+    // Sorted by their reversed bytes, a string that ends another comes just
+    // before the next string it is a suffix of; each takes its host from there.
+    std::vector<size_t> order(unique.size());
+    for (size_t u = 0; u < order.size(); ++u)
+      order[u] = u;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return reversed[a] != reversed[b] ? reversed[a] < reversed[b] : a < b;
+    });
+    std::vector<size_t> host(unique.size());
+    for (size_t k = order.size(); k-- > 0;) {
+      const size_t u = order[k];
+      host[u] = u;
+      if (k + 1 < order.size() && reversed[order[k + 1]].starts_with(reversed[u]))
+        host[u] = host[order[k + 1]];
+    }
+
+    // Hosts are laid out in order of first use; the rest point into them.
+    std::vector<size_t> unique_address(unique.size());
+    for (size_t u = 0; u < unique.size(); ++u) {
+      if (host[u] != u)
+        continue;
+      unique_address[u] = pos;
+      segments.push_back(Segment{pos, texts[unique[u]]});
+      pos += reversed[u].size() + 1;
+    }
+    for (size_t u = 0; u < unique.size(); ++u) {
+      if (host[u] != u)
+        unique_address[u] = unique_address[host[u]] + reversed[host[u]].size() - reversed[u].size();
+    }
+    for (size_t i = 0; i < texts.size(); ++i) {
+      addresses[i] = unique_address[unique_of[i]];
+      shared[texts[i]] = addresses[i];
+    }
+    return pos;
+  }
+
+  size_t Address(size_t id) const { return addresses[id]; }
+  const std::vector<Segment> &Segments() const { return segments; }
+  size_t NumLiterals() const { return texts.size(); }
+
+  // Where an already-placed text lives, if literals were shared.
+  std::optional<size_t> Find(const std::string &text) const {
+    auto it = shared.find(text);
+    return it == shared.end() ? std::nullopt : std::optional<size_t>(it->second);
+  }
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "ASTWalker.hpp"
+
+// Detect a write into a string through an index (`s[i] = c`).  Such a write
+// changes the bytes the string points at, which may be a literal's data, so
+// string literals can only share memory in programs that have none.
+class StringWriteFinder : public ASTWalker<StringWriteFinder, void, true> {
+private:
+  bool found = false;
+
+public:
+  bool foundWrite() const { return found; }
+
+  void visitMath2(const ASTNode_Math2 &node) {
+    if (node.GetOp() == OpId::Assign && isa<ASTNode_Indexing>(node.GetChild(0)))
+      found = true;
+    walkChildren(node);
+  }
+
+  void visitTailCallLoop(const ASTNode_TailCallLoop &node) {
+    for (size_t i = 0; i < node.NumArgs(); ++i) {
+      if (node.HasArg(i))
+        dispatch(node.GetArg(i));
+    }
+  }
+
+  void visitParent(const ASTNode_Parent &node) { walkChildren(node); }
+};
@@ -107,6 +107,14 @@ public:
     return id;
   }
 
+  // Add a variable that no source code declares (for example, one introduced
+  // by an optimization).  It is not entered into any scope.
+  size_t AddHiddenVar(std::string name, FilePos pos, Type type) {
+    const size_t id = var_array.size();
+    var_array.emplace_back(name, pos, type);
+    return id;
+  }
+
   size_t AddFunction(emplex::Token id_token,
                      const std::vector<Type> &param_types, Type return_type) {
     assert(id_token.id == emplex::Lexer::ID_ID);
@@ -1,13 +1,19 @@
 #pragma once
 
 #include "ASTNode.hpp"
+#include "CallGraph.hpp"
 #include "Pass.hpp"
 #include "SymbolTable.hpp"
 #include "core/ASTCloner.hpp"
 #include <algorithm>
 #include <memory>
+#include <optional>
+#include <unordered_map>
 #include <vector>
 
+// Function id -> the variable reserved as its accumulator.
+using AccumulatorVars = std::unordered_map<size_t, size_t>;
+
 class TailRecursionPass : public Pass {
 private:
   SymbolTable &symbols;
@@ -15,27 +21,43 @@ private:
   bool enableAccumulatorOptimization;
   bool enableMutualRecursion;
   size_t maxRecursionDepth;
+  const AccumulatorVars *accumulatorVars;
 
 public:
   TailRecursionPass(SymbolTable &symbols, bool loopify, bool accumulator = false, bool mutual = false,
-                    size_t maxDepth = 1000)
+                    size_t maxDepth = 1000, const AccumulatorVars *accumulatorVars = nullptr)
       : symbols(symbols), loopifyTailRecursion(loopify), enableAccumulatorOptimization(accumulator),
-        enableMutualRecursion(mutual), maxRecursionDepth(maxDepth) {}
+        enableMutualRecursion(mutual), maxRecursionDepth(maxDepth), accumulatorVars(accumulatorVars) {}
 
   std::string getName() const override { return "TailRecursion"; }
 
-  void run(ASTNode &node) override {
+  // Reserve an accumulator variable for each self-recursive function that
+  // returns an int.  Pipelines run on several threads at once, so the symbol
+  // table must gain these variables before any of them starts.
+  static AccumulatorVars ReserveAccumulators(const std::vector<ASTNode_Function *> &functions,
+                                             SymbolTable &symbols) {
+    AccumulatorVars vars;
+    for (const ASTNode_Function *fn : functions) {
+      if (symbols.GetType(fn->GetFunId()).ReturnType().IsInt() && callsFunction(*fn, fn->GetFunId())) {
+        const std::string name = symbols.GetName(fn->GetFunId()) + ".acc";
+        vars.emplace(fn->GetFunId(), symbols.AddHiddenVar(name, fn->GetFilePos(), Type("int")));
+      }
+    }
+    return vars;
+  }
+
+  bool run(ASTNode &node, AnalysisManager &analyses) override {
     if (!loopifyTailRecursion)
-      return;
+      return false;
 
-    if (auto *fn = dynamic_cast<ASTNode_Function *>(&node)) {
-      optimizeFunction(*fn);
-    } else if (auto *parent = dynamic_cast<ASTNode_Parent *>(&node)) {
-      for (size_t i = 0; i < parent->NumChildren(); ++i) {
-        if (parent->HasChild(i))
-          run(parent->GetChild(i));
-      }
+    // Only functions that call themselves can have self tail calls.
+    const CallGraph &callGraph = analyses.getCallGraph(node);
+    bool changed = false;
+    for (const auto &[funId, fn] : callGraph.functions) {
+      if (callGraph.isRecursive(funId))
+        changed |= optimizeFunction(*fn);
     }
+    return changed;
   }
 
 private:
@@ -56,30 +78,196 @@ private:
     return makeDefaultLiteral(returnType, fn.GetFilePos());
   }
 
-  void optimizeFunction(ASTNode_Function &fn) {
+  bool optimizeFunction(ASTNode_Function &fn) {
     if (fn.NumChildren() == 0 || !fn.HasChild(0))
-      return;
+      return false;
 
+    auto accumulatorInit = enableAccumulatorOptimization ? introduceAccumulator(fn) : nullptr;
     auto transformedBody = transformForTailCalls(fn, fn.GetChild(0));
     if (!transformedBody)
-      return;
+      return false;
 
     auto cond = std::make_unique<ASTNode_IntLit>(fn.GetFilePos(), 1);
     auto whileNode =
         std::make_unique<ASTNode_While>(fn.GetFilePos(), std::move(cond), std::move(transformedBody));
     auto newBlock = std::make_unique<ASTNode_Block>(fn.GetFilePos());
+    if (accumulatorInit)
+      newBlock->AddChild(std::move(accumulatorInit));
     newBlock->AddChild(std::move(whileNode));
     newBlock->AddChild(
         std::make_unique<ASTNode_Return>(fn.GetFilePos(), makeDefaultReturnExpr(fn)));
 
     fn.ReplaceChild(0, std::move(newBlock));
+    return true;
+  }
+
+  // ---- Accumulator introduction ----
+  //
+  // A function such as
+  //   if (n <= 1) return 1;
+  //   return n * Factorial(n - 1);
+  // multiplies each result by a value it knew before the call.  Integer + and
+  // * (modulo 2^32) are associative and commutative, so the pending
+  // operations can be folded into an accumulator instead:
+  //   if (n <= 1) return acc * 1;
+  //   acc = acc * n; return Factorial(n - 1);
+  // with acc starting at 1.  The self call is now a tail call, which
+  // loopification turns into a jump back to the top of the function.
+
+  struct ReturnSite {
+    ASTNode_Parent *parent; // The return is parent's child `index`.
+    size_t index;
+    bool tail; // Reached only through blocks and ifs, so loopification can rewrite it.
+  };
+
+  // Find every return statement under node.
+  static void collectReturns(ASTNode_Parent &node, bool tail, std::vector<ReturnSite> &sites) {
+    for (size_t i = 0; i < node.NumChildren(); ++i) {
+      if (!node.HasChild(i))
+        continue;
+      ASTNode &child = node.GetChild(i);
+      if (isa<ASTNode_Return>(child)) {
+        sites.push_back(ReturnSite{&node, i, tail});
+      } else if (auto *parent = dyn_cast<ASTNode_Parent>(&child)) {
+        collectReturns(*parent, tail && (isa<ASTNode_Block>(child) || isa<ASTNode_If>(child)), sites);
+      }
+    }
+  }
+
+  bool isSelfCall(const ASTNode &node, const ASTNode_Function &fn) const {
+    const auto *call = dyn_cast<ASTNode_FunctionCall>(&node);
+    return call && call->GetFunId() == fn.GetFunId() && call->NumChildren() == fn.GetParamIds().size();
+  }
+
+  static bool callsFunction(const ASTNode &node, size_t funId) {
+    CallFinder finder;
+    finder.dispatch(node);
+    const auto &calls = finder.getCalls();
+    return std::any_of(calls.begin(), calls.end(),
+                       [funId](const ASTNode_FunctionCall *call) { return call->GetFunId() == funId; });
+  }
+
+  // Could evaluating node have side effects (a call or an assignment)?
+  static bool hasEffects(const ASTNode &node) {
+    if (isa<ASTNode_FunctionCall>(node) || isa<ASTNode_TailCallLoop>(node))
+      return true;
+    if (auto *math = dyn_cast<ASTNode_Math2>(&node); math && math->GetOp() == OpId::Assign)
+      return true;
+    if (auto *parent = dyn_cast<ASTNode_Parent>(&node)) {
+      for (size_t i = 0; i < parent->NumChildren(); ++i) {
+        if (parent->HasChild(i) && hasEffects(parent->GetChild(i)))
+          return true;
+      }
+    }
+    return false;
+  }
+
+  // If expr is `a op F(...)` or `F(...) op a` for a self call F, an int a
+  // that does not call F, and op + or *, return the side holding the call.
+  // With the call on the left, a moves ahead of the recursion, so both it
+  // and the call's arguments must be free of side effects.
+  std::optional<size_t> accumulatedCallSide(const ASTNode &expr, const ASTNode_Function &fn) const {
+    const auto *math = dyn_cast<ASTNode_Math2>(&expr);
+    if (!math || (math->GetOp() != OpId::Add && math->GetOp() != OpId::Mult))
+      return std::nullopt;
+    for (size_t side : {size_t{1}, size_t{0}}) {
+      const ASTNode &call = math->GetChild(side);
+      const ASTNode &operand = math->GetChild(1 - side);
+      if (!isSelfCall(call, fn) || !operand.ReturnType(symbols).IsInt() || callsFunction(operand, fn.GetFunId()))
+        continue;
+      if (side == 0) {
+        bool effects = hasEffects(operand);
+        const auto &args = cast<ASTNode_FunctionCall>(call);
+        for (size_t i = 0; i < args.NumChildren(); ++i)
+          effects |= hasEffects(args.GetChild(i));
+        if (effects)
+          continue;
+      }
+      return side;
+    }
+    return std::nullopt;
+  }
+
+  std::unique_ptr<ASTNode> makeAccumulate(size_t accId, OpId op, std::unique_ptr<ASTNode> value, FilePos pos) {
+    auto combined = std::make_unique<ASTNode_Math2>(pos, op, std::make_unique<ASTNode_Var>(pos, accId),
+                                                    std::move(value));
+    combined->TypeCheck(symbols);
+    return combined;
+  }
+
+  // Rewrite fn around an accumulator if its self calls are combined with the
+  // result by a single operator (+ or *).  Returns the statement that
+  // initializes the accumulator, which belongs before the loop that
+  // loopification builds, or nullptr if fn was left alone.
+  std::unique_ptr<ASTNode> introduceAccumulator(ASTNode_Function &fn) {
+    if (!accumulatorVars || !isa<ASTNode_Block>(fn.GetChild(0)))
+      return nullptr;
+    auto var = accumulatorVars->find(fn.GetFunId());
+    if (var == accumulatorVars->end())
+      return nullptr;
+    const size_t accId = var->second;
+    const auto &varIds = fn.GetVarIds();
+    if (std::find(varIds.begin(), varIds.end(), accId) != varIds.end())
+      return nullptr; // Already introduced.
+
+    std::vector<ReturnSite> sites;
+    collectReturns(cast<ASTNode_Block>(fn.GetChild(0)), true, sites);
+    std::optional<OpId> op;
+    for (const ReturnSite &site : sites) {
+      const auto &ret = cast<ASTNode_Return>(site.parent->GetChild(site.index));
+      // Other returns become `acc op value`, which needs value to be an int.
+      if (!ret.HasChild(0) || !ret.GetChild(0).ReturnType(symbols).IsInt())
+        return nullptr;
+      if (!site.tail || !accumulatedCallSide(ret.GetChild(0), fn))
+        continue;
+      const OpId siteOp = cast<ASTNode_Math2>(ret.GetChild(0)).GetOp();
+      if (op && *op != siteOp)
+        return nullptr;
+      op = siteOp;
+    }
+    if (!op)
+      return nullptr;
+    const int identity = *op == OpId::Mult ? 1 : 0;
+
+    for (const ReturnSite &site : sites) {
+      auto &ret = cast<ASTNode_Return>(site.parent->GetChild(site.index));
+      ASTNode &expr = ret.GetChild(0);
+      const FilePos pos = ret.GetFilePos();
+      if (site.tail && isSelfCall(expr, fn))
+        continue; // The accumulator carries over to the next iteration.
+      const auto callSide = site.tail ? accumulatedCallSide(expr, fn) : std::nullopt;
+      if (callSide) {
+        // return a op F(args)  ->  { acc = acc op a; return F(args); }
+        auto &math = cast<ASTNode_Math2>(expr);
+        auto update = makeAccumulate(accId, *op, ASTCloner::clone(math.GetChild(1 - *callSide)), pos);
+        auto assign = std::make_unique<ASTNode_Math2>(pos, OpId::Assign, std::make_unique<ASTNode_Var>(pos, accId),
+                                                      std::move(update));
+        auto block = std::make_unique<ASTNode_Block>(pos);
+        block->AddChild(std::move(assign));
+        block->AddChild(std::make_unique<ASTNode_Return>(pos, ASTCloner::clone(math.GetChild(*callSide))));
+        block->TypeCheck(symbols);
+        site.parent->ReplaceChild(site.index, std::move(block));
+      } else if (const auto *lit = dyn_cast<ASTNode_IntLit>(&expr); lit && lit->GetValue() == identity) {
+        ret.ReplaceChild(0, std::make_unique<ASTNode_Var>(pos, accId));
+      } else {
+        // return value  ->  return acc op value
+        ret.ReplaceChild(0, makeAccumulate(accId, *op, ASTCloner::clone(expr), pos));
+      }
+    }
+
+    fn.AddVar(accId);
+    const FilePos pos = fn.GetFilePos();
+    auto init = std::make_unique<ASTNode_Math2>(pos, OpId::Assign, std::make_unique<ASTNode_Var>(pos, accId),
+                                                std::make_unique<ASTNode_IntLit>(pos, identity));
+    init->TypeCheck(symbols);
+    return init;
   }
 
   std::unique_ptr<ASTNode> transformForTailCalls(ASTNode_Function &fn, ASTNode &body) {
     size_t selfId = fn.GetFunId();
     const auto &params = fn.GetParamIds();
 
-    if (auto *block = dynamic_cast<ASTNode_Block *>(&body)) {
+    if (auto *block = dyn_cast<ASTNode_Block>(&body)) {
       auto newBlock = std::make_unique<ASTNode_Block>(block->GetFilePos());
       bool changed = false;
       for (size_t i = 0; i < block->NumChildren(); ++i) {
@@ -98,9 +286,9 @@ private:
 
   std::unique_ptr<ASTNode> transformNode(ASTNode_Function &fn, ASTNode &n, size_t selfId,
                                          const std::vector<size_t> &params, bool &changed) {
-    if (auto *ret = dynamic_cast<ASTNode_Return *>(&n)) {
+    if (auto *ret = dyn_cast<ASTNode_Return>(&n)) {
       if (ret->NumChildren() >= 1) {
-        if (auto *call = dynamic_cast<ASTNode_FunctionCall *>(&ret->GetChild(0))) {
+        if (auto *call = dyn_cast<ASTNode_FunctionCall>(&ret->GetChild(0))) {
           if (call->GetFunId() == selfId && call->NumChildren() == params.size()) {
             const size_t k = params.size();
             std::vector<ASTNode::ptr_t> argClones;
@@ -129,7 +317,7 @@ private:
       return ASTCloner::clone(*ret);
     }
 
-    if (auto *iff = dynamic_cast<ASTNode_If *>(&n)) {
+    if (auto *iff = dyn_cast<ASTNode_If>(&n)) {
       auto test = ASTCloner::clone(iff->GetChild(0));
       if (iff->NumChildren() == 2) {
         bool chThen = false;
@@ -151,7 +339,7 @@ private:
       return ASTCloner::clone(*iff);
     }
 
-    if (auto *blk = dynamic_cast<ASTNode_Block *>(&n)) {
+    if (auto *blk = dyn_cast<ASTNode_Block>(&n)) {
       auto out = std::make_unique<ASTNode_Block>(blk->GetFilePos());
       bool any = false;
       for (size_t i = 0; i < blk->NumChildren(); ++i) {
@@ -174,7 +362,7 @@ private:
 
   std::unique_ptr<ASTNode> transformNodeAsBlock(ASTNode_Function &fn, ASTNode &n, size_t selfId,
                                                 const std::vector<size_t> &params, bool &changed) {
-    if (auto *blk = dynamic_cast<ASTNode_Block *>(&n)) {
+    if (auto *blk = dyn_cast<ASTNode_Block>(&n)) {
       return transformNode(fn, *blk, selfId, params, changed);
     } else {
       bool ch = false;
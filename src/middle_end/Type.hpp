@@ -1,75 +1,44 @@
 #pragma once
 
+#include <array>
 #include <assert.h>
+#include <cstddef>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
+#include "Trace.hpp"
 #include "lexer.hpp"
 #include "tools.hpp"
 
+// A Type is a lightweight handle to a type description that is interned in
+// the TypeContext: each primitive type has exactly one description, and
+// function types are hash-consed so that identical signatures share one.
+// Copying a Type is a pointer copy, and two Types are the same exactly when
+// they point at the same description.
 class Type {
-private:
-  struct Info_Char;
-  struct Info_Int;
-  struct Info_Double;
-  struct Info_Function;
-  struct Info_String;
-
-  struct Info_Base {
-    virtual ~Info_Base() {}
-
-    virtual bool IsChar() const { return false; }
-    virtual bool IsInt() const { return false; }
-    virtual bool IsDouble() const { return false; }
-    virtual bool IsFunction() const { return false; }
-    virtual bool IsString() const { return false; }
-    bool IsBase() const {
-      return !(IsChar() || IsInt() || IsDouble() || IsFunction());
-    }
-
-    // Specialty types
-    bool IsNumeric() const { return IsChar() || IsInt() || IsDouble(); }
-
-    virtual std::string Name() const { return "void"; }
-    virtual std::string ToWAT() const { return "UNKNOWN_TYPE"; }
-
-    virtual bool IsSame(const Info_Base &in) const {
-      assert(IsBase());
-      return in.IsBase();
-    }
-    virtual bool ConvertToOK(const Info_Base &in) const {
-      assert(IsBase());
-      return in.IsBase();
-    }
-    virtual bool CastToOK(const Info_Base &) const {
-      assert(IsBase());
-      return false;
-    }
-
-    bool ConvertFromOK(const Info_Base &in) const {
-      return in.ConvertToOK(*this);
-    }
-    bool CastFromOK(const Info_Base &in) const { return in.CastToOK(*this); }
+public:
+  enum class Kind : unsigned char { Void = 0, Char, Int, Double, String, Function, NUM_KINDS };
 
-    virtual int BitCount() const { return 0; }
+  struct Info;
 
-    virtual std::unique_ptr<Info_Base> Clone() const {
-      return std::make_unique<Info_Base>();
-    }
-  };
+private:
+  const Info *info; // Interned description; never null (void has its own).
 
-  std::unique_ptr<Info_Base> info_ptr = nullptr;
+  explicit Type(const Info *info) : info(info) {}
+  friend class TypeContext;
 
-  // Helper functions
-  const Info_Base &Info() const { return *info_ptr; }
-  static const Info_Function &FunInfo(const Info_Base &in);
-  const Info_Function &FunInfo() const { return FunInfo(*info_ptr); }
+  Kind GetKind() const;
 
 public:
-  Type() {} // Void type.
+  Type(); // Void type.
 
-  // Create a base type from a string ("int", "double", or "char")
+  // Create a base type from a string ("int", "double", "char", or "string")
   Type(std::string type_name);
 
   // Create a base type from a token.
@@ -78,58 +47,33 @@ public:
   // Create a Function type
   Type(const std::vector<Type> &param_types, const Type &return_type);
 
-  // Move Constructor
-  Type(Type &&) = default;
-
-  // Copy Constructor
-  Type(const Type &in) {
-    if (in.info_ptr) {
-      info_ptr = in.Info().Clone();
-    }
-  }
-
-  bool IsChar() const { return info_ptr && Info().IsChar(); }
-  bool IsInt() const { return info_ptr && Info().IsInt(); }
-  bool IsDouble() const { return info_ptr && Info().IsDouble(); }
-  bool IsFunction() const { return info_ptr && Info().IsFunction(); }
-  bool IsBase() const { return info_ptr && Info().IsBase(); }
-  bool IsNumeric() const { return info_ptr && Info().IsNumeric(); }
-  bool IsString() const { return info_ptr && Info().IsString(); }
+  bool IsVoid() const { return GetKind() == Kind::Void; }
+  bool IsChar() const { return GetKind() == Kind::Char; }
+  bool IsInt() const { return GetKind() == Kind::Int; }
+  bool IsDouble() const { return GetKind() == Kind::Double; }
+  bool IsFunction() const { return GetKind() == Kind::Function; }
+  bool IsString() const { return GetKind() == Kind::String; }
+  bool IsNumeric() const { return IsChar() || IsInt() || IsDouble(); }
 
-  bool IsSame(const Type &in) const { return Info().IsSame(*in.info_ptr); }
+  bool IsSame(const Type &in) const { return info == in.info; }
   bool operator==(const Type &in) const { return IsSame(in); }
 
   // Can one type be implicitly converted to another?
-  bool ConvertToOK(const Type &in) const {
-    return Info().ConvertToOK(*in.info_ptr);
-  }
+  bool ConvertToOK(const Type &in) const;
 
   // Can one type be implicitly converted to another?
-  bool ConvertFromOK(const Type &in) const {
-    return Info().ConvertFromOK(*in.info_ptr);
-  }
+  bool ConvertFromOK(const Type &in) const { return in.ConvertToOK(*this); }
 
   // Can one type be cast to another?
-  bool CastToOK(const Type &in) const { return Info().CastToOK(*in.info_ptr); }
+  bool CastToOK(const Type &in) const;
 
   // Can one type be cast to another?
-  bool CastFromOK(const Type &in) const {
-    return Info().CastFromOK(*in.info_ptr);
-  }
+  bool CastFromOK(const Type &in) const { return in.CastToOK(*this); }
 
-  std::string Name() const {
-    assert(info_ptr);
-    return Info().Name();
-  }
-  std::string ToWAT() const {
-    assert(info_ptr);
-    return Info().ToWAT();
-  }
+  std::string Name() const;
+  std::string ToWAT() const;
 
-  int BitCount() const {
-    assert(info_ptr);
-    return Info().BitCount();
-  }
+  int BitCount() const;
 
   // Calls that can only be run function types for more type info.
   size_t NumParams() const;
@@ -137,147 +81,185 @@ public:
   const Type &ReturnType() const;
 };
 
-struct Type::Info_Char : Type::Info_Base {
-  bool IsChar() const override { return true; }
-  std::string Name() const override { return "char"; }
-  std::string ToWAT() const override { return "i32"; }
-  int BitCount() const override { return 22; }
-
-  std::unique_ptr<Info_Base> Clone() const override {
-    return std::make_unique<Info_Char>();
-  }
-
-  bool IsSame(const Info_Base &in) const override { return in.IsChar(); }
+static_assert(std::is_trivially_copyable_v<Type>, "Type must stay a plain handle.");
 
-  bool ConvertToOK(const Info_Base &in) const override {
-    return (in.IsChar() || in.IsInt() || in.IsDouble());
-  }
-  bool CastToOK(const Info_Base &in) const override {
-    return (in.IsChar() || in.IsInt() || in.IsDouble() || in.IsString());
-  }
+struct Type::Info {
+  Kind kind;
+  std::vector<Type> param_types;    // Function types only.
+  std::optional<Type> return_type; // Function types only.
 };
 
-struct Type::Info_Int : Type::Info_Base {
-  bool IsInt() const override { return true; }
-  std::string Name() const override { return "int"; }
-  std::string ToWAT() const override { return "i32"; }
-  int BitCount() const override { return 32; }
-
-  std::unique_ptr<Info_Base> Clone() const override {
-    return std::make_unique<Info_Int>();
-  }
-
-  bool IsSame(const Info_Base &in) const override { return in.IsInt(); }
-
-  bool ConvertToOK(const Info_Base &in) const override {
-    return (in.IsInt() || in.IsDouble());
-  }
-  bool CastToOK(const Info_Base &in) const override {
-    return (in.IsChar() || in.IsInt() || in.IsDouble() || in.IsString());
-  }
-};
+// Owner of all interned type descriptions.
+class TypeContext {
+private:
+  static constexpr size_t NUM_KINDS = static_cast<size_t>(Type::Kind::NUM_KINDS);
+
+  // Key for hash-consing function types: return type, then parameter types.
+  using signature_t = std::vector<const Type::Info *>;
+  struct SignatureHash {
+    size_t operator()(const signature_t &sig) const {
+      size_t hash = sig.size();
+      for (const Type::Info *info : sig) {
+        hash ^= std::hash<const void *>{}(info) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+      }
+      return hash;
+    }
+  };
 
-struct Type::Info_Double : Type::Info_Base {
-  bool IsDouble() const override { return true; }
-  std::string Name() const override { return "double"; }
-  std::string ToWAT() const override { return "f64"; }
-  int BitCount() const override { return 64; }
+  std::array<Type::Info, NUM_KINDS> primitives;
+  std::unordered_map<signature_t, std::unique_ptr<Type::Info>, SignatureHash> function_types;
+  std::mutex function_mutex; // Guards function_types.
 
-  std::unique_ptr<Info_Base> Clone() const override {
-    return std::make_unique<Info_Double>();
+  TypeContext() {
+    for (size_t i = 0; i < NUM_KINDS; ++i) {
+      primitives[i] = Type::Info{static_cast<Type::Kind>(i), {}, std::nullopt};
+    }
   }
 
-  bool IsSame(const Info_Base &in) const override { return in.IsDouble(); }
-
-  bool ConvertToOK(const Info_Base &in) const override {
-    return in.IsDouble(); // Cannot freely convert to any other type.
-  }
-  bool CastToOK(const Info_Base &in) const override {
-    return (in.IsChar() || in.IsInt() || in.IsDouble());
+public:
+  static TypeContext &Get() {
+    static TypeContext context;
+    return context;
   }
-};
-
-struct Type::Info_Function : Type::Info_Base {
-  std::vector<Type> param_types;
-  Type return_type;
 
-  Info_Function(const std::vector<Type> &param_types, Type return_type)
-      : param_types(param_types), return_type(return_type) {}
-  bool IsFunction() const override { return true; }
-  std::string Name() const override { return return_type.Name() + "(...)"; }
-  std::unique_ptr<Info_Base> Clone() const override {
-    return std::make_unique<Info_Function>(param_types, return_type);
+  Type Primitive(Type::Kind kind) const {
+    assert(kind != Type::Kind::Function && kind != Type::Kind::NUM_KINDS);
+    return Type(&primitives[static_cast<size_t>(kind)]);
   }
 
-  bool IsSame(const Info_Base &in) const override {
-    if (!in.IsFunction())
-      return false;
-    const Info_Function &in_fun = FunInfo(in);
-    if (param_types.size() != in_fun.param_types.size())
-      return false;
-    for (size_t i = 0; i < param_types.size(); ++i) {
-      if (param_types[i] != in_fun.param_types[i])
-        return false;
+  Type Function(const std::vector<Type> &param_types, const Type &return_type) {
+    TUBULAR_TRACE_COUNT(TypeInterns, 1);
+    signature_t sig;
+    sig.reserve(param_types.size() + 1);
+    sig.push_back(return_type.info);
+    for (const Type &param : param_types) {
+      sig.push_back(param.info);
     }
-    return return_type == in_fun.return_type;
-  }
-  bool ConvertToOK(const Info_Base &in) const override { return IsSame(in); }
-  bool CastToOK(const Info_Base &) const override {
-    return false; // There are no casts to functions.
-  }
-};
 
-struct Type::Info_String : Type::Info_Base {
-  bool IsString() const override { return true; }
-  std::string Name() const override { return "string"; }
-  std::string ToWAT() const override { return "i32"; }
-
-  std::unique_ptr<Info_Base> Clone() const override {
-    return std::make_unique<Info_String>();
+    std::lock_guard<std::mutex> lock(function_mutex);
+    auto &info_ptr = function_types[sig];
+    if (!info_ptr) {
+      info_ptr = std::make_unique<Type::Info>(Type::Info{Type::Kind::Function, param_types, return_type});
+    }
+    return Type(info_ptr.get());
   }
 
-  bool IsSame(const Info_Base &in) const override { return in.IsString(); }
-  bool ConvertToOK(const Info_Base &in) const override { return in.IsString(); }
-  bool CastToOK(const Info_Base &in) const override {
-    return in.IsString() || in.IsChar() || in.IsInt();
-  }
+  // Implicit conversion and explicit cast rules between primitive types,
+  // indexed by [from][to].  Function types only convert to themselves.
+  static constexpr bool CONVERT_OK[NUM_KINDS][NUM_KINDS] = {
+      //  void   char   int    double string function
+      {true, false, false, false, false, false},  // void
+      {false, true, true, true, false, false},    // char
+      {false, false, true, true, false, false},   // int
+      {false, false, false, true, false, false},  // double
+      {false, false, false, false, true, false},  // string
+      {false, false, false, false, false, false}, // function
+  };
+  static constexpr bool CAST_OK[NUM_KINDS][NUM_KINDS] = {
+      //  void   char   int    double string function
+      {false, false, false, false, false, false}, // void
+      {false, true, true, true, true, false},     // char
+      {false, true, true, true, true, false},     // int
+      {false, true, true, true, false, false},    // double
+      {false, true, true, false, true, false},    // string
+      {false, false, false, false, false, false}, // function
+  };
 };
 
 ///////////////////////////////////////
 //  Full function implementations
 
-const Type::Info_Function &Type::FunInfo(const Info_Base &in) {
-  assert(in.IsFunction()); // Ensure that this is a function type.
-  return dynamic_cast<const Info_Function &>(in);
-}
+Type::Kind Type::GetKind() const { return info->kind; }
+
+Type::Type() : Type(TypeContext::Get().Primitive(Kind::Void)) {}
 
 // Create a base type from a string.
-Type::Type(std::string type_name) {
+Type::Type(std::string type_name) : info(nullptr) {
+  Kind kind = Kind::Void;
   if (type_name == "char")
-    info_ptr = std::make_unique<Info_Char>();
+    kind = Kind::Char;
   else if (type_name == "int")
-    info_ptr = std::make_unique<Info_Int>();
+    kind = Kind::Int;
   else if (type_name == "double")
-    info_ptr = std::make_unique<Info_Double>();
+    kind = Kind::Double;
   else if (type_name == "string")
-    info_ptr = std::make_unique<Info_String>();
+    kind = Kind::String;
   else {
     std::cerr << "Internal ERROR: Unknown Type '" << type_name << "'."
               << std::endl;
     assert(false);
   }
+  *this = TypeContext::Get().Primitive(kind);
 }
 
 // Create a Function type
-Type::Type(const std::vector<Type> &param_types, const Type &return_type) {
-  info_ptr = std::make_unique<Info_Function>(param_types, return_type);
+Type::Type(const std::vector<Type> &param_types, const Type &return_type)
+    : Type(TypeContext::Get().Function(param_types, return_type)) {}
+
+bool Type::ConvertToOK(const Type &in) const {
+  if (IsFunction())
+    return IsSame(in);
+  return TypeContext::CONVERT_OK[static_cast<size_t>(GetKind())][static_cast<size_t>(in.GetKind())];
 }
 
-size_t Type::NumParams() const { return FunInfo().param_types.size(); }
+bool Type::CastToOK(const Type &in) const {
+  return TypeContext::CAST_OK[static_cast<size_t>(GetKind())][static_cast<size_t>(in.GetKind())];
+}
+
+std::string Type::Name() const {
+  switch (GetKind()) {
+  case Kind::Char:
+    return "char";
+  case Kind::Int:
+    return "int";
+  case Kind::Double:
+    return "double";
+  case Kind::String:
+    return "string";
+  case Kind::Function:
+    return ReturnType().Name() + "(...)";
+  default:
+    return "void";
+  }
+}
+
+std::string Type::ToWAT() const {
+  switch (GetKind()) {
+  case Kind::Char:
+  case Kind::Int:
+  case Kind::String:
+    return "i32";
+  case Kind::Double:
+    return "f64";
+  default:
+    return "UNKNOWN_TYPE";
+  }
+}
+
+int Type::BitCount() const {
+  switch (GetKind()) {
+  case Kind::Char:
+    return 22;
+  case Kind::Int:
+    return 32;
+  case Kind::Double:
+    return 64;
+  default:
+    return 0;
+  }
+}
+
+size_t Type::NumParams() const {
+  assert(IsFunction());
+  return info->param_types.size();
+}
 
 const Type &Type::ParamType(size_t id) const {
   assert(id < NumParams());
-  return FunInfo().param_types[id];
-};
+  return info->param_types[id];
+}
 
-const Type &Type::ReturnType() const { return FunInfo().return_type; }
+const Type &Type::ReturnType() const {
+  assert(IsFunction());
+  return *info->return_type;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "ASTNode.hpp"
+#include "ASTWalker.hpp"
+#include "Pass.hpp"
+#include "SymbolTable.hpp"
+
+// Fill in the cached type of every node in a tree.
+//
+// Nodes whose cache is still valid are left alone; a parent is only recomputed
+// if it has no cached type or one of its descendants had to be recomputed.
+// Running this after passes that rewrite subtrees (whose fresh nodes start
+// uncached) therefore refreshes just the rewritten subtrees and their ancestors,
+// and code generation never recomputes a type recursively.
+class TypeAnnotationPass : public Pass, public ASTWalker<TypeAnnotationPass, bool> {
+private:
+  const SymbolTable &symbols;
+
+public:
+  TypeAnnotationPass(const SymbolTable &symbols) : symbols(symbols) {}
+
+  std::string getName() const override { return "TypeAnnotation"; }
+
+  // Only cached types are refreshed, so the tree itself never changes.
+  bool run(ASTNode &node, AnalysisManager &) override {
+    dispatch(node);
+    return false;
+  }
+
+  // Only cached node types change.
+  PreservedAnalyses preservedAnalyses() const override { return PreservedAnalyses::all(); }
+
+  // Each visit returns true if the node's type had to be (re)computed.
+  bool visitNode(ASTNode &node) {
+    const bool stale = !node.HasCachedType();
+    node.ReturnType(symbols);
+    return stale;
+  }
+
+  bool visitParent(ASTNode_Parent &node) {
+    bool stale = !node.HasCachedType();
+    for (size_t i = 0; i < node.NumChildren(); ++i) {
+      if (node.HasChild(i) && dispatch(node.GetChild(i)))
+        stale = true;
+    }
+    return refresh(node, stale);
+  }
+
+  bool visitTailCallLoop(ASTNode_TailCallLoop &node) {
+    bool stale = !node.HasCachedType();
+    for (size_t i = 0; i < node.NumArgs(); ++i) {
+      if (node.HasArg(i) && dispatch(node.GetArg(i)))
+        stale = true;
+    }
+    return refresh(node, stale);
+  }
+
+private:
+  bool refresh(ASTNode &node, bool stale) {
+    if (stale) {
+      node.InvalidateType();
+      node.ReturnType(symbols);
+    }
+    return stale;
+  }
+};
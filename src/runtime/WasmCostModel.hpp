@@ -0,0 +1,202 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "WasmModule.hpp"
+
+// Static cost of one function of a module, per call.
+struct WasmFunctionCost {
+  struct Loop {
+    size_t depth = 0; // Number of enclosing loops.
+    double trips = 0.0;
+  };
+
+  size_t instructions = 0;    // Static instruction count.
+  double cost = 0.0;          // Weighted instructions executed, callees excluded.
+  double inclusiveCost = 0.0; // Including the estimated cost of every callee.
+  double calls = 0.0;         // Estimated calls made.
+  double memoryOps = 0.0;     // Estimated loads and stores executed.
+  double branches = 0.0;      // Estimated branches executed.
+  std::vector<Loop> loops{};
+  std::map<uint32_t, double> callees{}; // Function index -> estimated calls.
+};
+
+// Weighs the final instruction stream of a module to estimate, without
+// running it, what a call of each function costs.
+//
+// Example usage:
+//   std::vector<WasmFunctionCost> costs = WasmCostModel::Estimate(module, trips);
+//   double main_cost = costs[*module.FindExport("main")].inclusiveCost;
+//
+// Each opcode has a weight in rough machine-cycle units (memory operations,
+// divisions, and calls cost more than local and arithmetic ones).  An
+// instruction's weight is scaled by how often it is expected to run: inside a
+// loop, by the loop's trip count (its exit test once more than its body); in
+// either arm of an `if`, by one half.  Trip counts come from the caller, one
+// list per function in the order its loops open; loops without one are
+// assumed to run DEFAULT_TRIPS times.  A recursive call is charged only its
+// call overhead, so the estimate is finite and deterministic.
+class WasmCostModel {
+public:
+  static constexpr double DEFAULT_TRIPS = 10.0;
+
+  static double Weight(WasmOp op) {
+    switch (op) {
+    case WasmOp::Unreachable:
+    case WasmOp::Return: // Charged as part of the call.
+      return 0.0;
+    case WasmOp::BrIf:
+    case WasmOp::BrUnless:
+    case WasmOp::Select:
+      return 2.0;
+    case WasmOp::Call:
+      return 10.0;
+    case WasmOp::I32Load:
+    case WasmOp::I32Load8S:
+    case WasmOp::I32Load8U:
+    case WasmOp::I32Load16S:
+    case WasmOp::I32Load16U:
+    case WasmOp::F64Load:
+    case WasmOp::I64Load:
+    case WasmOp::I32Store:
+    case WasmOp::I32Store8:
+    case WasmOp::I32Store16:
+    case WasmOp::I64Store:
+    case WasmOp::F64Store:
+      return 3.0;
+    case WasmOp::MemoryGrow:
+      return 100.0;
+    case WasmOp::I32Mul:
+    case WasmOp::I64Mul:
+      return 3.0;
+    case WasmOp::I32DivS:
+    case WasmOp::I32DivU:
+    case WasmOp::I32RemS:
+    case WasmOp::I32RemU:
+      return 10.0;
+    case WasmOp::F64Add:
+    case WasmOp::F64Sub:
+    case WasmOp::F64Min:
+    case WasmOp::F64Max:
+    case WasmOp::F64Eq:
+    case WasmOp::F64Ne:
+    case WasmOp::F64Lt:
+    case WasmOp::F64Gt:
+    case WasmOp::F64Le:
+    case WasmOp::F64Ge:
+    case WasmOp::F64Ceil:
+    case WasmOp::F64Floor:
+    case WasmOp::F64Trunc:
+    case WasmOp::F64Nearest:
+      return 2.0;
+    case WasmOp::F64Mul:
+    case WasmOp::I32TruncF64S:
+    case WasmOp::I32TruncF64U:
+    case WasmOp::F64ConvertI32S:
+    case WasmOp::F64ConvertI32U:
+      return 4.0;
+    case WasmOp::F64Div:
+      return 10.0;
+    case WasmOp::F64Sqrt:
+      return 15.0;
+    default:
+      return 1.0;
+    }
+  }
+
+  static bool IsMemoryOp(WasmOp op) { return op >= WasmOp::I32Load && op <= WasmOp::F64Store; }
+  static bool IsBranch(WasmOp op) {
+    return op == WasmOp::Br || op == WasmOp::BrIf || op == WasmOp::BrUnless || op == WasmOp::Jump;
+  }
+
+  // How many times each instruction of a function runs per call.
+  static std::vector<double> Frequencies(const WasmFunction &fn, const std::vector<double> &trips,
+                                         std::vector<WasmFunctionCost::Loop> &loops_out) {
+    std::vector<double> freq(fn.code.size(), 1.0);
+
+    for (size_t id = 0; id < fn.loops.size(); ++id) {
+      const WasmLoop &loop = fn.loops[id];
+      const double count = id < trips.size() ? trips[id] : DEFAULT_TRIPS;
+      size_t depth = 0;
+      for (const WasmLoop &outer : fn.loops)
+        depth += outer.start <= loop.start && loop.end <= outer.end && &outer != &loop;
+      loops_out.push_back({depth, count});
+
+      // The exit test, up to the first branch out of the loop, runs once more than the body.
+      uint32_t body = loop.start;
+      for (uint32_t pc = loop.start; pc < loop.end; ++pc) {
+        const WasmInstr &in = fn.code[pc];
+        if ((in.op == WasmOp::BrIf || in.op == WasmOp::BrUnless) && in.index >= loop.end) {
+          body = pc + 1;
+          break;
+        }
+      }
+      for (uint32_t pc = loop.start; pc < loop.end; ++pc)
+        freq[pc] *= pc < body ? count + 1.0 : count;
+    }
+
+    // An `if` lowers to BrUnless past its then-arm; with an else-arm, the
+    // then-arm ends in a Jump past the else-arm.  Either arm runs half the time.
+    for (uint32_t pc = 0; pc < fn.code.size(); ++pc) {
+      const WasmInstr &in = fn.code[pc];
+      if (in.op != WasmOp::BrUnless || in.index <= pc)
+        continue;
+      uint32_t end = in.index;
+      const WasmInstr &last = fn.code[end - 1];
+      if (last.op == WasmOp::Jump && last.index > end)
+        end = last.index;
+      for (uint32_t i = pc + 1; i < end; ++i)
+        freq[i] *= 0.5;
+    }
+    return freq;
+  }
+
+  // Estimate every function; trips[i] lists the trip counts of function i's loops.
+  static std::vector<WasmFunctionCost> Estimate(const WasmModule &module,
+                                                const std::vector<std::vector<double>> &trips) {
+    std::vector<WasmFunctionCost> costs(module.functions.size());
+    static const std::vector<double> no_trips;
+
+    for (size_t f = 0; f < module.functions.size(); ++f) {
+      const WasmFunction &fn = module.functions[f];
+      WasmFunctionCost &out = costs[f];
+      const std::vector<double> freq = Frequencies(fn, f < trips.size() ? trips[f] : no_trips, out.loops);
+      out.instructions = fn.code.size();
+      for (size_t pc = 0; pc < fn.code.size(); ++pc) {
+        const WasmInstr &in = fn.code[pc];
+        out.cost += freq[pc] * Weight(in.op);
+        if (in.op == WasmOp::Call) {
+          out.calls += freq[pc];
+          out.callees[in.index] += freq[pc];
+        } else if (IsMemoryOp(in.op)) {
+          out.memoryOps += freq[pc];
+        } else if (IsBranch(in.op)) {
+          out.branches += freq[pc];
+        }
+      }
+    }
+
+    std::vector<int> state(costs.size(), 0); // 0: not done, 1: in progress, 2: done
+    for (size_t f = 0; f < costs.size(); ++f)
+      AddCallees(static_cast<uint32_t>(f), costs, state);
+    return costs;
+  }
+
+private:
+  static double AddCallees(uint32_t f, std::vector<WasmFunctionCost> &costs, std::vector<int> &state) {
+    if (state[f] == 2)
+      return costs[f].inclusiveCost;
+    if (state[f] == 1)
+      return 0.0; // Recursion: the call overhead is already counted by the caller.
+    state[f] = 1;
+    double total = costs[f].cost;
+    for (const auto &[callee, count] : costs[f].callees)
+      total += count * AddCallees(callee, costs, state);
+    costs[f].inclusiveCost = total;
+    state[f] = 2;
+    return total;
+  }
+};
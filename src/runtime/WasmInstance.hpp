@@ -0,0 +1,537 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "WasmModule.hpp"
+
+// Thrown when execution traps.
+class WasmTrap : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
+// A running instance of a WasmModule, with execution statistics.
+//
+// Example usage:
+//   WasmInstance instance(module);
+//   std::vector<uint64_t> results = instance.Invoke(*module.FindExport("main"), {});
+//   int32_t value = WasmInstance::AsI32(results[0]);
+//   uint64_t count = instance.NumInstructions();
+//
+// Values are held as raw bits: an i32 in the low 32 bits, an i64 as is, an f64
+// as its IEEE representation.  Calls are kept on an explicit frame stack rather than the
+// C++ stack, so deep recursion in the module is limited only by
+// SetCallDepthLimit().  Every executed instruction is counted (per function,
+// too), which gives a deterministic, noise-free measure of generated code.
+class WasmInstance {
+public:
+  struct FunctionStats {
+    uint64_t calls = 0;
+    uint64_t instructions = 0; // Executed in this function itself (not in callees).
+  };
+
+private:
+  struct Frame {
+    uint32_t func;
+    uint32_t pc;
+    size_t locals_base; // First local in locals.
+    size_t stack_base;  // Operand stack height when the frame was entered.
+  };
+
+  const WasmModule &module;
+  std::vector<uint8_t> memory;
+  std::vector<uint64_t> globals;
+  std::vector<uint64_t> stack{};
+  std::vector<uint64_t> locals{};
+  std::vector<Frame> frames{};
+
+  std::vector<FunctionStats> stats;
+  uint64_t instructions = 0;
+  uint64_t instruction_limit = std::numeric_limits<uint64_t>::max();
+  size_t call_depth_limit = 100000;
+  uint64_t high_water = 0; // One past the highest byte initialized or written.
+  uint32_t peak_pages = 0;
+
+  static constexpr uint32_t PAGE_SIZE = 65536;
+
+  // ---- Memory ----
+
+  uint64_t Address(uint64_t base, uint32_t offset, uint32_t size) const {
+    const uint64_t addr = static_cast<uint32_t>(base) + uint64_t{offset};
+    if (addr + size > memory.size())
+      throw WasmTrap("out of bounds memory access");
+    return addr;
+  }
+
+  template <typename T> T Load(uint64_t base, uint32_t offset) const {
+    T value;
+    std::memcpy(&value, memory.data() + Address(base, offset, sizeof(T)), sizeof(T));
+    return value;
+  }
+
+  template <typename T> void Store(uint64_t base, uint32_t offset, T value) {
+    const uint64_t addr = Address(base, offset, sizeof(T));
+    std::memcpy(memory.data() + addr, &value, sizeof(T));
+    high_water = std::max(high_water, addr + sizeof(T));
+  }
+
+  // ---- Value helpers ----
+
+  uint64_t Pop() {
+    const uint64_t value = stack.back();
+    stack.pop_back();
+    return value;
+  }
+  uint32_t PopU32() { return static_cast<uint32_t>(Pop()); }
+  int32_t PopI32() { return static_cast<int32_t>(PopU32()); }
+  double PopF64() { return AsF64(Pop()); }
+
+  void Push(uint64_t value) { stack.push_back(value); }
+  void PushU32(uint32_t value) { stack.push_back(value); }
+  void PushI32(int32_t value) { stack.push_back(static_cast<uint32_t>(value)); }
+  void PushBool(bool value) { stack.push_back(value ? 1 : 0); }
+  void PushF64(double value) { stack.push_back(FromF64(value)); }
+
+  // Keep the top arity values, placed right after the first height values.
+  void Unwind(size_t height, uint32_t arity) {
+    const size_t from = stack.size() - arity;
+    if (from != height) {
+      std::copy(stack.begin() + static_cast<std::ptrdiff_t>(from), stack.end(),
+                stack.begin() + static_cast<std::ptrdiff_t>(height));
+    }
+    stack.resize(height + arity);
+  }
+
+  static double Min(double a, double b) {
+    if (std::isnan(a) || std::isnan(b))
+      return std::numeric_limits<double>::quiet_NaN();
+    if (a == b)
+      return std::signbit(a) ? a : b; // min(-0, +0) is -0
+    return a < b ? a : b;
+  }
+
+  static double Max(double a, double b) {
+    if (std::isnan(a) || std::isnan(b))
+      return std::numeric_limits<double>::quiet_NaN();
+    if (a == b)
+      return std::signbit(a) ? b : a; // max(-0, +0) is +0
+    return a > b ? a : b;
+  }
+
+  static int32_t TruncS(double value) {
+    if (std::isnan(value))
+      throw WasmTrap("invalid conversion to integer");
+    const double truncated = std::trunc(value);
+    if (truncated < -2147483648.0 || truncated > 2147483647.0)
+      throw WasmTrap("integer overflow");
+    return static_cast<int32_t>(truncated);
+  }
+
+  static uint32_t TruncU(double value) {
+    if (std::isnan(value))
+      throw WasmTrap("invalid conversion to integer");
+    const double truncated = std::trunc(value);
+    if (truncated < 0.0 || truncated > 4294967295.0)
+      throw WasmTrap("integer overflow");
+    return static_cast<uint32_t>(truncated);
+  }
+
+  // ---- Execution ----
+
+  void EnterFunction(uint32_t func) {
+    if (frames.size() >= call_depth_limit)
+      throw WasmTrap("call stack exhausted");
+    const WasmFunction &fn = module.functions[func];
+    const size_t num_params = fn.params.size();
+    const size_t base = locals.size();
+    locals.resize(base + num_params + fn.locals.size(), 0); // Locals start at zero.
+    std::copy(stack.end() - static_cast<std::ptrdiff_t>(num_params), stack.end(), locals.begin() + static_cast<std::ptrdiff_t>(base));
+    stack.resize(stack.size() - num_params);
+    frames.push_back(Frame{func, 0, base, stack.size()});
+    ++stats[func].calls;
+  }
+
+  // Run until the frame at entry_depth returns.
+  void Run(size_t entry_depth) {
+    Frame *frame = &frames.back();
+    const WasmInstr *code = module.functions[frame->func].code.data();
+    uint64_t *counter = &stats[frame->func].instructions;
+    uint32_t pc = frame->pc;
+
+    while (true) {
+      const WasmInstr &in = code[pc++];
+      ++*counter;
+      if (++instructions > instruction_limit)
+        throw WasmTrap("instruction limit exceeded");
+
+      switch (in.op) {
+      case WasmOp::Unreachable:
+        throw WasmTrap("unreachable executed");
+      case WasmOp::Nop:
+        break;
+      case WasmOp::Br:
+        Unwind(frame->stack_base + in.height, in.arity);
+        pc = in.index;
+        break;
+      case WasmOp::BrIf:
+        if (PopU32() != 0) {
+          Unwind(frame->stack_base + in.height, in.arity);
+          pc = in.index;
+        }
+        break;
+      case WasmOp::BrUnless:
+        if (PopU32() == 0)
+          pc = in.index;
+        break;
+      case WasmOp::Jump:
+        pc = in.index;
+        break;
+      case WasmOp::Return:
+        Unwind(frame->stack_base, in.arity);
+        locals.resize(frame->locals_base);
+        frames.pop_back();
+        if (frames.size() == entry_depth)
+          return;
+        frame = &frames.back();
+        code = module.functions[frame->func].code.data();
+        counter = &stats[frame->func].instructions;
+        pc = frame->pc;
+        break;
+      case WasmOp::Call:
+        frame->pc = pc;
+        EnterFunction(in.index);
+        frame = &frames.back();
+        code = module.functions[frame->func].code.data();
+        counter = &stats[frame->func].instructions;
+        pc = 0;
+        break;
+      case WasmOp::Drop:
+        stack.pop_back();
+        break;
+      case WasmOp::Select: {
+        const uint32_t cond = PopU32();
+        const uint64_t second = Pop();
+        if (cond == 0)
+          stack.back() = second;
+        break;
+      }
+
+      case WasmOp::LocalGet:
+        Push(locals[frame->locals_base + in.index]);
+        break;
+      case WasmOp::LocalSet:
+        locals[frame->locals_base + in.index] = Pop();
+        break;
+      case WasmOp::LocalTee:
+        locals[frame->locals_base + in.index] = stack.back();
+        break;
+      case WasmOp::GlobalGet:
+        Push(globals[in.index]);
+        break;
+      case WasmOp::GlobalSet:
+        globals[in.index] = Pop();
+        break;
+
+      case WasmOp::I32Load:
+        PushU32(Load<uint32_t>(Pop(), in.index));
+        break;
+      case WasmOp::I32Load8S:
+        PushI32(Load<int8_t>(Pop(), in.index));
+        break;
+      case WasmOp::I32Load8U:
+        PushU32(Load<uint8_t>(Pop(), in.index));
+        break;
+      case WasmOp::I32Load16S:
+        PushI32(Load<int16_t>(Pop(), in.index));
+        break;
+      case WasmOp::I32Load16U:
+        PushU32(Load<uint16_t>(Pop(), in.index));
+        break;
+      case WasmOp::F64Load:
+      case WasmOp::I64Load:
+        Push(Load<uint64_t>(Pop(), in.index));
+        break;
+      case WasmOp::I32Store: {
+        const uint32_t value = PopU32();
+        Store<uint32_t>(Pop(), in.index, value);
+        break;
+      }
+      case WasmOp::I32Store8: {
+        const uint32_t value = PopU32();
+        Store<uint8_t>(Pop(), in.index, static_cast<uint8_t>(value));
+        break;
+      }
+      case WasmOp::I32Store16: {
+        const uint32_t value = PopU32();
+        Store<uint16_t>(Pop(), in.index, static_cast<uint16_t>(value));
+        break;
+      }
+      case WasmOp::F64Store:
+      case WasmOp::I64Store: {
+        const uint64_t value = Pop();
+        Store<uint64_t>(Pop(), in.index, value);
+        break;
+      }
+      case WasmOp::MemorySize:
+        PushU32(static_cast<uint32_t>(memory.size() / PAGE_SIZE));
+        break;
+      case WasmOp::MemoryGrow: {
+        const uint32_t delta = PopU32();
+        const uint64_t old_pages = memory.size() / PAGE_SIZE;
+        if (old_pages + delta > module.memory_max_pages) {
+          PushI32(-1);
+        } else {
+          memory.resize((old_pages + delta) * PAGE_SIZE, 0);
+          peak_pages = std::max(peak_pages, static_cast<uint32_t>(old_pages + delta));
+          PushU32(static_cast<uint32_t>(old_pages));
+        }
+        break;
+      }
+
+      case WasmOp::I32Const:
+      case WasmOp::I64Const:
+      case WasmOp::F64Const:
+        Push(in.value);
+        break;
+
+      case WasmOp::I32Eqz:
+        PushBool(PopU32() == 0);
+        break;
+#define TUBULAR_I32_BINARY(OP, EXPR)                                                                                   \
+  case WasmOp::OP: {                                                                                                   \
+    const uint32_t b = PopU32();                                                                                       \
+    const uint32_t a = PopU32();                                                                                       \
+    const int32_t sa = static_cast<int32_t>(a);                                                                        \
+    const int32_t sb = static_cast<int32_t>(b);                                                                        \
+    (void)sa;                                                                                                          \
+    (void)sb;                                                                                                          \
+    PushU32(static_cast<uint32_t>(EXPR));                                                                              \
+    break;                                                                                                             \
+  }
+        TUBULAR_I32_BINARY(I32Eq, a == b)
+        TUBULAR_I32_BINARY(I32Ne, a != b)
+        TUBULAR_I32_BINARY(I32LtS, sa < sb)
+        TUBULAR_I32_BINARY(I32LtU, a < b)
+        TUBULAR_I32_BINARY(I32GtS, sa > sb)
+        TUBULAR_I32_BINARY(I32GtU, a > b)
+        TUBULAR_I32_BINARY(I32LeS, sa <= sb)
+        TUBULAR_I32_BINARY(I32LeU, a <= b)
+        TUBULAR_I32_BINARY(I32GeS, sa >= sb)
+        TUBULAR_I32_BINARY(I32GeU, a >= b)
+        TUBULAR_I32_BINARY(I32Add, a + b)
+        TUBULAR_I32_BINARY(I32Sub, a - b)
+        TUBULAR_I32_BINARY(I32Mul, a * b)
+        TUBULAR_I32_BINARY(I32And, a & b)
+        TUBULAR_I32_BINARY(I32Or, a | b)
+        TUBULAR_I32_BINARY(I32Xor, a ^ b)
+        TUBULAR_I32_BINARY(I32Shl, a << (b & 31))
+        TUBULAR_I32_BINARY(I32ShrS, sa >> (b & 31))
+        TUBULAR_I32_BINARY(I32ShrU, a >> (b & 31))
+        TUBULAR_I32_BINARY(I32Rotl, std::rotl(a, static_cast<int>(b & 31)))
+        TUBULAR_I32_BINARY(I32Rotr, std::rotr(a, static_cast<int>(b & 31)))
+#undef TUBULAR_I32_BINARY
+
+      case WasmOp::I64Eqz:
+        PushBool(Pop() == 0);
+        break;
+      case WasmOp::I64Ctz:
+        Push(static_cast<uint64_t>(std::countr_zero(Pop())));
+        break;
+#define TUBULAR_I64_BINARY(OP, PUSH, EXPR)                                                                             \
+  case WasmOp::OP: {                                                                                                   \
+    const uint64_t b = Pop();                                                                                          \
+    const uint64_t a = Pop();                                                                                          \
+    PUSH(EXPR);                                                                                                        \
+    break;                                                                                                             \
+  }
+        TUBULAR_I64_BINARY(I64Eq, PushBool, a == b)
+        TUBULAR_I64_BINARY(I64Ne, PushBool, a != b)
+        TUBULAR_I64_BINARY(I64LtU, PushBool, a < b)
+        TUBULAR_I64_BINARY(I64Add, Push, a + b)
+        TUBULAR_I64_BINARY(I64Sub, Push, a - b)
+        TUBULAR_I64_BINARY(I64Mul, Push, a * b)
+        TUBULAR_I64_BINARY(I64And, Push, a & b)
+        TUBULAR_I64_BINARY(I64Or, Push, a | b)
+        TUBULAR_I64_BINARY(I64Xor, Push, a ^ b)
+        TUBULAR_I64_BINARY(I64Shl, Push, a << (b & 63))
+        TUBULAR_I64_BINARY(I64ShrU, Push, a >> (b & 63))
+#undef TUBULAR_I64_BINARY
+      case WasmOp::I32Clz:
+        PushU32(static_cast<uint32_t>(std::countl_zero(PopU32())));
+        break;
+      case WasmOp::I32Ctz:
+        PushU32(static_cast<uint32_t>(std::countr_zero(PopU32())));
+        break;
+      case WasmOp::I32Popcnt:
+        PushU32(static_cast<uint32_t>(std::popcount(PopU32())));
+        break;
+      case WasmOp::I32DivS:
+      case WasmOp::I32RemS: {
+        const int32_t b = PopI32();
+        const int32_t a = PopI32();
+        if (b == 0)
+          throw WasmTrap("integer divide by zero");
+        if (a == std::numeric_limits<int32_t>::min() && b == -1) {
+          if (in.op == WasmOp::I32DivS)
+            throw WasmTrap("integer overflow");
+          PushI32(0);
+        } else {
+          PushI32(in.op == WasmOp::I32DivS ? a / b : a % b);
+        }
+        break;
+      }
+      case WasmOp::I32DivU:
+      case WasmOp::I32RemU: {
+        const uint32_t b = PopU32();
+        const uint32_t a = PopU32();
+        if (b == 0)
+          throw WasmTrap("integer divide by zero");
+        PushU32(in.op == WasmOp::I32DivU ? a / b : a % b);
+        break;
+      }
+
+#define TUBULAR_F64_BINARY(OP, PUSH, EXPR)                                                                             \
+  case WasmOp::OP: {                                                                                                   \
+    const double b = PopF64();                                                                                         \
+    const double a = PopF64();                                                                                         \
+    PUSH(EXPR);                                                                                                        \
+    break;                                                                                                             \
+  }
+        TUBULAR_F64_BINARY(F64Eq, PushBool, a == b)
+        TUBULAR_F64_BINARY(F64Ne, PushBool, a != b)
+        TUBULAR_F64_BINARY(F64Lt, PushBool, a < b)
+        TUBULAR_F64_BINARY(F64Gt, PushBool, a > b)
+        TUBULAR_F64_BINARY(F64Le, PushBool, a <= b)
+        TUBULAR_F64_BINARY(F64Ge, PushBool, a >= b)
+        TUBULAR_F64_BINARY(F64Add, PushF64, a + b)
+        TUBULAR_F64_BINARY(F64Sub, PushF64, a - b)
+        TUBULAR_F64_BINARY(F64Mul, PushF64, a * b)
+        TUBULAR_F64_BINARY(F64Div, PushF64, a / b)
+        TUBULAR_F64_BINARY(F64Min, PushF64, Min(a, b))
+        TUBULAR_F64_BINARY(F64Max, PushF64, Max(a, b))
+        TUBULAR_F64_BINARY(F64Copysign, PushF64, std::copysign(a, b))
+#undef TUBULAR_F64_BINARY
+      case WasmOp::F64Abs:
+        PushF64(std::fabs(PopF64()));
+        break;
+      case WasmOp::F64Neg:
+        PushF64(-PopF64());
+        break;
+      case WasmOp::F64Ceil:
+        PushF64(std::ceil(PopF64()));
+        break;
+      case WasmOp::F64Floor:
+        PushF64(std::floor(PopF64()));
+        break;
+      case WasmOp::F64Trunc:
+        PushF64(std::trunc(PopF64()));
+        break;
+      case WasmOp::F64Nearest:
+        PushF64(std::nearbyint(PopF64()));
+        break;
+      case WasmOp::F64Sqrt:
+        PushF64(std::sqrt(PopF64()));
+        break;
+
+      case WasmOp::I32TruncF64S:
+        PushI32(TruncS(PopF64()));
+        break;
+      case WasmOp::I32TruncF64U:
+        PushU32(TruncU(PopF64()));
+        break;
+      case WasmOp::F64ConvertI32S:
+        PushF64(static_cast<double>(PopI32()));
+        break;
+      case WasmOp::F64ConvertI32U:
+        PushF64(static_cast<double>(PopU32()));
+        break;
+      case WasmOp::I32WrapI64:
+        PushU32(static_cast<uint32_t>(Pop()));
+        break;
+      case WasmOp::I64ExtendI32U:
+        Push(PopU32());
+        break;
+      }
+    }
+  }
+
+public:
+  explicit WasmInstance(const WasmModule &module)
+      : module(module), memory(size_t{module.memory_pages} * PAGE_SIZE, 0), stats(module.functions.size()),
+        peak_pages(module.memory_pages) {
+    for (const WasmGlobal &global : module.globals)
+      globals.push_back(global.init);
+    for (const WasmData &segment : module.data) {
+      if (uint64_t{segment.offset} + segment.bytes.size() > memory.size())
+        throw WasmTrap("data segment at line " + std::to_string(segment.line) + " does not fit in memory");
+      std::memcpy(memory.data() + segment.offset, segment.bytes.data(), segment.bytes.size());
+      high_water = std::max(high_water, uint64_t{segment.offset} + segment.bytes.size());
+    }
+    if (module.start)
+      Invoke(*module.start, {});
+  }
+
+  static int32_t AsI32(uint64_t value) { return static_cast<int32_t>(static_cast<uint32_t>(value)); }
+  static double AsF64(uint64_t value) { return std::bit_cast<double>(value); }
+  static uint64_t FromI32(int32_t value) { return static_cast<uint32_t>(value); }
+  static uint64_t FromF64(double value) { return std::bit_cast<uint64_t>(value); }
+
+  void SetInstructionLimit(uint64_t limit) { instruction_limit = limit; }
+  void SetCallDepthLimit(size_t limit) { call_depth_limit = limit; }
+
+  // Call a function; throws WasmTrap if execution traps.
+  std::vector<uint64_t> Invoke(uint32_t func, const std::vector<uint64_t> &args) {
+    const WasmFunction &fn = module.functions.at(func);
+    if (args.size() != fn.params.size())
+      throw WasmTrap("function " + fn.name + " expects " + std::to_string(fn.params.size()) + " argument(s)");
+    const size_t entry_depth = frames.size();
+    const size_t stack_base = stack.size();
+    stack.insert(stack.end(), args.begin(), args.end());
+    try {
+      EnterFunction(func);
+      Run(entry_depth);
+    } catch (...) {
+      frames.resize(entry_depth);
+      stack.resize(stack_base);
+      locals.clear();
+      throw;
+    }
+    std::vector<uint64_t> results(stack.end() - static_cast<std::ptrdiff_t>(fn.results.size()), stack.end());
+    stack.resize(stack_base);
+    return results;
+  }
+
+  // ---- Memory access for the host ----
+
+  void WriteBytes(uint32_t addr, const std::string &bytes) {
+    for (size_t i = 0; i < bytes.size(); ++i)
+      Store<uint8_t>(addr, static_cast<uint32_t>(i), static_cast<uint8_t>(bytes[i]));
+  }
+
+  // Read a null-terminated string (as the compiler lays strings out).
+  std::string ReadString(uint32_t addr) const {
+    std::string out;
+    for (uint32_t i = 0;; ++i) {
+      const uint8_t byte = Load<uint8_t>(addr, i);
+      if (byte == 0)
+        return out;
+      out.push_back(static_cast<char>(byte));
+    }
+  }
+
+  // ---- Statistics ----
+
+  uint64_t NumInstructions() const { return instructions; }
+  const std::vector<FunctionStats> &GetFunctionStats() const { return stats; }
+  uint64_t MemoryHighWater() const { return high_water; }
+  uint32_t MemoryPages() const { return static_cast<uint32_t>(memory.size() / PAGE_SIZE); }
+  uint32_t PeakMemoryPages() const { return peak_pages; }
+};
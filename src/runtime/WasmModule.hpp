@@ -0,0 +1,1129 @@
+#pragma once
+
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "WatParser.hpp"
+
+enum class ValType : uint8_t { I32, F64, I64 };
+
+inline const char *ValTypeName(ValType type) {
+  return type == ValType::I32 ? "i32" : type == ValType::I64 ? "i64" : "f64";
+}
+
+// Instructions after loading.  Structured control flow is resolved into
+// jumps, so block, loop, and end leave nothing behind; everything else maps
+// one-to-one onto a WebAssembly instruction.
+enum class WasmOp : uint8_t {
+  // Control
+  Unreachable,
+  Nop,
+  Br,        // Jump to index, keeping arity values on top of the frame's first height values.
+  BrIf,      // Pop a condition; branch like Br if it is non-zero.
+  BrUnless,  // Pop a condition; jump to index if it is zero (the test of an if).
+  Jump,      // Jump to index (from the end of an if's then-branch to past its else).
+  Return,
+  Call,
+  Drop,
+  Select,
+
+  // Variables
+  LocalGet,
+  LocalSet,
+  LocalTee,
+  GlobalGet,
+  GlobalSet,
+
+  // Memory (index holds the static offset)
+  I32Load,
+  I32Load8S,
+  I32Load8U,
+  I32Load16S,
+  I32Load16U,
+  F64Load,
+  I64Load,
+  I32Store,
+  I32Store8,
+  I32Store16,
+  I64Store,
+  F64Store,
+  MemorySize,
+  MemoryGrow,
+
+  // Numeric
+  I32Const,
+  F64Const,
+  I64Const,
+  I32Eqz,
+  I32Eq,
+  I32Ne,
+  I32LtS,
+  I32LtU,
+  I32GtS,
+  I32GtU,
+  I32LeS,
+  I32LeU,
+  I32GeS,
+  I32GeU,
+  I32Clz,
+  I32Ctz,
+  I32Popcnt,
+  I32Add,
+  I32Sub,
+  I32Mul,
+  I32DivS,
+  I32DivU,
+  I32RemS,
+  I32RemU,
+  I32And,
+  I32Or,
+  I32Xor,
+  I32Shl,
+  I32ShrS,
+  I32ShrU,
+  I32Rotl,
+  I32Rotr,
+  I64Eqz,
+  I64Eq,
+  I64Ne,
+  I64LtU,
+  I64Ctz,
+  I64Add,
+  I64Sub,
+  I64Mul,
+  I64And,
+  I64Or,
+  I64Xor,
+  I64Shl,
+  I64ShrU,
+  F64Eq,
+  F64Ne,
+  F64Lt,
+  F64Gt,
+  F64Le,
+  F64Ge,
+  F64Abs,
+  F64Neg,
+  F64Ceil,
+  F64Floor,
+  F64Trunc,
+  F64Nearest,
+  F64Sqrt,
+  F64Add,
+  F64Sub,
+  F64Mul,
+  F64Div,
+  F64Min,
+  F64Max,
+  F64Copysign,
+  I32TruncF64S,
+  I32TruncF64U,
+  F64ConvertI32S,
+  F64ConvertI32U,
+  I32WrapI64,
+  I64ExtendI32U,
+};
+
+struct WasmInstr {
+  WasmOp op = WasmOp::Nop;
+  uint32_t index = 0;  // Local, global, or function index; jump target; or memory offset.
+  uint32_t arity = 0;  // Values a branch or return carries.
+  uint32_t height = 0; // Operand stack height (within the frame) a branch cuts back to.
+  uint64_t value = 0;  // Bits of a constant.
+};
+
+// The instructions of a structured loop: code[start, end).
+struct WasmLoop {
+  uint32_t start = 0;
+  uint32_t end = 0;
+};
+
+struct WasmFunction {
+  std::string name{};               // $name without the '$', or "func<index>".
+  std::vector<ValType> params{};
+  std::vector<ValType> results{};
+  std::vector<ValType> locals{};    // Declared locals (after the parameters).
+  std::vector<WasmInstr> code{};
+  std::vector<WasmLoop> loops{};    // In the order the loops open in the source.
+};
+
+struct WasmGlobal {
+  ValType type = ValType::I32;
+  bool is_mutable = false;
+  uint64_t init = 0;
+};
+
+struct WasmData {
+  uint32_t offset = 0;
+  std::string bytes{};
+  size_t line = 0;
+};
+
+// A module read from WebAssembly text and validated.  Supports the subset of
+// WebAssembly 1.0 (plus multi-value results) that the compiler emits: i32 and
+// f64 arithmetic, the i64 loads and bit operations of its string runtime,
+// functions, one memory, globals, data segments, and exports.
+//
+// Example usage:
+//   WasmModule module = WasmModule::Load(WatParser(source).ParseModule());
+//   std::optional<uint32_t> main = module.FindExport("main");
+class WasmModule {
+public:
+  std::vector<WasmFunction> functions{};
+  std::vector<WasmGlobal> globals{};
+  std::vector<WasmData> data{};
+  std::unordered_map<std::string, uint32_t> exports{}; // Exported function name -> index
+  bool has_memory = false;
+  uint32_t memory_pages = 0;
+  uint32_t memory_max_pages = 65536;
+  std::optional<uint32_t> start{};
+
+  std::optional<uint32_t> FindExport(const std::string &name) const {
+    auto it = exports.find(name);
+    if (it == exports.end())
+      return std::nullopt;
+    return it->second;
+  }
+
+  static WasmModule Load(const SExpr &module_expr) {
+    WasmModule module;
+    ModuleLoader(module).Load(module_expr);
+    return module;
+  }
+
+  // ---- Literal parsing (shared with the command line) ----
+
+  static std::optional<uint32_t> ParseI32(const std::string &text) {
+    auto value = ParseInt(text, 0x80000000ull, 0xFFFFFFFFull);
+    return value ? std::optional<uint32_t>(static_cast<uint32_t>(*value)) : std::nullopt;
+  }
+
+  static std::optional<uint64_t> ParseI64(const std::string &text) {
+    return ParseInt(text, 0x8000000000000000ull, 0xFFFFFFFFFFFFFFFFull);
+  }
+
+  static std::optional<double> ParseF64(std::string text) {
+    std::erase(text, '_');
+    bool negative = false;
+    std::string body = text;
+    if (!body.empty() && (body[0] == '-' || body[0] == '+')) {
+      negative = body[0] == '-';
+      body = body.substr(1);
+    }
+    if (body == "inf")
+      return negative ? -std::numeric_limits<double>::infinity() : std::numeric_limits<double>::infinity();
+    if (body == "nan" || body.rfind("nan:", 0) == 0)
+      return negative ? -std::numeric_limits<double>::quiet_NaN() : std::numeric_limits<double>::quiet_NaN();
+    if (body.empty() || body.find_first_not_of("0123456789abcdefABCDEFxXpP.+-") != std::string::npos)
+      return std::nullopt;
+    char *end = nullptr;
+    const double value = std::strtod(text.c_str(), &end);
+    if (*end != '\0')
+      return std::nullopt;
+    return value;
+  }
+
+  static uint64_t F64Bits(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+  }
+
+private:
+  // An integer literal, signed or not, whose magnitude fits the given bounds.
+  static std::optional<uint64_t> ParseInt(std::string text, unsigned long long max_negative,
+                                          unsigned long long max_positive) {
+    std::erase(text, '_');
+    bool negative = false;
+    size_t pos = 0;
+    if (pos < text.size() && (text[pos] == '-' || text[pos] == '+')) {
+      negative = text[pos] == '-';
+      ++pos;
+    }
+    int base = 10;
+    if (text.compare(pos, 2, "0x") == 0 || text.compare(pos, 2, "0X") == 0) {
+      base = 16;
+      pos += 2;
+    }
+    if (pos >= text.size() || !std::isxdigit(static_cast<unsigned char>(text[pos])))
+      return std::nullopt;
+    errno = 0;
+    char *end = nullptr;
+    const unsigned long long magnitude = std::strtoull(text.c_str() + pos, &end, base);
+    if (errno != 0 || *end != '\0')
+      return std::nullopt;
+    if (negative ? magnitude > max_negative : magnitude > max_positive)
+      return std::nullopt;
+    return static_cast<uint64_t>(negative ? 0ull - magnitude : magnitude);
+  }
+
+  // How an instruction's immediates are written.
+  enum class Imm { None, Local, Global, Func, Label, I32, I64, F64, Mem };
+
+  struct OpInfo {
+    const char *name;
+    WasmOp op;
+    const char *params;  // 'i' for i32, 'l' for i64, 'd' for f64
+    const char *results;
+    Imm imm;
+    uint32_t natural_align = 0; // Bytes accessed, for memory instructions.
+  };
+
+  // Instructions with a fixed signature.
+  static const OpInfo *FindOp(const std::string &name) {
+    static const OpInfo table[] = {
+        {"unreachable", WasmOp::Unreachable, "", "", Imm::None},
+        {"nop", WasmOp::Nop, "", "", Imm::None},
+        {"i32.load", WasmOp::I32Load, "i", "i", Imm::Mem, 4},
+        {"i32.load8_s", WasmOp::I32Load8S, "i", "i", Imm::Mem, 1},
+        {"i32.load8_u", WasmOp::I32Load8U, "i", "i", Imm::Mem, 1},
+        {"i32.load16_s", WasmOp::I32Load16S, "i", "i", Imm::Mem, 2},
+        {"i32.load16_u", WasmOp::I32Load16U, "i", "i", Imm::Mem, 2},
+        {"f64.load", WasmOp::F64Load, "i", "d", Imm::Mem, 8},
+        {"i64.load", WasmOp::I64Load, "i", "l", Imm::Mem, 8},
+        {"i32.store", WasmOp::I32Store, "ii", "", Imm::Mem, 4},
+        {"i32.store8", WasmOp::I32Store8, "ii", "", Imm::Mem, 1},
+        {"i32.store16", WasmOp::I32Store16, "ii", "", Imm::Mem, 2},
+        {"f64.store", WasmOp::F64Store, "id", "", Imm::Mem, 8},
+        {"i64.store", WasmOp::I64Store, "il", "", Imm::Mem, 8},
+        {"memory.size", WasmOp::MemorySize, "", "i", Imm::None},
+        {"memory.grow", WasmOp::MemoryGrow, "i", "i", Imm::None},
+        {"i32.const", WasmOp::I32Const, "", "i", Imm::I32},
+        {"f64.const", WasmOp::F64Const, "", "d", Imm::F64},
+        {"i64.const", WasmOp::I64Const, "", "l", Imm::I64},
+        {"i32.eqz", WasmOp::I32Eqz, "i", "i", Imm::None},
+        {"i32.eq", WasmOp::I32Eq, "ii", "i", Imm::None},
+        {"i32.ne", WasmOp::I32Ne, "ii", "i", Imm::None},
+        {"i32.lt_s", WasmOp::I32LtS, "ii", "i", Imm::None},
+        {"i32.lt_u", WasmOp::I32LtU, "ii", "i", Imm::None},
+        {"i32.gt_s", WasmOp::I32GtS, "ii", "i", Imm::None},
+        {"i32.gt_u", WasmOp::I32GtU, "ii", "i", Imm::None},
+        {"i32.le_s", WasmOp::I32LeS, "ii", "i", Imm::None},
+        {"i32.le_u", WasmOp::I32LeU, "ii", "i", Imm::None},
+        {"i32.ge_s", WasmOp::I32GeS, "ii", "i", Imm::None},
+        {"i32.ge_u", WasmOp::I32GeU, "ii", "i", Imm::None},
+        {"i32.clz", WasmOp::I32Clz, "i", "i", Imm::None},
+        {"i32.ctz", WasmOp::I32Ctz, "i", "i", Imm::None},
+        {"i32.popcnt", WasmOp::I32Popcnt, "i", "i", Imm::None},
+        {"i32.add", WasmOp::I32Add, "ii", "i", Imm::None},
+        {"i32.sub", WasmOp::I32Sub, "ii", "i", Imm::None},
+        {"i32.mul", WasmOp::I32Mul, "ii", "i", Imm::None},
+        {"i32.div_s", WasmOp::I32DivS, "ii", "i", Imm::None},
+        {"i32.div_u", WasmOp::I32DivU, "ii", "i", Imm::None},
+        {"i32.rem_s", WasmOp::I32RemS, "ii", "i", Imm::None},
+        {"i32.rem_u", WasmOp::I32RemU, "ii", "i", Imm::None},
+        {"i32.and", WasmOp::I32And, "ii", "i", Imm::None},
+        {"i32.or", WasmOp::I32Or, "ii", "i", Imm::None},
+        {"i32.xor", WasmOp::I32Xor, "ii", "i", Imm::None},
+        {"i32.shl", WasmOp::I32Shl, "ii", "i", Imm::None},
+        {"i32.shr_s", WasmOp::I32ShrS, "ii", "i", Imm::None},
+        {"i32.shr_u", WasmOp::I32ShrU, "ii", "i", Imm::None},
+        {"i32.rotl", WasmOp::I32Rotl, "ii", "i", Imm::None},
+        {"i32.rotr", WasmOp::I32Rotr, "ii", "i", Imm::None},
+        {"i64.eqz", WasmOp::I64Eqz, "l", "i", Imm::None},
+        {"i64.eq", WasmOp::I64Eq, "ll", "i", Imm::None},
+        {"i64.ne", WasmOp::I64Ne, "ll", "i", Imm::None},
+        {"i64.lt_u", WasmOp::I64LtU, "ll", "i", Imm::None},
+        {"i64.ctz", WasmOp::I64Ctz, "l", "l", Imm::None},
+        {"i64.add", WasmOp::I64Add, "ll", "l", Imm::None},
+        {"i64.sub", WasmOp::I64Sub, "ll", "l", Imm::None},
+        {"i64.mul", WasmOp::I64Mul, "ll", "l", Imm::None},
+        {"i64.and", WasmOp::I64And, "ll", "l", Imm::None},
+        {"i64.or", WasmOp::I64Or, "ll", "l", Imm::None},
+        {"i64.xor", WasmOp::I64Xor, "ll", "l", Imm::None},
+        {"i64.shl", WasmOp::I64Shl, "ll", "l", Imm::None},
+        {"i64.shr_u", WasmOp::I64ShrU, "ll", "l", Imm::None},
+        {"f64.eq", WasmOp::F64Eq, "dd", "i", Imm::None},
+        {"f64.ne", WasmOp::F64Ne, "dd", "i", Imm::None},
+        {"f64.lt", WasmOp::F64Lt, "dd", "i", Imm::None},
+        {"f64.gt", WasmOp::F64Gt, "dd", "i", Imm::None},
+        {"f64.le", WasmOp::F64Le, "dd", "i", Imm::None},
+        {"f64.ge", WasmOp::F64Ge, "dd", "i", Imm::None},
+        {"f64.abs", WasmOp::F64Abs, "d", "d", Imm::None},
+        {"f64.neg", WasmOp::F64Neg, "d", "d", Imm::None},
+        {"f64.ceil", WasmOp::F64Ceil, "d", "d", Imm::None},
+        {"f64.floor", WasmOp::F64Floor, "d", "d", Imm::None},
+        {"f64.trunc", WasmOp::F64Trunc, "d", "d", Imm::None},
+        {"f64.nearest", WasmOp::F64Nearest, "d", "d", Imm::None},
+        {"f64.sqrt", WasmOp::F64Sqrt, "d", "d", Imm::None},
+        {"f64.add", WasmOp::F64Add, "dd", "d", Imm::None},
+        {"f64.sub", WasmOp::F64Sub, "dd", "d", Imm::None},
+        {"f64.mul", WasmOp::F64Mul, "dd", "d", Imm::None},
+        {"f64.div", WasmOp::F64Div, "dd", "d", Imm::None},
+        {"f64.min", WasmOp::F64Min, "dd", "d", Imm::None},
+        {"f64.max", WasmOp::F64Max, "dd", "d", Imm::None},
+        {"f64.copysign", WasmOp::F64Copysign, "dd", "d", Imm::None},
+        {"i32.trunc_f64_s", WasmOp::I32TruncF64S, "d", "i", Imm::None},
+        {"i32.trunc_f64_u", WasmOp::I32TruncF64U, "d", "i", Imm::None},
+        {"f64.convert_i32_s", WasmOp::F64ConvertI32S, "i", "d", Imm::None},
+        {"f64.convert_i32_u", WasmOp::F64ConvertI32U, "i", "d", Imm::None},
+        {"i32.wrap_i64", WasmOp::I32WrapI64, "l", "i", Imm::None},
+        {"i64.extend_i32_u", WasmOp::I64ExtendI32U, "i", "l", Imm::None},
+        // Instructions whose operand types depend on context (checked separately).
+        {"br", WasmOp::Br, "", "", Imm::Label},
+        {"br_if", WasmOp::BrIf, "", "", Imm::Label},
+        {"return", WasmOp::Return, "", "", Imm::None},
+        {"call", WasmOp::Call, "", "", Imm::Func},
+        {"drop", WasmOp::Drop, "", "", Imm::None},
+        {"select", WasmOp::Select, "", "", Imm::None},
+        {"local.get", WasmOp::LocalGet, "", "", Imm::Local},
+        {"local.set", WasmOp::LocalSet, "", "", Imm::Local},
+        {"local.tee", WasmOp::LocalTee, "", "", Imm::Local},
+        {"global.get", WasmOp::GlobalGet, "", "", Imm::Global},
+        {"global.set", WasmOp::GlobalSet, "", "", Imm::Global},
+        // Structured control (handled by the loader itself).
+        {"block", WasmOp::Nop, "", "", Imm::None},
+        {"loop", WasmOp::Nop, "", "", Imm::None},
+        {"if", WasmOp::BrUnless, "", "", Imm::None},
+        {"else", WasmOp::Jump, "", "", Imm::None},
+        {"end", WasmOp::Nop, "", "", Imm::None},
+        // Older spellings still accepted by wat2wasm.
+        {"get_local", WasmOp::LocalGet, "", "", Imm::Local},
+        {"set_local", WasmOp::LocalSet, "", "", Imm::Local},
+        {"tee_local", WasmOp::LocalTee, "", "", Imm::Local},
+        {"get_global", WasmOp::GlobalGet, "", "", Imm::Global},
+    };
+    static const std::unordered_map<std::string, const OpInfo *> by_name = [] {
+      std::unordered_map<std::string, const OpInfo *> out;
+      for (const OpInfo &info : table) {
+        out[info.name] = &info;
+      }
+      out["set_global"] = out["global.set"];
+      return out;
+    }();
+    auto it = by_name.find(name);
+    return it == by_name.end() ? nullptr : it->second;
+  }
+
+  static ValType TypeFromCode(char code) {
+    return code == 'i' ? ValType::I32 : code == 'l' ? ValType::I64 : ValType::F64;
+  }
+
+  static ValType ParseValType(const SExpr &expr) {
+    if (expr.IsAtom("i32"))
+      return ValType::I32;
+    if (expr.IsAtom("i64"))
+      return ValType::I64;
+    if (expr.IsAtom("f64"))
+      return ValType::F64;
+    if (expr.IsAtom("f32"))
+      throw WasmError(expr.line, "type '" + expr.text + "' is not supported (only i32, i64, and f64 are)");
+    throw WasmError(expr.line, "expected a value type, found '" + expr.text + "'");
+  }
+
+  // ---- Module-level loading ----
+
+  class ModuleLoader {
+  private:
+    WasmModule &module;
+    std::unordered_map<std::string, uint32_t> func_names{};
+    std::unordered_map<std::string, uint32_t> global_names{};
+    std::vector<const SExpr *> func_exprs{};
+
+    static std::string InlineExport(const SExpr &field, size_t &pos) {
+      if (pos < field.items.size() && field.items[pos].IsList("export")) {
+        const SExpr &exp = field.items[pos++];
+        if (exp.items.size() != 2 || !exp.items[1].IsString())
+          throw WasmError(exp.line, "expected (export \"name\")");
+        return exp.items[1].text;
+      }
+      return "";
+    }
+
+    void AddExport(const std::string &name, uint32_t index, size_t line) {
+      if (!module.exports.emplace(name, index).second)
+        throw WasmError(line, "duplicate export \"" + name + "\"");
+    }
+
+    uint64_t ConstExpr(const SExpr &expr, ValType type) const {
+      if (type == ValType::I32 && expr.IsList("i32.const") && expr.items.size() == 2) {
+        if (auto value = ParseI32(expr.items[1].text))
+          return *value;
+      } else if (type == ValType::I64 && expr.IsList("i64.const") && expr.items.size() == 2) {
+        if (auto value = ParseI64(expr.items[1].text))
+          return *value;
+      } else if (type == ValType::F64 && expr.IsList("f64.const") && expr.items.size() == 2) {
+        if (auto value = ParseF64(expr.items[1].text))
+          return F64Bits(*value);
+      }
+      throw WasmError(expr.line, std::string("expected a constant ") + ValTypeName(type) + " expression");
+    }
+
+    void DeclareFunction(const SExpr &field) {
+      const uint32_t index = static_cast<uint32_t>(module.functions.size());
+      WasmFunction fn;
+      size_t pos = 1;
+      fn.name = "func" + std::to_string(index);
+      if (pos < field.items.size() && field.items[pos].IsName()) {
+        fn.name = field.items[pos].text.substr(1);
+        if (!func_names.emplace(field.items[pos].text, index).second)
+          throw WasmError(field.line, "duplicate function " + field.items[pos].text);
+        ++pos;
+      }
+      while (pos < field.items.size() && field.items[pos].IsList("export")) {
+        const size_t line = field.items[pos].line;
+        AddExport(InlineExport(field, pos), index, line);
+      }
+      if (pos < field.items.size() && field.items[pos].IsList("import"))
+        throw WasmError(field.line, "imported functions are not supported");
+      if (pos < field.items.size() && field.items[pos].IsList("type"))
+        throw WasmError(field.line, "type uses are not supported; declare params and results inline");
+      for (; pos < field.items.size() && field.items[pos].IsList("param"); ++pos) {
+        const SExpr &param = field.items[pos];
+        for (size_t i = 1; i < param.items.size(); ++i) {
+          if (!param.items[i].IsName())
+            fn.params.push_back(ParseValType(param.items[i]));
+        }
+      }
+      for (; pos < field.items.size() && field.items[pos].IsList("result"); ++pos) {
+        for (size_t i = 1; i < field.items[pos].items.size(); ++i)
+          fn.results.push_back(ParseValType(field.items[pos].items[i]));
+      }
+      module.functions.push_back(std::move(fn));
+      func_exprs.push_back(&field);
+    }
+
+    void LoadMemory(const SExpr &field) {
+      if (module.has_memory)
+        throw WasmError(field.line, "only one memory is supported");
+      module.has_memory = true;
+      size_t pos = 1;
+      if (pos < field.items.size() && field.items[pos].IsName())
+        ++pos;
+      while (pos < field.items.size() && field.items[pos].IsList("export"))
+        InlineExport(field, pos); // Memory exports need no bookkeeping.
+      std::vector<uint32_t> limits;
+      for (; pos < field.items.size(); ++pos) {
+        auto value = field.items[pos].IsAtom() ? ParseI32(field.items[pos].text) : std::nullopt;
+        if (!value)
+          throw WasmError(field.items[pos].line, "expected memory limits");
+        limits.push_back(*value);
+      }
+      if (limits.empty() || limits.size() > 2)
+        throw WasmError(field.line, "memory needs a minimum (and optional maximum) size");
+      module.memory_pages = limits[0];
+      if (limits.size() == 2)
+        module.memory_max_pages = limits[1];
+      if (module.memory_pages > 65536 || module.memory_max_pages > 65536 ||
+          module.memory_pages > module.memory_max_pages)
+        throw WasmError(field.line, "invalid memory limits");
+    }
+
+    void LoadGlobal(const SExpr &field) {
+      const uint32_t index = static_cast<uint32_t>(module.globals.size());
+      size_t pos = 1;
+      if (pos < field.items.size() && field.items[pos].IsName()) {
+        if (!global_names.emplace(field.items[pos].text, index).second)
+          throw WasmError(field.line, "duplicate global " + field.items[pos].text);
+        ++pos;
+      }
+      while (pos < field.items.size() && field.items[pos].IsList("export"))
+        InlineExport(field, pos);
+      if (pos + 2 != field.items.size())
+        throw WasmError(field.line, "expected (global $name type (init))");
+      WasmGlobal global;
+      const SExpr &type = field.items[pos];
+      if (type.IsList("mut") && type.items.size() == 2) {
+        global.is_mutable = true;
+        global.type = ParseValType(type.items[1]);
+      } else {
+        global.type = ParseValType(type);
+      }
+      global.init = ConstExpr(field.items[pos + 1], global.type);
+      module.globals.push_back(global);
+    }
+
+    void LoadData(const SExpr &field) {
+      size_t pos = 1;
+      if (pos < field.items.size() && (field.items[pos].IsName() || field.items[pos].IsList("memory")))
+        ++pos;
+      if (pos >= field.items.size())
+        throw WasmError(field.line, "data segment needs an offset");
+      const SExpr *offset = &field.items[pos++];
+      if (offset->IsList("offset") && offset->items.size() == 2)
+        offset = &offset->items[1];
+      WasmData segment;
+      segment.offset = static_cast<uint32_t>(ConstExpr(*offset, ValType::I32));
+      segment.line = field.line;
+      for (; pos < field.items.size(); ++pos) {
+        if (!field.items[pos].IsString())
+          throw WasmError(field.items[pos].line, "expected a string in data segment");
+        segment.bytes += field.items[pos].text;
+      }
+      module.data.push_back(std::move(segment));
+    }
+
+    uint32_t ResolveFunc(const SExpr &ref) const {
+      if (ref.IsName()) {
+        auto it = func_names.find(ref.text);
+        if (it == func_names.end())
+          throw WasmError(ref.line, "unknown function " + ref.text);
+        return it->second;
+      }
+      auto index = ref.IsAtom() ? ParseI32(ref.text) : std::nullopt;
+      if (!index || *index >= module.functions.size())
+        throw WasmError(ref.line, "unknown function " + ref.text);
+      return *index;
+    }
+
+  public:
+    explicit ModuleLoader(WasmModule &module) : module(module) {}
+
+    uint32_t FunctionIndex(const SExpr &ref) const { return ResolveFunc(ref); }
+    uint32_t GlobalIndex(const SExpr &ref) const {
+      if (ref.IsName()) {
+        auto it = global_names.find(ref.text);
+        if (it == global_names.end())
+          throw WasmError(ref.line, "unknown global " + ref.text);
+        return it->second;
+      }
+      auto index = ref.IsAtom() ? ParseI32(ref.text) : std::nullopt;
+      if (!index || *index >= module.globals.size())
+        throw WasmError(ref.line, "unknown global " + ref.text);
+      return *index;
+    }
+
+    const WasmModule &GetModule() const { return module; }
+
+    void Load(const SExpr &module_expr) {
+      // Declarations first, so bodies can refer to anything in the module.
+      std::vector<const SExpr *> later;
+      for (size_t i = 1; i < module_expr.items.size(); ++i) {
+        const SExpr &field = module_expr.items[i];
+        const std::string &head = field.Head();
+        if (head == "func")
+          DeclareFunction(field);
+        else if (head == "memory")
+          LoadMemory(field);
+        else if (head == "global")
+          LoadGlobal(field);
+        else if (head == "data")
+          LoadData(field);
+        else if (head == "export" || head == "start")
+          later.push_back(&field);
+        else if (field.IsList())
+          throw WasmError(field.line, "module field '" + head + "' is not supported");
+        else
+          throw WasmError(field.line, "unexpected '" + field.text + "' in module");
+      }
+
+      for (const SExpr *field : later) {
+        if (field->Head() == "start") {
+          if (field->items.size() != 2)
+            throw WasmError(field->line, "expected (start $func)");
+          module.start = ResolveFunc(field->items[1]);
+          const WasmFunction &fn = module.functions[*module.start];
+          if (!fn.params.empty() || !fn.results.empty())
+            throw WasmError(field->line, "start function must take and return nothing");
+          continue;
+        }
+        if (field->items.size() != 3 || !field->items[1].IsString() || !field->items[2].IsList())
+          throw WasmError(field->line, "expected (export \"name\" (kind $ref))");
+        const SExpr &desc = field->items[2];
+        if (desc.Head() == "func" && desc.items.size() == 2)
+          AddExport(field->items[1].text, ResolveFunc(desc.items[1]), field->line);
+        else if (desc.Head() != "memory" && desc.Head() != "global")
+          throw WasmError(field->line, "unsupported export");
+      }
+
+      if (!module.data.empty() && !module.has_memory)
+        throw WasmError(module.data.front().line, "data segment without a memory");
+
+      for (size_t i = 0; i < func_exprs.size(); ++i) {
+        FunctionCompiler(*this, module.functions[i]).Compile(*func_exprs[i]);
+      }
+    }
+  };
+
+  // ---- Function bodies: validation and lowering to jumps ----
+
+  class FunctionCompiler {
+  private:
+    using StackType = std::optional<ValType>; // nullopt: unknown (in unreachable code)
+
+    enum class BlockKind { Function, Block, Loop, If };
+
+    struct Control {
+      BlockKind kind;
+      std::string label{};
+      std::vector<ValType> results{};
+      size_t height = 0;          // Operand stack height on entry.
+      bool unreachable = false;
+      uint32_t start = 0;         // Loop head (branch target of a loop).
+      size_t loop_id = 0;         // Index into fn.loops, for a loop.
+      std::vector<size_t> fixups{}; // Branches to patch with the end address.
+      std::optional<size_t> if_test{}; // BrUnless to patch with the else/end address.
+      bool has_else = false;
+      size_t line = 0;
+    };
+
+    const ModuleLoader &loader;
+    const WasmModule &module;
+    WasmFunction &fn;
+    std::unordered_map<std::string, uint32_t> local_names{};
+    std::vector<ValType> local_types{}; // Parameters, then declared locals.
+    std::vector<StackType> stack{};
+    std::vector<Control> controls{};
+
+    uint32_t Here() const { return static_cast<uint32_t>(fn.code.size()); }
+    size_t Emit(const WasmInstr &instr) {
+      fn.code.push_back(instr);
+      return fn.code.size() - 1;
+    }
+
+    // -- Operand type stack --
+
+    void Push(StackType type) { stack.push_back(type); }
+
+    StackType Pop(size_t line, StackType expected = std::nullopt) {
+      Control &frame = controls.back();
+      if (stack.size() == frame.height) {
+        if (frame.unreachable)
+          return expected;
+        throw WasmError(line, std::string("stack underflow in ") + fn.name +
+                                  (expected ? std::string(" (expected ") + ValTypeName(*expected) + ")" : ""));
+      }
+      const StackType actual = stack.back();
+      stack.pop_back();
+      if (actual && expected && *actual != *expected) {
+        throw WasmError(line, std::string("type mismatch in ") + fn.name + ": expected " + ValTypeName(*expected) +
+                                  ", found " + ValTypeName(*actual));
+      }
+      return actual ? actual : expected;
+    }
+
+    void PopTypes(const std::vector<ValType> &types, size_t line) {
+      for (size_t i = types.size(); i-- > 0;)
+        Pop(line, types[i]);
+    }
+
+    void PushTypes(const std::vector<ValType> &types) {
+      for (ValType type : types)
+        Push(type);
+    }
+
+    void SetUnreachable() {
+      stack.resize(controls.back().height);
+      controls.back().unreachable = true;
+    }
+
+    // -- Immediates --
+
+    uint32_t LocalIndex(const SExpr &ref) const {
+      if (ref.IsName()) {
+        auto it = local_names.find(ref.text);
+        if (it == local_names.end())
+          throw WasmError(ref.line, "unknown local " + ref.text + " in " + fn.name);
+        return it->second;
+      }
+      auto index = ref.IsAtom() ? ParseI32(ref.text) : std::nullopt;
+      if (!index || *index >= local_types.size())
+        throw WasmError(ref.line, "unknown local " + ref.text + " in " + fn.name);
+      return *index;
+    }
+
+    // Index into controls (from the bottom) of the block a label names.
+    size_t LabelTarget(const SExpr &ref) const {
+      if (ref.IsName()) {
+        for (size_t i = controls.size(); i-- > 1;) {
+          if (controls[i].label == ref.text)
+            return i;
+        }
+        throw WasmError(ref.line, "unknown label " + ref.text + " in " + fn.name);
+      }
+      auto depth = ref.IsAtom() ? ParseI32(ref.text) : std::nullopt;
+      if (!depth || *depth >= controls.size())
+        throw WasmError(ref.line, "invalid branch depth " + ref.text + " in " + fn.name);
+      return controls.size() - 1 - *depth;
+    }
+
+    static const SExpr &Immediate(const std::vector<SExpr> &items, size_t &pos, size_t line, const char *what) {
+      if (pos >= items.size() || !items[pos].IsAtom())
+        throw WasmError(line, std::string("missing ") + what);
+      return items[pos++];
+    }
+
+    // -- Structured control --
+
+    // Reads an optional label and block type: $label? (param)* (result t*)*
+    void ReadBlockHeader(const std::vector<SExpr> &items, size_t &pos, Control &control) {
+      if (pos < items.size() && items[pos].IsName())
+        control.label = items[pos++].text;
+      while (pos < items.size() && items[pos].IsList()) {
+        const SExpr &item = items[pos];
+        if (item.IsList("result")) {
+          for (size_t i = 1; i < item.items.size(); ++i)
+            control.results.push_back(ParseValType(item.items[i]));
+        } else if (item.IsList("param") || item.IsList("type")) {
+          throw WasmError(item.line, "block parameters and type uses are not supported");
+        } else {
+          break;
+        }
+        ++pos;
+      }
+    }
+
+    void BeginBlock(Control control) {
+      control.height = stack.size();
+      control.start = Here();
+      if (control.kind == BlockKind::Loop) {
+        control.loop_id = fn.loops.size();
+        fn.loops.push_back(WasmLoop{control.start, 0});
+      }
+      if (control.kind == BlockKind::If) {
+        Pop(control.line, ValType::I32);
+        control.height = stack.size();
+        control.if_test = Emit(WasmInstr{WasmOp::BrUnless});
+      }
+      controls.push_back(std::move(control));
+    }
+
+    void CheckBlockEnd(const Control &control, size_t line) {
+      PopTypes(control.results, line);
+      if (stack.size() != control.height)
+        throw WasmError(line, "values left on the stack at the end of a block in " + fn.name);
+    }
+
+    void Else(size_t line) {
+      Control &control = controls.back();
+      if (control.kind != BlockKind::If || control.has_else)
+        throw WasmError(line, "'else' without a matching 'if' in " + fn.name);
+      CheckBlockEnd(control, line);
+      control.fixups.push_back(Emit(WasmInstr{WasmOp::Jump}));
+      fn.code[*control.if_test].index = Here();
+      control.if_test.reset();
+      control.has_else = true;
+      control.unreachable = false;
+    }
+
+    void End(size_t line) {
+      if (controls.size() <= 1)
+        throw WasmError(line, "'end' without a matching block in " + fn.name);
+      Control &control = controls.back();
+      CheckBlockEnd(control, line);
+      if (control.kind == BlockKind::If && !control.has_else && !control.results.empty())
+        throw WasmError(line, "'if' with a result needs an 'else' in " + fn.name);
+      for (size_t fixup : control.fixups)
+        fn.code[fixup].index = Here();
+      if (control.if_test)
+        fn.code[*control.if_test].index = Here();
+      if (control.kind == BlockKind::Loop)
+        fn.loops[control.loop_id].end = Here();
+      const std::vector<ValType> results = control.results;
+      controls.pop_back();
+      PushTypes(results);
+    }
+
+    void Branch(WasmOp op, const SExpr &label, size_t line) {
+      if (op == WasmOp::BrIf)
+        Pop(line, ValType::I32);
+      const size_t target_id = LabelTarget(label);
+      Control &target = controls[target_id];
+      const std::vector<ValType> carried =
+          target.kind == BlockKind::Loop ? std::vector<ValType>{} : target.results;
+      PopTypes(carried, line);
+
+      WasmInstr instr{op};
+      instr.arity = static_cast<uint32_t>(carried.size());
+      instr.height = static_cast<uint32_t>(target.height);
+      if (target.kind == BlockKind::Function) {
+        instr.op = op == WasmOp::Br ? WasmOp::Return : op; // A branch to the function body returns.
+        if (op == WasmOp::BrIf) {
+          target.fixups.push_back(Emit(instr)); // Patched to the final return.
+        } else {
+          Emit(instr);
+        }
+      } else if (target.kind == BlockKind::Loop) {
+        instr.index = target.start;
+        Emit(instr);
+      } else {
+        target.fixups.push_back(Emit(instr));
+      }
+
+      if (op == WasmOp::Br)
+        SetUnreachable();
+      else
+        PushTypes(carried);
+    }
+
+    // -- Instructions --
+
+    void Simple(const OpInfo &info, const std::vector<SExpr> &items, size_t &pos, size_t line) {
+      WasmInstr instr{info.op};
+      switch (info.op) {
+      case WasmOp::Br:
+      case WasmOp::BrIf:
+        Branch(info.op, Immediate(items, pos, line, "branch label"), line);
+        return;
+      case WasmOp::Return:
+        PopTypes(fn.results, line);
+        instr.arity = static_cast<uint32_t>(fn.results.size());
+        Emit(instr);
+        SetUnreachable();
+        return;
+      case WasmOp::Unreachable:
+        Emit(instr);
+        SetUnreachable();
+        return;
+      case WasmOp::Call: {
+        instr.index = loader.FunctionIndex(Immediate(items, pos, line, "function"));
+        const WasmFunction &callee = module.functions[instr.index];
+        PopTypes(callee.params, line);
+        PushTypes(callee.results);
+        Emit(instr);
+        return;
+      }
+      case WasmOp::Drop:
+        Pop(line);
+        Emit(instr);
+        return;
+      case WasmOp::Select: {
+        Pop(line, ValType::I32);
+        const StackType second = Pop(line);
+        const StackType first = Pop(line, second);
+        Push(first ? first : second);
+        Emit(instr);
+        return;
+      }
+      case WasmOp::LocalGet:
+      case WasmOp::LocalSet:
+      case WasmOp::LocalTee: {
+        instr.index = LocalIndex(Immediate(items, pos, line, "local"));
+        const ValType type = local_types[instr.index];
+        if (info.op != WasmOp::LocalGet)
+          Pop(line, type);
+        if (info.op != WasmOp::LocalSet)
+          Push(type);
+        Emit(instr);
+        return;
+      }
+      case WasmOp::GlobalGet:
+      case WasmOp::GlobalSet: {
+        instr.index = loader.GlobalIndex(Immediate(items, pos, line, "global"));
+        const WasmGlobal &global = module.globals[instr.index];
+        if (info.op == WasmOp::GlobalSet) {
+          if (!global.is_mutable)
+            throw WasmError(line, "global.set of an immutable global in " + fn.name);
+          Pop(line, global.type);
+        } else {
+          Push(global.type);
+        }
+        Emit(instr);
+        return;
+      }
+      default:
+        break;
+      }
+
+      if (info.imm == Imm::I32) {
+        const SExpr &text = Immediate(items, pos, line, "i32 constant");
+        auto value = ParseI32(text.text);
+        if (!value)
+          throw WasmError(line, "invalid i32 constant '" + text.text + "'");
+        instr.value = *value;
+      } else if (info.imm == Imm::I64) {
+        const SExpr &text = Immediate(items, pos, line, "i64 constant");
+        auto value = ParseI64(text.text);
+        if (!value)
+          throw WasmError(line, "invalid i64 constant '" + text.text + "'");
+        instr.value = *value;
+      } else if (info.imm == Imm::F64) {
+        const SExpr &text = Immediate(items, pos, line, "f64 constant");
+        auto value = ParseF64(text.text);
+        if (!value)
+          throw WasmError(line, "invalid f64 constant '" + text.text + "'");
+        instr.value = F64Bits(*value);
+      } else if (info.imm == Imm::Mem) {
+        if (!module.has_memory)
+          throw WasmError(line, std::string(info.name) + " without a memory");
+        while (pos < items.size() && items[pos].IsAtom()) {
+          const std::string &text = items[pos].text;
+          if (text.rfind("offset=", 0) == 0) {
+            auto offset = ParseI32(text.substr(7));
+            if (!offset)
+              throw WasmError(line, "invalid memory offset '" + text + "'");
+            instr.index = *offset;
+          } else if (text.rfind("align=", 0) == 0) {
+            auto align = ParseI32(text.substr(6));
+            if (!align || *align == 0 || (*align & (*align - 1)) || *align > info.natural_align)
+              throw WasmError(line, "invalid alignment '" + text + "'");
+          } else {
+            break;
+          }
+          ++pos;
+        }
+      } else if ((info.op == WasmOp::MemorySize || info.op == WasmOp::MemoryGrow) && !module.has_memory) {
+        throw WasmError(line, std::string(info.name) + " without a memory");
+      }
+
+      for (size_t i = std::strlen(info.params); i-- > 0;)
+        Pop(line, TypeFromCode(info.params[i]));
+      for (const char *code = info.results; *code; ++code)
+        Push(TypeFromCode(*code));
+      Emit(instr);
+    }
+
+    static const OpInfo &Lookup(const SExpr &op) {
+      const OpInfo *info = op.IsAtom() ? FindOp(op.text) : nullptr;
+      if (!info)
+        throw WasmError(op.line, "unknown or unsupported instruction '" + op.text + "'");
+      return *info;
+    }
+
+    // An instruction written in flat form; consumes its immediates from items.
+    void Flat(const std::vector<SExpr> &items, size_t &pos) {
+      const SExpr &op = items[pos++];
+      const std::string &name = op.text;
+      if (name == "block" || name == "loop" || name == "if") {
+        Control control{name == "block" ? BlockKind::Block : name == "loop" ? BlockKind::Loop : BlockKind::If};
+        control.line = op.line;
+        ReadBlockHeader(items, pos, control);
+        BeginBlock(std::move(control));
+      } else if (name == "else" || name == "end") {
+        if (pos < items.size() && items[pos].IsName())
+          ++pos; // Optional repeated label.
+        if (name == "else")
+          Else(op.line);
+        else
+          End(op.line);
+      } else {
+        Simple(Lookup(op), items, pos, op.line);
+      }
+    }
+
+    // An instruction written in folded form: (op immediates... operands...).
+    void Folded(const SExpr &expr) {
+      if (expr.items.empty() || !expr.items[0].IsAtom())
+        throw WasmError(expr.line, "expected an instruction");
+      const std::string &name = expr.items[0].text;
+      size_t pos = 1;
+
+      if (name == "block" || name == "loop") {
+        Control control{name == "block" ? BlockKind::Block : BlockKind::Loop};
+        control.line = expr.line;
+        ReadBlockHeader(expr.items, pos, control);
+        BeginBlock(std::move(control));
+        Sequence(expr.items, pos);
+        End(expr.line);
+        return;
+      }
+
+      if (name == "if") {
+        Control control{BlockKind::If};
+        control.line = expr.line;
+        ReadBlockHeader(expr.items, pos, control);
+        for (; pos < expr.items.size() && !expr.items[pos].IsList("then"); ++pos)
+          Folded(expr.items[pos]); // The condition
+        if (pos >= expr.items.size())
+          throw WasmError(expr.line, "folded 'if' needs a (then ...) clause");
+        BeginBlock(std::move(control));
+        Sequence(expr.items[pos++].items, 1);
+        if (pos < expr.items.size() && expr.items[pos].IsList("else")) {
+          Else(expr.items[pos].line);
+          Sequence(expr.items[pos++].items, 1);
+        }
+        if (pos != expr.items.size())
+          throw WasmError(expr.line, "unexpected clause after (else ...)");
+        End(expr.line);
+        return;
+      }
+
+      const OpInfo &info = Lookup(expr.items[0]);
+      if (info.op == WasmOp::Br || info.op == WasmOp::BrIf || info.imm != Imm::None) {
+        // Immediates come first; operands after them are folded expressions.
+        std::vector<SExpr> immediates;
+        size_t operand_pos = pos;
+        while (operand_pos < expr.items.size() && !expr.items[operand_pos].IsList())
+          immediates.push_back(expr.items[operand_pos++]);
+        for (size_t i = operand_pos; i < expr.items.size(); ++i)
+          Folded(expr.items[i]);
+        size_t imm_pos = 0;
+        Simple(info, immediates, imm_pos, expr.line);
+        if (imm_pos != immediates.size())
+          throw WasmError(expr.line, "unexpected immediate '" + immediates[imm_pos].text + "'");
+        return;
+      }
+      for (; pos < expr.items.size(); ++pos) {
+        if (!expr.items[pos].IsList())
+          throw WasmError(expr.items[pos].line, "unexpected '" + expr.items[pos].text + "' in folded instruction");
+        Folded(expr.items[pos]);
+      }
+      size_t none = 0;
+      Simple(info, expr.items, none, expr.line);
+    }
+
+    void Sequence(const std::vector<SExpr> &items, size_t pos) {
+      while (pos < items.size()) {
+        if (items[pos].IsList())
+          Folded(items[pos++]);
+        else if (items[pos].IsAtom())
+          Flat(items, pos);
+        else
+          throw WasmError(items[pos].line, "unexpected string in function body");
+      }
+    }
+
+  public:
+    FunctionCompiler(const ModuleLoader &loader, WasmFunction &fn)
+        : loader(loader), module(loader.GetModule()), fn(fn) {}
+
+    void Compile(const SExpr &field) {
+      // Walk the header again to name parameters and declare locals.
+      size_t pos = 1;
+      if (pos < field.items.size() && field.items[pos].IsName())
+        ++pos;
+      while (pos < field.items.size() && field.items[pos].IsList("export"))
+        ++pos;
+      for (; pos < field.items.size() && field.items[pos].IsList("param"); ++pos) {
+        const SExpr &param = field.items[pos];
+        if (param.items.size() == 3 && param.items[1].IsName()) {
+          if (!local_names.emplace(param.items[1].text, static_cast<uint32_t>(local_types.size())).second)
+            throw WasmError(param.line, "duplicate local " + param.items[1].text);
+          local_types.push_back(ParseValType(param.items[2]));
+        } else {
+          for (size_t i = 1; i < param.items.size(); ++i)
+            local_types.push_back(ParseValType(param.items[i]));
+        }
+      }
+      while (pos < field.items.size() && field.items[pos].IsList("result"))
+        ++pos;
+      for (; pos < field.items.size() && field.items[pos].IsList("local"); ++pos) {
+        const SExpr &local = field.items[pos];
+        if (local.items.size() == 3 && local.items[1].IsName()) {
+          if (!local_names.emplace(local.items[1].text, static_cast<uint32_t>(local_types.size())).second)
+            throw WasmError(local.line, "duplicate local " + local.items[1].text);
+          local_types.push_back(ParseValType(local.items[2]));
+          fn.locals.push_back(local_types.back());
+        } else {
+          for (size_t i = 1; i < local.items.size(); ++i) {
+            local_types.push_back(ParseValType(local.items[i]));
+            fn.locals.push_back(local_types.back());
+          }
+        }
+      }
+
+      Control body{BlockKind::Function};
+      body.results = fn.results;
+      body.line = field.line;
+      controls.push_back(std::move(body));
+      Sequence(field.items, pos);
+      if (controls.size() != 1)
+        throw WasmError(controls.back().line, "block is missing its 'end' in " + fn.name);
+
+      CheckBlockEnd(controls.back(), field.line);
+      for (size_t fixup : controls.back().fixups)
+        fn.code[fixup].index = Here(); // br_if to the function body goes to the final return.
+      WasmInstr ret{WasmOp::Return};
+      ret.arity = static_cast<uint32_t>(fn.results.size());
+      Emit(ret);
+    }
+  };
+};
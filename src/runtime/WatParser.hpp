@@ -0,0 +1,189 @@
+#pragma once
+
+#include <cctype>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Problems found while reading or validating a module.
+class WasmError : public std::runtime_error {
+public:
+  WasmError(size_t line, const std::string &message)
+      : std::runtime_error("line " + std::to_string(line) + ": " + message) {}
+};
+
+// One node of a WebAssembly text file: an atom (keyword, $name, number), a
+// quoted string, or a parenthesized list.
+struct SExpr {
+  enum class Kind { Atom, String, List };
+
+  Kind kind = Kind::Atom;
+  std::string text{};         // Atom text, or the decoded bytes of a string.
+  std::vector<SExpr> items{}; // Children of a list.
+  size_t line = 0;
+
+  bool IsList() const { return kind == Kind::List; }
+  bool IsAtom() const { return kind == Kind::Atom; }
+  bool IsString() const { return kind == Kind::String; }
+  bool IsAtom(const std::string &name) const { return IsAtom() && text == name; }
+  bool IsName() const { return IsAtom() && !text.empty() && text[0] == '$'; }
+
+  // Is this a list starting with the given keyword, such as (result ...)?
+  bool IsList(const std::string &head) const { return IsList() && !items.empty() && items[0].IsAtom(head); }
+  const std::string &Head() const {
+    static const std::string none;
+    return IsList() && !items.empty() && items[0].IsAtom() ? items[0].text : none;
+  }
+};
+
+// Reads the S-expression syntax of a .wat file (comments included).
+//
+// Example usage:
+//   SExpr module = WatParser(source).ParseModule();
+class WatParser {
+private:
+  const std::string &source;
+  size_t pos = 0;
+  size_t line = 1;
+
+  [[noreturn]] void Fail(const std::string &message) const { throw WasmError(line, message); }
+
+  char Peek(size_t offset = 0) const { return pos + offset < source.size() ? source[pos + offset] : '\0'; }
+
+  void Advance() {
+    if (source[pos++] == '\n')
+      ++line;
+  }
+
+  void SkipSpaceAndComments() {
+    while (pos < source.size()) {
+      if (std::isspace(static_cast<unsigned char>(Peek()))) {
+        Advance();
+      } else if (Peek() == ';' && Peek(1) == ';') {
+        while (pos < source.size() && Peek() != '\n')
+          Advance();
+      } else if (Peek() == '(' && Peek(1) == ';') {
+        // Block comments nest.
+        size_t depth = 0;
+        do {
+          if (pos >= source.size())
+            Fail("unterminated block comment");
+          if (Peek() == '(' && Peek(1) == ';') {
+            ++depth;
+            Advance();
+          } else if (Peek() == ';' && Peek(1) == ')') {
+            --depth;
+            Advance();
+          }
+          Advance();
+        } while (depth > 0);
+      } else {
+        return;
+      }
+    }
+  }
+
+  static int HexValue(char ch) {
+    if (ch >= '0' && ch <= '9')
+      return ch - '0';
+    if (ch >= 'a' && ch <= 'f')
+      return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F')
+      return ch - 'A' + 10;
+    return -1;
+  }
+
+  SExpr ParseString() {
+    SExpr out{SExpr::Kind::String, "", {}, line};
+    Advance(); // Opening quote
+    while (true) {
+      if (pos >= source.size())
+        Fail("unterminated string");
+      const char ch = Peek();
+      Advance();
+      if (ch == '"')
+        return out;
+      if (ch != '\\') {
+        out.text.push_back(ch);
+        continue;
+      }
+      const char esc = Peek();
+      Advance();
+      switch (esc) {
+      case 'n':
+        out.text.push_back('\n');
+        break;
+      case 't':
+        out.text.push_back('\t');
+        break;
+      case 'r':
+        out.text.push_back('\r');
+        break;
+      case '"':
+      case '\'':
+      case '\\':
+        out.text.push_back(esc);
+        break;
+      default: {
+        const int high = HexValue(esc);
+        const int low = HexValue(Peek());
+        if (high < 0 || low < 0)
+          Fail(std::string("unknown escape '\\") + esc + "' in string");
+        Advance();
+        out.text.push_back(static_cast<char>(high * 16 + low));
+      }
+      }
+    }
+  }
+
+  SExpr ParseAtom() {
+    SExpr out{SExpr::Kind::Atom, "", {}, line};
+    while (pos < source.size()) {
+      const char ch = Peek();
+      if (std::isspace(static_cast<unsigned char>(ch)) || ch == '(' || ch == ')' || ch == '"' || ch == ';')
+        break;
+      out.text.push_back(ch);
+      Advance();
+    }
+    return out;
+  }
+
+  SExpr ParseExpr() {
+    SkipSpaceAndComments();
+    if (pos >= source.size())
+      Fail("unexpected end of file");
+    if (Peek() == '"')
+      return ParseString();
+    if (Peek() == ')')
+      Fail("unexpected ')'");
+    if (Peek() != '(')
+      return ParseAtom();
+
+    SExpr out{SExpr::Kind::List, "", {}, line};
+    Advance();
+    while (true) {
+      SkipSpaceAndComments();
+      if (pos >= source.size())
+        Fail("missing ')'");
+      if (Peek() == ')') {
+        Advance();
+        return out;
+      }
+      out.items.push_back(ParseExpr());
+    }
+  }
+
+public:
+  explicit WatParser(const std::string &source) : source(source) {}
+
+  SExpr ParseModule() {
+    SExpr module = ParseExpr();
+    if (!module.IsList("module"))
+      throw WasmError(module.line, "expected (module ...)");
+    SkipSpaceAndComments();
+    if (pos < source.size())
+      Fail("unexpected text after the module");
+    return module;
+  }
+};
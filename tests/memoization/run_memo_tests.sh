@@ -0,0 +1,93 @@
+#!/bin/bash
+
+# Memoization Tests
+#
+# The interpreter (and so scripts/validate_passes.py) never runs the memo
+# table code, which only exists in the generated WAT.  These cases compile
+# with --memoize or --memoize=N and execute the WAT with tubular-run.
+
+echo "=== MEMOIZATION TESTS ==="
+echo
+
+GREEN='\033[0;32m'
+RED='\033[0;31m'
+NC='\033[0m'
+
+SCRIPT_DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" &> /dev/null && pwd )"
+PROJECT_ROOT="$SCRIPT_DIR/../.."
+TUBULAR="$PROJECT_ROOT/build/Tubular"
+TUBULAR_RUN="$PROJECT_ROOT/build/tubular-run"
+
+for tool in "$TUBULAR" "$TUBULAR_RUN"; do
+  if [ ! -f "$tool" ]; then
+    echo -e "${RED}Error: $(basename "$tool") executable not found at $tool${NC}"
+    echo "Please run './make' from the project root first."
+    exit 1
+  fi
+done
+
+failures=0
+
+# run_case BASE FLAG FUNCTION EXPECTED [ARG...]
+run_case() {
+  local base="$1"; local flag="$2"; local func="$3"; local expect="$4"; shift 4
+  local src="$SCRIPT_DIR/${base}.tube"
+  local wat="$SCRIPT_DIR/${base}${flag#--memoize}.wat"
+  echo "--- $base $flag: $func($*) ---"
+
+  if ! "$TUBULAR" "$src" "$flag" > "$wat" 2>/dev/null; then
+    echo -e "${RED}✗ Compilation failed${NC}"; echo; ((failures++)); return
+  fi
+  # A memoized entry point wraps "$<name>.impl"; without one nothing is tested.
+  if ! grep -q '\.impl' "$wat"; then
+    echo -e "${RED}✗ No function was memoized${NC}"; echo; ((failures++)); return
+  fi
+  # Double results in table entries must be 8-byte aligned.
+  if grep -o 'f64\.\(load\|store\) offset=[0-9]*' "$wat" | awk -F= '$2 % 8 { bad = 1 } END { exit !bad }'; then
+    echo -e "${RED}✗ Misaligned double in the memo table${NC}"; echo; ((failures++)); return
+  fi
+
+  local args=()
+  for arg in "$@"; do args+=("--arg=$arg"); done
+  local out result instructions
+  out=$("$TUBULAR_RUN" "$wat" --invoke="$func" "${args[@]}" --report 2>&1)
+  result=$(echo "$out" | head -n 1)
+  instructions=$(echo "$out" | sed -n 's/^Instructions executed: *\([0-9]*\).*/\1/p')
+  if [ "$result" = "$expect" ]; then
+    echo "Output $result; instructions: $instructions"
+    echo -e "${GREEN}✓ Execution OK${NC}"
+  else
+    echo "Output $result, expected $expect"
+    echo -e "${RED}✗ Execution check failed${NC}"
+    ((failures++))
+  fi
+  echo
+}
+
+# Default table (1024 entries)
+run_case "memo-test-01" "--memoize" "main" 102334155
+run_case "memo-test-01" "--memoize" "Fib" 832040 30
+run_case "memo-test-02" "--memoize" "main" 601080390
+run_case "memo-test-02" "--memoize" "Paths" 137846528820 20 20
+run_case "memo-test-03" "--memoize" "Choose" 184756 20 10
+
+# Explicit table sizes
+run_case "memo-test-01" "--memoize=64" "Fib" 832040 30
+run_case "memo-test-02" "--memoize=64" "Paths" 2704156 12 12
+
+# Small tables, where different arguments keep colliding in the same entry
+echo "=== COLLISION TESTS ==="
+run_case "memo-test-01" "--memoize=2" "Fib" 75025 25
+run_case "memo-test-02" "--memoize=4" "Paths" 2704156 12 12
+run_case "memo-test-03" "--memoize=2" "Choose" 184756 20 10
+run_case "memo-test-03" "--memoize=4" "Choose" 184756 20 10
+
+rm -f "$SCRIPT_DIR"/*.wat
+
+if [ "$failures" -eq 0 ]; then
+  echo -e "${GREEN}All memoization tests passed${NC}"
+else
+  echo -e "${RED}$failures memoization test(s) failed${NC}"
+fi
+echo "=== END MEMOIZATION TESTS ==="
+[ "$failures" -eq 0 ]
@@ -0,0 +1,108 @@
+#!/bin/bash
+
+# Argument Specialization Tests
+#
+# Only internal (non-exported) functions are specialized, and by default every
+# function is exported, so these cases compile with --export-none-except-main.
+# --no-inline keeps each callee as its own WAT function, so its body shows
+# whether a parameter is still read or was replaced with a literal.
+
+echo "=== ARGUMENT SPECIALIZATION TESTS ==="
+echo
+
+GREEN='\033[0;32m'
+RED='\033[0;31m'
+NC='\033[0m'
+
+SCRIPT_DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" &> /dev/null && pwd )"
+PROJECT_ROOT="$SCRIPT_DIR/../.."
+TUBULAR="$PROJECT_ROOT/build/Tubular"
+TUBULAR_RUN="$PROJECT_ROOT/build/tubular-run"
+
+for tool in "$TUBULAR" "$TUBULAR_RUN"; do
+  if [ ! -f "$tool" ]; then
+    echo -e "${RED}Error: $(basename "$tool") executable not found at $tool${NC}"
+    echo "Please run './make' from the project root first."
+    exit 1
+  fi
+done
+
+failures=0
+
+pass() { echo -e "${GREEN}✓ $1${NC}"; }
+fail() { echo -e "${RED}✗ $1${NC}"; ((failures++)); }
+
+# Print the body of function FUNC from a WAT file.
+function_body() {
+  sed -n "/^  (func \$$2 /,/^  )/p" "$1"
+}
+
+# check_param WAT FUNC INDEX literal|param: is parameter INDEX (from 1) of FUNC
+# replaced with a literal, or still read as a parameter?
+check_param() {
+  local wat="$1"; local func="$2"; local index="$3"; local expect="$4"
+  local body param
+  body=$(function_body "$wat" "$func")
+  param=$(echo "$body" | head -n 1 | grep -o '(param \$var[0-9]*' | sed -n "${index}p" | cut -c8-)
+  if [ -z "$param" ]; then
+    fail "$func has no parameter $index"
+  elif echo "$body" | grep -q "(local.get \\$param)"; then
+    [ "$expect" = "param" ] && pass "$func parameter $index is still read" ||
+      fail "$func parameter $index should have been specialized"
+  else
+    [ "$expect" = "literal" ] && pass "$func parameter $index was replaced with its literal" ||
+      fail "$func parameter $index should not have been specialized"
+  fi
+}
+
+# check_emitted WAT FUNC yes|no
+check_emitted() {
+  local wat="$1"; local func="$2"; local expect="$3"
+  if grep -q "(func \$$func " "$wat"; then
+    [ "$expect" = "yes" ] && pass "$func is emitted" || fail "$func should have been dropped"
+  else
+    [ "$expect" = "no" ] && pass "$func is dropped" || fail "$func should have been emitted"
+  fi
+}
+
+# check_result WAT EXPECTED: does main() return EXPECTED?
+check_result() {
+  local result
+  result=$("$TUBULAR_RUN" "$1" --invoke=main 2>&1 | head -n 1)
+  [ "$result" = "$2" ] && pass "main() returns $result" || fail "main() returned $result, expected $2"
+}
+
+# compile BASE OUT FLAG...
+compile() {
+  local base="$1"; local out="$2"; shift 2
+  "$TUBULAR" "$SCRIPT_DIR/${base}.tube" --no-inline "$@" > "$out" 2>/dev/null || fail "Compiling $base $* failed"
+}
+
+echo "--- spec-test-01 --export-none-except-main ---"
+wat="$SCRIPT_DIR/spec-test-01-internal.wat"
+compile "spec-test-01" "$wat" --export-none-except-main
+check_param "$wat" "Scale" 2 literal  # Always called with 3
+check_param "$wat" "Scale" 1 param
+check_param "$wat" "Offset" 2 param   # Called with 5 and with 7
+check_param "$wat" "Clamp" 2 param    # Always called with 10, but assigned
+check_emitted "$wat" "Unused" no      # Internal and never called
+check_result "$wat" 55
+echo
+
+echo "--- spec-test-01 (every function exported) ---"
+wat="$SCRIPT_DIR/spec-test-01-exported.wat"
+compile "spec-test-01" "$wat"
+check_param "$wat" "Scale" 2 param    # Callers outside the module may pass anything
+check_emitted "$wat" "Unused" yes
+check_result "$wat" 55
+echo
+
+rm -f "$SCRIPT_DIR"/*.wat
+
+if [ "$failures" -eq 0 ]; then
+  echo -e "${GREEN}All argument specialization tests passed${NC}"
+else
+  echo -e "${RED}$failures argument specialization check(s) failed${NC}"
+fi
+echo "=== END ARGUMENT SPECIALIZATION TESTS ==="
+[ "$failures" -eq 0 ]
@@ -13,6 +13,7 @@ NC='\033[0m'
 SCRIPT_DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" &> /dev/null && pwd )"
 PROJECT_ROOT="$SCRIPT_DIR/../.."
 TUBULAR="$PROJECT_ROOT/build/Tubular"
+TUBULAR_RUN="$PROJECT_ROOT/build/tubular-run"
 
 if [ ! -f "$TUBULAR" ]; then
   echo -e "${RED}Error: Tubular executable not found at $TUBULAR${NC}"
@@ -34,6 +35,21 @@ else
   SKIP_NODE=false
 fi
 
+# Without wat2wasm/Node.js, execute the WAT directly and compare instruction counts
+if { [ "$SKIP_WASM" = true ] || [ "$SKIP_NODE" = true ]; } && [ -x "$TUBULAR_RUN" ]; then
+  echo -e "${YELLOW}Using tubular-run for execution checks (instruction counts instead of timings).${NC}"
+  USE_TUBULAR_RUN=true
+else
+  USE_TUBULAR_RUN=false
+fi
+
+# Print "<result> <instructions>" for a WAT file, or fail if execution traps
+run_wat() {
+  local out
+  out=$("$TUBULAR_RUN" "$1" --invoke="$2" --report-json 2>&1) || return 1
+  echo "$(echo "$out" | head -n 1) $(echo "$out" | sed -n 's/^{"instructions": \([0-9]*\).*/\1/p')"
+}
+
 run_case() {
   local base="$1"; local func="$2"; local expect="$3"
   local src="$SCRIPT_DIR/${base}.tube"
@@ -140,6 +156,40 @@ EOF
     node "$js" "$SCRIPT_DIR/${base}-off.wasm" "$SCRIPT_DIR/${base}-loop.wasm" "$func" "$expect" 2>/dev/null && \
       echo -e "${GREEN}✓ Execution OK${NC}" || echo -e "${YELLOW}⚠ Execution check failed${NC}"
     rm -f "$js"
+  elif [ "$USE_TUBULAR_RUN" = true ]; then
+    local off loop
+    loop=$(run_wat "$SCRIPT_DIR/${base}-loop.wat" "$func") || { echo -e "${YELLOW}⚠ Loop execution trapped${NC}"; echo; return; }
+    off=$(run_wat "$SCRIPT_DIR/${base}-off.wat" "$func") || off=""
+    [ "$expect" = "__baseline__" ] && expect="${loop% *}"
+    if [ "${loop% *}" = "$expect" ] && { [ -z "$off" ] || [ "${off% *}" = "$expect" ]; }; then
+      if [ -n "$off" ]; then
+        echo "Output ${loop% *}; instructions: off=${off#* }, loop=${loop#* }"
+      else
+        echo "Output ${loop% *}; instructions: loop=${loop#* } (baseline trapped)"
+      fi
+      echo -e "${GREEN}✓ Execution OK${NC}"
+    else
+      echo "Output off=${off% *}, loop=${loop% *}, expected=$expect"
+      echo -e "${YELLOW}⚠ Execution check failed${NC}"
+    fi
+  fi
+  echo
+}
+
+# Running a pass order as a fixed-point group must not unroll a loop again
+check_fixpoint() {
+  local base="$1"; local order="$2"
+  local src="$SCRIPT_DIR/${base}.tube"
+  echo "--- $base: ($order)* ---"
+  local once group
+  once=$("$TUBULAR" "$src" --pass-order="$order" 2>/dev/null | grep -c '(loop') || { echo -e "${RED}Compile failed${NC}"; return; }
+  group=$("$TUBULAR" "$src" --pass-order="($order)*" 2>/dev/null | grep -c '(loop') || { echo -e "${RED}Compile failed${NC}"; return; }
+  if [ "$once" = "$group" ]; then
+    echo "Loops: $once with $order, $group with ($order)*"
+    echo -e "${GREEN}✓ Loop count stable${NC}"
+  else
+    echo "Loops: $once with $order, $group with ($order)*"
+    echo -e "${RED}✗ Loop count changed${NC}"
   fi
   echo
 }
@@ -149,12 +199,18 @@ run_case "tail-test-02" "main" 5050
 run_case "tail-test-03" "main" 500500
 run_case "tail-test-04" "main" 6
 run_case "tail-test-05" "main" 1048576
+run_case "tail-test-06" "main" 705141753
+run_case "tail-test-07" "main" 1235197295
 run_case "tail-test-deep-01" "main" 50005000
 run_case "tail-test-deep-02" "main" 102334155
 run_case "tail-test-deep-03" "main" 50005000
 run_case "tail-test-extreme" "main" 1048576
 run_case "tail-test-order" "main" 8
 
+# Run fixed-point tests
+echo "=== FIXED-POINT TESTS ==="
+check_fixpoint "tail-test-07" "inline,unroll,tail"
+
 # Run stress tests
 echo "=== STRESS TESTS ==="
 run_case "tail-test-stress-01" "main" "__baseline__"  # Will be calculated dynamically